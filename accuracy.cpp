@@ -0,0 +1,479 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// accuracy.cpp : Differential error harness, measuring every color kernel and
+// the whole scRGB to RGBA16F, HDR10 and sRGB8 encodes against the f64 oracle
+// in color_oracle.cpp, portable so it runs on any machine, e.g. on Linux:
+//   c++ -O2 -std=c++17 -pthread accuracy.cpp color_oracle.cpp color.cpp format.cpp generate.cpp lut.cpp parallel.cpp trace.cpp -o accuracy
+//   ./accuracy -step 16
+//
+// f32 to f16 is checked on all 2^32 inputs, the transfer functions on every
+// f32 in their range (or every step'th one), and the matrix and the encodes on
+// a grid x grid x grid cube of colors, spread across the thread pool. Each
+// kernel reports its max and mean error, in code values for the integer
+// outputs and ULPs for the float ones, and the exit code is 1 if any kernel
+// goes over its budget, so a faster approximation can be swapped in knowing
+// exactly what it costs. Baked 3D LUTs of the HDR10 and sRGB transfers are
+// measured the same way, on the same grids.
+//
+
+#include "color.h"
+#include "color_oracle.h"
+#include "colorspace.h"
+#include "generate.h"
+#include "lut.h"
+#include "parallel.h"
+
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+struct Accuracy_Error
+{
+    u64 count = 0;
+    f64 sum = 0.0;
+    f64 max = 0.0;
+    /// The input with the largest error
+    f32 worst[3] = {};
+    u32 worstCount = 0;
+
+    void Add(f64 error, const f32* input, u32 n)
+    {
+        count++;
+        sum += error;
+        if (error > max || worstCount == 0)
+        {
+            max = error;
+            memcpy(worst, input, n * sizeof(f32));
+            worstCount = n;
+        }
+    }
+
+    void Merge(const Accuracy_Error& other)
+    {
+        if (other.count && (other.max > max || worstCount == 0))
+        {
+            max = other.max;
+            memcpy(worst, other.worst, sizeof(worst));
+            worstCount = other.worstCount;
+        }
+        count += other.count;
+        sum += other.sum;
+    }
+};
+
+struct Accuracy_Kernel
+{
+    const char* name;
+    const char* unit;
+    /// The largest error allowed
+    f64 budget;
+    Accuracy_Error error = {};
+};
+
+static u32 accuracy_failures = 0;
+
+static void Accuracy_Report(const Accuracy_Kernel& k)
+{
+    const Accuracy_Error& e = k.error;
+    bool ok = e.count && e.max <= k.budget;
+    accuracy_failures += ok ? 0 : 1;
+    printf("  %-6s %-36s %11llu inputs  max %-10.4g mean %-10.4g budget %-6g %s", ok ? "ok" : "FAILED", k.name, (unsigned long long)e.count, e.max,
+        e.count ? e.sum / e.count : 0.0, k.budget, k.unit);
+    if (e.max > 0.0)
+    {
+        printf(", worst at");
+        for (u32 i = 0; i < e.worstCount; i++)
+            printf(" %.9g", e.worst[i]);
+    }
+    printf("\n");
+    fflush(stdout);
+}
+
+// Calls measure(first, last, errors) for chunks of [0, count) in parallel, each
+// chunk with its own errors for every kernel, which are merged as they finish
+template <usize N, class F> static void Accuracy_Sweep(const char* name, Accuracy_Kernel (&kernels)[N], u64 count, u64 grain, F measure)
+{
+    printf("%s\n", name);
+    auto start = std::chrono::steady_clock::now();
+    std::mutex lock;
+    u64 chunks = (count + grain - 1) / grain;
+    Parallel_For((usize)chunks, 1, [&](usize begin, usize end) {
+        for (usize c = begin; c < end; c++)
+        {
+            Accuracy_Error errors[N];
+            u64 first = c * grain;
+            u64 last = first + grain < count ? first + grain : count;
+            measure(first, last, errors);
+            std::lock_guard<std::mutex> hold(lock);
+            for (usize i = 0; i < N; i++)
+                kernels[i].error.Merge(errors[i]);
+        }
+    });
+    for (const Accuracy_Kernel& k : kernels)
+        Accuracy_Report(k);
+    auto end = std::chrono::steady_clock::now();
+    printf("  %.1f s\n", std::chrono::duration<f64>(end - start).count());
+}
+
+static f32 Accuracy_F32(u32 bits)
+{
+    f32 f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+static u32 Accuracy_Bits(f32 f)
+{
+    u32 bits;
+    memcpy(&bits, &f, sizeof(bits));
+    return bits;
+}
+
+// Distance between two f16s in representable values, NaN must match exactly
+static f64 Accuracy_F16_Ulps(u16 fast, u16 exact)
+{
+    bool fastNaN = (fast & 0x7C00) == 0x7C00 && (fast & 0x3FF);
+    bool exactNaN = (exact & 0x7C00) == 0x7C00 && (exact & 0x3FF);
+    if (fastNaN || exactNaN)
+        return fast == exact ? 0.0 : INFINITY;
+    i32 a = fast & 0x8000 ? -(i32)(fast & 0x7FFF) : (i32)fast;
+    i32 b = exact & 0x8000 ? -(i32)(exact & 0x7FFF) : (i32)exact;
+    return fabs((f64)(a - b));
+}
+
+// Error in units of the spacing of f32s around magnitude
+static f64 Accuracy_F32_Ulps(f64 fast, f64 exact, f64 magnitude)
+{
+    if (std::isnan(exact) || std::isnan(fast))
+        return std::isnan(exact) && std::isnan(fast) ? 0.0 : INFINITY;
+    if (fast == exact)
+        return 0.0;
+    int e = magnitude > 0.0 ? ilogb(magnitude) : INT_MIN;
+    return fabs(fast - exact) / ldexp(1.0, (e > -126 ? e : -126) - 23);
+}
+
+// A grid coordinate, spread from low through 0 to high and denser near 0
+static f32 Accuracy_Grid(u64 i, u32 grid, f32 low, f32 high)
+{
+    f64 s = 2.0 * (f64)i / (grid - 1) - 1.0;
+    return (f32)(s < 0.0 ? -low * s * s * s * s : high * s * s * s * s);
+}
+
+// Every f32 from 0 up to high, or every step'th one
+static u64 Accuracy_Range_Count(f32 high, u32 step)
+{
+    return Accuracy_Bits(high) / step + 1;
+}
+
+static void Accuracy_F16(u32 step)
+{
+    Accuracy_Kernel kernels[] = {
+        { "ToF16", "f16 ULPs", 0.0 },
+        { "ToF16_Span", "f16 ULPs", 0.0 },
+        { "FromF16", "f32 ULPs", 0.0 },
+        { "FromF16_Span", "f32 ULPs", 0.0 },
+    };
+    const u64 count = ((u64)1 << 32) / step;
+    Accuracy_Sweep("f16, all f32 and f16 values", kernels, count, 65536, [&](u64 first, u64 last, Accuracy_Error* errors) {
+        usize n = (usize)(last - first);
+        std::vector<f32> in(n);
+        std::vector<u16> half(n);
+        for (usize i = 0; i < n; i++)
+            in[i] = Accuracy_F32((u32)((first + i) * step));
+        ToF16_Span(in.data(), half.data(), n);
+        for (usize i = 0; i < n; i++)
+        {
+            u16 exact = Oracle_ToF16(in[i]);
+            errors[0].Add(Accuracy_F16_Ulps(ToF16(in[i]), exact), &in[i], 1);
+            errors[1].Add(Accuracy_F16_Ulps(half[i], exact), &in[i], 1);
+        }
+        // The first chunk also covers every f16
+        if (first == 0)
+        {
+            std::vector<u16> codes(65536);
+            std::vector<f32> wide(65536);
+            for (u32 h = 0; h < 65536; h++)
+                codes[h] = (u16)h;
+            FromF16_Span(codes.data(), wide.data(), 65536);
+            for (u32 h = 0; h < 65536; h++)
+            {
+                f64 exact = Oracle_FromF16((u16)h);
+                f32 input = (f32)h;
+                errors[2].Add(Accuracy_F32_Ulps(FromF16((u16)h), exact, fabs(exact)), &input, 1);
+                errors[3].Add(Accuracy_F32_Ulps(wide[h], exact, fabs(exact)), &input, 1);
+            }
+        }
+    });
+}
+
+static void Accuracy_Transfers(u32 step)
+{
+    // PQ covers 0 to 10000 nits, every f32 in turn fills R, G and B. Both
+    // versions come within 0.06 of a 12-bit code, about what powf itself gets.
+    Accuracy_Kernel pq[] = {
+        { "Color_Transfer_To_PQ", "12-bit codes", 0.06 },
+        { "Color_Transfer_To_PQ_Span", "12-bit codes", 0.06 },
+    };
+    Accuracy_Sweep("PQ, every f32 from 0 to 125 (10000 nits)", pq, Accuracy_Range_Count(125.0f, step), 3 * 16384, [&](u64 first, u64 last, Accuracy_Error* errors) {
+        usize n = (usize)(last - first);
+        usize pixels = (n + 2) / 3;
+        std::vector<f32> in(4 * pixels, 0.0f), out(4 * pixels);
+        for (usize i = 0; i < n; i++)
+            in[i / 3 * 4 + i % 3] = Accuracy_F32((u32)((first + i) * step));
+        Color_Transfer_To_PQ_Span(in.data(), out.data(), pixels);
+        for (usize p = 0; p < pixels; p++)
+        {
+            f32 scalar[4];
+            Color_Transfer_To_PQ(&in[4 * p], scalar);
+            for (u32 c = 0; c < 3 && 3 * p + c < n; c++)
+            {
+                f64 exact = Oracle_Transfer_To_PQ(in[4 * p + c]);
+                errors[0].Add(fabs(scalar[c] - exact) * 4095.0, &in[4 * p + c], 1);
+                errors[1].Add(fabs(out[4 * p + c] - exact) * 4095.0, &in[4 * p + c], 1);
+            }
+        }
+    });
+
+    // sRGB covers 0 to 1. The curve uses 0.41666 for 1/2.4, which is worth
+    // 0.0016 of a code, and the encoder rounds to a code on top of that.
+    Accuracy_Kernel srgb[] = {
+        { "Color_Transfer_To_sRGB", "8-bit codes", 0.002 },
+        { "Color_Encode_BGRA8_sRGB_Span", "8-bit codes", 0.502 },
+    };
+    Accuracy_Sweep("sRGB, every f32 from 0 to 1", srgb, Accuracy_Range_Count(1.0f, step), 3 * 16384, [&](u64 first, u64 last, Accuracy_Error* errors) {
+        usize n = (usize)(last - first);
+        usize pixels = (n + 2) / 3;
+        std::vector<f32> in(4 * pixels, 1.0f);
+        std::vector<u32> encoded(pixels);
+        for (usize i = 0; i < n; i++)
+            in[i / 3 * 4 + i % 3] = Accuracy_F32((u32)((first + i) * step));
+        Color_Encode_BGRA8_sRGB_Span(in.data(), encoded.data(), pixels);
+        for (usize p = 0; p < pixels; p++)
+        {
+            f32 scalar[4];
+            Color_Transfer_To_sRGB(&in[4 * p], scalar);
+            const u32 code[3] = { (encoded[p] >> 16) & 0xFF, (encoded[p] >> 8) & 0xFF, encoded[p] & 0xFF };
+            for (u32 c = 0; c < 3 && 3 * p + c < n; c++)
+            {
+                f64 exact = Oracle_Transfer_To_sRGB(in[4 * p + c]);
+                errors[0].Add(fabs(scalar[c] - exact) * 255.0, &in[4 * p + c], 1);
+                errors[1].Add(fabs(code[c] - exact * 255.0), &in[4 * p + c], 1);
+            }
+        }
+    });
+}
+
+// The scRGB range the HDR test patterns use, a little below 0 (wide gamut
+// colors) up to the 10000 nits PQ peak
+static void Accuracy_Pixel_HDR(u64 i, u32 grid, f32 rgba[4])
+{
+    rgba[0] = Accuracy_Grid(i % grid, grid, -1.0f, 126.0f);
+    rgba[1] = Accuracy_Grid(i / grid % grid, grid, -1.0f, 126.0f);
+    rgba[2] = Accuracy_Grid(i / grid / grid, grid, -1.0f, 126.0f);
+    rgba[3] = (f32)(i % 5) / 4.0f;
+}
+
+static void Accuracy_Encodes(u32 grid)
+{
+    // The matrix error is in ULPs of the largest input, as the outputs of wide
+    // gamut colors can cancel to near 0. The integer encodes round to a code,
+    // so their budgets are half a code plus what the f32 kernels add.
+    const Color_Mat3f mat = Mat3_To_f32(Color_RGB_To_RGB(primaries_rec709, primaries_rec2020));
+    Accuracy_Kernel hdr[] = {
+        { "Color_scRGB_To_Rec2020", "f32 ULPs of the input", 2.0 },
+        { "Color_rgb_through_mat3_Span", "f32 ULPs of the input", 2.0 },
+        { "GenerateImage RGBA16F scRGB", "f16 ULPs", 0.0 },
+        { "GenerateImage RGB10A2 HDR10", "10-bit codes", 0.52 },
+    };
+    const u64 pixels = (u64)grid * grid * grid;
+    Accuracy_Sweep("scRGB -1 to 126, HDR10 and RGBA16F", hdr, pixels, 4096, [&](u64 first, u64 last, Accuracy_Error* errors) {
+        usize n = (usize)(last - first);
+        std::vector<f32> in(4 * n), mat3(4 * n), scratch(4 * n);
+        std::vector<u16> scrgb(4 * n);
+        std::vector<u32> hdr10(n);
+        for (usize p = 0; p < n; p++)
+            Accuracy_Pixel_HDR(first + p, grid, &in[4 * p]);
+        Color_rgb_through_mat3_Span(in.data(), mat3.data(), n, mat.m);
+        scratch = in;
+        Generate_Encoder<Transfer_scRGB, Format_RGBA16F>::Encode(scratch.data(), scrgb.data(), n);
+        scratch = in;
+        Generate_Encoder<Transfer_HDR10, Format_RGB10A2>::Encode(scratch.data(), hdr10.data(), n);
+        for (usize p = 0; p < n; p++)
+        {
+            f32* c = &in[4 * p];
+            const f64 wide[3] = { c[0], c[1], c[2] };
+            f64 exact[3];
+            Oracle_scRGB_To_Rec2020(wide, exact);
+            f32 scalar[4];
+            Color_scRGB_To_Rec2020(c, scalar);
+            f64 magnitude = fmax(fabs(wide[0]), fmax(fabs(wide[1]), fabs(wide[2])));
+            for (u32 k = 0; k < 3; k++)
+            {
+                errors[0].Add(Accuracy_F32_Ulps(scalar[k], exact[k], magnitude), c, 3);
+                errors[1].Add(Accuracy_F32_Ulps(mat3[4 * p + k], exact[k], magnitude), c, 3);
+            }
+
+            u16 half[4];
+            Oracle_Encode_scRGB16F(c, half);
+            for (u32 k = 0; k < 4; k++)
+                errors[2].Add(Accuracy_F16_Ulps(scrgb[4 * p + k], half[k]), c, 3);
+
+            f64 codes[3];
+            Oracle_Encode_HDR10(c, codes);
+            for (u32 k = 0; k < 3; k++)
+                errors[3].Add(fabs((f64)((hdr10[p] >> (10 * k)) & 0x3FF) - codes[k]), c, 3);
+        }
+    });
+
+    Accuracy_Kernel sdr[] = {
+        { "GenerateImage BGRA8 sRGB", "8-bit codes", 0.501 },
+    };
+    Accuracy_Sweep("scRGB -0.1 to 1.1, sRGB8", sdr, pixels, 4096, [&](u64 first, u64 last, Accuracy_Error* errors) {
+        usize n = (usize)(last - first);
+        std::vector<f32> in(4 * n);
+        std::vector<u32> srgb8(n);
+        for (usize p = 0; p < n; p++)
+        {
+            u64 i = first + p;
+            in[4 * p] = Accuracy_Grid(i % grid, grid, -0.1f, 1.1f);
+            in[4 * p + 1] = Accuracy_Grid(i / grid % grid, grid, -0.1f, 1.1f);
+            in[4 * p + 2] = Accuracy_Grid(i / grid / grid, grid, -0.1f, 1.1f);
+            in[4 * p + 3] = 1.0f;
+        }
+        Generate_Encoder<Transfer_sRGB, Format_BGRA8>::Encode(in.data(), srgb8.data(), n);
+        // The encoder uses in as scratch, so rebuild each pixel for the oracle
+        for (usize p = 0; p < n; p++)
+        {
+            u64 i = first + p;
+            const f32 c[4] = { Accuracy_Grid(i % grid, grid, -0.1f, 1.1f), Accuracy_Grid(i / grid % grid, grid, -0.1f, 1.1f), Accuracy_Grid(i / grid / grid, grid, -0.1f, 1.1f), 1.0f };
+            f64 codes[3];
+            Oracle_Encode_sRGB8(c, codes);
+            const u32 code[3] = { (srgb8[p] >> 16) & 0xFF, (srgb8[p] >> 8) & 0xFF, srgb8[p] & 0xFF };
+            for (u32 k = 0; k < 3; k++)
+                errors[0].Add(fabs(code[k] - codes[k]), c, 3);
+        }
+    });
+}
+
+// The transfers baked into 3D LUTs, unquantized outputs against the oracle's
+// codes. Nothing rounds, so this is all interpolation error, which is worst
+// just above black where the PQ curve bends hardest inside the first cells.
+static void Accuracy_Luts(u32 grid)
+{
+    // Over the whole HDR grid but for the last 1/127 of it, which clamps
+    Lut3D hdr65;
+    Lut3D hdr33;
+    Lut_Bake(&hdr65, 65, Lut_Shaper::PQ, -1.0f, 125.0f, Transfer_HDR10::Apply);
+    Lut_Bake(&hdr33, 33, Lut_Shaper::PQ, -1.0f, 125.0f, Transfer_HDR10::Apply);
+    Accuracy_Kernel hdr[] = {
+        { "Lut_Apply HDR10 65^3 PQ", "10-bit codes", 2.5 },
+        { "Lut_Apply HDR10 33^3 PQ", "10-bit codes", 5.0 },
+    };
+    const Lut3D* hdr_luts[] = { &hdr65, &hdr33 };
+    const u64 pixels = (u64)grid * grid * grid;
+    Accuracy_Sweep("scRGB -1 to 126, HDR10 LUTs", hdr, pixels, 4096, [&](u64 first, u64 last, Accuracy_Error* errors) {
+        usize n = (usize)(last - first);
+        std::vector<f32> in(4 * n), out(4 * n);
+        for (usize p = 0; p < n; p++)
+            Accuracy_Pixel_HDR(first + p, grid, &in[4 * p]);
+        for (u32 l = 0; l < 2; l++)
+        {
+            Lut_Apply(*hdr_luts[l], in.data(), out.data(), n);
+            for (usize p = 0; p < n; p++)
+            {
+                f64 codes[3];
+                Oracle_Encode_HDR10(&in[4 * p], codes);
+                for (u32 k = 0; k < 3; k++)
+                    errors[l].Add(fabs(out[4 * p + k] * 1023.0 - codes[k]), &in[4 * p], 3);
+            }
+        }
+    });
+
+    // PQ shaped too, a linear one puts the whole toe of the sRGB curve in the
+    // first cell and is 10 codes off there
+    Lut3D sdr33;
+    Lut_Bake(&sdr33, 33, Lut_Shaper::PQ, 0.0f, 1.0f, Transfer_sRGB::Apply);
+    Accuracy_Kernel sdr[] = {
+        { "Lut_Apply sRGB 33^3 PQ", "8-bit codes", 0.2 },
+    };
+    Accuracy_Sweep("scRGB -0.1 to 1.1, sRGB LUT", sdr, pixels, 4096, [&](u64 first, u64 last, Accuracy_Error* errors) {
+        usize n = (usize)(last - first);
+        std::vector<f32> in(4 * n), out(4 * n);
+        for (usize p = 0; p < n; p++)
+        {
+            u64 i = first + p;
+            in[4 * p] = Accuracy_Grid(i % grid, grid, -0.1f, 1.1f);
+            in[4 * p + 1] = Accuracy_Grid(i / grid % grid, grid, -0.1f, 1.1f);
+            in[4 * p + 2] = Accuracy_Grid(i / grid / grid, grid, -0.1f, 1.1f);
+            in[4 * p + 3] = 1.0f;
+        }
+        Lut_Apply(sdr33, in.data(), out.data(), n);
+        for (usize p = 0; p < n; p++)
+        {
+            f64 codes[3];
+            Oracle_Encode_sRGB8(&in[4 * p], codes);
+            for (u32 k = 0; k < 3; k++)
+                errors[0].Add(fabs(out[4 * p + k] * 255.0 - codes[k]), &in[4 * p], 3);
+        }
+    });
+}
+
+static void Accuracy_Usage()
+{
+    printf("usage: accuracy [-step n] [-grid n] [-threads n] [-isa name]\n"
+           "  -step n     check every nth f32 of the f16 and transfer sweeps (default 1, all of them)\n"
+           "  -grid n     n x n x n colors for the matrix, the encodes and the LUTs (default 129)\n"
+           "  -threads n  worker threads, 0 for one per hardware thread (default 0)\n"
+           "  -isa name   instruction set for the span kernels: scalar, sse2, sse4.1, avx2,\n"
+           "              avx512 or neon (default the best one)\n");
+}
+
+int main(int argc, char** argv)
+{
+    u32 step = 1;
+    u32 grid = 129;
+    for (int i = 1; i < argc; i++)
+    {
+        if (i + 1 < argc && strcmp(argv[i], "-step") == 0)
+            step = (u32)atoi(argv[++i]);
+        else if (i + 1 < argc && strcmp(argv[i], "-grid") == 0)
+            grid = (u32)atoi(argv[++i]);
+        else if (i + 1 < argc && strcmp(argv[i], "-threads") == 0)
+            Parallel_SetThreads((u32)atoi(argv[++i]));
+        else if (i + 1 < argc && strcmp(argv[i], "-isa") == 0)
+        {
+            Color_ISA isa;
+            if (!Color_ISA_Parse(argv[++i], &isa) || !Color_Set_ISA(isa))
+            {
+                printf("instruction set %s isn't supported here, the best is %s\n", argv[i], Color_ISA_Name(Color_ISA_Best()));
+                return 1;
+            }
+        }
+        else
+        {
+            Accuracy_Usage();
+            return 1;
+        }
+    }
+    if (step < 1 || grid < 2 || grid > 2048)
+    {
+        Accuracy_Usage();
+        return 1;
+    }
+
+    printf("%u threads, %s\n", Parallel_Threads(), Color_ISA_Name(Color_Get_ISA()));
+    Accuracy_F16(step);
+    Accuracy_Transfers(step);
+    Accuracy_Encodes(grid);
+    Accuracy_Luts(grid);
+    if (accuracy_failures)
+        printf("%u kernels over budget\n", accuracy_failures);
+    return accuracy_failures ? 1 : 0;
+}
@@ -0,0 +1,152 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// arena.cpp : Bump allocator for storage that lives exactly as long as one
+// scene.
+//
+
+#include "arena.h"
+
+#include <cassert>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+// Chunks are multiples of this, which is the Windows allocation granularity
+constexpr usize arena_granularity = 64 * 1024;
+constexpr usize arena_large_page = 2 * 1024 * 1024;
+
+static usize Arena_Round_Up(usize size, usize multiple)
+{
+    return (size + multiple - 1) / multiple * multiple;
+}
+
+Arena::Arena(usize _chunkBytes, Arena_Pages _pages)
+    : chunkBytes(Arena_Round_Up(_chunkBytes < 1 ? 1 : _chunkBytes, _pages == Arena_Pages::Large ? arena_large_page : arena_granularity))
+    , pages(_pages)
+{
+}
+
+Arena::~Arena()
+{
+    ReleaseChunks();
+}
+
+bool Arena::AddChunk(usize minimum)
+{
+    Chunk chunk = { nullptr, 0, false };
+#ifdef _WIN32
+    if (pages == Arena_Pages::Large)
+    {
+        usize page = GetLargePageMinimum();
+        if (page)
+        {
+            chunk.size = Arena_Round_Up(minimum, page);
+            chunk.base = (u8*)VirtualAlloc(nullptr, chunk.size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+            chunk.large = chunk.base != nullptr;
+        }
+    }
+    if (!chunk.base)
+    {
+        chunk.size = Arena_Round_Up(minimum, arena_granularity);
+        chunk.base = (u8*)VirtualAlloc(nullptr, chunk.size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    }
+#else
+    chunk.size = Arena_Round_Up(minimum, pages == Arena_Pages::Large ? arena_large_page : arena_granularity);
+    void* p = mmap(nullptr, chunk.size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    chunk.base = p == MAP_FAILED ? nullptr : (u8*)p;
+#ifdef MADV_HUGEPAGE
+    // Transparent huge pages are only a hint, there's no way to tell whether
+    // the kernel honoured it
+    if (chunk.base && pages == Arena_Pages::Large)
+        chunk.large = madvise(chunk.base, chunk.size, MADV_HUGEPAGE) == 0;
+#endif
+#endif
+    if (!chunk.base)
+        return false;
+    if (!chunks.empty())
+        filled += offset;
+    offset = 0;
+    chunks.push_back(chunk);
+    return true;
+}
+
+void Arena::ReleaseChunks()
+{
+    for (const Chunk& chunk : chunks)
+    {
+#ifdef _WIN32
+        VirtualFree(chunk.base, 0, MEM_RELEASE);
+#else
+        munmap(chunk.base, chunk.size);
+#endif
+    }
+    chunks.clear();
+}
+
+void* Arena::Allocate(usize size, usize align)
+{
+    assert(align && (align & (align - 1)) == 0);
+    if (!chunks.empty())
+    {
+        const Chunk& chunk = chunks.back();
+        usize start = Arena_Round_Up((usize)chunk.base + offset, align) - (usize)chunk.base;
+        if (start <= chunk.size && size <= chunk.size - start)
+        {
+            offset = start + size;
+            peak = Bytes() > peak ? Bytes() : peak;
+            return chunk.base + start;
+        }
+    }
+    // The rest of the current chunk is wasted, but this only happens while a
+    // scene is bigger than the last one, Reset then merges the chunks
+    usize minimum = size + align;
+    if (minimum < size || !AddChunk(minimum > chunkBytes ? minimum : chunkBytes))
+        return nullptr;
+    return Allocate(size, align);
+}
+
+void Arena::Reset()
+{
+    usize used = Bytes();
+    usize target = used > chunkBytes ? used : chunkBytes;
+    // Merge the chunks into one that fits the whole generation, or give memory
+    // back after a generation that was much bigger than this one
+    if (chunks.size() > 1 || (chunks.size() == 1 && chunks[0].size / 4 > target))
+    {
+        ReleaseChunks();
+        AddChunk(target);
+    }
+    filled = 0;
+    offset = 0;
+}
+
+usize Arena::Bytes() const
+{
+    return filled + offset;
+}
+
+usize Arena::PeakBytes() const
+{
+    return peak;
+}
+
+usize Arena::ReservedBytes() const
+{
+    usize total = 0;
+    for (const Chunk& chunk : chunks)
+        total += chunk.size;
+    return total;
+}
+
+bool Arena::UsingLargePages() const
+{
+    for (const Chunk& chunk : chunks)
+        if (chunk.large)
+            return true;
+    return false;
+}
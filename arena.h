@@ -0,0 +1,114 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// arena.h : Bump allocator for storage that lives exactly as long as one scene,
+// released all at once by rewinding rather than freeing each allocation.
+//
+
+#pragma once
+
+#include "common.h"
+
+#include <new>
+#include <type_traits>
+#include <vector>
+
+enum class Arena_Pages
+{
+    Normal,
+    /// Ask the OS for large (2MB) pages, which cuts TLB misses when walking
+    /// big images. Falls back to normal pages when the OS refuses, e.g. on
+    /// Windows without the "Lock pages in memory" privilege.
+    Large,
+};
+
+/// Hands out memory from chunks taken directly from the OS. Reset rewinds to
+/// the start without returning anything to the OS, and if the last generation
+/// needed more than one chunk they are replaced by a single chunk big enough
+/// for all of it, so a scene that is rebuilt with the same contents allocates
+/// nothing and resets in O(1), and memory stays bounded by the largest recent
+/// generation instead of growing with every reset.
+class Arena
+{
+public:
+    explicit Arena(usize chunkBytes, Arena_Pages pages = Arena_Pages::Normal);
+    ~Arena();
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    /// Returns size bytes aligned to align (a power of two), or nullptr if the
+    /// OS is out of memory. The memory is not cleared.
+    void* Allocate(usize size, usize align = 64);
+    template <class T> T* Allocate(usize count)
+    {
+        return static_cast<T*>(Allocate(sizeof(T) * count, alignof(T) < 64 ? 64 : alignof(T)));
+    }
+
+    /// Invalidates everything allocated so far.
+    void Reset();
+
+    /// Bytes handed out since the last Reset, including alignment padding
+    usize Bytes() const;
+    /// Most bytes handed out between two Resets
+    usize PeakBytes() const;
+    /// Bytes currently held from the OS
+    usize ReservedBytes() const;
+    /// Whether any chunk actually got large pages
+    bool UsingLargePages() const;
+
+private:
+    struct Chunk
+    {
+        u8* base;
+        usize size;
+        bool large;
+    };
+
+    bool AddChunk(usize minimum);
+    void ReleaseChunks();
+
+    std::vector<Chunk> chunks;
+    usize chunkBytes;
+    Arena_Pages pages;
+    /// Bytes used in the chunks before the last one
+    usize filled = 0;
+    /// Bytes used in the last chunk
+    usize offset = 0;
+    usize peak = 0;
+};
+
+/// Standard allocator over an Arena, for containers whose contents are all
+/// discarded before the arena is reset. Deallocate does nothing.
+template <class T> struct Arena_Allocator
+{
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_copy_assignment;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    Arena* arena;
+
+    explicit Arena_Allocator(Arena& _arena)
+        : arena(&_arena)
+    {
+    }
+    template <class U> Arena_Allocator(const Arena_Allocator<U>& o)
+        : arena(o.arena)
+    {
+    }
+
+    T* allocate(usize count)
+    {
+        T* p = arena->Allocate<T>(count);
+        if (!p)
+            throw std::bad_alloc();
+        return p;
+    }
+    void deallocate(T*, usize)
+    {
+    }
+
+    template <class U> bool operator==(const Arena_Allocator<U>& o) const { return arena == o.arena; }
+    template <class U> bool operator!=(const Arena_Allocator<U>& o) const { return arena != o.arena; }
+};
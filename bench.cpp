@@ -0,0 +1,1957 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// bench.cpp : Headless benchmark suite for the per pixel kernels and the image
+// generators, portable so it can run on any machine, e.g. on Linux:
+//   c++ -O2 -std=c++17 -pthread bench.cpp arena.cpp color.cpp format.cpp generate.cpp image_cache.cpp image_file.cpp lut.cpp parallel.cpp scene.cpp frame_scheduler.cpp trace.cpp -o bench
+//   ./bench -json new.json -baseline old.json -threshold 0.1
+//
+// Every kernel and generator is timed at each size and reported as ns/pixel,
+// Mpix/s and GB/s (bytes read plus written per pixel). The accuracy checks run
+// first, a failed check or a result slower than the baseline by more than the
+// threshold makes the exit code non-zero.
+//
+
+#include "arena.h"
+#include "color.h"
+#include "format.h"
+#include "frame_scheduler.h"
+#include "generate.h"
+#include "image_cache.h"
+#include "image_file.h"
+#include "lut.h"
+#include "parallel.h"
+#include "scene.h"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct Bench_Result
+{
+    std::string name;
+    u32 width;
+    u32 height;
+    f64 nsPerPixel;
+    f64 mpixPerSecond;
+    f64 gbPerSecond;
+};
+
+static std::vector<Bench_Result> bench_results;
+static const char* bench_filter = nullptr;
+static u32 bench_failures = 0;
+
+// Kernels work through the image in blocks of at most this many pixels, so the
+// largest sizes stream through memory without needing gigabytes of f32 input
+constexpr u64 bench_block_pixels = 1 << 20;
+
+template <class F> static f64 Bench_Seconds(F& kernel, u32 reps)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (u32 i = 0; i < reps; i++)
+        kernel();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<f64>(end - start).count();
+}
+
+// Times kernel, which processes width x height pixels moving bytesPerPixel of
+// memory for each, and records the best of up to 5 runs. Small kernels are
+// repeated until a run takes at least 10ms, and slow ones get fewer runs.
+template <class F> static void Bench_Time(const std::string& name, u32 width, u32 height, f64 bytesPerPixel, F kernel)
+{
+    if (bench_filter && name.find(bench_filter) == std::string::npos)
+        return;
+    u32 reps = 1;
+    f64 seconds = Bench_Seconds(kernel, reps);
+    while (seconds < 0.01)
+    {
+        reps *= 2;
+        seconds = Bench_Seconds(kernel, reps);
+    }
+    f64 best = seconds / reps;
+    f64 total = seconds;
+    for (u32 run = 1; run < 5 && total < 2.0; run++)
+    {
+        seconds = Bench_Seconds(kernel, reps);
+        best = seconds / reps < best ? seconds / reps : best;
+        total += seconds;
+    }
+
+    f64 pixels = (f64)width * height;
+    Bench_Result r = { name, width, height, best * 1e9 / pixels, pixels / best / 1e6, pixels * bytesPerPixel / best / 1e9 };
+    bench_results.push_back(r);
+    printf("  %-48s %5ux%-5u %9.3f ns/px %9.1f Mpix/s %7.2f GB/s\n", name.c_str(), width, height, r.nsPerPixel, r.mpixPerSecond, r.gbPerSecond);
+    fflush(stdout);
+}
+
+static void Bench_Check(bool ok, const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    printf("  %-6s ", ok ? "ok" : "FAILED");
+    vprintf(format, args);
+    printf("\n");
+    va_end(args);
+    bench_failures += ok ? 0 : 1;
+}
+
+// Calls fn(count) for blocks covering pixels, each block reuses the start of
+// the buffers, which are bench_block_pixels long
+template <class F> static void Bench_Blocks(u64 pixels, F fn)
+{
+    for (u64 done = 0; done < pixels; done += bench_block_pixels)
+        fn((usize)(pixels - done < bench_block_pixels ? pixels - done : bench_block_pixels));
+}
+
+// The per pixel kernels, on width x height pixels of input covering each
+// kernel's useful range
+static void Bench_Kernels(u32 width, u32 height)
+{
+    u64 pixels = (u64)width * height;
+    usize block = (usize)(pixels < bench_block_pixels ? pixels : bench_block_pixels);
+    // scRGB from slightly negative up to the 10000 nits PQ peak, SDR from
+    // slightly negative to slightly over 1.0, and signal values in 0..1
+    std::vector<f32> hdr(4 * block), sdr(4 * block), signal(4 * block), out(4 * block), dst(4 * block);
+    std::vector<u16> half(4 * block);
+    std::vector<u32> packed(block);
+    for (usize i = 0; i < hdr.size(); i++)
+    {
+        bool alpha = (i & 3) == 3;
+        hdr[i] = alpha ? 1.0f : (f32)(i % 100003) * (126.0f / 100003.0f) - 1.0f;
+        sdr[i] = alpha ? 1.0f : (f32)(i % 100003) * (1.2f / 100003.0f) - 0.1f;
+        signal[i] = alpha ? 1.0f : (f32)(i % 100003) * (1.0f / 100002.0f);
+        half[i] = (u16)(i * 40503u);
+    }
+    for (usize i = 0; i < block; i++)
+        packed[i] = (u32)(i * 2654435761u);
+    const f32 mat[3][3] = { { 0.6274f, 0.3293f, 0.0433f }, { 0.0691f, 0.9195f, 0.0114f }, { 0.0164f, 0.0880f, 0.8956f } };
+
+    Bench_Time("PixelCallback_TestColors_scRGB", width, height, 16, [&]() {
+        for (u32 y = 0; y < height; y++)
+            for (u32 x = 0; x < width; x++)
+                PixelCallback_TestColors_scRGB(&out[4 * (usize)x], (f32)x, (f32)y, (f32)width, (f32)height);
+    });
+    Bench_Time("ToF16_RoundTowardZero", width, height, 24, [&]() {
+        Bench_Blocks(pixels, [&](usize n) {
+            u16* o = (u16*)out.data();
+            for (usize i = 0; i < 4 * n; i++)
+                o[i] = ToF16_RoundTowardZero(hdr[i]);
+        });
+    });
+    Bench_Time("ToF16", width, height, 24, [&]() {
+        Bench_Blocks(pixels, [&](usize n) {
+            u16* o = (u16*)out.data();
+            for (usize i = 0; i < 4 * n; i++)
+                o[i] = ToF16(hdr[i]);
+        });
+    });
+    Bench_Time("ToF16_Span", width, height, 24, [&]() {
+        Bench_Blocks(pixels, [&](usize n) { ToF16_Span(hdr.data(), (u16*)out.data(), 4 * n); });
+    });
+    Bench_Time("FromF16", width, height, 24, [&]() {
+        Bench_Blocks(pixels, [&](usize n) {
+            for (usize i = 0; i < 4 * n; i++)
+                out[i] = FromF16(half[i]);
+        });
+    });
+    Bench_Time("FromF16_Span", width, height, 24, [&]() {
+        Bench_Blocks(pixels, [&](usize n) { FromF16_Span(half.data(), out.data(), 4 * n); });
+    });
+    Bench_Time("Color_scRGB_To_Rec2020", width, height, 32, [&]() {
+        Bench_Blocks(pixels, [&](usize n) {
+            for (usize i = 0; i < n; i++)
+                Color_scRGB_To_Rec2020(&hdr[4 * i], &out[4 * i]);
+        });
+    });
+    Bench_Time("Color_rgb_through_mat3_Span", width, height, 32, [&]() {
+        Bench_Blocks(pixels, [&](usize n) { Color_rgb_through_mat3_Span(hdr.data(), out.data(), n, mat); });
+    });
+    Bench_Time("Color_Transfer_To_PQ", width, height, 32, [&]() {
+        Bench_Blocks(pixels, [&](usize n) {
+            for (usize i = 0; i < n; i++)
+                Color_Transfer_To_PQ(&hdr[4 * i], &out[4 * i]);
+        });
+    });
+    Bench_Time("Color_Transfer_To_PQ_Span", width, height, 32, [&]() {
+        Bench_Blocks(pixels, [&](usize n) { Color_Transfer_To_PQ_Span(hdr.data(), out.data(), n); });
+    });
+    Bench_Time("Color_Transfer_From_PQ", width, height, 32, [&]() {
+        Bench_Blocks(pixels, [&](usize n) {
+            for (usize i = 0; i < n; i++)
+                for (u32 c = 0; c < 3; c++)
+                    out[4 * i + c] = Color_Transfer_From_PQ(signal[4 * i + c]);
+        });
+    });
+    Bench_Time("Color_Transfer_From_PQ_Span", width, height, 32, [&]() {
+        Bench_Blocks(pixels, [&](usize n) { Color_Transfer_From_PQ_Span(signal.data(), out.data(), n); });
+    });
+    Bench_Time("Color_Transfer_From_sRGB", width, height, 32, [&]() {
+        Bench_Blocks(pixels, [&](usize n) {
+            for (usize i = 0; i < n; i++)
+                for (u32 c = 0; c < 3; c++)
+                    out[4 * i + c] = Color_Transfer_From_sRGB(signal[4 * i + c]);
+        });
+    });
+    Bench_Time("Color_Transfer_From_sRGB_Span", width, height, 32, [&]() {
+        Bench_Blocks(pixels, [&](usize n) { Color_Transfer_From_sRGB_Span(signal.data(), out.data(), n); });
+    });
+    Bench_Time("Pixel_To_Int", width, height, 32, [&]() {
+        Bench_Blocks(pixels, [&](usize n) {
+            memcpy(out.data(), sdr.data(), 4 * n * sizeof(f32));
+            for (usize i = 0; i < n; i++)
+                Pixel_To_Int(&out[4 * i], 1023.0f, 0.0f, 1023.0f);
+        });
+    });
+    Bench_Time("Color_Transfer_To_sRGB + Pixel_To_Int", width, height, 20, [&]() {
+        Bench_Blocks(pixels, [&](usize n) {
+            u32* o = (u32*)out.data();
+            for (usize i = 0; i < n; i++)
+            {
+                f32 c[4] = { sdr[4 * i], sdr[4 * i + 1], sdr[4 * i + 2], sdr[4 * i + 3] };
+                Color_Transfer_To_sRGB(c, c);
+                Pixel_To_Int(c, 255.0f, 0.0f, 255.0f);
+                o[i] = (u32)c[2] * 0x1 + (u32)c[1] * 0x100 + (u32)c[0] * 0x10000 + (u32)c[3] * 0x1000000;
+            }
+        });
+    });
+    Bench_Time("Color_Encode_BGRA8_sRGB_Span", width, height, 20, [&]() {
+        Bench_Blocks(pixels, [&](usize n) { Color_Encode_BGRA8_sRGB_Span(sdr.data(), (u32*)out.data(), n); });
+    });
+    Bench_Time("Color_Unpack_RGB10A2_Span", width, height, 20, [&]() {
+        Bench_Blocks(pixels, [&](usize n) { Color_Unpack_RGB10A2_Span(packed.data(), out.data(), n); });
+    });
+    Bench_Time("Color_Unpack_BGRA8_Span", width, height, 20, [&]() {
+        Bench_Blocks(pixels, [&](usize n) { Color_Unpack_BGRA8_Span(packed.data(), out.data(), n); });
+    });
+    Bench_Time("Pixel_Over_Span", width, height, 48, [&]() {
+        Bench_Blocks(pixels, [&](usize n) { Pixel_Over_Span(sdr.data(), dst.data(), n); });
+    });
+    Bench_Time("Transfer_HDR10::Apply", width, height, 32, [&]() {
+        Bench_Blocks(pixels, [&](usize n) {
+            memcpy(out.data(), hdr.data(), 4 * n * sizeof(f32));
+            Transfer_HDR10::Apply(out.data(), n);
+        });
+    });
+    for (u32 size : { 33u, 65u })
+    {
+        Lut3D lut;
+        Lut_Bake(&lut, size, Lut_Shaper::PQ, -0.5f, 125.0f, Transfer_HDR10::Apply);
+        Bench_Time("Lut_Apply HDR10 " + std::to_string(size) + "^3 PQ", width, height, 32, [&]() {
+            Bench_Blocks(pixels, [&](usize n) { Lut_Apply(lut, hdr.data(), out.data(), n); });
+        });
+    }
+    std::vector<u64> texels(block);
+    for (usize i = 0; i < block; i++)
+        texels[i] = (u64)(i * 0x9E3779B97F4A7C15ull);
+    for (usize f = 0; f < format_desc_count; f++)
+    {
+        const Format_Desc& desc = format_descs[f];
+        Bench_Time(std::string("Format pack ") + desc.name, width, height, 16.0 + desc.bpp, [&]() {
+            Bench_Blocks(pixels, [&](usize n) { desc.pack(sdr.data(), texels.data(), n); });
+        });
+        Bench_Time(std::string("Format unpack ") + desc.name, width, height, 16.0 + desc.bpp, [&]() {
+            Bench_Blocks(pixels, [&](usize n) { desc.unpack(texels.data(), out.data(), n); });
+        });
+    }
+}
+
+// The testcolors gradient evaluated at every pixel, to measure the generators'
+// per pixel work rather than row replication
+static Pattern_Gradient Bench_Pattern_2D()
+{
+    Pattern_Gradient pattern = pattern_testcolors;
+    pattern.separability = Pattern_Separability::Full_2D;
+    return pattern;
+}
+
+// The three generators the compositor uses, and the HDR10 one with the other
+// pattern types, the callback and Full_2D gradient should give the same image
+// as the row replicated gradient
+static void Bench_Generators(u32 width, u32 height)
+{
+    u32 w = width;
+    u32 h = height;
+    u64 pixels = (u64)width * height;
+    std::vector<u16> image(4 * pixels);
+    u32* image32 = (u32*)image.data();
+    Bench_Time("GenerateImage_RGBA16F_scRGB", width, height, 8, [&]() { GenerateImage_RGBA16F_scRGB(image.data(), w, h); });
+    Bench_Time("GenerateImage_RGB10A2_HDR10", width, height, 4, [&]() { GenerateImage_RGB10A2_HDR10(image32, w, h); });
+    Bench_Time("GenerateImage_BGRA8_sRGB", width, height, 4, [&]() { GenerateImage_BGRA8_sRGB(image32, w, h); });
+    // All three encodings, one after another and in one pass
+    std::vector<u32> hdr10(pixels), srgb(pixels);
+    Bench_Time("GenerateImage testcolors x3 separately", width, height, 16, [&]() {
+        GenerateImage_RGBA16F_scRGB(image.data(), w, h);
+        GenerateImage_RGB10A2_HDR10(hdr10.data(), w, h);
+        GenerateImage_BGRA8_sRGB(srgb.data(), w, h);
+    });
+    Generate_Outputs all;
+    all.scRGB.pixels = image.data();
+    all.hdr10.pixels = hdr10.data();
+    all.sRGB.pixels = srgb.data();
+    Bench_Time("GenerateImage_TestColors x3", width, height, 16, [&]() { GenerateImage_TestColors(all, w, h); });
+
+    typedef Transfer_HDR10 T;
+    typedef Format_RGB10A2 F;
+    const Pattern_Callback callback = { PixelCallback_TestColors_scRGB, Pattern_Separability::Full_2D };
+    const Pattern_Gradient full = Bench_Pattern_2D();
+    const Pattern_Checkerboard checkers = { { 2.0f, 2.0f, 2.0f, 1.0f }, { 0.0f, 0.0f, 0.0f, 1.0f }, 16 };
+    std::vector<u32> replicated(pixels), other(pixels);
+    GenerateImage_RGB10A2_HDR10(replicated.data(), w, h);
+    Bench_Time("GenerateImage HDR10 Pattern_Callback Full_2D", width, height, 4, [&]() { GenerateImage<Pattern_Callback, T, F>(image32, w, h, callback); });
+    Bench_Time("GenerateImage HDR10 Pattern_Gradient Full_2D", width, height, 4, [&]() { GenerateImage<Pattern_Gradient, T, F>(other.data(), w, h, full); });
+    if (!bench_filter)
+        Bench_Check(memcmp(image32, replicated.data(), 4 * pixels) == 0 && other == replicated, "%ux%u callback, Full_2D and Row_Invariant gradients give the same image", width, height);
+    Bench_Time("GenerateImage HDR10 Pattern_Checkerboard", width, height, 4, [&]() { GenerateImage<Pattern_Checkerboard, T, F>(image32, w, h, checkers); });
+
+    // A pattern evaluated for every pixel, where one pass saves the most
+    Bench_Time("GenerateImage Pattern_Callback x3 separately", width, height, 16, [&]() {
+        GenerateImage<Pattern_Callback, Transfer_scRGB, Format_RGBA16F>(image.data(), w, h, callback);
+        GenerateImage<Pattern_Callback, T, F>(hdr10.data(), w, h, callback);
+        GenerateImage<Pattern_Callback, Transfer_sRGB, Format_BGRA8>(srgb.data(), w, h, callback);
+    });
+    const Generate_Rect rect = { 0, 0, w, h };
+    Bench_Time("GenerateImage_Multi_Rect Pattern_Callback x3", width, height, 16, [&]() { GenerateImage_Multi_Rect(all, w, h, rect, callback); });
+}
+
+// Time each generator from 1 thread up to one per hardware thread, checking the
+// output matches the single threaded output
+static void Bench_Generate_Scaling(u32 width, u32 height)
+{
+    typedef Pattern_Gradient P;
+    const P pattern = Bench_Pattern_2D();
+    u64 pixels = (u64)width * height;
+    std::vector<u16> scrgb(4 * pixels), scrgbRef(4 * pixels);
+    std::vector<u32> hdr10(pixels), hdr10Ref(pixels);
+    std::vector<u32> srgb8(pixels), srgb8Ref(pixels);
+    u32 previous = Parallel_Threads();
+    Parallel_SetThreads(1);
+    GenerateImage<P, Transfer_scRGB, Format_RGBA16F>(scrgbRef.data(), width, height, pattern);
+    GenerateImage<P, Transfer_HDR10, Format_RGB10A2>(hdr10Ref.data(), width, height, pattern);
+    GenerateImage<P, Transfer_sRGB, Format_BGRA8>(srgb8Ref.data(), width, height, pattern);
+
+    u32 maxThreads = std::thread::hardware_concurrency();
+    maxThreads = maxThreads < 1 ? 1 : maxThreads;
+    for (u32 threads = 1;; threads = threads * 2 < maxThreads ? threads * 2 : maxThreads)
+    {
+        Parallel_SetThreads(threads);
+        std::string suffix = " Full_2D threads=" + std::to_string(threads);
+        Bench_Time("GenerateImage RGBA16F scRGB" + suffix, width, height, 8, [&]() { GenerateImage<P, Transfer_scRGB, Format_RGBA16F>(scrgb.data(), width, height, pattern); });
+        Bench_Time("GenerateImage RGB10A2 HDR10" + suffix, width, height, 4, [&]() { GenerateImage<P, Transfer_HDR10, Format_RGB10A2>(hdr10.data(), width, height, pattern); });
+        Bench_Time("GenerateImage BGRA8 sRGB" + suffix, width, height, 4, [&]() { GenerateImage<P, Transfer_sRGB, Format_BGRA8>(srgb8.data(), width, height, pattern); });
+        if (!bench_filter)
+            Bench_Check(scrgb == scrgbRef && hdr10 == hdr10Ref && srgb8 == srgb8Ref, "%u threads give the same images as 1 thread", threads);
+        if (threads == maxThreads)
+            break;
+    }
+    Parallel_SetThreads(previous);
+}
+
+// Accuracy of the fast kernels against their reference formulas, and round
+// trips of every decoder through its encoder
+static void Bench_Accuracy()
+{
+    // PQ inverse EOTF table against the powf formula on a dense sweep of 0 to
+    // 10000 nits
+    constexpr u32 steps = 1 << 20;
+    std::vector<f32> sweep(4 * steps);
+    std::vector<f32> fast(4 * steps);
+    for (u32 i = 0; i < sweep.size(); i++)
+        sweep[i] = powf((f32)i / (f32)sweep.size(), 4.0f) * 125.0f;
+    Color_Transfer_To_PQ_Span(sweep.data(), fast.data(), steps);
+    f64 maxerr = 0.0;
+    for (u32 i = 0; i < steps; i++)
+    {
+        f32 ref[4];
+        Color_Transfer_To_PQ(&sweep[4 * i], ref);
+        for (u32 c = 0; c < 3; c++)
+        {
+            f64 err = fabs((f64)fast[4 * i + c] - ref[c]);
+            maxerr = err > maxerr ? err : maxerr;
+        }
+    }
+    Bench_Check(maxerr < 3e-5, "Color_Transfer_To_PQ_Span max error %.3g (%.4f 10-bit, %.4f 12-bit code values)", maxerr, maxerr * 1023.0, maxerr * 4095.0);
+
+    // sRGB8 encoder against the formula, which should be bit exact
+    for (u32 i = 0; i < sweep.size(); i++)
+        sweep[i] = (i & 3) == 3 ? 1.0f : (f32)(i % 100003) * (1.2f / 100003.0f) - 0.1f;
+    std::vector<u32> encoded(steps);
+    Color_Encode_BGRA8_sRGB_Span(sweep.data(), encoded.data(), steps);
+    u32 mismatches = 0;
+    for (u32 i = 0; i < steps; i++)
+    {
+        f32 c[4] = { sweep[4 * i], sweep[4 * i + 1], sweep[4 * i + 2], sweep[4 * i + 3] };
+        Color_Transfer_To_sRGB(c, c);
+        Pixel_To_Int(c, 255.0f, 0.0f, 255.0f);
+        u32 ref = (u32)c[2] * 0x1 + (u32)c[1] * 0x100 + (u32)c[0] * 0x10000 + (u32)c[3] * 0x1000000;
+        mismatches += encoded[i] != ref ? 1 : 0;
+    }
+    Bench_Check(mismatches == 0, "Color_Encode_BGRA8_sRGB_Span, %u of %u pixels differ from the formula", mismatches, steps);
+
+    // f16, every value should survive f16 -> f32 -> f16, except signaling NaN
+    // which becomes quiet
+    u32 f16bad = 0;
+    {
+        std::vector<u16> all(65536), again(65536);
+        std::vector<f32> wide(65536);
+        for (u32 h = 0; h < 65536; h++)
+            all[h] = (u16)h;
+        FromF16_Span(all.data(), wide.data(), all.size());
+        ToF16_Span(wide.data(), again.data(), wide.size());
+        for (u32 h = 0; h < 65536; h++)
+        {
+            bool snan = (h & 0x7C00) == 0x7C00 && (h & 0x3FF) && !(h & 0x200);
+            f32 scalar = FromF16((u16)h);
+            bool same = memcmp(&scalar, &wide[h], sizeof(scalar)) == 0;
+            f16bad += again[h] != (snan ? (h | 0x200) : h) || !same ? 1 : 0;
+        }
+    }
+    Bench_Check(f16bad == 0, "FromF16_Span, %u of 65536 f16 values don't round trip", f16bad);
+
+    // RGB10A2 and BGRA8 unpack, repacking must give back the same bits
+    std::vector<u32> packed(steps), repacked(steps);
+    for (u32 i = 0; i < steps; i++)
+        packed[i] = i * 2654435761u;
+    Color_Unpack_RGB10A2_Span(packed.data(), fast.data(), steps);
+    Format_RGB10A2::Pack(fast.data(), repacked.data(), steps);
+    Bench_Check(packed == repacked, "Color_Unpack_RGB10A2_Span round trips through Format_RGB10A2");
+    Color_Unpack_BGRA8_Span(packed.data(), fast.data(), steps);
+    Format_BGRA8::Pack(fast.data(), repacked.data(), steps);
+    Bench_Check(packed == repacked, "Color_Unpack_BGRA8_Span round trips through Format_BGRA8");
+
+    // PQ EOTF against the f64 formula, and every 12-bit code back through the
+    // inverse EOTF
+    for (u32 i = 0; i < sweep.size(); i++)
+        sweep[i] = (i & 3) == 3 ? 1.0f : (f32)(i / 4) / (f32)(steps - 1);
+    Color_Transfer_From_PQ_Span(sweep.data(), fast.data(), steps);
+    f64 pqerr = 0.0;
+    for (u32 i = 0; i < steps; i++)
+    {
+        f64 e = sweep[4 * i];
+        f64 p = pow(e, 1.0 / (128.0 * 2523.0 / 4096.0));
+        f64 n = p - 3424.0 / 4096.0 > 0.0 ? p - 3424.0 / 4096.0 : 0.0;
+        f64 ref = pow(n / (32.0 * 2413.0 / 4096.0 - 32.0 * 2392.0 / 4096.0 * p), 16384.0 / 2610.0) * (10000.0 / 80.0);
+        // Relative, but with a floor of 0.0001 nits where the curve is flat
+        f64 err = fabs(fast[4 * i] - ref) / (ref > 1e-6 ? ref : 1e-6);
+        pqerr = err > pqerr ? err : pqerr;
+    }
+    std::vector<f32> codes(4 * 4096), linear(4 * 4096), signal(4 * 4096);
+    for (u32 i = 0; i < codes.size(); i++)
+        codes[i] = (f32)(i / 4) / 4095.0f;
+    Color_Transfer_From_PQ_Span(codes.data(), linear.data(), 4096);
+    Color_Transfer_To_PQ_Span(linear.data(), signal.data(), 4096);
+    f64 pqcode = 0.0;
+    for (u32 i = 0; i < 4096; i++)
+    {
+        f64 err = fabs(signal[4 * i] - codes[4 * i]) * 4095.0;
+        pqcode = err > pqcode ? err : pqcode;
+    }
+    Bench_Check(pqerr < 2e-4, "Color_Transfer_From_PQ_Span max relative error %.3g", pqerr);
+    Bench_Check(pqcode < 0.1, "Color_Transfer_From_PQ_Span 12-bit codes round trip within %.4f codes", pqcode);
+
+    // sRGB EOTF, every 8-bit code must come back through the BGRA8 encoder
+    Color_Transfer_From_sRGB_Span(sweep.data(), fast.data(), steps);
+    f64 srgberr = 0.0;
+    for (u32 i = 0; i < steps; i++)
+    {
+        f64 e = sweep[4 * i];
+        f64 ref = e < 0.04045 ? e / 12.92 : pow((e + 0.055) / 1.055, 2.4);
+        f64 err = fabs(fast[4 * i] - ref) / (ref > 1e-6 ? ref : 1e-6);
+        srgberr = err > srgberr ? err : srgberr;
+    }
+    std::vector<u32> bytes(256), bytesBack(256);
+    for (u32 i = 0; i < 256; i++)
+        bytes[i] = i * 0x01010101u;
+    std::vector<f32> unpacked(4 * 256), eotf(4 * 256);
+    Color_Unpack_BGRA8_Span(bytes.data(), unpacked.data(), 256);
+    Color_Transfer_From_sRGB_Span(unpacked.data(), eotf.data(), 256);
+    Color_Encode_BGRA8_sRGB_Span(eotf.data(), bytesBack.data(), 256);
+    Bench_Check(srgberr < 3e-5, "Color_Transfer_From_sRGB_Span max relative error %.3g", srgberr);
+    Bench_Check(bytes == bytesBack, "Color_Transfer_From_sRGB_Span 8-bit codes round trip through Color_Encode_BGRA8_sRGB_Span");
+}
+
+// Bits of an f32, for the float formats' rounding checks
+static f32 Bench_F32(u32 bits)
+{
+    f32 f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+// The decoded value of an 11-bit (mbits 6) or 10-bit (mbits 5) unsigned float
+static f64 Bench_UFloat(u32 code, u32 mbits)
+{
+    u32 e = code >> mbits;
+    u32 m = code & ((1u << mbits) - 1);
+    return e ? ldexp(1.0 + m / (f64)(1u << mbits), (i32)e - 15) : ldexp(m / (f64)(1u << mbits), -14);
+}
+
+// The pixel formats: the vectorized spans against their own scalar tails, every
+// code round tripping, and the float formats' rounding
+static void Bench_Formats()
+{
+    // Values around every edge case, the spans must give the same bits whether
+    // a pixel goes through the vector body or the scalar tail
+    const f32 inf = std::numeric_limits<f32>::infinity();
+    const f32 nan = std::numeric_limits<f32>::quiet_NaN();
+    const f32 edges[] = { 0.0f, -0.0f, 1.0f, -1.0f, 0.5f, 2.0f, 1e-8f, 6e-5f, 6.1e-5f, 1.0f / 255.0f, 0.5f / 255.0f, 127.5f / 255.0f, 0.5f / 1023.0f, 0.5f / 65535.0f,
+        0.99999f, 1.00001f, 0.0031308f, 65504.0f, 65520.0f, 65024.0f, 65408.0f, 65536.0f, 1e9f, -1e9f, inf, -inf, nan, -nan, Bench_F32(0x7F800001), 3.14159f, 1.5e-5f, 100.0f };
+    const u32 count = sizeof(edges) / sizeof(edges[0]);
+    const u32 pixels = count * count;
+    std::vector<f32> rgba(4 * (usize)pixels);
+    for (u32 i = 0; i < pixels; i++)
+    {
+        rgba[4 * i] = edges[i % count];
+        rgba[4 * i + 1] = edges[i / count];
+        rgba[4 * i + 2] = edges[(i * 7 + 3) % count];
+        rgba[4 * i + 3] = edges[(i * 13 + 5) % count];
+    }
+    for (usize f = 0; f < format_desc_count; f++)
+    {
+        const Format_Desc& desc = format_descs[f];
+        std::vector<u8> span(pixels * desc.bpp), single(pixels * desc.bpp);
+        std::vector<f32> unpacked(4 * (usize)pixels), unpackedSingle(4 * (usize)pixels);
+        desc.pack(rgba.data(), span.data(), pixels);
+        for (u32 i = 0; i < pixels; i++)
+            desc.pack(&rgba[4 * i], &single[i * desc.bpp], 1);
+        desc.unpack(span.data(), unpacked.data(), pixels);
+        for (u32 i = 0; i < pixels; i++)
+            desc.unpack(&span[i * desc.bpp], &unpackedSingle[4 * i], 1);
+        bool same = span == single && memcmp(unpacked.data(), unpackedSingle.data(), unpacked.size() * sizeof(f32)) == 0;
+        Bench_Check(same, "Format %s spans match their scalar tails on edge cases", desc.name);
+    }
+
+    // Every code of every channel unpacks and packs back to the same bits,
+    // apart from signaling NaN becoming quiet and the non-canonical RGB9E5
+    // encodings of values that have a shorter one
+    std::vector<u16> codes16(4 * 65536), back16(4 * 65536);
+    std::vector<f32> wide(4 * 65536);
+    for (u32 i = 0; i < 4 * 65536; i++)
+        codes16[i] = (u16)(i / 4 + i % 4 * 0x4001);
+    Format_RGBA16::Unpack(codes16.data(), wide.data(), 65536);
+    Format_RGBA16::Pack(wide.data(), back16.data(), 65536);
+    Bench_Check(codes16 == back16, "Format_RGBA16 round trips all 65536 codes");
+
+    std::vector<u32> codes32(4096), back32(4096);
+    for (u32 i = 0; i < 1024; i++)
+        codes32[i] = i | ((i * 7) & 1023) << 10 | ((1023 - i) << 20) | (i & 3) << 30;
+    Format_RGB10A2::Unpack(codes32.data(), wide.data(), 1024);
+    Format_RGB10A2::Pack(wide.data(), back32.data(), 1024);
+    bool ok = memcmp(codes32.data(), back32.data(), 1024 * sizeof(u32)) == 0;
+    Bench_Check(ok, "Format_RGB10A2 round trips all 1024 codes");
+
+    // Alpha rounds to the nearest of 0, 1/3, 2/3 and 1, past the SIMD widths
+    const f32 alphas[] = { 0.0f, 0.1f, 0.2f, 0.5f, 0.7f, 0.9f, 1.0f, -1.0f, 2.0f };
+    const u32 levels[] = { 0, 0, 1, 2, 2, 3, 3, 0, 3 };
+    std::vector<f32> alphaPixels(4 * 36, 0.5f);
+    for (u32 i = 0; i < 36; i++)
+        alphaPixels[4 * i + 3] = alphas[i % 9];
+    Format_RGB10A2::Pack(alphaPixels.data(), back32.data(), 36);
+    ok = true;
+    for (u32 i = 0; i < 36; i++)
+        ok = ok && back32[i] >> 30 == levels[i % 9];
+    Bench_Check(ok, "Format_RGB10A2 rounds alpha to the nearest of its 4 levels");
+
+    for (u32 i = 0; i < 2048; i++)
+    {
+        u32 b = (i >> 1) & 1023;
+        codes32[i] = i | (2047 - i) << 11 | b << 22;
+    }
+    Format_R11G11B10F::Unpack(codes32.data(), wide.data(), 2048);
+    Format_R11G11B10F::Pack(wide.data(), back32.data(), 2048);
+    ok = true;
+    for (u32 i = 0; i < 2048; i++)
+    {
+        u32 quiet = codes32[i];
+        quiet |= (quiet & 0x7C0) == 0x7C0 && (quiet & 0x3F) ? 0x20 : 0;
+        quiet |= (quiet & 0x3E0000) == 0x3E0000 && (quiet & 0x1F800) ? 0x10000 : 0;
+        quiet |= (quiet & 0xF8000000) == 0xF8000000 && (quiet & 0x7C00000) ? 0x4000000 : 0;
+        ok = ok && back32[i] == quiet && wide[4 * i + 3] == 1.0f;
+    }
+    Bench_Check(ok, "Format_R11G11B10F round trips all 2048 codes");
+
+    for (u32 i = 0; i < 256; i++)
+        codes32[i] = i | (255 - i) << 8 | (i * 3 & 255) << 16 | (i ^ 0x5A) << 24;
+    Format_BGRA8::Unpack(codes32.data(), wide.data(), 256);
+    Format_BGRA8::Pack(wide.data(), back32.data(), 256);
+    ok = memcmp(codes32.data(), back32.data(), 256 * sizeof(u32)) == 0;
+    Format_RGBA8_sRGB::Unpack(codes32.data(), wide.data(), 256);
+    Format_RGBA8_sRGB::Pack(wide.data(), back32.data(), 256);
+    ok = ok && memcmp(codes32.data(), back32.data(), 256 * sizeof(u32)) == 0;
+    Bench_Check(ok, "Format_BGRA8 and Format_RGBA8_sRGB round trip all 256 codes");
+
+    // RGB9E5, every mantissa at every exponent, canonical when the largest
+    // mantissa uses the top bit or the exponent is already the smallest
+    ok = true;
+    u32 canonical = 0;
+    for (u32 e = 0; e < 32; e++)
+    {
+        u32 n = 0;
+        for (u32 m = 0; m < 512; m++)
+        {
+            u32 g = (m * 5 + 17) & 511;
+            u32 b = (m * 3 + 100) & 511;
+            u32 largest = m > g ? (m > b ? m : b) : (g > b ? g : b);
+            if (e && largest < 256)
+                continue;
+            codes32[n++] = m | g << 9 | b << 18 | e << 27;
+        }
+        Format_RGB9E5::Unpack(codes32.data(), wide.data(), n);
+        Format_RGB9E5::Pack(wide.data(), back32.data(), n);
+        ok = ok && memcmp(codes32.data(), back32.data(), n * sizeof(u32)) == 0;
+        canonical += n;
+    }
+    Bench_Check(ok, "Format_RGB9E5 round trips all %u canonical test codes", canonical);
+
+    // R11G11B10F rounds to nearest even: just under, at and just over the
+    // midpoint between neighbouring codes, checked on R
+    ok = true;
+    for (u32 code = 0; code < 0x7BF; code++)
+    {
+        f32 mid = (f32)((Bench_UFloat(code, 6) + Bench_UFloat(code + 1, 6)) / 2.0);
+        u32 bits;
+        memcpy(&bits, &mid, sizeof(bits));
+        const f32 probe[3] = { Bench_F32(bits - 1), mid, Bench_F32(bits + 1) };
+        const u32 expect[3] = { code, code + (code & 1), code + 1 };
+        for (u32 k = 0; k < 3; k++)
+        {
+            f32 p[4] = { probe[k], 0.0f, 0.0f, 1.0f };
+            u32 out = 0;
+            Format_R11G11B10F::Pack(p, &out, 1);
+            ok = ok && (out & 0x7FF) == expect[k];
+        }
+    }
+    const f32 extremes[4] = { -1.0f, 1e9f, inf, 0.0f };
+    u32 out = 0;
+    Format_R11G11B10F::Pack(extremes, &out, 1);
+    ok = ok && out == (0x7C0u << 11 | 0x3E0u << 22);
+    Bench_Check(ok, "Format_R11G11B10F rounds to nearest even, negatives to 0 and overflow to infinity");
+
+    // RGB9E5 error stays within half a step of the shared exponent
+    std::vector<f32> values(4 * 4096);
+    for (u32 i = 0; i < values.size(); i++)
+        values[i] = (i & 3) == 3 ? 1.0f : (f32)ldexp(((i * 2654435761u) >> 8) / 16777216.0, (i * 40503u >> 10) % 40 - 24);
+    Format_RGB9E5::Pack(values.data(), codes32.data(), 4096);
+    Format_RGB9E5::Unpack(codes32.data(), wide.data(), 4096);
+    ok = true;
+    for (u32 i = 0; i < 4096; i++)
+    {
+        i32 e = (i32)(codes32[i] >> 27);
+        f64 step = ldexp(1.0, e - 15 - 9);
+        for (u32 c = 0; c < 3; c++)
+            ok = ok && fabs((f64)wide[4 * i + c] - values[4 * i + c]) <= step / 2.0;
+    }
+    Bench_Check(ok, "Format_RGB9E5 errors are within half a step of the shared exponent");
+
+    // RGBA8_SRGB is the BGRA8 sRGB encoder with red and blue swapped
+    std::vector<u32> bgra(pixels), rgba8(pixels);
+    Color_Encode_BGRA8_sRGB_Span(rgba.data(), bgra.data(), pixels);
+    Format_RGBA8_sRGB::Pack(rgba.data(), rgba8.data(), pixels);
+    ok = true;
+    for (u32 i = 0; i < pixels; i++)
+        ok = ok && rgba8[i] == ((bgra[i] & 0xFF00FF00) | (bgra[i] >> 16 & 0xFF) | (bgra[i] & 0xFF) << 16);
+    Bench_Check(ok, "Format_RGBA8_sRGB packs like Color_Encode_BGRA8_sRGB_Span with red and blue swapped");
+
+    ok = Format_Find(dxgi_format_r16g16b16a16_float)->pack == Format_RGBA16F::Pack && Format_Find(dxgi_format_r9g9b9e5_sharedexp)->bpp == 4 && !Format_Find(0) && !Format_Find(2);
+    for (usize f = 0; f < format_desc_count; f++)
+        ok = ok && Format_Find(format_descs[f].dxgi) == &format_descs[f] && (f == 0 || format_descs[f - 1].dxgi < format_descs[f].dxgi);
+    Bench_Check(ok, "Format_Find looks up every format by DXGI_FORMAT");
+}
+
+// Largest difference between two spans of RGBA pixels' colors
+static f64 Bench_Max_Difference(const std::vector<f32>& a, const std::vector<f32>& b)
+{
+    f64 worst = 0.0;
+    for (usize i = 0; i < a.size(); i++)
+        worst = (i & 3) != 3 && fabs((f64)a[i] - b[i]) > worst ? fabs((f64)a[i] - b[i]) : worst;
+    return worst;
+}
+
+// Baking, tetrahedral interpolation and .cube files
+static void Bench_Lut()
+{
+    const usize pixels = 4099;
+    std::vector<f32> rgba(4 * pixels), out(4 * pixels), expect(4 * pixels);
+    for (usize i = 0; i < rgba.size(); i++)
+        rgba[i] = (i & 3) == 3 ? 0.5f : (f32)((u32)(i * 2654435761u) >> 8) / 16777216.0f * 3.0f - 1.0f;
+
+    // Tetrahedral interpolation reproduces a linear function exactly, so the
+    // identity comes back to rounding, and from outside the domain clamped
+    Lut3D identity;
+    bool ok = Lut_Bake(&identity, 17, Lut_Shaper::Linear, -1.0f, 2.0f, Transfer_scRGB::Apply);
+    Lut_Apply(identity, rgba.data(), out.data(), pixels);
+    f64 error = Bench_Max_Difference(rgba, out);
+    ok = ok && error < 2e-6;
+    for (usize i = 0; i < pixels; i++)
+        ok = ok && out[4 * i + 3] == rgba[4 * i + 3];
+    const f32 outside[8] = { -5.0f, 7.0f, std::numeric_limits<f32>::quiet_NaN(), 1.0f, 2.0f, -1.0f, 0.5f, 0.25f };
+    f32 clamped[8];
+    Lut_Apply(identity, outside, clamped, 2);
+    ok = ok && clamped[0] == -1.0f && clamped[1] == 2.0f && clamped[2] == -1.0f && clamped[4] == 2.0f && clamped[5] == -1.0f && fabsf(clamped[6] - 0.5f) < 1e-6f;
+    Bench_Check(ok, "Lut_Apply of a baked identity matches to %.2g, clamped to the domain", error);
+
+    ok = !Lut_Bake(&identity, 1, Lut_Shaper::Linear, 0.0f, 1.0f, Transfer_scRGB::Apply) && !Lut_Bake(&identity, 257, Lut_Shaper::Linear, 0.0f, 1.0f, Transfer_scRGB::Apply) &&
+        !Lut_Bake(&identity, 33, Lut_Shaper::Linear, 1.0f, 1.0f, Transfer_scRGB::Apply) && !Lut_Bake(&identity, 33, Lut_Shaper::PQ, 0.0f, 200.0f, Transfer_scRGB::Apply) &&
+        !Lut_Bake(&identity, 33, Lut_Shaper::Table, 0.0f, 1.0f, Transfer_scRGB::Apply) && identity.size == 17;
+    Bench_Check(ok, "Lut_Bake rejects bad sizes, domains and shapers");
+
+    // A 65^3 PQ shaped HDR10 LUT against the direct conversion, on HDR values
+    Lut3D hdr10;
+    ok = Lut_Bake(&hdr10, 65, Lut_Shaper::PQ, -0.5f, 125.0f, Transfer_HDR10::Apply);
+    std::vector<f32> hdr(4 * pixels);
+    for (usize i = 0; i < hdr.size(); i++)
+        hdr[i] = (i & 3) == 3 ? 1.0f : (f32)((u32)(i * 2654435761u) >> 8) / 16777216.0f * 12.5f - 0.1f;
+    expect = hdr;
+    Transfer_HDR10::Apply(expect.data(), pixels);
+    Lut_Apply(hdr10, hdr.data(), out.data(), pixels);
+    error = Bench_Max_Difference(expect, out) * 1023.0;
+    Bench_Check(ok && error < 1.0, "Lut_Apply of a 65^3 PQ shaped HDR10 LUT is within %.3f of a 10-bit code of Transfer_HDR10", error);
+
+    // .cube files come back with the same nodes and shaper
+    Lut3D parsed;
+    identity.title = "identity";
+    ok = Lut_Parse_Cube(Lut_Format_Cube(identity).c_str(), &parsed) && parsed.title == "identity" && parsed.shaper == Lut_Shaper::Linear &&
+        parsed.size == 17 && parsed.lattice == identity.lattice && parsed.domainMin[1] == -1.0f && parsed.domainMax[2] == 2.0f;
+    Bench_Check(ok, "Lut_Format_Cube and Lut_Parse_Cube round trip a linear shaped LUT");
+    std::string cube = Lut_Format_Cube(hdr10);
+    ok = Lut_Parse_Cube(cube.c_str(), &parsed) && parsed.shaper == Lut_Shaper::PQ && parsed.size == 65 && parsed.lattice == hdr10.lattice && parsed.domainMin[0] == -0.5f &&
+        parsed.domainMax[0] == 125.0f;
+    Bench_Check(ok, "Lut_Format_Cube and Lut_Parse_Cube round trip a PQ shaped LUT");
+
+    // Without our comment it's the sampled 1D shaper other tools see, which
+    // is coarse near black but close above it
+    usize marker = cube.find("# Shaper: PQ\n");
+    cube.erase(marker, 13);
+    ok = Lut_Parse_Cube(cube.c_str(), &parsed) && parsed.shaper == Lut_Shaper::Table && parsed.shaperSize == lut_cube_shaper_size && parsed.lattice == hdr10.lattice;
+    for (usize i = 0; i < hdr.size(); i++)
+        hdr[i] = (i & 3) == 3 ? 1.0f : (f32)((u32)(i * 2654435761u) >> 8) / 16777216.0f * 12.0f + 0.5f;
+    Lut_Apply(hdr10, hdr.data(), expect.data(), pixels);
+    Lut_Apply(parsed, hdr.data(), out.data(), pixels);
+    error = Bench_Max_Difference(expect, out) * 1023.0;
+    Bench_Check(ok && error < 0.5, "A sampled 1D shaper from a .cube file is within %.3f of a 10-bit code of the PQ one from 40 nits up", error);
+
+    // A 1D only file, and a 3D one with the Resolve input range keyword
+    const char* curve = "# gamma\nTITLE \"curve\"\nLUT_1D_SIZE 3\n\n0 0 0\n0.25 0.5 1\n1 1 1\n";
+    const f32 mid[8] = { 0.5f, 0.5f, 0.5f, 1.0f, 0.25f, 0.75f, 1.5f, 0.0f };
+    f32 curved[8];
+    ok = Lut_Parse_Cube(curve, &parsed) && parsed.shaper == Lut_Shaper::Table && parsed.size == 2;
+    Lut_Apply(parsed, mid, curved, 2);
+    ok = ok && fabsf(curved[0] - 0.25f) < 1e-6f && fabsf(curved[1] - 0.5f) < 1e-6f && fabsf(curved[2] - 1.0f) < 1e-6f && curved[3] == 1.0f;
+    ok = ok && fabsf(curved[4] - 0.125f) < 1e-6f && fabsf(curved[5] - 0.75f) < 1e-6f && fabsf(curved[6] - 1.0f) < 1e-6f;
+    const char* ranged = "LUT_3D_SIZE 2\r\nLUT_3D_INPUT_RANGE 0 2\r\n0 0 0\r\n1 0 0\r\n0 1 0\r\n1 1 0\r\n0 0 1\r\n1 0 1\r\n0 1 1\r\n1 1 1\r\n";
+    ok = ok && Lut_Parse_Cube(ranged, &parsed) && parsed.shaper == Lut_Shaper::Linear && parsed.domainMax[1] == 2.0f;
+    Lut_Apply(parsed, mid, curved, 2);
+    ok = ok && fabsf(curved[0] - 0.25f) < 1e-6f && fabsf(curved[6] - 0.75f) < 1e-6f;
+    Bench_Check(ok, "Lut_Parse_Cube reads 1D only files and LUT_3D_INPUT_RANGE");
+
+    const char* bad[] = { "", "LUT_3D_SIZE 2\n0 0 0\n", "LUT_3D_SIZE 1\n0 0 0\n", "LUT_1D_SIZE 2\n0 0 0\n1 1\n", "LUT_1D_SIZE 2\n0 0 0\nLUT_3D_SIZE 2\n1 1 1\n",
+        "LUT_1D_SIZE 2\nDOMAIN_MIN 1 0 0\n0 0 0\n1 1 1\n", "LUT_1D_SIZE 2\n0 0 0\n1 1 1 1\n", "TITLE \"open\nLUT_1D_SIZE 2\n0 0 0\n1 1 1\n" };
+    ok = true;
+    for (const char* text : bad)
+        ok = ok && !Lut_Parse_Cube(text, &parsed);
+    ok = ok && parsed.size == 2 && parsed.domainMax[1] == 2.0f;
+    Bench_Check(ok, "Lut_Parse_Cube rejects malformed files and leaves the LUT alone");
+
+    // Generating through a LUT is the pattern then Lut_Apply
+    const u32 width = 301;
+    const u32 height = 7;
+    const Pattern_Gradient pattern = Bench_Pattern_2D();
+    std::vector<f32> direct(4 * (usize)width * height);
+    std::vector<u16> image(direct.size()), expected(direct.size());
+    const Pattern_Lut<Pattern_Gradient> through(pattern, hdr10);
+    GenerateImage<Pattern_Lut<Pattern_Gradient>, Transfer_scRGB, Format_RGBA16F>(image.data(), width, height, through);
+    for (u32 y = 0; y < height; y++)
+        pattern.Span(&direct[4 * (usize)y * width], 0, y, width, width, height);
+    Lut_Apply(hdr10, direct.data(), direct.data(), (usize)width * height);
+    Format_RGBA16F::Pack(direct.data(), expected.data(), (usize)width * height);
+    Bench_Check(image == expected, "GenerateImage through Pattern_Lut matches Lut_Apply");
+}
+
+// An HDR image that changes along both axes, so a flipped or shifted row shows
+static void Bench_Image_Pixel(f32 output[], f32 x, f32 y, f32 width, f32 height)
+{
+    output[0] = x / width * 12.0f - 0.05f;
+    output[1] = y / height * 2.0f;
+    output[2] = (f32)((u32)(x + 3 * y) % 7) * 0.4f - 0.2f;
+    output[3] = 1.0f;
+}
+
+static bool Bench_Write_File(const char* path, const std::string& header, const void* data, usize bytes)
+{
+    FILE* file = fopen(path, "wb");
+    if (!file)
+        return false;
+    bool ok = fwrite(header.data(), 1, header.size(), file) == header.size() && fwrite(data, 1, bytes, file) == bytes;
+    return fclose(file) == 0 && ok;
+}
+
+// Image files, converted from their mapping, give the same pixels as the
+// pattern they were written from
+static void Bench_Image()
+{
+    const u32 width = 203;
+    const u32 height = 37;
+    const usize pixels = (usize)width * height;
+    const Pattern_Callback pattern = { Bench_Image_Pixel, Pattern_Separability::Full_2D };
+    std::vector<f32> rgba(4 * pixels);
+    for (u32 y = 0; y < height; y++)
+        pattern.Span(&rgba[4 * (usize)y * width], 0, y, width, width, height);
+
+    // The files: PFM both byte orders (bottom up), grayscale PFM and raw
+    std::vector<u8> rgbLE(12 * pixels), rgbBE(12 * pixels), gray(4 * pixels);
+    for (u32 y = 0; y < height; y++)
+    {
+        for (u32 x = 0; x < width; x++)
+        {
+            const f32* c = &rgba[4 * ((usize)(height - 1 - y) * width + x)];
+            usize i = (usize)y * width + x;
+            memcpy(&rgbLE[12 * i], c, 12);
+            for (u32 k = 0; k < 12; k++)
+                rgbBE[12 * i + k] = rgbLE[12 * i + (k & ~3u) + 3 - (k & 3)];
+            memcpy(&gray[4 * i], &c[1], 4);
+        }
+    }
+    std::vector<u16> halves(4 * pixels);
+    Format_RGBA16F::Pack(std::vector<f32>(rgba).data(), halves.data(), pixels);
+    std::string size = std::to_string(width) + " " + std::to_string(height);
+    bool ok = Bench_Write_File("bench-image-le.pfm", "PF\n" + size + "\n-1.0\n", rgbLE.data(), rgbLE.size());
+    ok = ok && Bench_Write_File("bench-image-be.pfm", "PF " + size + " 2.5\n", rgbBE.data(), rgbBE.size());
+    ok = ok && Bench_Write_File("bench-image-gray.pfm", "Pf\r\n" + size + "\r\n-1\n", gray.data(), gray.size());
+    ok = ok && Bench_Write_File("bench-image.rgba32f", "", rgba.data(), 4 * sizeof(f32) * pixels);
+    ok = ok && Bench_Write_File("bench-image.rgba16f", "", halves.data(), 4 * sizeof(u16) * pixels);
+    Bench_Check(ok, "wrote the image files");
+
+    // Every layer format from every file matches the pattern generated
+    // directly, and RGBA16F comes back bit for bit from a half float file
+    const struct
+    {
+        u32 format;
+        usize bpp;
+    } layers[] = { { dxgi_format_r16g16b16a16_float, 8 }, { dxgi_format_r10g10b10a2_unorm, 4 }, { dxgi_format_b8g8r8a8_unorm, 4 } };
+    std::vector<u8> expect(8 * pixels), got(8 * pixels);
+    for (const char* path : { "bench-image-le.pfm", "bench-image-be.pfm", "bench-image.rgba32f" })
+    {
+        Image_File image;
+        ok = image.Open(path, width, height) && image.Width() == width && image.Height() == height;
+        for (const auto& layer : layers)
+        {
+            if (layer.format == dxgi_format_r16g16b16a16_float)
+                GenerateImage<Pattern_Callback, Transfer_scRGB, Format_RGBA16F>(expect.data(), width, height, pattern);
+            else if (layer.format == dxgi_format_r10g10b10a2_unorm)
+                GenerateImage<Pattern_Callback, Transfer_HDR10, Format_RGB10A2>(expect.data(), width, height, pattern);
+            else
+                GenerateImage<Pattern_Callback, Transfer_sRGB, Format_BGRA8>(expect.data(), width, height, pattern);
+            ok = ok && Image_File_Generate(image, got.data(), 0, width, height, layer.format) && memcmp(expect.data(), got.data(), layer.bpp * pixels) == 0;
+        }
+        Bench_Check(ok, "%s gives the pattern's RGBA16F, HDR10 and sRGB8 pixels", path);
+    }
+    Image_File image;
+    ok = image.Open("bench-image.rgba16f", width, height) && Image_File_Generate(image, got.data(), 0, width, height, dxgi_format_r16g16b16a16_float);
+    ok = ok && memcmp(got.data(), halves.data(), 8 * pixels) == 0;
+    Bench_Check(ok, "bench-image.rgba16f comes back bit for bit as RGBA16F");
+    ok = image.Open("bench-image-gray.pfm") && image.Layout() == Image_File_Layout::Gray32F;
+    std::vector<f32> span(4 * width);
+    for (u32 y = 0; y < height && ok; y++)
+    {
+        image.Read(span.data(), 0, y, width, width, height);
+        for (u32 x = 0; x < width; x++)
+        {
+            const f32* c = &rgba[4 * ((usize)y * width + x)];
+            ok = ok && span[4 * x] == c[1] && span[4 * x + 1] == c[1] && span[4 * x + 2] == c[1] && span[4 * x + 3] == 1.0f;
+        }
+    }
+    Bench_Check(ok, "a grayscale PFM reads as gray RGB");
+
+    // A band at a time into rows with padding is the same as the whole image,
+    // and twice the size each image pixel is doubled
+    ok = image.Open("bench-image.rgba32f", width, height);
+    const usize pitch = 4 * width + 12;
+    std::vector<u8> banded(pitch * height);
+    for (u32 y = 0; y < height; y += 5)
+    {
+        Generate_Rect rect = { 0, y, width, height - y < 5 ? height - y : 5 };
+        ok = ok && Image_File_Generate(image, &banded[y * pitch], pitch, width, height, dxgi_format_r10g10b10a2_unorm, &rect);
+    }
+    Image_File_Generate(image, got.data(), 0, width, height, dxgi_format_r10g10b10a2_unorm);
+    for (u32 y = 0; y < height; y++)
+        ok = ok && memcmp(&banded[y * pitch], &got[4 * (usize)y * width], 4 * width) == 0;
+    std::vector<u32> doubled(4 * pixels);
+    ok = ok && Image_File_Generate(image, doubled.data(), 0, 2 * width, 2 * height, dxgi_format_r10g10b10a2_unorm);
+    const u32* single = (const u32*)got.data();
+    for (u32 y = 0; y < 2 * height; y++)
+        for (u32 x = 0; x < 2 * width; x++)
+            ok = ok && doubled[(usize)y * 2 * width + x] == single[(usize)(y / 2) * width + x / 2];
+    Bench_Check(ok, "Image_File_Generate in bands matches the whole image, and scales by nearest neighbour");
+
+    // Raw files have to be the size given, PFM headers have to be complete
+    std::string header = "PF\n" + size + "\n-1.0\n";
+    ok = Bench_Write_File("bench-image-short.pfm", header, rgbLE.data(), rgbLE.size() - 1);
+    ok = ok && Bench_Write_File("bench-image-header.pfm", "PF\n" + size + "\n", nullptr, 0);
+    ok = ok && Bench_Write_File("bench-image-p6.pfm", "P6\n" + size + "\n255\n", rgbLE.data(), rgbLE.size());
+    ok = ok && Bench_Write_File("bench-image-zero.pfm", "PF\n" + size + "\n0\n", rgbLE.data(), rgbLE.size());
+    ok = ok && !image.Open("bench-image.rgba32f", width + 1, height) && !image.Open("bench-image.rgba16f") && !image.Open("bench-image-le.pfm.txt");
+    for (const char* bad : { "bench-image-short.pfm", "bench-image-header.pfm", "bench-image-p6.pfm", "bench-image-zero.pfm", "bench-image-missing.pfm" })
+        ok = ok && !image.Open(bad) && !image.IsOpen();
+    Bench_Check(ok, "Image_File rejects raw files of the wrong size and truncated or malformed PFM files");
+
+    image.Close();
+    for (const char* path : { "bench-image-le.pfm", "bench-image-be.pfm", "bench-image-gray.pfm", "bench-image.rgba32f", "bench-image.rgba16f", "bench-image-short.pfm",
+             "bench-image-header.pfm", "bench-image-p6.pfm", "bench-image-zero.pfm" })
+        remove(path);
+}
+
+// Converting a half float file into each layer format straight from its
+// mapping, against generating the same pixels from a pattern
+static void Bench_Image_Stream(u32 width, u32 height)
+{
+    const char* names[] = { "Image_File RGBA16F to RGBA16F scRGB", "Image_File RGBA16F to RGB10A2 HDR10", "Image_File RGBA16F to BGRA8 sRGB" };
+    const u32 formats[] = { dxgi_format_r16g16b16a16_float, dxgi_format_r10g10b10a2_unorm, dxgi_format_b8g8r8a8_unorm };
+    const f64 bytes[] = { 16, 12, 12 };
+    bool wanted = !bench_filter;
+    for (const char* name : names)
+        wanted = wanted || strstr(name, bench_filter);
+    if (!wanted)
+        return;
+
+    usize pixels = (usize)width * height;
+    std::vector<u16> halves(4 * pixels);
+    GenerateImage<Pattern_Gradient, Transfer_scRGB, Format_RGBA16F>(halves.data(), width, height, Bench_Pattern_2D());
+    const char* path = "bench-stream.rgba16f";
+    Image_File image;
+    if (!Bench_Write_File(path, "", halves.data(), halves.size() * sizeof(u16)) || !image.Open(path, width, height))
+    {
+        Bench_Check(false, "wrote and mapped %s", path);
+        remove(path);
+        return;
+    }
+    for (u32 i = 0; i < 3; i++)
+        Bench_Time(names[i], width, height, bytes[i], [&]() { Image_File_Generate(image, halves.data(), 0, width, height, formats[i]); });
+    image.Close();
+    remove(path);
+}
+
+// Runs every span kernel on the same inputs and returns each one's output
+// bytes, to compare the instruction sets
+static std::vector<std::vector<u8>> Bench_ISA_Outputs(const std::vector<f32>& rgba, const std::vector<u32>& codes, const std::vector<u16>& halves)
+{
+    usize pixels = codes.size();
+    std::vector<std::vector<u8>> outputs;
+    std::vector<f32> f(4 * pixels);
+    std::vector<u32> u(pixels);
+    std::vector<u16> h(4 * pixels);
+    auto add = [&](const void* data, usize bytes) { outputs.emplace_back((const u8*)data, (const u8*)data + bytes); };
+    // Which NaN comes out of something like inf - inf depends on the operand
+    // order, which is up to the compiler, so they're all made the same
+    auto addf = [&]() {
+        for (f32& x : f)
+            x = std::isnan(x) ? std::numeric_limits<f32>::quiet_NaN() : x;
+        add(f.data(), f.size() * sizeof(f32));
+    };
+    auto addu = [&]() { add(u.data(), u.size() * sizeof(u32)); };
+    auto addh = [&]() { add(h.data(), h.size() * sizeof(u16)); };
+
+    const f32 mat[3][3] = { { 0.6274f, 0.3293f, 0.0433f }, { 0.0691f, 0.9195f, 0.0114f }, { -0.0164f, 0.0880f, 1.8956f } };
+    std::vector<f32> table10(1024), table8(256);
+    for (u32 i = 0; i < 1024; i++)
+        table10[i] = Color_Transfer_From_PQ(i / 1023.0f);
+    for (u32 i = 0; i < 256; i++)
+        table8[i] = Color_Transfer_From_sRGB(i / 255.0f);
+
+    ToF16_Span(rgba.data(), h.data(), 4 * pixels);
+    addh();
+    FromF16_Span(halves.data(), f.data(), 4 * pixels);
+    addf();
+    Color_rgb_through_mat3_Span(rgba.data(), f.data(), pixels, mat);
+    addf();
+    Color_Transfer_To_PQ_Span(rgba.data(), f.data(), pixels);
+    addf();
+    Color_Transfer_From_PQ_Span(rgba.data(), f.data(), pixels);
+    addf();
+    Color_Transfer_From_sRGB_Span(rgba.data(), f.data(), pixels);
+    addf();
+    Color_Encode_BGRA8_sRGB_Span(rgba.data(), u.data(), pixels);
+    addu();
+    Color_Encode_RGBA8_sRGB_Span(rgba.data(), u.data(), pixels);
+    addu();
+    Color_Pack_RGB10A2_Span(rgba.data(), u.data(), pixels);
+    addu();
+    Color_Pack_BGRA8_Span(rgba.data(), u.data(), pixels);
+    addu();
+    Color_Pack_RGBA16_Span(rgba.data(), h.data(), pixels);
+    addh();
+    Color_Pack_R11G11B10F_Span(rgba.data(), u.data(), pixels);
+    addu();
+    Color_Pack_RGB9E5_Span(rgba.data(), u.data(), pixels);
+    addu();
+    Color_Unpack_RGB10A2_Span(codes.data(), f.data(), pixels);
+    addf();
+    Color_Unpack_BGRA8_Span(codes.data(), f.data(), pixels);
+    addf();
+    Color_Unpack_RGBA16_Span(halves.data(), f.data(), pixels);
+    addf();
+    Color_Unpack_R11G11B10F_Span(codes.data(), f.data(), pixels);
+    addf();
+    Color_Unpack_RGB9E5_Span(codes.data(), f.data(), pixels);
+    addf();
+    Color_Decode_RGB10A2_Span(codes.data(), f.data(), pixels, table10.data());
+    addf();
+    Color_Decode_BGRA8_Span(codes.data(), f.data(), pixels, table8.data());
+    addf();
+    Color_Decode_RGBA8_sRGB_Span(codes.data(), f.data(), pixels);
+    addf();
+    for (usize i = 0; i < f.size(); i++)
+        f[i] = rgba[(i * 7 + 5) % rgba.size()];
+    Pixel_Over_Span(rgba.data(), f.data(), pixels);
+    addf();
+    std::vector<f32> lattice(4 * 5 * 5 * 5);
+    for (usize i = 0; i < lattice.size(); i++)
+        lattice[i] = (i & 3) == 3 ? 0.0f : (f32)((u32)(i * 2654435761u) >> 16) / 65536.0f - 0.25f;
+    Color_Lut3D_Span(rgba.data(), f.data(), pixels, lattice.data(), 5);
+    addf();
+    return outputs;
+}
+
+// Every instruction set the CPU has gives the same bits as the scalar kernels
+// (apart from which NaN), on edge cases and random values, with an odd pixel count so the vector
+// bodies' tails run too
+static void Bench_ISA()
+{
+    static const char* const spans[] = { "ToF16_Span", "FromF16_Span", "Color_rgb_through_mat3_Span", "Color_Transfer_To_PQ_Span", "Color_Transfer_From_PQ_Span",
+        "Color_Transfer_From_sRGB_Span", "Color_Encode_BGRA8_sRGB_Span", "Color_Encode_RGBA8_sRGB_Span", "Color_Pack_RGB10A2_Span", "Color_Pack_BGRA8_Span",
+        "Color_Pack_RGBA16_Span", "Color_Pack_R11G11B10F_Span", "Color_Pack_RGB9E5_Span", "Color_Unpack_RGB10A2_Span", "Color_Unpack_BGRA8_Span",
+        "Color_Unpack_RGBA16_Span", "Color_Unpack_R11G11B10F_Span", "Color_Unpack_RGB9E5_Span", "Color_Decode_RGB10A2_Span", "Color_Decode_BGRA8_Span",
+        "Color_Decode_RGBA8_sRGB_Span", "Pixel_Over_Span", "Color_Lut3D_Span" };
+    const f32 inf = std::numeric_limits<f32>::infinity();
+    const f32 nan = std::numeric_limits<f32>::quiet_NaN();
+    const f32 edges[] = { 0.0f, -0.0f, 1.0f, -1.0f, 0.5f, 2.0f, 1e-8f, 6e-5f, 6.1e-5f, 1.0f / 255.0f, 0.5f / 255.0f, 0.5f / 1023.0f, 0.99999f, 1.00001f,
+        0.0031308f, 0.04045f, 65504.0f, 65520.0f, 65536.0f, 125.0f, 1e9f, -1e9f, inf, -inf, nan, Bench_F32(0x7F800001), 1.5e-5f, 100.0f };
+    const u32 count = sizeof(edges) / sizeof(edges[0]);
+    const usize pixels = count * count + 8191;
+    std::vector<f32> rgba(4 * pixels);
+    std::vector<u32> codes(pixels);
+    std::vector<u16> halves(4 * pixels);
+    u64 seed = 0x9E3779B97F4A7C15ull;
+    auto next = [&]() {
+        seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+        return (u32)(seed >> 32);
+    };
+    for (usize i = 0; i < count * count; i++)
+    {
+        rgba[4 * i] = edges[i % count];
+        rgba[4 * i + 1] = edges[i / count];
+        rgba[4 * i + 2] = edges[(i * 7 + 3) % count];
+        rgba[4 * i + 3] = edges[(i * 13 + 5) % count];
+    }
+    // The rest are any bits at all, SDR values and HDR values
+    for (usize i = 4 * count * count; i < 4 * pixels; i++)
+    {
+        u32 r = next();
+        if (r % 4 == 0)
+            rgba[i] = Bench_F32(next());
+        else if (r % 4 == 1)
+            rgba[i] = (f32)(next() / 4294967296.0 * 1.2 - 0.1);
+        else
+            rgba[i] = (f32)(next() / 4294967296.0 * 130.0 - 2.0);
+    }
+    for (usize i = 0; i < 4 * pixels; i++)
+        halves[i] = (u16)next();
+    for (usize i = 0; i < pixels; i++)
+        codes[i] = next();
+
+    Color_ISA chosen = Color_Get_ISA();
+    Color_Set_ISA(Color_ISA::Scalar);
+    std::vector<std::vector<u8>> scalar = Bench_ISA_Outputs(rgba, codes, halves);
+    const Color_ISA all[] = { Color_ISA::SSE2, Color_ISA::SSE41, Color_ISA::AVX2, Color_ISA::AVX512, Color_ISA::NEON };
+    for (Color_ISA isa : all)
+    {
+        if (!Color_Set_ISA(isa))
+            continue;
+        std::vector<std::vector<u8>> outputs = Bench_ISA_Outputs(rgba, codes, halves);
+        std::string differ;
+        for (usize k = 0; k < outputs.size(); k++)
+            differ += outputs[k] == scalar[k] ? "" : std::string(differ.empty() ? " (differs: " : ", ") + spans[k];
+        differ += differ.empty() ? "" : ")";
+        Bench_Check(differ.empty(), "%s span kernels match the scalar ones bit for bit%s", Color_ISA_Name(isa), differ.c_str());
+    }
+    Color_Set_ISA(chosen);
+}
+
+// The hot span kernels on each instruction set the CPU has, to see what each
+// level is worth
+static void Bench_Kernels_ISA(u32 width, u32 height)
+{
+    u64 pixels = (u64)width * height;
+    usize block = (usize)(pixels < bench_block_pixels ? pixels : bench_block_pixels);
+    std::vector<f32> hdr(4 * block), sdr(4 * block), out(4 * block);
+    std::vector<u32> packed(block);
+    for (usize i = 0; i < hdr.size(); i++)
+    {
+        bool alpha = (i & 3) == 3;
+        hdr[i] = alpha ? 1.0f : (f32)(i % 100003) * (126.0f / 100003.0f) - 1.0f;
+        sdr[i] = alpha ? 1.0f : (f32)(i % 100003) * (1.2f / 100003.0f) - 0.1f;
+    }
+    const f32 mat[3][3] = { { 0.6274f, 0.3293f, 0.0433f }, { 0.0691f, 0.9195f, 0.0114f }, { 0.0164f, 0.0880f, 0.8956f } };
+
+    Color_ISA chosen = Color_Get_ISA();
+    const Color_ISA all[] = { Color_ISA::Scalar, Color_ISA::SSE2, Color_ISA::SSE41, Color_ISA::AVX2, Color_ISA::AVX512, Color_ISA::NEON };
+    for (Color_ISA isa : all)
+    {
+        if (!Color_Set_ISA(isa))
+            continue;
+        std::string suffix = std::string(" [") + Color_ISA_Name(isa) + "]";
+        Bench_Time("ToF16_Span" + suffix, width, height, 24, [&]() {
+            Bench_Blocks(pixels, [&](usize n) { ToF16_Span(hdr.data(), (u16*)out.data(), 4 * n); });
+        });
+        Bench_Time("Color_rgb_through_mat3_Span" + suffix, width, height, 32, [&]() {
+            Bench_Blocks(pixels, [&](usize n) { Color_rgb_through_mat3_Span(hdr.data(), out.data(), n, mat); });
+        });
+        Bench_Time("Color_Transfer_To_PQ_Span" + suffix, width, height, 32, [&]() {
+            Bench_Blocks(pixels, [&](usize n) { Color_Transfer_To_PQ_Span(hdr.data(), out.data(), n); });
+        });
+        Bench_Time("Color_Encode_BGRA8_sRGB_Span" + suffix, width, height, 20, [&]() {
+            Bench_Blocks(pixels, [&](usize n) { Color_Encode_BGRA8_sRGB_Span(sdr.data(), packed.data(), n); });
+        });
+        Bench_Time("Color_Pack_RGB10A2_Span" + suffix, width, height, 20, [&]() {
+            Bench_Blocks(pixels, [&](usize n) { Color_Pack_RGB10A2_Span(sdr.data(), packed.data(), n); });
+        });
+        Bench_Time("Color_Pack_R11G11B10F_Span" + suffix, width, height, 20, [&]() {
+            Bench_Blocks(pixels, [&](usize n) { Color_Pack_R11G11B10F_Span(hdr.data(), packed.data(), n); });
+        });
+    }
+    Color_Set_ISA(chosen);
+}
+
+// Generates rect of a width x height image into rows pitch bytes apart, and
+// checks it matches the same pixels of the tightly packed image and that the
+// bytes between and after the rows are untouched
+template <class Pattern, class Transfer, class Format>
+static bool Bench_Strided_Image(const Pattern& pattern, u32 width, u32 height, Generate_Rect rect, usize pitch)
+{
+    constexpr usize bpp = Format::bpp;
+    std::vector<u8> whole(bpp * width * (usize)height);
+    GenerateImage<Pattern, Transfer, Format>(whole.data(), width, height, pattern);
+    std::vector<u8> strided(pitch * (rect.height + 1), 0xcd);
+    GenerateImage_Rect<Pattern, Transfer, Format>(strided.data(), pitch, width, height, rect, pattern);
+    usize bytes = bpp * rect.width;
+    for (usize r = 0; r <= rect.height; r++)
+    {
+        const u8* row = &strided[r * pitch];
+        if (r < rect.height && memcmp(row, &whole[bpp * ((rect.y + r) * width + rect.x)], bytes) != 0)
+            return false;
+        for (usize i = r < rect.height ? bytes : 0; i < pitch; i++)
+            if (row[i] != 0xcd)
+                return false;
+    }
+    return true;
+}
+
+template <class Pattern, class Transfer, class Format>
+static void Bench_Strided_Pattern(const char* name, const Pattern& pattern)
+{
+    // An odd size, rects touching each edge, and pitches that are tight, a
+    // few pixels over and rounded up to 256 bytes like D3D staging textures
+    const u32 width = 301;
+    const u32 height = 67;
+    const Generate_Rect rects[] = {
+        { 0, 0, width, height },
+        { 13, 7, 100, 33 },
+        { 0, height - 1, width, 1 },
+        { width - 1, 0, 1, height },
+    };
+    bool ok = true;
+    for (const Generate_Rect& rect : rects)
+    {
+        usize tight = Format::bpp * rect.width;
+        const usize pitches[] = { tight, tight + 4, tight + 60, (tight + 255) & ~(usize)255 };
+        for (usize pitch : pitches)
+            ok = ok && Bench_Strided_Image<Pattern, Transfer, Format>(pattern, width, height, rect, pitch);
+    }
+    Bench_Check(ok, "GenerateImage_Rect %s matches GenerateImage with padded pitches and sub-rects", name);
+}
+
+// Generating into caller owned strided memory, as the compositor does into
+// mapped textures
+static void Bench_Strided()
+{
+    const Pattern_Checkerboard checkers = { { 2.0f, 2.0f, 2.0f, 1.0f }, { 0.0f, 0.0f, 0.0f, 1.0f }, 16 };
+    Bench_Strided_Pattern<Pattern_Gradient, Transfer_scRGB, Format_RGBA16F>("scRGB RGBA16F Row_Invariant", pattern_testcolors);
+    Bench_Strided_Pattern<Pattern_Gradient, Transfer_HDR10, Format_RGB10A2>("HDR10 RGB10A2 Column_Invariant", pattern_testcolors_vertical);
+    Bench_Strided_Pattern<Pattern_Gradient, Transfer_sRGB, Format_BGRA8>("sRGB BGRA8 Full_2D", Bench_Pattern_2D());
+    Bench_Strided_Pattern<Pattern_Checkerboard, Transfer_HDR10, Format_RGB10A2>("HDR10 RGB10A2 checkerboard", checkers);
+}
+
+// Runs GenerateImage_Multi_Rect for every subset of outputs, rects and padded
+// pitches, and checks each output against GenerateImage_Rect on its own and
+// that padding and skipped outputs are left alone
+template <class Pattern>
+static void Bench_Multi_Pattern(const char* name, const Pattern& pattern)
+{
+    // Wider than two tiles, with a partial one at the end
+    const u32 width = 2 * generate_tile_pixels + 89;
+    const u32 height = 37;
+    const Generate_Rect rects[] = {
+        { 0, 0, width, height },
+        { 13, 7, generate_tile_pixels + 1, 20 },
+        { width - 1, 0, 1, height },
+    };
+    const usize bpps[] = { Format_RGBA16F::bpp, Format_RGB10A2::bpp, Format_BGRA8::bpp };
+    bool ok = true;
+    for (const Generate_Rect& rect : rects)
+    {
+        usize pitches[3];
+        std::vector<u8> expected[3];
+        for (usize i = 0; i < 3; i++)
+        {
+            pitches[i] = bpps[i] * rect.width + 12;
+            expected[i].assign(pitches[i] * rect.height, 0xcd);
+        }
+        GenerateImage_Rect<Pattern, Transfer_scRGB, Format_RGBA16F>(expected[0].data(), pitches[0], width, height, rect, pattern);
+        GenerateImage_Rect<Pattern, Transfer_HDR10, Format_RGB10A2>(expected[1].data(), pitches[1], width, height, rect, pattern);
+        GenerateImage_Rect<Pattern, Transfer_sRGB, Format_BGRA8>(expected[2].data(), pitches[2], width, height, rect, pattern);
+        for (u32 subset = 1; subset < 8; subset++)
+        {
+            std::vector<u8> images[3];
+            Generate_Output* outputs[3];
+            Generate_Outputs multi;
+            outputs[0] = &multi.scRGB;
+            outputs[1] = &multi.hdr10;
+            outputs[2] = &multi.sRGB;
+            for (usize i = 0; i < 3; i++)
+            {
+                images[i].assign(pitches[i] * rect.height, 0xcd);
+                if (subset & (1u << i))
+                {
+                    outputs[i]->pixels = images[i].data();
+                    outputs[i]->pitch = pitches[i];
+                }
+            }
+            GenerateImage_Multi_Rect(multi, width, height, rect, pattern);
+            for (usize i = 0; i < 3; i++)
+            {
+                if (subset & (1u << i))
+                    ok = ok && images[i] == expected[i];
+                else
+                    ok = ok && std::vector<u8>(images[i].size(), 0xcd) == images[i];
+            }
+        }
+    }
+    Bench_Check(ok, "GenerateImage_Multi_Rect %s matches GenerateImage_Rect for every subset of outputs", name);
+}
+
+// Generating every encoding of the scene in one pass
+static void Bench_Multi()
+{
+    const Pattern_Checkerboard checkers = { { 2.0f, 2.0f, 2.0f, 1.0f }, { 0.0f, 0.0f, 0.0f, 1.0f }, 16 };
+    Bench_Multi_Pattern("Row_Invariant", pattern_testcolors);
+    Bench_Multi_Pattern("Column_Invariant", pattern_testcolors_vertical);
+    Bench_Multi_Pattern("Full_2D", Bench_Pattern_2D());
+    Bench_Multi_Pattern("checkerboard", checkers);
+
+    // Tight pitches and the whole image by default
+    const u32 width = 301;
+    const u32 height = 67;
+    std::vector<u16> scrgb(4 * width * height), scrgbRef(scrgb.size());
+    std::vector<u32> srgb(width * height), srgbRef(srgb.size());
+    Generate_Outputs outputs;
+    outputs.scRGB.pixels = scrgb.data();
+    outputs.sRGB.pixels = srgb.data();
+    GenerateImage_TestColors(outputs, width, height);
+    GenerateImage_RGBA16F_scRGB(scrgbRef.data(), width, height);
+    GenerateImage_BGRA8_sRGB(srgbRef.data(), width, height);
+    Bench_Check(scrgb == scrgbRef && srgb == srgbRef, "GenerateImage_TestColors scRGB and sRGB match their own generators");
+}
+
+// The smallest patterns the constructors take: a two stop gradient runs from
+// the first stop to the second, and a checkerboard of size 0 is one of size 1
+static void Bench_Pattern_Bounds()
+{
+    const f32 table[] = { 0.0f, 1.0f, 0.25f, 0.5f, 2.0f, 4.0f, 1.0f, 1.0f };
+    const Pattern_Gradient two(table, 2, false);
+    f32 rgba[4 * 5];
+    two.Span(rgba, 0, 0, 5, 5, 1);
+    bool ok = true;
+    for (u32 c = 0; c < 4; c++)
+        ok = ok && rgba[c] == table[2 * c] && rgba[16 + c] == table[2 * c + 1] && rgba[8 + c] == 0.5f * (table[2 * c] + table[2 * c + 1]);
+    Bench_Check(ok, "Pattern_Gradient with 2 stops goes from one to the other");
+
+    const Pattern_Bars bar(table, 1);
+    bar.Span(rgba, 0, 0, 5, 5, 1);
+    ok = true;
+    for (u32 i = 0; i < 5; i++)
+        for (u32 c = 0; c < 4; c++)
+            ok = ok && rgba[4 * i + c] == table[c];
+    Bench_Check(ok, "Pattern_Bars with 1 bar fills the whole width");
+
+    const Pattern_Checkerboard zero = { { 1.0f, 1.0f, 1.0f, 1.0f }, { 0.0f, 0.0f, 0.0f, 1.0f }, 0 };
+    const Pattern_Checkerboard one = { { 1.0f, 1.0f, 1.0f, 1.0f }, { 0.0f, 0.0f, 0.0f, 1.0f }, 1 };
+    std::vector<u16> a(4 * 16 * 4), b(a.size());
+    GenerateImage<Pattern_Checkerboard, Transfer_scRGB, Format_RGBA16F>(a.data(), 16, 4, zero);
+    GenerateImage<Pattern_Checkerboard, Transfer_scRGB, Format_RGBA16F>(b.data(), 16, 4, one);
+    Bench_Check(zero.size == 1 && a == b, "Pattern_Checkerboard of size 0 is size 1");
+}
+
+// Image sizing, chunked generation and coordinates near the largest extent,
+// without allocating a whole 32K x 32K image
+static void Bench_Large()
+{
+    usize bytes = 0;
+    bool ok = Generate_Size(generate_max_extent, generate_max_extent, 8, &bytes);
+    Bench_Check(sizeof(usize) < 8 ? !ok : ok && bytes == (usize)8 << 30, "Generate_Size takes 32K x 32K RGBA16F only where it fits in a usize");
+    Bench_Check(!Generate_Size(generate_max_extent + 1, 1, 4, &bytes) && !Generate_Size(1, 0, 4, &bytes) && Generate_Size(1, 1, 4, &bytes) && bytes == 4, "Generate_Size rejects empty and oversized extents");
+
+    // Chunks of a few rows, top down and bottom up, put back together
+    const u32 width = 301;
+    const u32 height = 67;
+    const Pattern_Gradient pattern = Bench_Pattern_2D();
+    std::vector<u32> whole((usize)width * height);
+    GenerateImage<Pattern_Gradient, Transfer_HDR10, Format_RGB10A2>(whole.data(), width, height, pattern);
+    for (u32 bottomUp = 0; bottomUp < 2; bottomUp++)
+    {
+        std::vector<u32> chunked(whole.size());
+        u32 chunks = 0;
+        u32 next = bottomUp ? height : 0;
+        bool ordered = true;
+        ok = GenerateImage_Chunked<Pattern_Gradient, Transfer_HDR10, Format_RGB10A2>(width, height, pattern, 5 * 4 * width + 7, bottomUp != 0, [&](const void* rows, u32 y0, u32 count, usize pitch) {
+            ordered = ordered && count <= 5 && (bottomUp ? y0 + count == next : y0 == next);
+            next = bottomUp ? y0 : y0 + count;
+            memcpy(&chunked[(usize)y0 * width], rows, count * pitch);
+            chunks++;
+            return true;
+        });
+        Bench_Check(ok && ordered && chunks == (height + 4) / 5 && chunked == whole, "GenerateImage_Chunked %s in 5 row chunks matches GenerateImage", bottomUp ? "bottom up" : "top down");
+    }
+
+    // The far corner of the largest image, checkerboard squares are known
+    const Pattern_Checkerboard checkers = { { 2.0f, 2.0f, 2.0f, 1.0f }, { 0.0f, 0.0f, 0.0f, 1.0f }, 3 };
+    const Generate_Rect corner = { generate_max_extent - 8, generate_max_extent - 4, 8, 4 };
+    u16 rgba[4 * 8 * 4];
+    GenerateImage_Rect<Pattern_Checkerboard, Transfer_scRGB, Format_RGBA16F>(rgba, 8 * 8, generate_max_extent, generate_max_extent, corner, checkers);
+    ok = true;
+    for (u32 y = 0; y < corner.height; y++)
+        for (u32 x = 0; x < corner.width; x++)
+        {
+            bool b = ((corner.x + x) / 3 + (corner.y + y) / 3) & 1;
+            ok = ok && rgba[4 * (8 * y + x)] == (b ? 0x0000 : 0x4000);
+        }
+    Bench_Check(ok, "GenerateImage_Rect at the far corner of a %ux%u image", generate_max_extent, generate_max_extent);
+}
+
+// Scene_Apply backend that records what it was asked to do
+struct Bench_Scene_Backend
+{
+    struct Layer
+    {
+        u32 id = ~0u;
+        bool live = false;
+    };
+    std::string log;
+    u32 commits = 0;
+
+    void Record(const char* what, u32 id)
+    {
+        log += (log.empty() ? "" : " ") + std::string(what) + std::to_string(id);
+    }
+    void Add(Layer& layer, const Scene_Layer& s, Layer* below)
+    {
+        // below has to be there already, layers are added bottom up
+        Record(below && !below->live ? "add-over-dead" : "add", s.id);
+        layer.id = s.id;
+        layer.live = true;
+    }
+    void Remove(Layer& layer, const Scene_Layer& old)
+    {
+        Record(layer.live && layer.id == old.id ? "remove" : "remove-wrong", old.id);
+        layer.live = false;
+    }
+    void Move(Layer& layer, const Scene_Layer& s) { Record(layer.id == s.id ? "move" : "move-wrong", s.id); }
+    void Content(Layer& layer, const Scene_Layer& old, const Scene_Layer& s) { Record(layer.id == s.id && old.id == s.id ? "content" : "content-wrong", s.id); }
+    void Commit() { commits++; }
+};
+
+// Runs one scene change through Scene_Apply and checks the backend was asked
+// for exactly the expected work, and that its layers match the new scene
+static void Bench_Scene_Step(const char* name, Bench_Scene_Backend& backend, std::vector<Scene_Layer>& current, std::vector<Bench_Scene_Backend::Layer>& layers, const std::vector<Scene_Layer>& desired, const char* expected)
+{
+    backend.log.clear();
+    u32 commits = backend.commits;
+    usize changes = Scene_Apply(backend, current, layers, desired.data(), desired.size());
+    bool ok = backend.log == expected && backend.commits == commits + (changes ? 1 : 0) && layers.size() == desired.size();
+    for (usize i = 0; i < layers.size() && ok; i++)
+        ok = layers[i].live && layers[i].id == desired[i].id;
+    Bench_Check(ok, "Scene_Apply %s: %s", name, backend.log.empty() ? "no changes" : backend.log.c_str());
+}
+
+// Scene diffing against a mock backend, tweaking a layer should only touch
+// that layer
+static void Bench_Scene()
+{
+    Bench_Scene_Backend backend;
+    std::vector<Scene_Layer> current;
+    std::vector<Bench_Scene_Backend::Layer> layers;
+    std::vector<Scene_Layer> desired;
+    Scene_TestColors(desired, 1.0f);
+    Bench_Scene_Step("new scene", backend, current, layers, desired, "add0 add1 add2 add3 add4 add5");
+    Bench_Scene_Step("same scene", backend, current, layers, desired, "");
+    desired[4].x += 10.0f;
+    Bench_Scene_Step("one layer moved", backend, current, layers, desired, "move4");
+    desired[2].pattern = 2;
+    Bench_Scene_Step("one layer's pattern changed", backend, current, layers, desired, "content2");
+    desired[1].width += 1;
+    desired[1].y += 1.0f;
+    Bench_Scene_Step("one layer moved and resized", backend, current, layers, desired, "move1 content1");
+    desired.erase(desired.begin() + 3);
+    Bench_Scene_Step("one layer removed", backend, current, layers, desired, "remove3");
+    std::swap(desired[0], desired[1]);
+    Bench_Scene_Step("two layers swapped in z order", backend, current, layers, desired, "remove0 add0");
+    desired[2].isSurface = !desired[2].isSurface;
+    Bench_Scene_Step("swapchain layer changed to a surface", backend, current, layers, desired, "remove2 add2");
+    desired.clear();
+    Scene_TestColors(desired, 1.5f);
+    Bench_Scene_Step("DPI change", backend, current, layers, desired, "remove1 remove2 move0 content0 add1 add2 add3 move4 content4 move5 content5");
+}
+
+// Scene_Apply_Async backend standing in for a device, which takes as long as
+// a real one would to make layers and generate their images and records when
+// each thing happened
+struct Bench_Scene_Async_Backend
+{
+    typedef Bench_Scene_Backend::Layer Layer;
+    typedef const Scene_Layer* Pixels;
+    struct Event
+    {
+        char what;
+        u32 id;
+    };
+    std::mutex mutex;
+    std::vector<Event> events;
+    std::atomic<u32> generates{ 0 };
+    u32 generateMs = 40;
+
+    void Record(char what, u32 id)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        events.push_back({ what, id });
+    }
+    // Finished generating, the pixels are the layer they were made for
+    Pixels Generate(const Scene_Layer& s)
+    {
+        u32 n = generates++;
+        std::this_thread::sleep_for(std::chrono::milliseconds(generateMs + 10 * (n % 3)));
+        Record('g', s.id);
+        return &s;
+    }
+    void Present(Layer& layer, const Scene_Layer& s, const Pixels& pixels)
+    {
+        Record(layer.live && layer.id == s.id && pixels && Scene_Same_Content(*pixels, s) ? 'p' : 'x', s.id);
+    }
+    void Add(Layer& layer, const Scene_Layer& s, Layer*)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        Record('a', s.id);
+        layer.id = s.id;
+        layer.live = true;
+    }
+    void Remove(Layer& layer, const Scene_Layer& old)
+    {
+        Record('r', old.id);
+        layer.live = false;
+    }
+    void Move(Layer&, const Scene_Layer& s) { Record('m', s.id); }
+    void Content(Layer&, const Scene_Layer&, const Scene_Layer& s) { Record('c', s.id); }
+    void Commit() { Record('C', 0); }
+};
+
+// Checks the events of one Scene_Apply_Async: setup ('s') before any layer is
+// made, each layer presented once after it was made and its image generated,
+// and a single commit last
+static bool Bench_Scene_Async_Order(const std::vector<Bench_Scene_Async_Backend::Event>& events, const std::vector<Scene_Layer>& desired)
+{
+    if (events.empty() || events.back().what != 'C')
+        return false;
+    usize setup = events.size();
+    for (usize e = 0; e < events.size() && setup == events.size(); e++)
+        if (events[e].what == 's')
+            setup = e;
+    for (usize i = 0; i < desired.size(); i++)
+    {
+        usize made = events.size();
+        usize generated = events.size();
+        usize presented = events.size();
+        u32 presents = 0;
+        for (usize e = 0; e < events.size(); e++)
+        {
+            const Bench_Scene_Async_Backend::Event& ev = events[e];
+            if (ev.what == 'x' || (ev.what == 'C' && e + 1 != events.size()))
+                return false;
+            if ((ev.what == 'a' || ev.what == 'c') && ev.id == desired[i].id)
+                made = e;
+            // Whichever layer an image was generated for, it's this one's if
+            // the content is the same
+            if (ev.what == 'g' && generated == events.size())
+                for (const Scene_Layer& s : desired)
+                    if (s.id == ev.id && Scene_Same_Content(s, desired[i]))
+                        generated = e;
+            if (ev.what == 'p' && ev.id == desired[i].id)
+            {
+                presented = e;
+                presents++;
+            }
+        }
+        if (presents != 1 || setup > made || made > presented || generated > presented)
+            return false;
+    }
+    return true;
+}
+
+// Scene preparation against a mock device: images generated on the pool while
+// the device is made, each layer presented as soon as its image is ready, and
+// the first frame taking about as long as the slowest part rather than all of
+// them added up
+static void Bench_Scene_Async()
+{
+    u32 threads = Parallel_Threads();
+    std::vector<Scene_Layer> desired;
+    Scene_TestColors(desired, 1.0f);
+    usize images = 0;
+    for (usize i = 0; i < desired.size(); i++)
+    {
+        bool first = true;
+        for (usize j = 0; j < i; j++)
+            first = first && !Scene_Same_Content(desired[j], desired[i]);
+        images += first ? 1 : 0;
+    }
+    const u32 setupMs = 60;
+
+    // Parallel_Start on its own, with and without pool threads
+    for (u32 n : { 1u, 4u })
+    {
+        Parallel_SetThreads(n);
+        std::atomic<u32> ran{ 0 };
+        std::vector<Parallel_Task> tasks;
+        for (u32 i = 0; i < 8; i++)
+            tasks.push_back(Parallel_Start([&ran, i]() {
+                std::this_thread::sleep_for(std::chrono::milliseconds(i % 2));
+                ran += 1u << i;
+            }));
+        Parallel_Wait(tasks[5]);
+        bool ok = (ran.load() & (1u << 5)) != 0;
+        bool taken[8] = {};
+        taken[5] = true;
+        u32 order = 0;
+        for (usize t; (t = Parallel_Wait_Any(tasks.data(), tasks.size(), taken)) != tasks.size(); order++)
+            ok = ok && (ran.load() & (1u << t)) != 0;
+        Bench_Check(ok && order == 7 && ran.load() == 0xff, "Parallel_Start with %u threads runs every task once, Parallel_Wait_Any returns each", n);
+    }
+
+    for (u32 n : { 1u, 4u })
+    {
+        Parallel_SetThreads(n);
+        Bench_Scene_Async_Backend backend;
+        std::vector<Scene_Layer> current;
+        std::vector<Bench_Scene_Async_Backend::Layer> layers;
+        auto start = std::chrono::steady_clock::now();
+        usize changes = Scene_Apply_Async(backend, current, layers, desired.data(), desired.size(), [&]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(setupMs));
+            backend.Record('s', 0);
+            return true;
+        });
+        f64 ms = std::chrono::duration<f64, std::milli>(std::chrono::steady_clock::now() - start).count();
+        bool ok = changes == desired.size() && current.size() == desired.size() && layers.size() == desired.size() && Bench_Scene_Async_Order(backend.events, desired);
+        Bench_Check(ok, "Scene_Apply_Async with %u threads presents each of %u layers once, after setup, its Add and its image", n, (u32)desired.size());
+        Bench_Check(backend.generates.load() == images, "Scene_Apply_Async with %u threads generates %u images for %u layers, each once", n, backend.generates.load(), (u32)desired.size());
+        if (n > 1)
+        {
+            // Setup, the layers and the images one after another
+            f64 serial = setupMs + 5.0 * desired.size();
+            for (u32 i = 0; i < images; i++)
+                serial += backend.generateMs + 10 * (i % 3);
+            Bench_Check(ms < 0.6 * serial, "Scene_Apply_Async with %u threads takes %.0f ms, well under the %.0f ms of doing it serially", n, ms, serial);
+        }
+
+        // Only the layer that changed is regenerated
+        std::vector<Scene_Layer> changed = desired;
+        changed[2].pattern = 2;
+        backend.events.clear();
+        backend.generates = 0;
+        changes = Scene_Apply_Async(backend, current, layers, changed.data(), changed.size(), [&]() {
+            backend.Record('s', 0);
+            return true;
+        });
+        ok = changes == 1 && backend.generates.load() == 1 && backend.events.size() == 5 && backend.events[1].what == 'c' && backend.events[2].what == 'g' && backend.events[3].what == 'p' && backend.events[3].id == changed[2].id;
+        Bench_Check(ok, "Scene_Apply_Async with %u threads regenerates and presents only a changed layer", n);
+
+        // A device that couldn't be made leaves the scene as it was, and
+        // the images started for it are finished before it returns
+        backend.events.clear();
+        backend.generates = 0;
+        current.clear();
+        layers.clear();
+        changes = Scene_Apply_Async(backend, current, layers, desired.data(), desired.size(), [&]() { return false; });
+        ok = changes == 0 && current.empty() && layers.empty() && backend.generates.load() == images && backend.events.size() == images;
+        for (const Bench_Scene_Async_Backend::Event& ev : backend.events)
+            ok = ok && ev.what == 'g';
+        Bench_Check(ok, "Scene_Apply_Async with %u threads does nothing when setup fails", n);
+    }
+    Parallel_SetThreads(threads);
+}
+
+// Runs the frame scheduler against a fake clock and fake input, checking it
+// only updates for dirty messages and deadlines and reports the right stats
+static void Bench_Frame_Scheduler()
+{
+    const u64 ms = 1000000;
+    struct Message
+    {
+        u64 time;
+        bool dirty;
+        bool quit;
+    };
+    const Message messages[] = {
+        { 30 * ms, true, false },
+        { 50 * ms, false, false },
+        { 250 * ms, true, false },
+        { 400 * ms, false, true },
+    };
+    usize next = 0;
+    u64 now = 0;
+    bool waitedForever = false;
+    Frame_Clock clock = [&]() { return now; };
+    Frame_Wait wait = [&](u64 timeout) {
+        if (next < 4 && (timeout == frame_forever || messages[next].time - now <= timeout))
+        {
+            now = messages[next].time > now ? messages[next].time : now;
+            return true;
+        }
+        waitedForever = waitedForever || timeout == frame_forever;
+        now += timeout == frame_forever ? 0 : timeout;
+        return false;
+    };
+    Frame_Scheduler scheduler(clock, wait);
+    auto pump = [&]() {
+        for (; next < 4 && messages[next].time <= now; next++)
+        {
+            if (messages[next].quit)
+                return false;
+            if (messages[next].dirty)
+                scheduler.MarkDirty();
+        }
+        return true;
+    };
+    std::vector<u64> updates;
+    auto update = [&]() {
+        now += 2 * ms;
+        updates.push_back(now / ms);
+    };
+
+    // Updates end at 32 (dirty), 134 and 236 (deadlines), 252 (dirty) and 354
+    // (deadline), the message at 50 changes nothing
+    scheduler.SetInterval(100 * ms);
+    u32 steps = 0;
+    while (scheduler.Step(pump, update) && steps < 100)
+        steps++;
+    Frame_Stats stats = scheduler.Stats();
+    const std::vector<u64> expected = { 32, 134, 236, 252, 354 };
+    Bench_Check(updates == expected && !waitedForever, "Frame_Scheduler updates for dirty messages and deadlines only, %zu updates", updates.size());
+    Bench_Check(stats.updates == 5 && stats.wakeups == 7 && stats.idleWakeups == 1, "Frame_Scheduler counts %llu updates, %llu wakeups, %llu idle",
+        (unsigned long long)stats.updates, (unsigned long long)stats.wakeups, (unsigned long long)stats.idleWakeups);
+    Bench_Check(stats.durationMean == 2.0 && stats.latencyMedian == 2.0 && stats.latencyMax == 2.0, "Frame_Scheduler update %.2f ms, latency %.2f ms median %.2f ms max",
+        stats.durationMean, stats.latencyMedian, stats.latencyMax);
+
+    // Dirty before the step updates without waiting, and with no interval an
+    // idle scheduler waits forever
+    Frame_Scheduler idle(clock, wait);
+    next = 3;
+    now = 0;
+    updates.clear();
+    idle.MarkDirty();
+    idle.Step(pump, update);
+    bool quit = !idle.Step(pump, update);
+    Bench_Check(updates.size() == 1 && idle.Stats().wakeups == 1 && quit, "Frame_Scheduler without an interval only wakes for input");
+}
+
+static Image_Key Bench_Image_Key(u32 pattern)
+{
+    Image_Key key;
+    key.pattern = pattern;
+    key.width = 10;
+    key.height = 10;
+    return key;
+}
+
+// The image cache without a device: sizes are in bytes, so a budget of 300
+// holds three images of 100
+static void Bench_Image_Cache()
+{
+    Image_Cache cache(300);
+    u32 generated = 0;
+    auto generate = [&](void* pixels) {
+        memset(pixels, (int)generated, 100);
+        generated++;
+    };
+    auto a = cache.Get(Bench_Image_Key(1), 100, generate);
+    auto again = cache.Get(Bench_Image_Key(1), 100, generate);
+    bool found = cache.Find(Bench_Image_Key(1)) == a && !cache.Find(Bench_Image_Key(2));
+    Bench_Check(a == again && generated == 1 && cache.Hits() == 1 && cache.Misses() == 1 && found, "Image_Cache counts a miss, then a hit, and Find counts neither");
+
+    // Touching 1 leaves 2 the least recently used
+    cache.Get(Bench_Image_Key(2), 100, generate);
+    cache.Get(Bench_Image_Key(3), 100, generate);
+    cache.Get(Bench_Image_Key(1), 100, generate);
+    cache.Get(Bench_Image_Key(4), 100, generate);
+    bool ok = !cache.Find(Bench_Image_Key(2)) && cache.Find(Bench_Image_Key(1)) && cache.Find(Bench_Image_Key(3)) && cache.Find(Bench_Image_Key(4));
+    Bench_Check(ok && cache.Evictions() == 1 && cache.Bytes() == 300, "Image_Cache evicts the least recently used image to stay in its budget");
+
+    auto big = cache.Get(Bench_Image_Key(5), 400, [&](void* pixels) { memset(pixels, 5, 400); });
+    ok = big && big->size() == 400 && big->data()[399] == 5 && !cache.Find(Bench_Image_Key(5));
+    Bench_Check(ok && cache.Evictions() == 1 && cache.Bytes() == 300, "Image_Cache returns an image bigger than its budget without caching it or evicting");
+
+    // Most recently used first: 4, 1, 3
+    cache.SetBudget(150);
+    ok = cache.Find(Bench_Image_Key(4)) && !cache.Find(Bench_Image_Key(1)) && !cache.Find(Bench_Image_Key(3));
+    Bench_Check(ok && cache.Evictions() == 3 && cache.Bytes() == 100, "Image_Cache::SetBudget evicts the least recently used images down to the new budget");
+
+    // Another thread putting the same key while this one generates, the first
+    // one in wins and is only counted once
+    auto first = std::make_shared<Image_Pixels>(100);
+    auto raced = cache.Get(Bench_Image_Key(6), 100, [&](void*) { cache.Put(Bench_Image_Key(6), first); });
+    auto second = cache.Put(Bench_Image_Key(6), std::make_shared<Image_Pixels>(100));
+    ok = raced == first && second == first && cache.Find(Bench_Image_Key(6)) == first;
+    Bench_Check(ok && cache.Bytes() == 100, "Image_Cache keeps the first image inserted for a key and hands it to later inserts");
+
+    cache.Clear();
+    Bench_Check(cache.Bytes() == 0 && !cache.Find(Bench_Image_Key(6)) && first.use_count() == 3, "Image_Cache::Clear drops every image, handed out ones stay valid");
+}
+
+static void Bench_Arena()
+{
+    Arena arena(64 * 1024);
+    bool aligned = true;
+    u8* bytes = (u8*)arena.Allocate(1, 1);
+    for (usize align = 1; align <= 4096; align *= 2)
+        aligned = aligned && (usize)arena.Allocate(3, align) % align == 0;
+    f64* doubles = arena.Allocate<f64>(3);
+    aligned = aligned && bytes && (usize)doubles % 64 == 0;
+    Bench_Check(aligned, "Arena aligns every allocation to what was asked, 64 bytes by default");
+
+    usize used = arena.Bytes();
+    Bench_Check(used >= 1 + 12 * 3 + 3 * sizeof(f64) && used < 3 * 4096 && arena.PeakBytes() == used, "Arena::Bytes counts the allocations and their padding");
+
+    // A generation that spills over three chunks is merged into one on Reset,
+    // after which rebuilding the same generation takes no memory from the OS
+    arena.Reset();
+    std::vector<void*> blocks;
+    for (u32 i = 0; i < 3; i++)
+        blocks.push_back(arena.Allocate(200 * 1024));
+    usize spilled = arena.Bytes();
+    arena.Reset();
+    usize reserved = arena.ReservedBytes();
+    for (u32 i = 0; i < 3; i++)
+        blocks[i] = arena.Allocate(200 * 1024);
+    bool same = arena.ReservedBytes() == reserved && (u8*)blocks[2] - (u8*)blocks[0] == 2 * 200 * 1024;
+    Bench_Check(same && arena.Bytes() == 3 * 200 * 1024 && arena.PeakBytes() == spilled, "Arena::Reset merges chunks so the next generation fits in one, and PeakBytes keeps the most used");
+
+    // Resetting and rebuilding the same generation only rewinds and bumps,
+    // however much the arena holds
+    bool rewound = true;
+    auto begin = std::chrono::steady_clock::now();
+    for (u32 i = 0; i < 100000; i++)
+    {
+        arena.Reset();
+        rewound = rewound && arena.Allocate(200 * 1024) == blocks[0];
+        arena.Allocate(200 * 1024);
+        arena.Allocate(200 * 1024);
+    }
+    f64 ns = std::chrono::duration<f64, std::nano>(std::chrono::steady_clock::now() - begin).count() / 100000;
+    Bench_Check(rewound && arena.ReservedBytes() == reserved, "Arena::Reset rewinds to the start of its chunk, %.1f ns for a reset and 3 allocations", ns);
+
+    // A much smaller generation gives the merged chunk back
+    arena.Reset();
+    arena.Allocate(64);
+    arena.Reset();
+    Bench_Check(arena.ReservedBytes() == 64 * 1024 && arena.Bytes() == 0, "Arena::Reset after a small generation shrinks back to one chunk");
+}
+
+static bool Bench_Write_JSON(const char* path)
+{
+    FILE* file = fopen(path, "w");
+    if (!file)
+        return false;
+    // One result per line, which is what Bench_Read_JSON expects
+    fprintf(file, "{\n  \"threads\": %u,\n  \"results\": [\n", Parallel_Threads());
+    for (usize i = 0; i < bench_results.size(); i++)
+    {
+        const Bench_Result& r = bench_results[i];
+        fprintf(file, "    { \"name\": \"%s\", \"width\": %u, \"height\": %u, \"ns_per_pixel\": %.6g, \"mpix_per_s\": %.6g, \"gb_per_s\": %.6g }%s\n",
+            r.name.c_str(), r.width, r.height, r.nsPerPixel, r.mpixPerSecond, r.gbPerSecond, i + 1 < bench_results.size() ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    return fclose(file) == 0;
+}
+
+// Reads back a file written by Bench_Write_JSON, this is not a general JSON
+// parser
+static bool Bench_Read_JSON(const char* path, std::vector<Bench_Result>& results)
+{
+    FILE* file = fopen(path, "r");
+    if (!file)
+        return false;
+    char line[1024];
+    while (fgets(line, sizeof(line), file))
+    {
+        char name[256];
+        Bench_Result r = {};
+        if (sscanf(line, " { \"name\": \"%255[^\"]\", \"width\": %u, \"height\": %u, \"ns_per_pixel\": %lf, \"mpix_per_s\": %lf, \"gb_per_s\": %lf",
+                name, &r.width, &r.height, &r.nsPerPixel, &r.mpixPerSecond, &r.gbPerSecond) == 6)
+        {
+            r.name = name;
+            results.push_back(r);
+        }
+    }
+    fclose(file);
+    return true;
+}
+
+// Returns how many results are slower than the baseline by more than threshold
+// (0.1 = 10%)
+static u32 Bench_Compare(const std::vector<Bench_Result>& baseline, f64 threshold)
+{
+    u32 regressions = 0;
+    u32 improvements = 0;
+    u32 compared = 0;
+    printf("Compared with the baseline, threshold %.0f%%\n", threshold * 100.0);
+    for (const Bench_Result& r : bench_results)
+    {
+        for (const Bench_Result& b : baseline)
+        {
+            if (b.name != r.name || b.width != r.width || b.height != r.height)
+                continue;
+            compared++;
+            f64 ratio = r.nsPerPixel / b.nsPerPixel;
+            bool slower = ratio > 1.0 + threshold;
+            bool faster = ratio < 1.0 - threshold;
+            if (slower || faster)
+                printf("  %-48s %5ux%-5u %9.3f -> %9.3f ns/px %+7.1f%% %s\n", r.name.c_str(), r.width, r.height, b.nsPerPixel, r.nsPerPixel, (ratio - 1.0) * 100.0, slower ? "REGRESSION" : "faster");
+            regressions += slower ? 1 : 0;
+            improvements += faster ? 1 : 0;
+            break;
+        }
+    }
+    printf("  %u results compared, %u regressions, %u faster\n", compared, regressions, improvements);
+    return regressions;
+}
+
+static void Bench_Usage()
+{
+    printf("usage: bench [-sizes WxH,...] [-filter name] [-threads n] [-json out.json]\n"
+           "             [-baseline baseline.json] [-threshold 0.1] [-isa name] [-no-checks]\n"
+           "sizes default to 256x64,1920x1080,3840x2160,16384x16384, isa is one of\n"
+           "scalar, sse2, sse4.1, avx2, avx512 or neon and defaults to the best one\n");
+}
+
+int main(int argc, char** argv)
+{
+    const char* sizes = "256x64,1920x1080,3840x2160,16384x16384";
+    const char* jsonPath = nullptr;
+    const char* baselinePath = nullptr;
+    f64 threshold = 0.1;
+    bool checks = true;
+    for (int i = 1; i < argc; i++)
+    {
+        if (i + 1 < argc && strcmp(argv[i], "-sizes") == 0)
+            sizes = argv[++i];
+        else if (i + 1 < argc && strcmp(argv[i], "-filter") == 0)
+            bench_filter = argv[++i];
+        else if (i + 1 < argc && strcmp(argv[i], "-threads") == 0)
+            Parallel_SetThreads((u32)atoi(argv[++i]));
+        else if (i + 1 < argc && strcmp(argv[i], "-json") == 0)
+            jsonPath = argv[++i];
+        else if (i + 1 < argc && strcmp(argv[i], "-baseline") == 0)
+            baselinePath = argv[++i];
+        else if (i + 1 < argc && strcmp(argv[i], "-threshold") == 0)
+            threshold = atof(argv[++i]);
+        else if (i + 1 < argc && strcmp(argv[i], "-isa") == 0)
+        {
+            Color_ISA isa;
+            if (!Color_ISA_Parse(argv[++i], &isa) || !Color_Set_ISA(isa))
+            {
+                printf("instruction set %s isn't supported here, the best is %s\n", argv[i], Color_ISA_Name(Color_ISA_Best()));
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "-no-checks") == 0)
+            checks = false;
+        else
+        {
+            Bench_Usage();
+            return 1;
+        }
+    }
+
+    std::vector<Bench_Result> baseline;
+    if (baselinePath && !Bench_Read_JSON(baselinePath, baseline))
+    {
+        printf("can't read %s\n", baselinePath);
+        return 1;
+    }
+
+    if (checks && !bench_filter)
+    {
+        printf("Accuracy\n");
+        Bench_Accuracy();
+        Bench_Strided();
+        Bench_Pattern_Bounds();
+        Bench_Multi();
+        Bench_Large();
+        Bench_Formats();
+        Bench_ISA();
+        Bench_Lut();
+        Bench_Image();
+        Bench_Scene();
+        Bench_Scene_Async();
+        Bench_Frame_Scheduler();
+        Bench_Image_Cache();
+        Bench_Arena();
+    }
+    for (const char* s = sizes; *s;)
+    {
+        u32 width = 0;
+        u32 height = 0;
+        int used = 0;
+        if (sscanf(s, "%ux%u%n", &width, &height, &used) != 2 || width < 1 || height < 1 || width > 65535 || height > 65535)
+        {
+            Bench_Usage();
+            return 1;
+        }
+        s += used;
+        s += *s == ',' ? 1 : 0;
+        printf("Kernels, %ux%u, %s\n", width, height, Color_ISA_Name(Color_Get_ISA()));
+        Bench_Kernels(width, height);
+        printf("Kernels by instruction set, %ux%u\n", width, height);
+        Bench_Kernels_ISA(width, height);
+        printf("Generators, %ux%u, %u threads\n", width, height, Parallel_Threads());
+        Bench_Generators(width, height);
+    }
+    printf("Generator thread scaling, 3840x2160\n");
+    Bench_Generate_Scaling(3840, 2160);
+    printf("Image files, 3840x2160, %u threads\n", Parallel_Threads());
+    Bench_Image_Stream(3840, 2160);
+
+    if (jsonPath && !Bench_Write_JSON(jsonPath))
+    {
+        printf("can't write %s\n", jsonPath);
+        return 1;
+    }
+    u32 regressions = baselinePath ? Bench_Compare(baseline, threshold) : 0;
+    if (bench_failures)
+        printf("%u accuracy checks FAILED\n", bench_failures);
+    return regressions || bench_failures ? 1 : 0;
+}
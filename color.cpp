@@ -0,0 +1,772 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// color.cpp : Portable color math used to generate the test images.
+//
+// The span kernels live in color_kernels.inl, which is compiled once for each
+// instruction set at the end of this file, and every call goes through the
+// table of the best set the CPU has, so one binary runs at full speed on
+// anything from SSE2 to AVX-512 without needing /arch or -m flags.
+//
+
+#include "color.h"
+
+#include "colorspace.h"
+
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define COLOR_X86 1
+// Every intrinsic is usable in a function built for its target, whatever the
+// flags the file is compiled with. GCC 12 warns about the _mm512_undefined_ps
+// inside its own AVX-512 intrinsics unless that's off for both the header and
+// the callers.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64) || defined(__ARM_NEON)
+// NEON is part of every 64-bit ARM CPU, so it's chosen at compile time
+#define COLOR_ARM_NEON 1
+#include <arm_neon.h>
+#endif
+
+const f32 testcolors[4][7] = {
+    // Red
+    {  2.00f,  2.00f, -0.20f, -0.20f, -0.20f,  2.00f,  2.00f},
+    // Green
+    { -0.20f,  2.00f,  2.00f,  2.00f, -0.20f, -0.20f, -0.20f},
+    // Blue
+    { -0.20f, -0.20f, -0.20f,  2.00f,  2.00f,  2.00f, -0.20f},
+    // Alpha
+    {  1.00f,  1.00f,  1.00f,  1.00f,  1.00f,  1.00f,  1.00f}
+};
+
+void PixelCallback_TestColors_scRGB(float output[], f32 x, f32 y, f32 width, f32 height)
+{
+    constexpr u32 limit = sizeof(testcolors[0]) / sizeof(testcolors[0][0]);
+    constexpr u32 limit1 = limit - 1;
+    constexpr u32 limit2 = limit - 2;
+    f32 f = (x / (width - 1.0f)) * limit1;
+    f = f < 0.0f ? 0.0f : f < (float)limit1 ? f : (float)limit1;
+    u32 i = (int)floor(f);
+    i = i < 0 ? 0 : i < limit2 ? i : limit2;
+    f32 lerp = (f - i) < 1.0f ? (f - i) : 1.0f;
+    f32 ilerp = 1.0f - lerp;
+    for (u32 c = 0; c < 4; c++)
+        output[c] = testcolors[c][i] * ilerp + testcolors[c][i + 1] * lerp;
+}
+
+void Pixel_To_Int(f32 c[], f32 scale, f32 low, f32 high)
+{
+    for (u32 i = 0; i < 4; i++)
+    {
+        f32 f = c[i];
+        f *= scale;
+        f = floorf(f + 0.5f);
+        f = f < low ? low : f < high ? f : high;
+        c[i] = f;
+    }
+}
+
+u16 ToF16(f32 f)
+{
+    // f32 is 1 sign bit, 8 exponent bits, 23 mantissa bits
+    // f16 is 1 sign bit, 5 exponent bits, 10 mantissa bits
+    //
+    // Three cases, based on the magnitude of the input:
+    // - >= 65536 (e143) is infinity or NaN, anything that rounds up to 65536
+    //   is handled by the normal case carrying into the exponent.
+    // - < 2^-14 (e113) is an f16 denormal, adding 0.5 lines the 10 denormal
+    //   mantissa bits up with the bottom of the f32 mantissa so the FPU does
+    //   the round to nearest even for us.
+    // - everything else rebiases the exponent by 127-15=112 and rounds the 13
+    //   discarded mantissa bits to nearest even before shifting them out.
+    u32 i;
+    memcpy(&i, &f, sizeof(i));
+    u32 sign = (i & 0x80000000) >> 16;
+    u32 a = i & 0x7FFFFFFF;
+    u32 n;
+    if (a >= 0x47800000)
+    {
+        n = a > 0x7F800000 ? 0x7E00 | ((a >> 13) & 0x3FF) : 0x7C00;
+    }
+    else if (a < 0x38800000)
+    {
+        constexpr u32 magic = 0x3F000000;
+        f32 m;
+        memcpy(&m, &a, sizeof(m));
+        m += 0.5f;
+        memcpy(&n, &m, sizeof(n));
+        n -= magic;
+    }
+    else
+    {
+        u32 odd = (a >> 13) & 1;
+        n = (a - 0x38000000 + 0xFFF + odd) >> 13;
+    }
+    return (u16)(n | sign);
+}
+
+/// This converts an f32 to an f16 using bit manipulation (which achieves round
+/// toward zero behavior, which may not be the active floating point mode).
+/// See https://en.wikipedia.org/wiki/Half-precision_floating-point_format and
+/// compare to https://en.wikipedia.org/wiki/Single-precision_floating-point_format
+u16 ToF16_RoundTowardZero(f32 f)
+{
+    // Some notes:
+    // f32 is 1 sign bit, 8 exponent bits, 23 mantissa bits
+    // f16 is 1 sign bit, 5 exponent bits, 10 mantissa bits
+    // 1.0 as f32 is 0x3f800000 (exp=127 of 0-255)
+    // s0 e01111111 m00000000000000000000000
+    // 1.0 as f16 is 0x7800 (exp=15 of 0-31)
+    // s0 e...01111 m0000000000.............
+    // if we shift the exponents to align the same, 127-15=112, f16 exp is f32
+    // exp - 112, since the sign bit precedes it we need to mask that off before
+    // adjusting, the mantissa directly follows the exponent so we can shift
+    // both by the same amount to align with the f16 format, and subtract 112
+    // from the exponent and we get f16 from f32 with bit math alone.
+    //
+    // e112 = s0 e011100000 m... = 0x38000000
+    // e113 = s0 e011100001 m... = 0x38800000
+    //
+    // We also have to handle the fact that e103 to 112 become denormals, but
+    // it is easier to simply treat <=e112 as zero, a lot of float
+    // implementations either ignore denormals or process them very slowly so
+    // turning them into zero is a reasonable behavior here.
+    union
+    {
+        f32 f;
+        u32 i;
+    }
+    u;
+    u.f = f;
+    u32 i = u.i;
+    // Adjust exponent from +127 bias to +15 bias, if it would become less than
+    // exponent 1 we treat it as a full zero (rather than try to deal with
+    // denormals, which typically have a performance penalty anyway)
+    u32 a = ((i & 0x7FFFFFFF) < 0x38800000) ? 0 : i - 0x38000000;
+    // Shift exponent and mantissa to the correct place (same shift for both)
+    // and put the sign bit into place
+    u16 n = (a >> 13) | ((a & 0x80000000) >> 16);
+    return n;
+}
+
+f32 FromF16(u16 h)
+{
+    u32 sign = (u32)(h & 0x8000) << 16;
+    u32 a = h & 0x7FFF;
+    u32 bits;
+    if (a >= 0x7C00)
+    {
+        // Infinity or NaN, NaN is made quiet and keeps its payload like F16C
+        bits = 0x7F800000 | ((a & 0x3FF) << 13) | (a > 0x7C00 ? 0x400000 : 0);
+    }
+    else if (a >= 0x400)
+    {
+        // Normal, just rebias the exponent from 15 to 127
+        bits = (a << 13) + 0x38000000;
+    }
+    else
+    {
+        // Zero or denormal, which is the mantissa times 2^-24
+        f32 f = (f32)a * (1.0f / 16777216.0f);
+        memcpy(&bits, &f, sizeof(bits));
+    }
+    bits |= sign;
+    f32 f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+// scRGB has the Rec.709 primaries, so the conversion through XYZ is fused into
+// a single matrix at compile time
+constexpr Color_Mat3f scrgb_to_rec2020 = Mat3_To_f32(Color_RGB_To_RGB(primaries_rec709, primaries_rec2020));
+
+void Color_rgb_through_mat3(const f32 c[], f32 o[], const f32 mat[3][3]) {
+    o[0] = c[0] * mat[0][0] + c[1] * mat[0][1] + c[2] * mat[0][2];
+    o[1] = c[0] * mat[1][0] + c[1] * mat[1][1] + c[2] * mat[1][2];
+    o[2] = c[0] * mat[2][0] + c[1] * mat[2][1] + c[2] * mat[2][2];
+}
+
+void Color_scRGB_To_Rec2020(f32 c[3], f32 o[3])
+{
+    Color_rgb_through_mat3(c, o, scrgb_to_rec2020.m);
+}
+
+void Color_scRGB_To_Rec2020_Span(const f32* src, f32* dst, usize pixels)
+{
+    Color_rgb_through_mat3_Span(src, dst, pixels, scrgb_to_rec2020.m);
+}
+
+void Color_Transfer_To_PQ(const f32 c[3], f32 o[3])
+{
+    constexpr auto m1 = 2610.0f / 16384.0f;
+    constexpr auto m2 = 128.0f * 2523.0f / 4096.0f;
+    constexpr auto c1 = 3424.0f / 4096.0f;
+    constexpr auto c2 = 32.0f * 2413.0f / 4096.0f;
+    constexpr auto c3 = 32.0f * 2392.0f / 4096.0f;
+    for (u32 i = 0; i < 3; i++)
+    {
+        f32 y = c[i] * 80.0f / 10000.0f;
+        y = y < 0.0f ? 0.0f : y;
+        f32 j = powf(y, m1);
+        f32 f = powf((c1 + c2 * j) / (1 + c3 * j), m2);
+        o[i] = f < 0.0f ? 0.0f : f < 1.0f ? f : 1.0f;
+    }
+    o[3] = c[3];
+}
+
+f32 Color_Transfer_From_PQ(f32 e)
+{
+    constexpr auto m1 = 2610.0f / 16384.0f;
+    constexpr auto m2 = 128.0f * 2523.0f / 4096.0f;
+    constexpr auto c1 = 3424.0f / 4096.0f;
+    constexpr auto c2 = 32.0f * 2413.0f / 4096.0f;
+    constexpr auto c3 = 32.0f * 2392.0f / 4096.0f;
+    e = e < 0.0f ? 0.0f : e < 1.0f ? e : 1.0f;
+    f32 p = powf(e, 1.0f / m2);
+    f32 n = p - c1;
+    n = n < 0.0f ? 0.0f : n;
+    return powf(n / (c2 - c3 * p), 1.0f / m1) * (10000.0f / 80.0f);
+}
+
+// The PQ table samples the curve at every f32 in 0..1 whose low 18 mantissa
+// bits are zero, which is 32 evenly spaced points per octave, so the table
+// index is just the top bits of the float and the low bits are the lerp factor.
+constexpr u32 pq_table_shift = 18;
+constexpr u32 pq_table_size = (0x3F800000 >> pq_table_shift) + 2;
+
+static const f32* PQ_Table()
+{
+    static const std::vector<f32> table = [] {
+        constexpr f64 m1 = 2610.0 / 16384.0;
+        constexpr f64 m2 = 128.0 * 2523.0 / 4096.0;
+        constexpr f64 c1 = 3424.0 / 4096.0;
+        constexpr f64 c2 = 32.0 * 2413.0 / 4096.0;
+        constexpr f64 c3 = 32.0 * 2392.0 / 4096.0;
+        std::vector<f32> t(pq_table_size);
+        for (u32 i = 0; i < pq_table_size; i++)
+        {
+            u32 bits = i << pq_table_shift;
+            f32 y;
+            memcpy(&y, &bits, sizeof(y));
+            y = y < 1.0f ? y : 1.0f;
+            f64 j = pow((f64)y, m1);
+            t[i] = (f32)pow((c1 + c2 * j) / (1 + c3 * j), m2);
+        }
+        return t;
+    }();
+    return table.data();
+}
+
+static inline f32 PQ_Table_Lookup(const f32* table, f32 c)
+{
+    f32 y = c * (80.0f / 10000.0f);
+    y = y > 0.0f ? y : 0.0f;
+    y = y < 1.0f ? y : 1.0f;
+    u32 bits;
+    memcpy(&bits, &y, sizeof(bits));
+    u32 i = bits >> pq_table_shift;
+    f32 lerp = (bits & ((1u << pq_table_shift) - 1)) * (1.0f / (1u << pq_table_shift));
+    return table[i] + (table[i + 1] - table[i]) * lerp;
+}
+
+void Color_Transfer_To_sRGB(f32 c[], f32 o[])
+{
+    // sRGB piecewise gamma
+    for (u32 i = 0; i < 3; i++)
+    {
+        f32 f = c[i];
+        f = f < 0.0f ? 0.0f : f < 1.0f ? f : 1.0f;
+        o[i] = f < 0.0031308f ? f * 12.92f : 1.055f * powf(f, 0.41666f) - 0.055f;
+    }
+    o[3] = c[3];
+}
+
+f32 Color_Transfer_From_sRGB(f32 e)
+{
+    e = e < 0.0f ? 0.0f : e < 1.0f ? e : 1.0f;
+    return e < 0.04045f ? e / 12.92f : powf((e + 0.055f) / 1.055f, 2.4f);
+}
+
+// The EOTF tables sample the curve at every f32 in 0..1 whose low 16 mantissa
+// bits are zero, 128 evenly spaced points per octave, indexed the same way as
+// the PQ table. The EOTFs are much steeper than the inverse near the top (the
+// PQ EOTF behaves like a power of 6 there), so they need the finer spacing.
+constexpr u32 eotf_table_shift = 16;
+constexpr u32 eotf_table_size = (0x3F800000 >> eotf_table_shift) + 2;
+
+static std::vector<f32> EOTF_Table(f64 (*eotf)(f64 e))
+{
+    std::vector<f32> t(eotf_table_size);
+    for (u32 i = 0; i < eotf_table_size; i++)
+    {
+        u32 bits = i << eotf_table_shift;
+        f32 e;
+        memcpy(&e, &bits, sizeof(e));
+        t[i] = (f32)eotf(e < 1.0f ? e : 1.0f);
+    }
+    return t;
+}
+
+static f64 PQ_EOTF_f64(f64 e)
+{
+    constexpr f64 m1 = 2610.0 / 16384.0;
+    constexpr f64 m2 = 128.0 * 2523.0 / 4096.0;
+    constexpr f64 c1 = 3424.0 / 4096.0;
+    constexpr f64 c2 = 32.0 * 2413.0 / 4096.0;
+    constexpr f64 c3 = 32.0 * 2392.0 / 4096.0;
+    f64 p = pow(e, 1.0 / m2);
+    f64 n = p - c1 > 0.0 ? p - c1 : 0.0;
+    return pow(n / (c2 - c3 * p), 1.0 / m1) * (10000.0 / 80.0);
+}
+
+static f64 sRGB_EOTF_f64(f64 e)
+{
+    return e < 0.04045 ? e / 12.92 : pow((e + 0.055) / 1.055, 2.4);
+}
+
+static const f32* PQ_EOTF_Table()
+{
+    static const std::vector<f32> table = EOTF_Table(PQ_EOTF_f64);
+    return table.data();
+}
+
+static const f32* sRGB_EOTF_Table()
+{
+    static const std::vector<f32> table = EOTF_Table(sRGB_EOTF_f64);
+    return table.data();
+}
+
+// Each 8-bit code's linear value, for the RGBA8 sRGB decoder
+static const f32* sRGB8_EOTF_Table()
+{
+    static const std::vector<f32> table = [] {
+        std::vector<f32> t(256);
+        for (u32 i = 0; i < 256; i++)
+            t[i] = (f32)sRGB_EOTF_f64(i / 255.0);
+        return t;
+    }();
+    return table.data();
+}
+
+// The sRGB8 encoder finds the 8-bit code directly from the f32 bits. The bucket
+// table holds the code at the start of each bucket of 128 per octave (from
+// 2^-13, below which everything encodes to 0), and the threshold table holds
+// the smallest input that encodes to each code. No bucket crosses more than one
+// threshold, so a single compare fixes up the bucket's code. Both tables are
+// built by searching with the reference formula, which makes the result bit
+// exact against Color_Transfer_To_sRGB followed by Pixel_To_Int.
+constexpr u32 srgb8_bucket_shift = 16;
+constexpr u32 srgb8_bucket_base = 0x39000000;
+constexpr u32 srgb8_bucket_size = ((0x3F800000 - srgb8_bucket_base) >> srgb8_bucket_shift) + 1;
+
+struct sRGB8_Tables
+{
+    u32 bucket[srgb8_bucket_size];
+    f32 threshold[257];
+};
+
+static u32 sRGB8_Reference(f32 f)
+{
+    f32 c[4] = { f, 0.0f, 0.0f, 0.0f };
+    Color_Transfer_To_sRGB(c, c);
+    Pixel_To_Int(c, 255.0f, 0.0f, 255.0f);
+    return (u32)c[0];
+}
+
+static const sRGB8_Tables& sRGB8_Table()
+{
+    static const sRGB8_Tables tables = [] {
+        sRGB8_Tables t;
+        t.threshold[0] = 0.0f;
+        for (u32 code = 1; code < 256; code++)
+        {
+            // Smallest f32 in 0..1 that encodes to at least this code
+            u32 low = 0;
+            u32 high = 0x3F800000;
+            while (low < high)
+            {
+                u32 mid = low + (high - low) / 2;
+                f32 f;
+                memcpy(&f, &mid, sizeof(f));
+                if (sRGB8_Reference(f) >= code)
+                    high = mid;
+                else
+                    low = mid + 1;
+            }
+            memcpy(&t.threshold[code], &low, sizeof(f32));
+        }
+        t.threshold[256] = 2.0f;
+        for (u32 i = 0; i < srgb8_bucket_size; i++)
+        {
+            u32 bits = srgb8_bucket_base + (i << srgb8_bucket_shift);
+            f32 f;
+            memcpy(&f, &bits, sizeof(f));
+            t.bucket[i] = sRGB8_Reference(f);
+        }
+        return t;
+    }();
+    return tables;
+}
+
+static inline u32 sRGB8_Lookup(const sRGB8_Tables& t, f32 f)
+{
+    // Same clamp as Color_Transfer_To_sRGB, which sends NaN to 1
+    f = f < 0.0f ? 0.0f : f < 1.0f ? f : 1.0f;
+    if (f < 1.0f / 8192.0f)
+        return 0;
+    u32 bits;
+    memcpy(&bits, &f, sizeof(bits));
+    u32 code = t.bucket[(bits - srgb8_bucket_base) >> srgb8_bucket_shift];
+    return code + (f >= t.threshold[code + 1] ? 1 : 0);
+}
+
+// The R11G11B10_FLOAT channels are unsigned floats with a 5 bit exponent (bias
+// 15) and 6 or 5 mantissa bits. They convert like ToF16 and FromF16 with the
+// mantissa cut shorter, except that there is no sign bit, so negative numbers
+// and -infinity become 0. NaN stays NaN and keeps the top of its payload.
+template <u32 mbits> static inline u32 ToUFloat(f32 f)
+{
+    constexpr u32 shift = 23 - mbits;
+    constexpr u32 inf = 0x1Fu << mbits;
+    u32 i;
+    memcpy(&i, &f, sizeof(i));
+    u32 a = i & 0x7FFFFFFF;
+    if (a > 0x7F800000)
+        return inf | (1u << (mbits - 1)) | ((a >> shift) & ((1u << mbits) - 1));
+    if (i & 0x80000000)
+        return 0;
+    if (a >= 0x47800000)
+        return inf;
+    if (a < 0x38800000)
+    {
+        // The last mantissa bit of 2^(9 - mbits) is the denormal step
+        // 2^(-14 - mbits), so adding it rounds to nearest even for us
+        constexpr u32 magic = (127 + 9 - mbits) << 23;
+        f32 m;
+        f32 c;
+        memcpy(&m, &a, sizeof(m));
+        memcpy(&c, &magic, sizeof(c));
+        m += c;
+        u32 n;
+        memcpy(&n, &m, sizeof(n));
+        return n - magic;
+    }
+    u32 odd = (a >> shift) & 1;
+    return (a - 0x38000000 + (1u << (shift - 1)) - 1 + odd) >> shift;
+}
+
+template <u32 mbits> static inline f32 FromUFloat(u32 v)
+{
+    constexpr u32 shift = 23 - mbits;
+    constexpr u32 inf = 0x1Fu << mbits;
+    u32 bits;
+    if (v >= inf)
+    {
+        bits = 0x7F800000 | ((v - inf) << shift);
+    }
+    else if (v >= (1u << mbits))
+    {
+        bits = (v << shift) + 0x38000000;
+    }
+    else
+    {
+        f32 f = (f32)v * (1.0f / (f32)(1u << (14 + mbits)));
+        memcpy(&bits, &f, sizeof(bits));
+    }
+    f32 f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+// R9G9B9E5_SHAREDEXP the way D3D and DirectXMath's XMStoreFloat3SE do it. The
+// channels are clamped to 0..65408 (511/512 * 2^16, NaN to 0), the exponent
+// comes from the largest channel rounded up at half of a 9 bit mantissa's
+// last bit, so one that would round to 512 uses the next exponent, and each
+// mantissa is rounded to nearest even.
+constexpr f32 rgb9e5_max = 65408.0f;
+constexpr f32 rgb9e5_min = 1.0f / 65536.0f;
+
+// Every span kernel, as X(name, parameters, arguments), in the order each
+// instruction set's table holds them
+#define COLOR_SPANS(X) \
+    X(ToF16_Span, (const f32* src, u16* dst, usize count), (src, dst, count)) \
+    X(FromF16_Span, (const u16* src, f32* dst, usize count), (src, dst, count)) \
+    X(Color_rgb_through_mat3_Span, (const f32* src, f32* dst, usize pixels, const f32 mat[3][3]), (src, dst, pixels, mat)) \
+    X(Color_Transfer_To_PQ_Span, (const f32* src, f32* dst, usize pixels), (src, dst, pixels)) \
+    X(Color_Transfer_From_PQ_Span, (const f32* src, f32* dst, usize pixels), (src, dst, pixels)) \
+    X(Color_Transfer_From_sRGB_Span, (const f32* src, f32* dst, usize pixels), (src, dst, pixels)) \
+    X(Color_Encode_BGRA8_sRGB_Span, (const f32* src, u32* dst, usize pixels), (src, dst, pixels)) \
+    X(Color_Encode_RGBA8_sRGB_Span, (const f32* src, u32* dst, usize pixels), (src, dst, pixels)) \
+    X(Color_Pack_RGB10A2_Span, (const f32* src, u32* dst, usize pixels), (src, dst, pixels)) \
+    X(Color_Pack_BGRA8_Span, (const f32* src, u32* dst, usize pixels), (src, dst, pixels)) \
+    X(Color_Pack_RGBA16_Span, (const f32* src, u16* dst, usize pixels), (src, dst, pixels)) \
+    X(Color_Pack_R11G11B10F_Span, (const f32* src, u32* dst, usize pixels), (src, dst, pixels)) \
+    X(Color_Pack_RGB9E5_Span, (const f32* src, u32* dst, usize pixels), (src, dst, pixels)) \
+    X(Color_Unpack_RGB10A2_Span, (const u32* src, f32* dst, usize pixels), (src, dst, pixels)) \
+    X(Color_Unpack_BGRA8_Span, (const u32* src, f32* dst, usize pixels), (src, dst, pixels)) \
+    X(Color_Unpack_RGBA16_Span, (const u16* src, f32* dst, usize pixels), (src, dst, pixels)) \
+    X(Color_Unpack_R11G11B10F_Span, (const u32* src, f32* dst, usize pixels), (src, dst, pixels)) \
+    X(Color_Unpack_RGB9E5_Span, (const u32* src, f32* dst, usize pixels), (src, dst, pixels)) \
+    X(Color_Decode_RGB10A2_Span, (const u32* src, f32* dst, usize pixels, const f32* table), (src, dst, pixels, table)) \
+    X(Color_Decode_BGRA8_Span, (const u32* src, f32* dst, usize pixels, const f32* table), (src, dst, pixels, table)) \
+    X(Color_Decode_RGBA8_sRGB_Span, (const u32* src, f32* dst, usize pixels), (src, dst, pixels)) \
+    X(Pixel_Over_Span, (const f32* src, f32* dst, usize pixels), (src, dst, pixels)) \
+    X(Color_Lut3D_Span, (const f32* src, f32* dst, usize pixels, const f32* lattice, u32 size), (src, dst, pixels, lattice, size))
+
+struct Color_Spans
+{
+#define COLOR_SPAN_POINTER(name, params, args) void(*name) params;
+    COLOR_SPANS(COLOR_SPAN_POINTER)
+#undef COLOR_SPAN_POINTER
+};
+
+// Inside each namespace the kernels' own names hide the dispatching ones
+#define COLOR_SPAN_ENTRY(name, params, args) name,
+
+// GCC and Clang need the target set on every function that uses the wider
+// instructions, MSVC lets any function use any intrinsic. Fused multiply-add is
+// left out so every instruction set rounds the same way.
+#if defined(__clang__)
+#pragma STDC FP_CONTRACT OFF
+#define COLOR_TARGET_SSE41 _Pragma("clang attribute push (__attribute__((target(\"sse4.1\"))), apply_to = function)")
+#define COLOR_TARGET_AVX2 _Pragma("clang attribute push (__attribute__((target(\"avx2,f16c\"))), apply_to = function)")
+#define COLOR_TARGET_AVX512 _Pragma("clang attribute push (__attribute__((target(\"avx512f,avx2,f16c\"))), apply_to = function)")
+#define COLOR_TARGET_END _Pragma("clang attribute pop")
+#elif defined(__GNUC__)
+#define COLOR_TARGET_SSE41 _Pragma("GCC push_options") _Pragma("GCC target(\"sse4.1\")")
+#define COLOR_TARGET_AVX2 _Pragma("GCC push_options") _Pragma("GCC target(\"avx2,f16c\")")
+// AVX-512F brings FMA along, which GCC would fuse the intrinsics' mul and add
+// into
+#define COLOR_TARGET_AVX512 _Pragma("GCC push_options") _Pragma("GCC target(\"avx512f,avx2,f16c\")") \
+    _Pragma("GCC optimize(\"fp-contract=off\")")
+#define COLOR_TARGET_END _Pragma("GCC pop_options")
+#else
+#define COLOR_TARGET_SSE41
+#define COLOR_TARGET_AVX2
+#define COLOR_TARGET_AVX512
+#define COLOR_TARGET_END
+#endif
+
+namespace color_scalar
+{
+#include "color_kernels.inl"
+const Color_Spans spans = { COLOR_SPANS(COLOR_SPAN_ENTRY) };
+}
+
+#if COLOR_X86
+#define COLOR_SSE2 1
+namespace color_sse2
+{
+#include "color_kernels.inl"
+const Color_Spans spans = { COLOR_SPANS(COLOR_SPAN_ENTRY) };
+}
+
+#define COLOR_SSE41 1
+COLOR_TARGET_SSE41
+namespace color_sse41
+{
+#include "color_kernels.inl"
+const Color_Spans spans = { COLOR_SPANS(COLOR_SPAN_ENTRY) };
+}
+COLOR_TARGET_END
+#undef COLOR_SSE41
+#undef COLOR_SSE2
+
+#define COLOR_AVX2 1
+COLOR_TARGET_AVX2
+namespace color_avx2
+{
+#include "color_kernels.inl"
+const Color_Spans spans = { COLOR_SPANS(COLOR_SPAN_ENTRY) };
+}
+COLOR_TARGET_END
+
+#define COLOR_AVX512 1
+COLOR_TARGET_AVX512
+namespace color_avx512
+{
+#include "color_kernels.inl"
+const Color_Spans spans = { COLOR_SPANS(COLOR_SPAN_ENTRY) };
+}
+COLOR_TARGET_END
+#undef COLOR_AVX512
+#undef COLOR_AVX2
+#endif
+
+#if COLOR_ARM_NEON
+#define COLOR_NEON 1
+namespace color_neon
+{
+#include "color_kernels.inl"
+const Color_Spans spans = { COLOR_SPANS(COLOR_SPAN_ENTRY) };
+}
+#undef COLOR_NEON
+#endif
+
+#if COLOR_X86
+static void Color_CPUID(u32 leaf, u32 r[4])
+{
+#if defined(_MSC_VER)
+    int v[4];
+    __cpuidex(v, (int)leaf, 0);
+    for (u32 i = 0; i < 4; i++)
+        r[i] = (u32)v[i];
+#else
+    __cpuid_count(leaf, 0, r[0], r[1], r[2], r[3]);
+#endif
+}
+
+// Which register state the OS saves on a context switch, XCR0
+static u64 Color_XGETBV()
+{
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    u32 lo;
+    u32 hi;
+    __asm__("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    return ((u64)hi << 32) | lo;
+#endif
+}
+#endif
+
+static Color_ISA Color_ISA_Detect()
+{
+#if COLOR_X86
+    u32 r[4];
+    Color_CPUID(0, r);
+    u32 leaves = r[0];
+    Color_CPUID(1, r);
+    bool sse2 = (r[3] >> 26) & 1;
+    bool sse41 = (r[2] >> 19) & 1;
+    bool osxsave = (r[2] >> 27) & 1;
+    bool avx = (r[2] >> 28) & 1;
+    bool f16c = (r[2] >> 29) & 1;
+    u64 xcr0 = osxsave ? Color_XGETBV() : 0;
+    // XMM and YMM state for AVX, and opmask and all of ZMM for AVX-512
+    bool ymm = (xcr0 & 0x06) == 0x06;
+    bool zmm = (xcr0 & 0xE6) == 0xE6;
+    u32 features7 = 0;
+    if (leaves >= 7)
+    {
+        Color_CPUID(7, r);
+        features7 = r[1];
+    }
+    bool avx2 = avx && ymm && f16c && ((features7 >> 5) & 1);
+    bool avx512 = avx2 && zmm && ((features7 >> 16) & 1);
+    return avx512 ? Color_ISA::AVX512 : avx2 ? Color_ISA::AVX2 : sse41 ? Color_ISA::SSE41 : sse2 ? Color_ISA::SSE2 : Color_ISA::Scalar;
+#elif COLOR_ARM_NEON
+    return Color_ISA::NEON;
+#else
+    return Color_ISA::Scalar;
+#endif
+}
+
+static const Color_Spans* Color_Spans_For(Color_ISA isa)
+{
+    switch (isa)
+    {
+#if COLOR_X86
+    case Color_ISA::SSE2:
+        return &color_sse2::spans;
+    case Color_ISA::SSE41:
+        return &color_sse41::spans;
+    case Color_ISA::AVX2:
+        return &color_avx2::spans;
+    case Color_ISA::AVX512:
+        return &color_avx512::spans;
+#endif
+#if COLOR_ARM_NEON
+    case Color_ISA::NEON:
+        return &color_neon::spans;
+#endif
+    default:
+        return &color_scalar::spans;
+    }
+}
+
+static std::atomic<Color_ISA> color_isa{ Color_ISA::Scalar };
+static std::atomic<const Color_Spans*> color_spans{ nullptr };
+
+static const Color_Spans* Color_Spans_Current()
+{
+    const Color_Spans* spans = color_spans.load(std::memory_order_relaxed);
+    if (!spans)
+    {
+        Color_ISA isa = Color_ISA_Best();
+        spans = Color_Spans_For(isa);
+        color_isa.store(isa, std::memory_order_relaxed);
+        color_spans.store(spans, std::memory_order_relaxed);
+    }
+    return spans;
+}
+
+Color_ISA Color_ISA_Best()
+{
+    static const Color_ISA best = Color_ISA_Detect();
+    return best;
+}
+
+bool Color_ISA_Supported(Color_ISA isa)
+{
+    Color_ISA best = Color_ISA_Best();
+    if (isa == Color_ISA::Scalar || isa == best)
+        return true;
+    // The x86 levels each include the ones below
+    return best != Color_ISA::NEON && isa != Color_ISA::NEON && (u32)isa < (u32)best;
+}
+
+bool Color_Set_ISA(Color_ISA isa)
+{
+    if (!Color_ISA_Supported(isa))
+        return false;
+    color_isa.store(isa, std::memory_order_relaxed);
+    color_spans.store(Color_Spans_For(isa), std::memory_order_relaxed);
+    return true;
+}
+
+Color_ISA Color_Get_ISA()
+{
+    Color_Spans_Current();
+    return color_isa.load(std::memory_order_relaxed);
+}
+
+static const char* const color_isa_names[] = { "scalar", "sse2", "sse4.1", "avx2", "avx512", "neon" };
+
+const char* Color_ISA_Name(Color_ISA isa)
+{
+    return color_isa_names[(u32)isa];
+}
+
+bool Color_ISA_Parse(const char* name, Color_ISA* isa)
+{
+    for (u32 i = 0; i < sizeof(color_isa_names) / sizeof(color_isa_names[0]); i++)
+    {
+        if (strcmp(name, color_isa_names[i]) == 0)
+        {
+            *isa = (Color_ISA)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+#define COLOR_SPAN_DISPATCH(name, params, args) \
+    void name params \
+    { \
+        Color_Spans_Current()->name args; \
+    }
+COLOR_SPANS(COLOR_SPAN_DISPATCH)
@@ -0,0 +1,175 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// color.h : Portable color math used to generate the test images - test
+// patterns, colorspace matrices, transfer functions and pixel packing.
+//
+
+#pragma once
+
+#include "common.h"
+
+// These test colors represent an scRGB color wheel with deliberately wide gamut
+// colors (which often require negative values for other components) and HDR
+// intensity (2.0 = 160 nits scene referred)
+extern const f32 testcolors[4][7];
+
+void PixelCallback_TestColors_scRGB(float output[], f32 x, f32 y, f32 width, f32 height);
+void Pixel_To_Int(f32 c[], f32 scale, f32 low, f32 high);
+
+/// Converts an f32 to an f16 with round to nearest even, producing denormals
+/// for tiny values, infinity for values that overflow, and quiet NaN (keeping
+/// the upper payload bits) for NaN, the same as the F16C instructions do.
+u16 ToF16(f32 f);
+
+/// The original bit manipulation f32 to f16 conversion, which rounds toward
+/// zero and flushes anything below 2^-14 to zero. Only kept so the benchmark
+/// can compare against it.
+u16 ToF16_RoundTowardZero(f32 f);
+
+/// Instruction sets the span kernels below are built for, the best one the CPU
+/// has is picked on first use. Each x86 level includes
+/// the ones before it, AVX2 also needs F16C and AVX512 means AVX-512F.
+enum class Color_ISA
+{
+    Scalar,
+    SSE2,
+    SSE41,
+    AVX2,
+    AVX512,
+    NEON,
+};
+
+/// The best instruction set this CPU (and build) has, which the span kernels
+/// use unless Color_Set_ISA says otherwise.
+Color_ISA Color_ISA_Best();
+bool Color_ISA_Supported(Color_ISA isa);
+
+/// Forces every span kernel to one instruction set, for tests and benchmarks.
+/// Returns false and changes nothing if the CPU can't run it. Kernels already
+/// running on other threads finish with the old one.
+bool Color_Set_ISA(Color_ISA isa);
+Color_ISA Color_Get_ISA();
+
+/// "scalar", "sse2", "sse4.1", "avx2", "avx512" or "neon"
+const char* Color_ISA_Name(Color_ISA isa);
+bool Color_ISA_Parse(const char* name, Color_ISA* isa);
+
+/// Converts count f32 values to f16 with the same results as ToF16, using
+/// F16C, SSE2 or NEON when the CPU has them.
+void ToF16_Span(const f32* src, u16* dst, usize count);
+
+/// Converts an f16 to an f32, which is always exact apart from signaling NaN
+/// becoming quiet, the same as the F16C instructions do.
+f32 FromF16(u16 h);
+
+/// Converts count f16 values to f32 with the same results as FromF16, using
+/// F16C, SSE2 or NEON when the CPU has them.
+void FromF16_Span(const u16* src, f32* dst, usize count);
+
+void Color_rgb_through_mat3(const f32 c[], f32 o[], const f32 mat[3][3]);
+/// Color_rgb_through_mat3 for count RGBA pixels, alpha is passed through
+void Color_rgb_through_mat3_Span(const f32* src, f32* dst, usize pixels, const f32 mat[3][3]);
+void Color_scRGB_To_Rec2020(f32 c[3], f32 o[3]);
+/// Color_scRGB_To_Rec2020 for count RGBA pixels, through
+/// Color_rgb_through_mat3_Span, alpha is passed through
+void Color_scRGB_To_Rec2020_Span(const f32* src, f32* dst, usize pixels);
+void Color_Transfer_To_PQ(const f32 c[3], f32 o[3]);
+/// PQ EOTF, from a 0..1 signal to scRGB (80 nits = 1.0)
+f32 Color_Transfer_From_PQ(f32 e);
+
+/// Same as Color_Transfer_To_PQ for count RGBA pixels, but interpolates a
+/// table of the curve (32 segments per octave) instead of calling powf, and
+/// maps NaN to 0 rather than 1. The maximum error is 1.3e-5 against the f64
+/// formula (0.013 of a 10-bit and 0.054 of a 12-bit code value), which is the
+/// same as the powf version's own error, and 2.5e-5 against the powf version
+/// (0.025 of a 10-bit and 0.10 of a 12-bit code value). AVX2 and AVX-512
+/// gather the table entries, SSE2 and NEON load them a lane at a time.
+void Color_Transfer_To_PQ_Span(const f32* src, f32* dst, usize pixels);
+void Color_Transfer_To_sRGB(f32 c[], f32 o[]);
+/// sRGB EOTF, from a 0..1 signal to linear 0..1
+f32 Color_Transfer_From_sRGB(f32 e);
+
+/// PQ EOTF for count RGBA pixels, from a 0..1 signal to scRGB, alpha is passed
+/// through. Interpolates a table of the f64 curve (128 segments per octave) and
+/// maps NaN to 0. The maximum relative error is 1.8e-4, just below 1.0 where
+/// the curve is steepest, and every 12-bit code comes back within 0.08 of a
+/// code through Color_Transfer_To_PQ_Span.
+void Color_Transfer_From_PQ_Span(const f32* src, f32* dst, usize pixels);
+
+/// sRGB EOTF for count RGBA pixels, the same way as the PQ one. The maximum
+/// relative error is 2.3e-5, and every 8-bit code comes back exactly through
+/// Color_Encode_BGRA8_sRGB_Span.
+void Color_Transfer_From_sRGB_Span(const f32* src, f32* dst, usize pixels);
+
+/// Encodes count linear RGBA pixels to packed BGRA8 sRGB, bit exact with
+/// Color_Transfer_To_sRGB followed by Pixel_To_Int(c, 255.0f, 0.0f, 255.0f),
+/// but using a small table and one compare per channel instead of powf.
+void Color_Encode_BGRA8_sRGB_Span(const f32* src, u32* dst, usize pixels);
+
+/// Same as Color_Encode_BGRA8_sRGB_Span with R and B swapped, for
+/// R8G8B8A8_UNORM_SRGB.
+void Color_Encode_RGBA8_sRGB_Span(const f32* src, u32* dst, usize pixels);
+
+/// Packs count RGBA pixels to R10G10B10A2, bit exact with Pixel_To_Int(c,
+/// 1023.0f, 0.0f, 1023.0f) per color channel and Pixel_To_Int(c, 3.0f, 0.0f,
+/// 3.0f) for alpha, so alpha rounds to the nearest of its 4 levels.
+void Color_Pack_RGB10A2_Span(const f32* src, u32* dst, usize pixels);
+
+/// Packs count RGBA pixels to BGRA8, bit exact with Pixel_To_Int(c, 255.0f,
+/// 0.0f, 255.0f).
+void Color_Pack_BGRA8_Span(const f32* src, u32* dst, usize pixels);
+
+/// Packs count RGBA pixels to R16G16B16A16_UNORM, bit exact with
+/// Pixel_To_Int(c, 65535.0f, 0.0f, 65535.0f).
+void Color_Pack_RGBA16_Span(const f32* src, u16* dst, usize pixels);
+
+/// Packs count RGBA pixels to R11G11B10_FLOAT, alpha is dropped. Rounds to
+/// nearest even like ToF16, negative values become 0, values that round past
+/// the largest finite value (65024) become infinity and NaN stays NaN.
+void Color_Pack_R11G11B10F_Span(const f32* src, u32* dst, usize pixels);
+
+/// Packs count RGBA pixels to R9G9B9E5_SHAREDEXP the same way as D3D, alpha
+/// is dropped, the colors are clamped to 0..65408 (NaN to 0) and rounded to
+/// nearest even at the largest channel's exponent.
+void Color_Pack_RGB9E5_Span(const f32* src, u32* dst, usize pixels);
+
+/// Unpacks count packed R10G10B10A2 pixels to RGBA f32 in 0..1.
+void Color_Unpack_RGB10A2_Span(const u32* src, f32* dst, usize pixels);
+
+/// Unpacks count packed BGRA8 pixels to RGBA f32 in 0..1.
+void Color_Unpack_BGRA8_Span(const u32* src, f32* dst, usize pixels);
+
+/// Unpacks count R16G16B16A16_UNORM pixels to RGBA f32 in 0..1.
+void Color_Unpack_RGBA16_Span(const u16* src, f32* dst, usize pixels);
+
+/// Unpacks count R11G11B10_FLOAT pixels to RGBA f32, exactly, alpha is 1.
+void Color_Unpack_R11G11B10F_Span(const u32* src, f32* dst, usize pixels);
+
+/// Unpacks count R9G9B9E5_SHAREDEXP pixels to RGBA f32, exactly, alpha is 1.
+void Color_Unpack_RGB9E5_Span(const u32* src, f32* dst, usize pixels);
+
+/// Decodes count packed R10G10B10A2 pixels to RGBA f32, looking each color
+/// code up in table (1024 entries, typically a transfer function's EOTF) and
+/// scaling alpha to 0..1.
+void Color_Decode_RGB10A2_Span(const u32* src, f32* dst, usize pixels, const f32* table);
+
+/// Decodes count packed BGRA8 pixels to RGBA f32, looking each color code up
+/// in table (256 entries) and scaling alpha to 0..1.
+void Color_Decode_BGRA8_Span(const u32* src, f32* dst, usize pixels, const f32* table);
+
+/// Decodes count R8G8B8A8_UNORM_SRGB pixels to linear RGBA f32 in 0..1, the
+/// colors through the sRGB EOTF and alpha linearly, so every code comes back
+/// through Color_Encode_RGBA8_sRGB_Span.
+void Color_Decode_RGBA8_sRGB_Span(const u32* src, f32* dst, usize pixels);
+
+/// Blends count premultiplied alpha RGBA pixels over dst, in place.
+void Pixel_Over_Span(const f32* src, f32* dst, usize pixels);
+
+/// Looks count RGBA pixels up in a size^3 lattice of RGBA nodes (red
+/// changing fastest, alpha unused) with tetrahedral interpolation. The colors
+/// are lattice coordinates, 0..1 from the first node to the last along each
+/// axis and clamped to it, alpha is passed through. src and dst may be the
+/// same. See lut.h for the shaper and baking.
+void Color_Lut3D_Span(const f32* src, f32* dst, usize pixels, const f32* lattice, u32 size);
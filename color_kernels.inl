@@ -0,0 +1,1259 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// color_kernels.inl : The span kernels, included by color.cpp once for each
+// instruction set inside its own namespace and compiled for that target.
+//
+// Exactly one of COLOR_AVX2, COLOR_SSE2 or COLOR_NEON is defined to pick the
+// vector body, or none for the plain scalar build. COLOR_SSE41 adds SSE4.1
+// instructions to the SSE2 body and COLOR_AVX512 adds 16 lane loops in front
+// of some AVX2 ones. Every body handles what it can and leaves the rest to the
+// scalar loop at the end, which is the reference the others match bit for bit.
+//
+
+#if COLOR_SSE2
+// mask ? a : b for each 32 bit lane, the mask lanes are all ones or all zeros
+static inline __m128i Select_SSE2(__m128i mask, __m128i a, __m128i b)
+{
+#if COLOR_SSE41
+    return _mm_blendv_epi8(b, a, mask);
+#else
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+#endif
+}
+
+// Same three cases as ToF16, computed for all lanes and then selected, the
+// result is in the low 16 bits of each 32 bit lane.
+static inline __m128i ToF16_SSE2(__m128 f)
+{
+    const __m128i magic = _mm_set1_epi32(0x3F000000);
+    __m128i i = _mm_castps_si128(f);
+    __m128i sign = _mm_srli_epi32(_mm_and_si128(i, _mm_set1_epi32((int)0x80000000)), 16);
+    __m128i a = _mm_and_si128(i, _mm_set1_epi32(0x7FFFFFFF));
+
+    __m128i isnan = _mm_cmpgt_epi32(a, _mm_set1_epi32(0x7F800000));
+    __m128i nan = _mm_or_si128(_mm_set1_epi32(0x7E00), _mm_and_si128(_mm_srli_epi32(a, 13), _mm_set1_epi32(0x3FF)));
+    __m128i big = Select_SSE2(isnan, nan, _mm_set1_epi32(0x7C00));
+
+    __m128i tiny = _mm_sub_epi32(_mm_castps_si128(_mm_add_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(magic))), magic);
+
+    __m128i odd = _mm_and_si128(_mm_srli_epi32(a, 13), _mm_set1_epi32(1));
+    __m128i normal = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(a, _mm_set1_epi32(0xFFF - 0x38000000)), odd), 13);
+
+    __m128i isbig = _mm_cmpgt_epi32(a, _mm_set1_epi32(0x47800000 - 1));
+    __m128i istiny = _mm_cmplt_epi32(a, _mm_set1_epi32(0x38800000));
+    __m128i n = Select_SSE2(istiny, tiny, normal);
+    n = Select_SSE2(isbig, big, n);
+    return _mm_or_si128(n, sign);
+}
+#endif
+
+void ToF16_Span(const f32* src, u16* dst, usize count)
+{
+    usize i = 0;
+#if COLOR_AVX512
+    for (; i + 16 <= count; i += 16)
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm512_cvtps_ph(_mm512_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT));
+#endif
+#if COLOR_AVX2
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128((__m128i*)(dst + i), h);
+    }
+#elif COLOR_SSE2
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i lo = ToF16_SSE2(_mm_loadu_ps(src + i));
+        __m128i hi = ToF16_SSE2(_mm_loadu_ps(src + i + 4));
+#if COLOR_SSE41
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi32(lo, hi));
+#else
+        // SSE2 only has a signed 32->16 pack, so sign extend the f16 bits first
+        lo = _mm_srai_epi32(_mm_slli_epi32(lo, 16), 16);
+        hi = _mm_srai_epi32(_mm_slli_epi32(hi, 16), 16);
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_packs_epi32(lo, hi));
+#endif
+    }
+#elif COLOR_NEON
+    for (; i + 4 <= count; i += 4)
+    {
+        float16x4_t h = vcvt_f16_f32(vld1q_f32(src + i));
+        vst1_u16(dst + i, vreinterpret_u16_f16(h));
+    }
+#endif
+#if COLOR_AVX2
+    // The tail calls code built without AVX, which is slow while the upper
+    // halves of the vector registers are still dirty
+    _mm256_zeroupper();
+#endif
+    for (; i < count; i++)
+        dst[i] = ToF16(src[i]);
+}
+
+#if COLOR_SSE2
+// Moves the exponent and mantissa into place and multiplies by 2^112 to rebias
+// the exponent, which also normalizes denormals exactly, then patches up
+// infinity and NaN. The input is in the low 16 bits of each 32 bit lane.
+static inline __m128 FromF16_SSE2(__m128i h)
+{
+    __m128i a = _mm_and_si128(h, _mm_set1_epi32(0x7FFF));
+    __m128i sign = _mm_slli_epi32(_mm_xor_si128(h, a), 16);
+    __m128 scaled = _mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(a, 13)), _mm_castsi128_ps(_mm_set1_epi32(239 << 23)));
+    __m128i isinfnan = _mm_cmpgt_epi32(a, _mm_set1_epi32(0x7BFF));
+    __m128i isnan = _mm_cmpgt_epi32(a, _mm_set1_epi32(0x7C00));
+    __m128i fixup = _mm_or_si128(_mm_and_si128(isinfnan, _mm_set1_epi32(0x7F800000)), _mm_and_si128(isnan, _mm_set1_epi32(0x400000)));
+    return _mm_or_ps(scaled, _mm_castsi128_ps(_mm_or_si128(sign, fixup)));
+}
+#endif
+
+void FromF16_Span(const u16* src, f32* dst, usize count)
+{
+    usize i = 0;
+#if COLOR_AVX512
+    for (; i + 16 <= count; i += 16)
+        _mm512_storeu_ps(dst + i, _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i*)(src + i))));
+#endif
+#if COLOR_AVX2
+    for (; i + 8 <= count; i += 8)
+        _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(src + i))));
+#elif COLOR_SSE2
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i h = _mm_loadu_si128((const __m128i*)(src + i));
+        _mm_storeu_ps(dst + i, FromF16_SSE2(_mm_unpacklo_epi16(h, _mm_setzero_si128())));
+        _mm_storeu_ps(dst + i + 4, FromF16_SSE2(_mm_unpackhi_epi16(h, _mm_setzero_si128())));
+    }
+#elif COLOR_NEON
+    for (; i + 4 <= count; i += 4)
+        vst1q_f32(dst + i, vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(src + i))));
+#endif
+#if COLOR_AVX2
+    _mm256_zeroupper();
+#endif
+    for (; i < count; i++)
+        dst[i] = FromF16(src[i]);
+}
+
+void Color_rgb_through_mat3_Span(const f32* src, f32* dst, usize pixels, const f32 mat[3][3])
+{
+    usize i = 0;
+#if COLOR_AVX512
+    // Four pixels per iteration, the same way as AVX2 below
+    {
+        const __m512 c0 = _mm512_broadcast_f32x4(_mm_setr_ps(mat[0][0], mat[1][0], mat[2][0], 0.0f));
+        const __m512 c1 = _mm512_broadcast_f32x4(_mm_setr_ps(mat[0][1], mat[1][1], mat[2][1], 0.0f));
+        const __m512 c2 = _mm512_broadcast_f32x4(_mm_setr_ps(mat[0][2], mat[1][2], mat[2][2], 0.0f));
+        for (; i + 4 <= pixels; i += 4)
+        {
+            __m512 p = _mm512_loadu_ps(src + 4 * i);
+            __m512 o = _mm512_mul_ps(c0, _mm512_permute_ps(p, 0x00));
+            o = _mm512_add_ps(o, _mm512_mul_ps(c1, _mm512_permute_ps(p, 0x55)));
+            o = _mm512_add_ps(o, _mm512_mul_ps(c2, _mm512_permute_ps(p, 0xAA)));
+            _mm512_storeu_ps(dst + 4 * i, _mm512_mask_blend_ps(0x8888, o, p));
+        }
+    }
+#endif
+#if COLOR_AVX2
+    // Two RGBA pixels per iteration, each column of the matrix is broadcast to
+    // both halves and multiplied by the matching channel of each pixel
+    const __m256 c0 = _mm256_setr_ps(mat[0][0], mat[1][0], mat[2][0], 0.0f, mat[0][0], mat[1][0], mat[2][0], 0.0f);
+    const __m256 c1 = _mm256_setr_ps(mat[0][1], mat[1][1], mat[2][1], 0.0f, mat[0][1], mat[1][1], mat[2][1], 0.0f);
+    const __m256 c2 = _mm256_setr_ps(mat[0][2], mat[1][2], mat[2][2], 0.0f, mat[0][2], mat[1][2], mat[2][2], 0.0f);
+    for (; i + 2 <= pixels; i += 2)
+    {
+        __m256 p = _mm256_loadu_ps(src + 4 * i);
+        __m256 o = _mm256_mul_ps(c0, _mm256_permute_ps(p, 0x00));
+        o = _mm256_add_ps(o, _mm256_mul_ps(c1, _mm256_permute_ps(p, 0x55)));
+        o = _mm256_add_ps(o, _mm256_mul_ps(c2, _mm256_permute_ps(p, 0xAA)));
+        _mm256_storeu_ps(dst + 4 * i, _mm256_blend_ps(o, p, 0x88));
+    }
+#elif COLOR_SSE2
+    const __m128 c0 = _mm_setr_ps(mat[0][0], mat[1][0], mat[2][0], 0.0f);
+    const __m128 c1 = _mm_setr_ps(mat[0][1], mat[1][1], mat[2][1], 0.0f);
+    const __m128 c2 = _mm_setr_ps(mat[0][2], mat[1][2], mat[2][2], 0.0f);
+#if !COLOR_SSE41
+    const __m128 alpha = _mm_castsi128_ps(_mm_setr_epi32(0, 0, 0, -1));
+#endif
+    for (; i < pixels; i++)
+    {
+        __m128 p = _mm_loadu_ps(src + 4 * i);
+        __m128 o = _mm_mul_ps(c0, _mm_shuffle_ps(p, p, 0x00));
+        o = _mm_add_ps(o, _mm_mul_ps(c1, _mm_shuffle_ps(p, p, 0x55)));
+        o = _mm_add_ps(o, _mm_mul_ps(c2, _mm_shuffle_ps(p, p, 0xAA)));
+        // The alpha lane of o is 0 * the color channels, which is NaN for
+        // infinite ones, so it's masked off rather than just or'd into
+#if COLOR_SSE41
+        _mm_storeu_ps(dst + 4 * i, _mm_blend_ps(o, p, 0x8));
+#else
+        _mm_storeu_ps(dst + 4 * i, _mm_or_ps(_mm_andnot_ps(alpha, o), _mm_and_ps(p, alpha)));
+#endif
+    }
+#endif
+#if COLOR_AVX2
+    _mm256_zeroupper();
+#endif
+    for (; i < pixels; i++)
+    {
+        f32 c[4] = { src[4 * i], src[4 * i + 1], src[4 * i + 2], src[4 * i + 3] };
+        Color_rgb_through_mat3(c, &dst[4 * i], mat);
+        dst[4 * i + 3] = c[3];
+    }
+}
+
+void Color_Transfer_To_PQ_Span(const f32* src, f32* dst, usize pixels)
+{
+    const f32* table = PQ_Table();
+    usize i = 0;
+#if COLOR_AVX512
+    // Four RGBA pixels per iteration, the same way as AVX2 below
+    {
+        const __m512 scale = _mm512_set1_ps(80.0f / 10000.0f);
+        const __m512i mask = _mm512_set1_epi32((1 << pq_table_shift) - 1);
+        const __m512 lerpscale = _mm512_set1_ps(1.0f / (1u << pq_table_shift));
+        for (; i + 4 <= pixels; i += 4)
+        {
+            __m512 c = _mm512_loadu_ps(src + 4 * i);
+            __m512 y = _mm512_max_ps(_mm512_mul_ps(c, scale), _mm512_setzero_ps());
+            y = _mm512_min_ps(y, _mm512_set1_ps(1.0f));
+            __m512i bits = _mm512_castps_si512(y);
+            __m512i index = _mm512_srli_epi32(bits, pq_table_shift);
+            __m512 lerp = _mm512_mul_ps(_mm512_cvtepi32_ps(_mm512_and_si512(bits, mask)), lerpscale);
+            __m512 a = _mm512_i32gather_ps(index, table, 4);
+            __m512 b = _mm512_i32gather_ps(index, table + 1, 4);
+            __m512 o = _mm512_add_ps(a, _mm512_mul_ps(_mm512_sub_ps(b, a), lerp));
+            _mm512_storeu_ps(dst + 4 * i, _mm512_mask_blend_ps(0x8888, o, c));
+        }
+    }
+#endif
+#if COLOR_AVX2
+    // Two RGBA pixels per iteration, alpha lanes are passed through
+    const __m256 scale = _mm256_set1_ps(80.0f / 10000.0f);
+    const __m256i mask = _mm256_set1_epi32((1 << pq_table_shift) - 1);
+    const __m256 lerpscale = _mm256_set1_ps(1.0f / (1u << pq_table_shift));
+    for (; i + 2 <= pixels; i += 2)
+    {
+        __m256 c = _mm256_loadu_ps(src + 4 * i);
+        __m256 y = _mm256_max_ps(_mm256_mul_ps(c, scale), _mm256_setzero_ps());
+        y = _mm256_min_ps(y, _mm256_set1_ps(1.0f));
+        __m256i bits = _mm256_castps_si256(y);
+        __m256i index = _mm256_srli_epi32(bits, pq_table_shift);
+        __m256 lerp = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(bits, mask)), lerpscale);
+        __m256 a = _mm256_i32gather_ps(table, index, 4);
+        __m256 b = _mm256_i32gather_ps(table + 1, index, 4);
+        __m256 o = _mm256_add_ps(a, _mm256_mul_ps(_mm256_sub_ps(b, a), lerp));
+        _mm256_storeu_ps(dst + 4 * i, _mm256_blend_ps(o, c, 0x88));
+    }
+#elif COLOR_SSE2
+    // There's no gather before AVX2, so four pixels are transposed into
+    // channels, the indices and weights worked out a channel at a time and
+    // the table pairs loaded one by one
+    const __m128 scale = _mm_set1_ps(80.0f / 10000.0f);
+    const __m128i mask = _mm_set1_epi32((1 << pq_table_shift) - 1);
+    const __m128 lerpscale = _mm_set1_ps(1.0f / (1u << pq_table_shift));
+    for (; i + 4 <= pixels; i += 4)
+    {
+        __m128 v[4] = { _mm_loadu_ps(src + 4 * i), _mm_loadu_ps(src + 4 * i + 4), _mm_loadu_ps(src + 4 * i + 8), _mm_loadu_ps(src + 4 * i + 12) };
+        _MM_TRANSPOSE4_PS(v[0], v[1], v[2], v[3]);
+        for (u32 c = 0; c < 3; c++)
+        {
+            // max returns its second operand for NaN, so NaN becomes 0
+            __m128 y = _mm_min_ps(_mm_max_ps(_mm_mul_ps(v[c], scale), _mm_setzero_ps()), _mm_set1_ps(1.0f));
+            __m128i bits = _mm_castps_si128(y);
+            alignas(16) u32 index[4];
+            _mm_store_si128((__m128i*)index, _mm_srli_epi32(bits, pq_table_shift));
+            __m128 lerp = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(bits, mask)), lerpscale);
+            __m128 a = _mm_setr_ps(table[index[0]], table[index[1]], table[index[2]], table[index[3]]);
+            __m128 b = _mm_setr_ps(table[index[0] + 1], table[index[1] + 1], table[index[2] + 1], table[index[3] + 1]);
+            v[c] = _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), lerp));
+        }
+        _MM_TRANSPOSE4_PS(v[0], v[1], v[2], v[3]);
+        _mm_storeu_ps(dst + 4 * i, v[0]);
+        _mm_storeu_ps(dst + 4 * i + 4, v[1]);
+        _mm_storeu_ps(dst + 4 * i + 8, v[2]);
+        _mm_storeu_ps(dst + 4 * i + 12, v[3]);
+    }
+#elif COLOR_NEON
+    // The same way as SSE2, vld4q_f32 does the transposing
+    const float32x4_t scale = vdupq_n_f32(80.0f / 10000.0f);
+    const uint32x4_t mask = vdupq_n_u32((1u << pq_table_shift) - 1);
+    for (; i + 4 <= pixels; i += 4)
+    {
+        float32x4x4_t v = vld4q_f32(src + 4 * i);
+        for (u32 c = 0; c < 3; c++)
+        {
+            // NEON's max keeps NaN, so select 0 unless y > 0 like the scalar loop
+            float32x4_t y = vmulq_f32(v.val[c], scale);
+            y = vbslq_f32(vcgtq_f32(y, vdupq_n_f32(0.0f)), y, vdupq_n_f32(0.0f));
+            y = vminq_f32(y, vdupq_n_f32(1.0f));
+            uint32x4_t bits = vreinterpretq_u32_f32(y);
+            u32 index[4];
+            vst1q_u32(index, vshrq_n_u32(bits, pq_table_shift));
+            float32x4_t lerp = vmulq_n_f32(vcvtq_f32_u32(vandq_u32(bits, mask)), 1.0f / (1u << pq_table_shift));
+            f32 pa[4] = { table[index[0]], table[index[1]], table[index[2]], table[index[3]] };
+            f32 pb[4] = { table[index[0] + 1], table[index[1] + 1], table[index[2] + 1], table[index[3] + 1] };
+            float32x4_t a = vld1q_f32(pa);
+            v.val[c] = vaddq_f32(a, vmulq_f32(vsubq_f32(vld1q_f32(pb), a), lerp));
+        }
+        vst4q_f32(dst + 4 * i, v);
+    }
+#endif
+    for (; i < pixels; i++)
+    {
+        const f32* c = src + 4 * i;
+        f32* o = dst + 4 * i;
+        f32 a = c[3];
+        for (u32 j = 0; j < 3; j++)
+            o[j] = PQ_Table_Lookup(table, c[j]);
+        o[3] = a;
+    }
+}
+
+// Interpolates the color channels of count RGBA pixels through an EOTF table,
+// clamping the input to 0..1 (NaN to 0), alpha is passed through
+static void EOTF_Span(const f32* table, const f32* src, f32* dst, usize pixels)
+{
+    usize i = 0;
+#if COLOR_AVX512
+    {
+        const __m512i mask = _mm512_set1_epi32((1 << eotf_table_shift) - 1);
+        const __m512 lerpscale = _mm512_set1_ps(1.0f / (1u << eotf_table_shift));
+        for (; i + 4 <= pixels; i += 4)
+        {
+            __m512 c = _mm512_loadu_ps(src + 4 * i);
+            __m512 e = _mm512_min_ps(_mm512_max_ps(c, _mm512_setzero_ps()), _mm512_set1_ps(1.0f));
+            __m512i bits = _mm512_castps_si512(e);
+            __m512i index = _mm512_srli_epi32(bits, eotf_table_shift);
+            __m512 lerp = _mm512_mul_ps(_mm512_cvtepi32_ps(_mm512_and_si512(bits, mask)), lerpscale);
+            __m512 a = _mm512_i32gather_ps(index, table, 4);
+            __m512 b = _mm512_i32gather_ps(index, table + 1, 4);
+            __m512 o = _mm512_add_ps(a, _mm512_mul_ps(_mm512_sub_ps(b, a), lerp));
+            _mm512_storeu_ps(dst + 4 * i, _mm512_mask_blend_ps(0x8888, o, c));
+        }
+    }
+#endif
+#if COLOR_AVX2
+    const __m256i mask = _mm256_set1_epi32((1 << eotf_table_shift) - 1);
+    const __m256 lerpscale = _mm256_set1_ps(1.0f / (1u << eotf_table_shift));
+    for (; i + 2 <= pixels; i += 2)
+    {
+        __m256 c = _mm256_loadu_ps(src + 4 * i);
+        __m256 e = _mm256_min_ps(_mm256_max_ps(c, _mm256_setzero_ps()), _mm256_set1_ps(1.0f));
+        __m256i bits = _mm256_castps_si256(e);
+        __m256i index = _mm256_srli_epi32(bits, eotf_table_shift);
+        __m256 lerp = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(bits, mask)), lerpscale);
+        __m256 a = _mm256_i32gather_ps(table, index, 4);
+        __m256 b = _mm256_i32gather_ps(table + 1, index, 4);
+        __m256 o = _mm256_add_ps(a, _mm256_mul_ps(_mm256_sub_ps(b, a), lerp));
+        _mm256_storeu_ps(dst + 4 * i, _mm256_blend_ps(o, c, 0x88));
+    }
+#endif
+    for (; i < pixels; i++)
+    {
+        f32 a = src[4 * i + 3];
+        for (u32 j = 0; j < 3; j++)
+        {
+            f32 e = src[4 * i + j];
+            e = e > 0.0f ? e : 0.0f;
+            e = e < 1.0f ? e : 1.0f;
+            u32 bits;
+            memcpy(&bits, &e, sizeof(bits));
+            u32 k = bits >> eotf_table_shift;
+            f32 lerp = (bits & ((1u << eotf_table_shift) - 1)) * (1.0f / (1u << eotf_table_shift));
+            dst[4 * i + j] = table[k] + (table[k + 1] - table[k]) * lerp;
+        }
+        dst[4 * i + 3] = a;
+    }
+}
+
+void Color_Transfer_From_PQ_Span(const f32* src, f32* dst, usize pixels)
+{
+    EOTF_Span(PQ_EOTF_Table(), src, dst, pixels);
+}
+
+void Color_Transfer_From_sRGB_Span(const f32* src, f32* dst, usize pixels)
+{
+    EOTF_Span(sRGB_EOTF_Table(), src, dst, pixels);
+}
+
+// Shared by the BGRA8 and RGBA8 encoders, which only differ in byte order
+template <bool rgba> static void Encode_sRGB8_Span(const f32* src, u32* dst, usize pixels)
+{
+    const sRGB8_Tables& t = sRGB8_Table();
+    usize i = 0;
+#if COLOR_AVX2
+    // Two RGBA pixels per iteration, the alpha lanes are only scaled and
+    // rounded like Pixel_To_Int does
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256i base = _mm256_set1_epi32(srgb8_bucket_base);
+    // Pick byte 0 of dwords 2, 1, 0, 3 (B, G, R, A), or 0, 1, 2, 3 for RGBA,
+    // into the low dword of each 128-bit half
+    const char r = rgba ? 0 : 8;
+    const char b = rgba ? 8 : 0;
+    const __m256i order = _mm256_setr_epi8(
+        r, 4, b, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        r, 4, b, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    for (; i + 2 <= pixels; i += 2)
+    {
+        __m256 c = _mm256_loadu_ps(src + 4 * i);
+        // min first so NaN becomes 1 like the scalar clamp
+        __m256 f = _mm256_max_ps(_mm256_min_ps(c, one), zero);
+        __m256i bits = _mm256_castps_si256(f);
+        __m256i index = _mm256_srli_epi32(_mm256_sub_epi32(bits, base), srgb8_bucket_shift);
+        __m256 tiny = _mm256_cmp_ps(f, _mm256_set1_ps(1.0f / 8192.0f), _CMP_LT_OQ);
+        index = _mm256_andnot_si256(_mm256_castps_si256(tiny), index);
+        __m256i code = _mm256_i32gather_epi32((const int*)t.bucket, index, 4);
+        __m256 next = _mm256_i32gather_ps(t.threshold + 1, code, 4);
+        // The compare mask is -1 where we need to step up to the next code
+        code = _mm256_sub_epi32(code, _mm256_castps_si256(_mm256_cmp_ps(f, next, _CMP_GE_OQ)));
+        code = _mm256_andnot_si256(_mm256_castps_si256(tiny), code);
+
+        __m256 a = _mm256_floor_ps(_mm256_add_ps(_mm256_mul_ps(c, _mm256_set1_ps(255.0f)), _mm256_set1_ps(0.5f)));
+        a = _mm256_max_ps(_mm256_min_ps(a, _mm256_set1_ps(255.0f)), zero);
+        code = _mm256_blend_epi32(code, _mm256_cvttps_epi32(a), 0x88);
+
+        code = _mm256_shuffle_epi8(code, order);
+        code = _mm256_permutevar8x32_epi32(code, _mm256_setr_epi32(0, 4, 0, 0, 0, 0, 0, 0));
+        _mm_storel_epi64((__m128i*)(dst + i), _mm256_castsi256_si128(code));
+    }
+#endif
+    for (; i < pixels; i++)
+    {
+        const f32* c = src + 4 * i;
+        f32 a[4] = { 0.0f, 0.0f, 0.0f, c[3] };
+        Pixel_To_Int(a, 255.0f, 0.0f, 255.0f);
+        dst[i] =
+            sRGB8_Lookup(t, c[rgba ? 0 : 2]) * 0x1 +
+            sRGB8_Lookup(t, c[1]) * 0x100 +
+            sRGB8_Lookup(t, c[rgba ? 2 : 0]) * 0x10000 +
+            (u32)a[3] * 0x1000000;
+    }
+}
+
+void Color_Encode_BGRA8_sRGB_Span(const f32* src, u32* dst, usize pixels)
+{
+    Encode_sRGB8_Span<false>(src, dst, pixels);
+}
+
+void Color_Encode_RGBA8_sRGB_Span(const f32* src, u32* dst, usize pixels)
+{
+    Encode_sRGB8_Span<true>(src, dst, pixels);
+}
+
+#if COLOR_AVX2
+// Transposes 8 pixels held as one vector per channel into 8 RGBA pixels
+static inline void Store_RGBA_AVX2(f32* dst, __m256 r, __m256 g, __m256 b, __m256 a)
+{
+    __m256 rg0 = _mm256_unpacklo_ps(r, g);
+    __m256 rg1 = _mm256_unpackhi_ps(r, g);
+    __m256 ba0 = _mm256_unpacklo_ps(b, a);
+    __m256 ba1 = _mm256_unpackhi_ps(b, a);
+    // Pixels 0 and 4, 1 and 5, 2 and 6, 3 and 7
+    __m256 p04 = _mm256_shuffle_ps(rg0, ba0, 0x44);
+    __m256 p15 = _mm256_shuffle_ps(rg0, ba0, 0xEE);
+    __m256 p26 = _mm256_shuffle_ps(rg1, ba1, 0x44);
+    __m256 p37 = _mm256_shuffle_ps(rg1, ba1, 0xEE);
+    _mm256_storeu_ps(dst + 0, _mm256_permute2f128_ps(p04, p15, 0x20));
+    _mm256_storeu_ps(dst + 8, _mm256_permute2f128_ps(p26, p37, 0x20));
+    _mm256_storeu_ps(dst + 16, _mm256_permute2f128_ps(p04, p15, 0x31));
+    _mm256_storeu_ps(dst + 24, _mm256_permute2f128_ps(p26, p37, 0x31));
+}
+
+// Transposes 8 RGBA pixels into one vector per channel, the inverse of
+// Store_RGBA_AVX2. Pixels 0 to 3 go in the low half and 4 to 7 in the high
+// half, so each half is an SSE style 4x4 transpose.
+static inline void Load_RGBA_AVX2(const f32* src, __m256& r, __m256& g, __m256& b, __m256& a)
+{
+    __m256 p04 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(src + 0)), _mm_loadu_ps(src + 16), 1);
+    __m256 p15 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(src + 4)), _mm_loadu_ps(src + 20), 1);
+    __m256 p26 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(src + 8)), _mm_loadu_ps(src + 24), 1);
+    __m256 p37 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(src + 12)), _mm_loadu_ps(src + 28), 1);
+    __m256 rg01 = _mm256_unpacklo_ps(p04, p15);
+    __m256 ba01 = _mm256_unpackhi_ps(p04, p15);
+    __m256 rg23 = _mm256_unpacklo_ps(p26, p37);
+    __m256 ba23 = _mm256_unpackhi_ps(p26, p37);
+    r = _mm256_shuffle_ps(rg01, rg23, 0x44);
+    g = _mm256_shuffle_ps(rg01, rg23, 0xEE);
+    b = _mm256_shuffle_ps(ba01, ba23, 0x44);
+    a = _mm256_shuffle_ps(ba01, ba23, 0xEE);
+}
+#endif
+
+void Color_Decode_RGB10A2_Span(const u32* src, f32* dst, usize pixels, const f32* table)
+{
+    usize i = 0;
+#if COLOR_AVX2
+    const __m256i mask = _mm256_set1_epi32(0x3FF);
+    for (; i + 8 <= pixels; i += 8)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(src + i));
+        __m256 r = _mm256_i32gather_ps(table, _mm256_and_si256(v, mask), 4);
+        __m256 g = _mm256_i32gather_ps(table, _mm256_and_si256(_mm256_srli_epi32(v, 10), mask), 4);
+        __m256 b = _mm256_i32gather_ps(table, _mm256_and_si256(_mm256_srli_epi32(v, 20), mask), 4);
+        __m256 a = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(v, 30)), _mm256_set1_ps(1.0f / 3.0f));
+        Store_RGBA_AVX2(dst + 4 * i, r, g, b, a);
+    }
+#endif
+    for (; i < pixels; i++)
+    {
+        u32 v = src[i];
+        dst[4 * i + 0] = table[v & 0x3FF];
+        dst[4 * i + 1] = table[(v >> 10) & 0x3FF];
+        dst[4 * i + 2] = table[(v >> 20) & 0x3FF];
+        dst[4 * i + 3] = (f32)(v >> 30) * (1.0f / 3.0f);
+    }
+}
+
+// Shared by the BGRA8 and RGBA8 decoders, which only differ in byte order
+template <bool rgba> static void Decode_8888_Span(const u32* src, f32* dst, usize pixels, const f32* table)
+{
+    constexpr u32 rshift = rgba ? 0 : 16;
+    constexpr u32 bshift = rgba ? 16 : 0;
+    usize i = 0;
+#if COLOR_AVX2
+    const __m256i mask = _mm256_set1_epi32(0xFF);
+    for (; i + 8 <= pixels; i += 8)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(src + i));
+        __m256 b = _mm256_i32gather_ps(table, _mm256_and_si256(_mm256_srli_epi32(v, bshift), mask), 4);
+        __m256 g = _mm256_i32gather_ps(table, _mm256_and_si256(_mm256_srli_epi32(v, 8), mask), 4);
+        __m256 r = _mm256_i32gather_ps(table, _mm256_and_si256(_mm256_srli_epi32(v, rshift), mask), 4);
+        __m256 a = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(v, 24)), _mm256_set1_ps(1.0f / 255.0f));
+        Store_RGBA_AVX2(dst + 4 * i, r, g, b, a);
+    }
+#endif
+    for (; i < pixels; i++)
+    {
+        u32 v = src[i];
+        dst[4 * i + 0] = table[(v >> rshift) & 0xFF];
+        dst[4 * i + 1] = table[(v >> 8) & 0xFF];
+        dst[4 * i + 2] = table[(v >> bshift) & 0xFF];
+        dst[4 * i + 3] = (f32)(v >> 24) * (1.0f / 255.0f);
+    }
+}
+
+void Color_Decode_BGRA8_Span(const u32* src, f32* dst, usize pixels, const f32* table)
+{
+    Decode_8888_Span<false>(src, dst, pixels, table);
+}
+
+void Color_Decode_RGBA8_sRGB_Span(const u32* src, f32* dst, usize pixels)
+{
+    Decode_8888_Span<true>(src, dst, pixels, sRGB8_EOTF_Table());
+}
+
+void Color_Unpack_RGB10A2_Span(const u32* src, f32* dst, usize pixels)
+{
+    usize i = 0;
+#if COLOR_AVX2
+    const __m256i mask = _mm256_set1_epi32(0x3FF);
+    const __m256 scale = _mm256_set1_ps(1.0f / 1023.0f);
+    for (; i + 8 <= pixels; i += 8)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(src + i));
+        __m256 r = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(v, mask)), scale);
+        __m256 g = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(v, 10), mask)), scale);
+        __m256 b = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(v, 20), mask)), scale);
+        __m256 a = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(v, 30)), _mm256_set1_ps(1.0f / 3.0f));
+        Store_RGBA_AVX2(dst + 4 * i, r, g, b, a);
+    }
+#elif COLOR_SSE2
+    const __m128i mask = _mm_set1_epi32(0x3FF);
+    const __m128 scale = _mm_set1_ps(1.0f / 1023.0f);
+    for (; i + 4 <= pixels; i += 4)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128 r = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(v, mask)), scale);
+        __m128 g = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(v, 10), mask)), scale);
+        __m128 b = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(v, 20), mask)), scale);
+        __m128 a = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(v, 30)), _mm_set1_ps(1.0f / 3.0f));
+        _MM_TRANSPOSE4_PS(r, g, b, a);
+        _mm_storeu_ps(dst + 4 * i + 0, r);
+        _mm_storeu_ps(dst + 4 * i + 4, g);
+        _mm_storeu_ps(dst + 4 * i + 8, b);
+        _mm_storeu_ps(dst + 4 * i + 12, a);
+    }
+#elif COLOR_NEON
+    const uint32x4_t mask = vdupq_n_u32(0x3FF);
+    for (; i + 4 <= pixels; i += 4)
+    {
+        uint32x4_t v = vld1q_u32(src + i);
+        float32x4x4_t o;
+        o.val[0] = vmulq_n_f32(vcvtq_f32_u32(vandq_u32(v, mask)), 1.0f / 1023.0f);
+        o.val[1] = vmulq_n_f32(vcvtq_f32_u32(vandq_u32(vshrq_n_u32(v, 10), mask)), 1.0f / 1023.0f);
+        o.val[2] = vmulq_n_f32(vcvtq_f32_u32(vandq_u32(vshrq_n_u32(v, 20), mask)), 1.0f / 1023.0f);
+        o.val[3] = vmulq_n_f32(vcvtq_f32_u32(vshrq_n_u32(v, 30)), 1.0f / 3.0f);
+        vst4q_f32(dst + 4 * i, o);
+    }
+#endif
+    for (; i < pixels; i++)
+    {
+        u32 v = src[i];
+        dst[4 * i + 0] = (f32)(v & 0x3FF) * (1.0f / 1023.0f);
+        dst[4 * i + 1] = (f32)((v >> 10) & 0x3FF) * (1.0f / 1023.0f);
+        dst[4 * i + 2] = (f32)((v >> 20) & 0x3FF) * (1.0f / 1023.0f);
+        dst[4 * i + 3] = (f32)(v >> 30) * (1.0f / 3.0f);
+    }
+}
+
+void Color_Unpack_BGRA8_Span(const u32* src, f32* dst, usize pixels)
+{
+    usize i = 0;
+#if COLOR_AVX2
+    const __m256i mask = _mm256_set1_epi32(0xFF);
+    const __m256 scale = _mm256_set1_ps(1.0f / 255.0f);
+    for (; i + 8 <= pixels; i += 8)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(src + i));
+        __m256 b = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(v, mask)), scale);
+        __m256 g = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(v, 8), mask)), scale);
+        __m256 r = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(v, 16), mask)), scale);
+        __m256 a = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(v, 24)), scale);
+        Store_RGBA_AVX2(dst + 4 * i, r, g, b, a);
+    }
+#elif COLOR_SSE2
+    const __m128i mask = _mm_set1_epi32(0xFF);
+    const __m128 scale = _mm_set1_ps(1.0f / 255.0f);
+    for (; i + 4 <= pixels; i += 4)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128 b = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(v, mask)), scale);
+        __m128 g = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(v, 8), mask)), scale);
+        __m128 r = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(v, 16), mask)), scale);
+        __m128 a = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(v, 24)), scale);
+        _MM_TRANSPOSE4_PS(r, g, b, a);
+        _mm_storeu_ps(dst + 4 * i + 0, r);
+        _mm_storeu_ps(dst + 4 * i + 4, g);
+        _mm_storeu_ps(dst + 4 * i + 8, b);
+        _mm_storeu_ps(dst + 4 * i + 12, a);
+    }
+#elif COLOR_NEON
+    for (; i + 16 <= pixels; i += 16)
+    {
+        // De-interleaves B, G, R and A bytes into separate registers
+        uint8x16x4_t v = vld4q_u8((const u8*)(src + i));
+        const u32 order[4] = { 2, 1, 0, 3 };
+        for (u32 q = 0; q < 4; q++)
+        {
+            float32x4x4_t o;
+            for (u32 c = 0; c < 4; c++)
+            {
+                uint8x16_t bytes = v.val[order[c]];
+                uint16x8_t wide = q < 2 ? vmovl_u8(vget_low_u8(bytes)) : vmovl_u8(vget_high_u8(bytes));
+                uint32x4_t words = q & 1 ? vmovl_u16(vget_high_u16(wide)) : vmovl_u16(vget_low_u16(wide));
+                o.val[c] = vmulq_n_f32(vcvtq_f32_u32(words), 1.0f / 255.0f);
+            }
+            vst4q_f32(dst + 4 * (i + 4 * q), o);
+        }
+    }
+#endif
+    for (; i < pixels; i++)
+    {
+        u32 v = src[i];
+        dst[4 * i + 0] = (f32)((v >> 16) & 0xFF) * (1.0f / 255.0f);
+        dst[4 * i + 1] = (f32)((v >> 8) & 0xFF) * (1.0f / 255.0f);
+        dst[4 * i + 2] = (f32)(v & 0xFF) * (1.0f / 255.0f);
+        dst[4 * i + 3] = (f32)(v >> 24) * (1.0f / 255.0f);
+    }
+}
+
+#if COLOR_AVX2 || COLOR_SSE2
+// Pixel_To_Int(c, scale, 0, scale) for 4 values. The clamp is done before the
+// truncation, which gives the same result as flooring first, and min comes
+// first so NaN becomes scale like the scalar clamp.
+static inline __m128i To_Int_SSE2(__m128 c, __m128 scale)
+{
+    __m128 f = _mm_add_ps(_mm_mul_ps(c, scale), _mm_set1_ps(0.5f));
+    f = _mm_max_ps(_mm_min_ps(f, scale), _mm_setzero_ps());
+    return _mm_cvttps_epi32(f);
+}
+#endif
+
+#if COLOR_AVX2
+static inline __m256i To_Int_AVX2(__m256 c, __m256 scale)
+{
+    __m256 f = _mm256_add_ps(_mm256_mul_ps(c, scale), _mm256_set1_ps(0.5f));
+    f = _mm256_max_ps(_mm256_min_ps(f, scale), _mm256_setzero_ps());
+    return _mm256_cvttps_epi32(f);
+}
+#endif
+
+void Color_Pack_RGB10A2_Span(const f32* src, u32* dst, usize pixels)
+{
+    usize i = 0;
+#if COLOR_AVX2
+    const __m256 scale = _mm256_set1_ps(1023.0f);
+    const __m256 alphaScale = _mm256_set1_ps(3.0f);
+    for (; i + 8 <= pixels; i += 8)
+    {
+        __m256 r, g, b, a;
+        Load_RGBA_AVX2(src + 4 * i, r, g, b, a);
+        __m256i v = To_Int_AVX2(r, scale);
+        v = _mm256_or_si256(v, _mm256_slli_epi32(To_Int_AVX2(g, scale), 10));
+        v = _mm256_or_si256(v, _mm256_slli_epi32(To_Int_AVX2(b, scale), 20));
+        v = _mm256_or_si256(v, _mm256_slli_epi32(To_Int_AVX2(a, alphaScale), 30));
+        _mm256_storeu_si256((__m256i*)(dst + i), v);
+    }
+#elif COLOR_SSE2
+    const __m128 scale = _mm_set1_ps(1023.0f);
+    const __m128 alphaScale = _mm_set1_ps(3.0f);
+    for (; i + 4 <= pixels; i += 4)
+    {
+        __m128 r = _mm_loadu_ps(src + 4 * i + 0);
+        __m128 g = _mm_loadu_ps(src + 4 * i + 4);
+        __m128 b = _mm_loadu_ps(src + 4 * i + 8);
+        __m128 a = _mm_loadu_ps(src + 4 * i + 12);
+        _MM_TRANSPOSE4_PS(r, g, b, a);
+        __m128i v = To_Int_SSE2(r, scale);
+        v = _mm_or_si128(v, _mm_slli_epi32(To_Int_SSE2(g, scale), 10));
+        v = _mm_or_si128(v, _mm_slli_epi32(To_Int_SSE2(b, scale), 20));
+        v = _mm_or_si128(v, _mm_slli_epi32(To_Int_SSE2(a, alphaScale), 30));
+        _mm_storeu_si128((__m128i*)(dst + i), v);
+    }
+#endif
+    for (; i < pixels; i++)
+    {
+        f32 t[4] = { src[4 * i], src[4 * i + 1], src[4 * i + 2], src[4 * i + 3] };
+        f32 a[4] = { src[4 * i + 3], 0.0f, 0.0f, 0.0f };
+        Pixel_To_Int(t, 1023.0f, 0.0f, 1023.0f);
+        Pixel_To_Int(a, 3.0f, 0.0f, 3.0f);
+        dst[i] =
+            (u32)t[0] * 0x1 +
+            (u32)t[1] * 0x400 +
+            (u32)t[2] * 0x100000 +
+            (u32)a[0] * 0x40000000;
+    }
+}
+
+void Color_Pack_BGRA8_Span(const f32* src, u32* dst, usize pixels)
+{
+    usize i = 0;
+#if COLOR_AVX2 || COLOR_SSE2
+    // Swap R and B in each pixel, then saturating packs narrow the codes to
+    // bytes in memory order
+    const __m128 scale = _mm_set1_ps(255.0f);
+    for (; i + 4 <= pixels; i += 4)
+    {
+        __m128i p[4];
+        for (u32 j = 0; j < 4; j++)
+            p[j] = _mm_shuffle_epi32(To_Int_SSE2(_mm_loadu_ps(src + 4 * (i + j)), scale), _MM_SHUFFLE(3, 0, 1, 2));
+        __m128i lo = _mm_packs_epi32(p[0], p[1]);
+        __m128i hi = _mm_packs_epi32(p[2], p[3]);
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(lo, hi));
+    }
+#endif
+    for (; i < pixels; i++)
+    {
+        f32 c[4] = { src[4 * i], src[4 * i + 1], src[4 * i + 2], src[4 * i + 3] };
+        Pixel_To_Int(c, 255.0f, 0.0f, 255.0f);
+        dst[i] =
+            (u32)c[2] * 0x1 +
+            (u32)c[1] * 0x100 +
+            (u32)c[0] * 0x10000 +
+            (u32)c[3] * 0x1000000;
+    }
+}
+
+void Color_Pack_RGBA16_Span(const f32* src, u16* dst, usize pixels)
+{
+    usize i = 0;
+#if COLOR_AVX2 || COLOR_SSE41
+    const __m128 scale = _mm_set1_ps(65535.0f);
+    for (; i + 2 <= pixels; i += 2)
+    {
+        __m128i lo = To_Int_SSE2(_mm_loadu_ps(src + 4 * i), scale);
+        __m128i hi = To_Int_SSE2(_mm_loadu_ps(src + 4 * i + 4), scale);
+        _mm_storeu_si128((__m128i*)(dst + 4 * i), _mm_packus_epi32(lo, hi));
+    }
+#elif COLOR_SSE2
+    // SSE2 only has a signed 32->16 pack, so offset the codes into the signed
+    // range and flip the top bit back afterwards
+    const __m128 scale = _mm_set1_ps(65535.0f);
+    const __m128i offset = _mm_set1_epi32(32768);
+    for (; i + 2 <= pixels; i += 2)
+    {
+        __m128i lo = _mm_sub_epi32(To_Int_SSE2(_mm_loadu_ps(src + 4 * i), scale), offset);
+        __m128i hi = _mm_sub_epi32(To_Int_SSE2(_mm_loadu_ps(src + 4 * i + 4), scale), offset);
+        _mm_storeu_si128((__m128i*)(dst + 4 * i), _mm_xor_si128(_mm_packs_epi32(lo, hi), _mm_set1_epi16(-32768)));
+    }
+#endif
+    for (; i < pixels; i++)
+    {
+        f32 c[4] = { src[4 * i], src[4 * i + 1], src[4 * i + 2], src[4 * i + 3] };
+        Pixel_To_Int(c, 65535.0f, 0.0f, 65535.0f);
+        for (u32 j = 0; j < 4; j++)
+            dst[4 * i + j] = (u16)c[j];
+    }
+}
+
+void Color_Unpack_RGBA16_Span(const u16* src, f32* dst, usize pixels)
+{
+    usize i = 0;
+#if COLOR_AVX2 || COLOR_SSE2
+    const __m128 scale = _mm_set1_ps(1.0f / 65535.0f);
+    for (; i + 2 <= pixels; i += 2)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + 4 * i));
+        _mm_storeu_ps(dst + 4 * i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(v, _mm_setzero_si128())), scale));
+        _mm_storeu_ps(dst + 4 * i + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(v, _mm_setzero_si128())), scale));
+    }
+#endif
+    for (usize j = 4 * i; j < 4 * pixels; j++)
+        dst[j] = (f32)src[j] * (1.0f / 65535.0f);
+}
+
+#if COLOR_AVX2
+// Same cases as ToUFloat, computed for all lanes and then selected
+template <u32 mbits> static inline __m256i ToUFloat_AVX2(__m256 f)
+{
+    constexpr u32 shift = 23 - mbits;
+    const __m256i magic = _mm256_set1_epi32((127 + 9 - mbits) << 23);
+    __m256i i = _mm256_castps_si256(f);
+    __m256i a = _mm256_and_si256(i, _mm256_set1_epi32(0x7FFFFFFF));
+    __m256i nan = _mm256_or_si256(_mm256_set1_epi32((0x1F << mbits) | (1 << (mbits - 1))), _mm256_and_si256(_mm256_srli_epi32(a, shift), _mm256_set1_epi32((1 << mbits) - 1)));
+    __m256i tiny = _mm256_sub_epi32(_mm256_castps_si256(_mm256_add_ps(_mm256_castsi256_ps(a), _mm256_castsi256_ps(magic))), magic);
+    __m256i odd = _mm256_and_si256(_mm256_srli_epi32(a, shift), _mm256_set1_epi32(1));
+    __m256i normal = _mm256_srli_epi32(_mm256_add_epi32(_mm256_add_epi32(a, _mm256_set1_epi32((1 << (shift - 1)) - 1 - 0x38000000)), odd), shift);
+    __m256i n = _mm256_blendv_epi8(normal, tiny, _mm256_cmpgt_epi32(_mm256_set1_epi32(0x38800000), a));
+    n = _mm256_blendv_epi8(n, _mm256_set1_epi32(0x1F << mbits), _mm256_cmpgt_epi32(a, _mm256_set1_epi32(0x47800000 - 1)));
+    n = _mm256_andnot_si256(_mm256_srai_epi32(i, 31), n);
+    return _mm256_blendv_epi8(n, nan, _mm256_cmpgt_epi32(a, _mm256_set1_epi32(0x7F800000)));
+}
+
+// Like FromF16_SSE2, moves the bits into place and multiplies by 2^112, which
+// also normalizes denormals, then patches up infinity and NaN
+template <u32 mbits> static inline __m256 FromUFloat_AVX2(__m256i v)
+{
+    __m256 scaled = _mm256_mul_ps(_mm256_castsi256_ps(_mm256_slli_epi32(v, 23 - mbits)), _mm256_castsi256_ps(_mm256_set1_epi32(239 << 23)));
+    __m256i isinfnan = _mm256_cmpgt_epi32(v, _mm256_set1_epi32((0x1F << mbits) - 1));
+    return _mm256_or_ps(scaled, _mm256_castsi256_ps(_mm256_and_si256(isinfnan, _mm256_set1_epi32(0x7F800000))));
+}
+#elif COLOR_SSE2
+template <u32 mbits> static inline __m128i ToUFloat_SSE2(__m128 f)
+{
+    constexpr u32 shift = 23 - mbits;
+    const __m128i magic = _mm_set1_epi32((127 + 9 - mbits) << 23);
+    __m128i i = _mm_castps_si128(f);
+    __m128i a = _mm_and_si128(i, _mm_set1_epi32(0x7FFFFFFF));
+    __m128i nan = _mm_or_si128(_mm_set1_epi32((0x1F << mbits) | (1 << (mbits - 1))), _mm_and_si128(_mm_srli_epi32(a, shift), _mm_set1_epi32((1 << mbits) - 1)));
+    __m128i tiny = _mm_sub_epi32(_mm_castps_si128(_mm_add_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(magic))), magic);
+    __m128i odd = _mm_and_si128(_mm_srli_epi32(a, shift), _mm_set1_epi32(1));
+    __m128i normal = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(a, _mm_set1_epi32((1 << (shift - 1)) - 1 - 0x38000000)), odd), shift);
+    __m128i istiny = _mm_cmplt_epi32(a, _mm_set1_epi32(0x38800000));
+    __m128i isbig = _mm_cmpgt_epi32(a, _mm_set1_epi32(0x47800000 - 1));
+    __m128i isnan = _mm_cmpgt_epi32(a, _mm_set1_epi32(0x7F800000));
+    __m128i n = Select_SSE2(istiny, tiny, normal);
+    n = Select_SSE2(isbig, _mm_set1_epi32(0x1F << mbits), n);
+    n = _mm_andnot_si128(_mm_srai_epi32(i, 31), n);
+    return Select_SSE2(isnan, nan, n);
+}
+
+template <u32 mbits> static inline __m128 FromUFloat_SSE2(__m128i v)
+{
+    __m128 scaled = _mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(v, 23 - mbits)), _mm_castsi128_ps(_mm_set1_epi32(239 << 23)));
+    __m128i isinfnan = _mm_cmpgt_epi32(v, _mm_set1_epi32((0x1F << mbits) - 1));
+    return _mm_or_ps(scaled, _mm_castsi128_ps(_mm_and_si128(isinfnan, _mm_set1_epi32(0x7F800000))));
+}
+#endif
+
+void Color_Pack_R11G11B10F_Span(const f32* src, u32* dst, usize pixels)
+{
+    usize i = 0;
+#if COLOR_AVX2
+    for (; i + 8 <= pixels; i += 8)
+    {
+        __m256 r, g, b, a;
+        Load_RGBA_AVX2(src + 4 * i, r, g, b, a);
+        __m256i v = ToUFloat_AVX2<6>(r);
+        v = _mm256_or_si256(v, _mm256_slli_epi32(ToUFloat_AVX2<6>(g), 11));
+        v = _mm256_or_si256(v, _mm256_slli_epi32(ToUFloat_AVX2<5>(b), 22));
+        _mm256_storeu_si256((__m256i*)(dst + i), v);
+    }
+#elif COLOR_SSE2
+    for (; i + 4 <= pixels; i += 4)
+    {
+        __m128 r = _mm_loadu_ps(src + 4 * i + 0);
+        __m128 g = _mm_loadu_ps(src + 4 * i + 4);
+        __m128 b = _mm_loadu_ps(src + 4 * i + 8);
+        __m128 a = _mm_loadu_ps(src + 4 * i + 12);
+        _MM_TRANSPOSE4_PS(r, g, b, a);
+        __m128i v = ToUFloat_SSE2<6>(r);
+        v = _mm_or_si128(v, _mm_slli_epi32(ToUFloat_SSE2<6>(g), 11));
+        v = _mm_or_si128(v, _mm_slli_epi32(ToUFloat_SSE2<5>(b), 22));
+        _mm_storeu_si128((__m128i*)(dst + i), v);
+    }
+#endif
+    for (; i < pixels; i++)
+        dst[i] = ToUFloat<6>(src[4 * i]) | ToUFloat<6>(src[4 * i + 1]) << 11 | ToUFloat<5>(src[4 * i + 2]) << 22;
+}
+
+void Color_Unpack_R11G11B10F_Span(const u32* src, f32* dst, usize pixels)
+{
+    usize i = 0;
+#if COLOR_AVX2
+    const __m256i mask = _mm256_set1_epi32(0x7FF);
+    for (; i + 8 <= pixels; i += 8)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(src + i));
+        __m256 r = FromUFloat_AVX2<6>(_mm256_and_si256(v, mask));
+        __m256 g = FromUFloat_AVX2<6>(_mm256_and_si256(_mm256_srli_epi32(v, 11), mask));
+        __m256 b = FromUFloat_AVX2<5>(_mm256_srli_epi32(v, 22));
+        Store_RGBA_AVX2(dst + 4 * i, r, g, b, _mm256_set1_ps(1.0f));
+    }
+#elif COLOR_SSE2
+    const __m128i mask = _mm_set1_epi32(0x7FF);
+    for (; i + 4 <= pixels; i += 4)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128 r = FromUFloat_SSE2<6>(_mm_and_si128(v, mask));
+        __m128 g = FromUFloat_SSE2<6>(_mm_and_si128(_mm_srli_epi32(v, 11), mask));
+        __m128 b = FromUFloat_SSE2<5>(_mm_srli_epi32(v, 22));
+        __m128 a = _mm_set1_ps(1.0f);
+        _MM_TRANSPOSE4_PS(r, g, b, a);
+        _mm_storeu_ps(dst + 4 * i + 0, r);
+        _mm_storeu_ps(dst + 4 * i + 4, g);
+        _mm_storeu_ps(dst + 4 * i + 8, b);
+        _mm_storeu_ps(dst + 4 * i + 12, a);
+    }
+#endif
+    for (; i < pixels; i++)
+    {
+        u32 v = src[i];
+        dst[4 * i + 0] = FromUFloat<6>(v & 0x7FF);
+        dst[4 * i + 1] = FromUFloat<6>((v >> 11) & 0x7FF);
+        dst[4 * i + 2] = FromUFloat<5>(v >> 22);
+        dst[4 * i + 3] = 1.0f;
+    }
+}
+
+void Color_Pack_RGB9E5_Span(const f32* src, u32* dst, usize pixels)
+{
+    usize i = 0;
+#if COLOR_AVX2
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 high = _mm256_set1_ps(rgb9e5_max);
+    for (; i + 8 <= pixels; i += 8)
+    {
+        __m256 r, g, b, a;
+        Load_RGBA_AVX2(src + 4 * i, r, g, b, a);
+        // max first so NaN becomes 0
+        r = _mm256_min_ps(_mm256_max_ps(r, zero), high);
+        g = _mm256_min_ps(_mm256_max_ps(g, zero), high);
+        b = _mm256_min_ps(_mm256_max_ps(b, zero), high);
+        __m256 m = _mm256_max_ps(_mm256_max_ps(_mm256_max_ps(r, g), b), _mm256_set1_ps(rgb9e5_min));
+        __m256i exp = _mm256_srli_epi32(_mm256_add_epi32(_mm256_castps_si256(m), _mm256_set1_epi32(0x4000)), 23);
+        __m256 scale = _mm256_castsi256_ps(_mm256_sub_epi32(_mm256_set1_epi32((int)0x83000000), _mm256_slli_epi32(exp, 23)));
+        __m256i v = _mm256_cvtps_epi32(_mm256_mul_ps(r, scale));
+        v = _mm256_or_si256(v, _mm256_slli_epi32(_mm256_cvtps_epi32(_mm256_mul_ps(g, scale)), 9));
+        v = _mm256_or_si256(v, _mm256_slli_epi32(_mm256_cvtps_epi32(_mm256_mul_ps(b, scale)), 18));
+        v = _mm256_or_si256(v, _mm256_slli_epi32(_mm256_sub_epi32(exp, _mm256_set1_epi32(111)), 27));
+        _mm256_storeu_si256((__m256i*)(dst + i), v);
+    }
+#elif COLOR_SSE2
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 high = _mm_set1_ps(rgb9e5_max);
+    for (; i + 4 <= pixels; i += 4)
+    {
+        __m128 r = _mm_loadu_ps(src + 4 * i + 0);
+        __m128 g = _mm_loadu_ps(src + 4 * i + 4);
+        __m128 b = _mm_loadu_ps(src + 4 * i + 8);
+        __m128 a = _mm_loadu_ps(src + 4 * i + 12);
+        _MM_TRANSPOSE4_PS(r, g, b, a);
+        r = _mm_min_ps(_mm_max_ps(r, zero), high);
+        g = _mm_min_ps(_mm_max_ps(g, zero), high);
+        b = _mm_min_ps(_mm_max_ps(b, zero), high);
+        __m128 m = _mm_max_ps(_mm_max_ps(_mm_max_ps(r, g), b), _mm_set1_ps(rgb9e5_min));
+        __m128i exp = _mm_srli_epi32(_mm_add_epi32(_mm_castps_si128(m), _mm_set1_epi32(0x4000)), 23);
+        __m128 scale = _mm_castsi128_ps(_mm_sub_epi32(_mm_set1_epi32((int)0x83000000), _mm_slli_epi32(exp, 23)));
+        __m128i v = _mm_cvtps_epi32(_mm_mul_ps(r, scale));
+        v = _mm_or_si128(v, _mm_slli_epi32(_mm_cvtps_epi32(_mm_mul_ps(g, scale)), 9));
+        v = _mm_or_si128(v, _mm_slli_epi32(_mm_cvtps_epi32(_mm_mul_ps(b, scale)), 18));
+        v = _mm_or_si128(v, _mm_slli_epi32(_mm_sub_epi32(exp, _mm_set1_epi32(111)), 27));
+        _mm_storeu_si128((__m128i*)(dst + i), v);
+    }
+#endif
+    for (; i < pixels; i++)
+    {
+        f32 c[3];
+        for (u32 j = 0; j < 3; j++)
+        {
+            f32 f = src[4 * i + j];
+            c[j] = f > 0.0f ? (f < rgb9e5_max ? f : rgb9e5_max) : 0.0f;
+        }
+        f32 m = c[0] > c[1] ? c[0] : c[1];
+        m = m > c[2] ? m : c[2];
+        m = m > rgb9e5_min ? m : rgb9e5_min;
+        u32 bits;
+        memcpy(&bits, &m, sizeof(bits));
+        u32 exp = (bits + 0x4000) >> 23;
+        bits = 0x83000000 - (exp << 23);
+        f32 scale;
+        memcpy(&scale, &bits, sizeof(scale));
+        // Round to nearest even like the SIMD conversion
+        dst[i] =
+            (u32)nearbyintf(c[0] * scale) +
+            ((u32)nearbyintf(c[1] * scale) << 9) +
+            ((u32)nearbyintf(c[2] * scale) << 18) +
+            ((exp - 111) << 27);
+    }
+}
+
+void Color_Unpack_RGB9E5_Span(const u32* src, f32* dst, usize pixels)
+{
+    usize i = 0;
+#if COLOR_AVX2
+    const __m256i mask = _mm256_set1_epi32(0x1FF);
+    for (; i + 8 <= pixels; i += 8)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(src + i));
+        // 2^(e - 24), the exponent bias is 15 and there are 9 mantissa bits
+        __m256 scale = _mm256_castsi256_ps(_mm256_add_epi32(_mm256_set1_epi32(0x33800000), _mm256_slli_epi32(_mm256_srli_epi32(v, 27), 23)));
+        __m256 r = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(v, mask)), scale);
+        __m256 g = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(v, 9), mask)), scale);
+        __m256 b = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(v, 18), mask)), scale);
+        Store_RGBA_AVX2(dst + 4 * i, r, g, b, _mm256_set1_ps(1.0f));
+    }
+#elif COLOR_SSE2
+    const __m128i mask = _mm_set1_epi32(0x1FF);
+    for (; i + 4 <= pixels; i += 4)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128 scale = _mm_castsi128_ps(_mm_add_epi32(_mm_set1_epi32(0x33800000), _mm_slli_epi32(_mm_srli_epi32(v, 27), 23)));
+        __m128 r = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(v, mask)), scale);
+        __m128 g = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(v, 9), mask)), scale);
+        __m128 b = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(v, 18), mask)), scale);
+        __m128 a = _mm_set1_ps(1.0f);
+        _MM_TRANSPOSE4_PS(r, g, b, a);
+        _mm_storeu_ps(dst + 4 * i + 0, r);
+        _mm_storeu_ps(dst + 4 * i + 4, g);
+        _mm_storeu_ps(dst + 4 * i + 8, b);
+        _mm_storeu_ps(dst + 4 * i + 12, a);
+    }
+#endif
+    for (; i < pixels; i++)
+    {
+        u32 v = src[i];
+        u32 bits = 0x33800000 + ((v >> 27) << 23);
+        f32 scale;
+        memcpy(&scale, &bits, sizeof(scale));
+        dst[4 * i + 0] = (f32)(v & 0x1FF) * scale;
+        dst[4 * i + 1] = (f32)((v >> 9) & 0x1FF) * scale;
+        dst[4 * i + 2] = (f32)((v >> 18) & 0x1FF) * scale;
+        dst[4 * i + 3] = 1.0f;
+    }
+}
+
+void Pixel_Over_Span(const f32* src, f32* dst, usize pixels)
+{
+    usize i = 0;
+#if COLOR_AVX512
+    for (; i + 4 <= pixels; i += 4)
+    {
+        __m512 s = _mm512_loadu_ps(src + 4 * i);
+        __m512 d = _mm512_loadu_ps(dst + 4 * i);
+        __m512 k = _mm512_sub_ps(_mm512_set1_ps(1.0f), _mm512_permute_ps(s, 0xFF));
+        _mm512_storeu_ps(dst + 4 * i, _mm512_add_ps(s, _mm512_mul_ps(d, k)));
+    }
+#endif
+#if COLOR_AVX2
+    const __m256 one = _mm256_set1_ps(1.0f);
+    for (; i + 2 <= pixels; i += 2)
+    {
+        __m256 s = _mm256_loadu_ps(src + 4 * i);
+        __m256 d = _mm256_loadu_ps(dst + 4 * i);
+        __m256 k = _mm256_sub_ps(one, _mm256_permute_ps(s, 0xFF));
+        _mm256_storeu_ps(dst + 4 * i, _mm256_add_ps(s, _mm256_mul_ps(d, k)));
+    }
+#elif COLOR_SSE2
+    const __m128 one = _mm_set1_ps(1.0f);
+    for (; i < pixels; i++)
+    {
+        __m128 s = _mm_loadu_ps(src + 4 * i);
+        __m128 d = _mm_loadu_ps(dst + 4 * i);
+        __m128 k = _mm_sub_ps(one, _mm_shuffle_ps(s, s, 0xFF));
+        _mm_storeu_ps(dst + 4 * i, _mm_add_ps(s, _mm_mul_ps(d, k)));
+    }
+#elif COLOR_NEON
+    for (; i < pixels; i++)
+    {
+        float32x4_t s = vld1q_f32(src + 4 * i);
+        float32x4_t d = vld1q_f32(dst + 4 * i);
+        vst1q_f32(dst + 4 * i, vmlaq_f32(s, d, vdupq_n_f32(1.0f - src[4 * i + 3])));
+    }
+#endif
+    for (; i < pixels; i++)
+    {
+        f32 k = 1.0f - src[4 * i + 3];
+        for (u32 c = 0; c < 4; c++)
+            dst[4 * i + c] = src[4 * i + c] + dst[4 * i + c] * k;
+    }
+}
+
+// The tetrahedron of a size^3 lattice a shaped RGB coordinate falls in, as the
+// indices of its four nodes and their weights. The cube's diagonal splits it
+// into six tetrahedra, picked by the order of the fractions, and the path from
+// the first corner to the last steps along the axes largest fraction first.
+// The order is as good as random for near grey colors, so it's all selects
+// rather than branches, and it's compiled with each kernel set so the AVX2
+// loop doesn't call into SSE code.
+static inline void Lut3D_Cell(const f32* c, u32 size, usize node[4], f32 w[4])
+{
+    const usize stride[3] = { 1, size, (usize)size * size };
+    f32 f[3];
+    usize base = 0;
+    for (u32 k = 0; k < 3; k++)
+    {
+        // Clamped to the lattice, NaN to 0
+        f32 x = c[k] > 0.0f ? (c[k] < 1.0f ? c[k] : 1.0f) : 0.0f;
+        x *= (f32)(size - 1);
+        u32 i = (u32)x;
+        i = i < size - 2 ? i : size - 2;
+        f[k] = x - (f32)i;
+        base += i * stride[k];
+    }
+    // Ties go to red then green then blue for the largest, the other way for
+    // the smallest, so the two are never the same axis
+    f32 high = f[0] > f[1] ? f[0] : f[1];
+    high = high > f[2] ? high : f[2];
+    f32 low = f[0] < f[1] ? f[0] : f[1];
+    low = low < f[2] ? low : f[2];
+    f32 rg_low = f[0] < f[1] ? f[0] : f[1];
+    f32 rg_high = f[0] > f[1] ? f[0] : f[1];
+    f32 mid = rg_high < f[2] ? rg_high : f[2];
+    mid = mid > rg_low ? mid : rg_low;
+    usize first = f[0] >= f[1] && f[0] >= f[2] ? stride[0] : f[1] >= f[2] ? stride[1] : stride[2];
+    usize last = f[2] <= f[0] && f[2] <= f[1] ? stride[2] : f[1] <= f[0] ? stride[1] : stride[0];
+    node[0] = base;
+    node[1] = base + first;
+    node[3] = base + stride[0] + stride[1] + stride[2];
+    node[2] = node[3] - last;
+    w[0] = 1.0f - high;
+    w[1] = high - mid;
+    w[2] = mid - low;
+    w[3] = low;
+}
+
+#if COLOR_SSE2 || COLOR_AVX2
+// Lut3D_Cell for four pixels at once, transposed so each vector holds one
+// channel. Node indices stay below 2^24, so they're worked out exactly in f32
+// and the selects need nothing past SSE2. node and w get each pixel's four in
+// turn.
+static inline void Lut3D_Cells_SSE(const f32* src, u32 size, i32 node[16], f32 w[16])
+{
+    __m128 c[4] = { _mm_loadu_ps(src), _mm_loadu_ps(src + 4), _mm_loadu_ps(src + 8), _mm_loadu_ps(src + 12) };
+    _MM_TRANSPOSE4_PS(c[0], c[1], c[2], c[3]);
+    const __m128 scale = _mm_set1_ps((f32)(size - 1));
+    const __m128 top = _mm_set1_ps((f32)(size - 2));
+    const __m128 stride[3] = { _mm_set1_ps(1.0f), _mm_set1_ps((f32)size), _mm_set1_ps((f32)size * (f32)size) };
+    auto select = [](__m128 mask, __m128 a, __m128 b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); };
+    __m128 f[3];
+    __m128 base = _mm_setzero_ps();
+    for (u32 k = 0; k < 3; k++)
+    {
+        // max returns its second operand for NaN, so NaN goes to 0
+        __m128 x = _mm_mul_ps(_mm_min_ps(_mm_max_ps(c[k], _mm_setzero_ps()), _mm_set1_ps(1.0f)), scale);
+        __m128 i = _mm_min_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(x)), top);
+        f[k] = _mm_sub_ps(x, i);
+        base = _mm_add_ps(base, _mm_mul_ps(i, stride[k]));
+    }
+    __m128 rg_low = _mm_min_ps(f[0], f[1]);
+    __m128 rg_high = _mm_max_ps(f[0], f[1]);
+    __m128 high = _mm_max_ps(rg_high, f[2]);
+    __m128 low = _mm_min_ps(rg_low, f[2]);
+    __m128 mid = _mm_max_ps(_mm_min_ps(rg_high, f[2]), rg_low);
+    __m128 red_first = _mm_and_ps(_mm_cmpge_ps(f[0], f[1]), _mm_cmpge_ps(f[0], f[2]));
+    __m128 first = select(red_first, stride[0], select(_mm_cmpge_ps(f[1], f[2]), stride[1], stride[2]));
+    __m128 blue_last = _mm_and_ps(_mm_cmple_ps(f[2], f[0]), _mm_cmple_ps(f[2], f[1]));
+    __m128 last = select(blue_last, stride[2], select(_mm_cmple_ps(f[1], f[0]), stride[1], stride[0]));
+    __m128 corner = _mm_add_ps(base, _mm_add_ps(_mm_add_ps(stride[0], stride[1]), stride[2]));
+    __m128 n[4] = { base, _mm_add_ps(base, first), _mm_sub_ps(corner, last), corner };
+    __m128 v[4] = { _mm_sub_ps(_mm_set1_ps(1.0f), high), _mm_sub_ps(high, mid), _mm_sub_ps(mid, low), low };
+    _MM_TRANSPOSE4_PS(n[0], n[1], n[2], n[3]);
+    _MM_TRANSPOSE4_PS(v[0], v[1], v[2], v[3]);
+    for (u32 p = 0; p < 4; p++)
+    {
+        _mm_storeu_si128((__m128i*)(node + 4 * p), _mm_cvttps_epi32(n[p]));
+        _mm_storeu_ps(w + 4 * p, v[p]);
+    }
+}
+#endif
+
+void Color_Lut3D_Span(const f32* src, f32* dst, usize pixels, const f32* lattice, u32 size)
+{
+    usize i = 0;
+    usize node[4];
+    f32 w[4];
+#if COLOR_AVX2
+    // Four pixels per iteration, two at a time in each half
+    for (; i + 4 <= pixels; i += 4)
+    {
+        i32 cell[16];
+        f32 v[16];
+        Lut3D_Cells_SSE(src + 4 * i, size, cell, v);
+        f32 a[4] = { src[4 * i + 3], src[4 * i + 7], src[4 * i + 11], src[4 * i + 15] };
+        for (u32 p = 0; p < 4; p += 2)
+        {
+            const i32* n = cell + 4 * p;
+            const f32* u = v + 4 * p;
+            __m256 o = _mm256_setzero_ps();
+            for (u32 k = 0; k < 4; k++)
+            {
+                __m256 l = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(lattice + 4 * (usize)n[k])), _mm_loadu_ps(lattice + 4 * (usize)n[4 + k]), 1);
+                __m256 l_w = _mm256_mul_ps(l, _mm256_setr_ps(u[k], u[k], u[k], u[k], u[4 + k], u[4 + k], u[4 + k], u[4 + k]));
+                o = k ? _mm256_add_ps(o, l_w) : l_w;
+            }
+            _mm256_storeu_ps(dst + 4 * (i + p), o);
+        }
+        for (u32 p = 0; p < 4; p++)
+            dst[4 * (i + p) + 3] = a[p];
+    }
+#elif COLOR_SSE2
+    for (; i + 4 <= pixels; i += 4)
+    {
+        i32 cell[16];
+        f32 v[16];
+        Lut3D_Cells_SSE(src + 4 * i, size, cell, v);
+        f32 a[4] = { src[4 * i + 3], src[4 * i + 7], src[4 * i + 11], src[4 * i + 15] };
+        for (u32 p = 0; p < 4; p++)
+        {
+            const i32* n = cell + 4 * p;
+            const f32* u = v + 4 * p;
+            __m128 o = _mm_mul_ps(_mm_loadu_ps(lattice + 4 * (usize)n[0]), _mm_set1_ps(u[0]));
+            o = _mm_add_ps(o, _mm_mul_ps(_mm_loadu_ps(lattice + 4 * (usize)n[1]), _mm_set1_ps(u[1])));
+            o = _mm_add_ps(o, _mm_mul_ps(_mm_loadu_ps(lattice + 4 * (usize)n[2]), _mm_set1_ps(u[2])));
+            o = _mm_add_ps(o, _mm_mul_ps(_mm_loadu_ps(lattice + 4 * (usize)n[3]), _mm_set1_ps(u[3])));
+            _mm_storeu_ps(dst + 4 * (i + p), o);
+        }
+        for (u32 p = 0; p < 4; p++)
+            dst[4 * (i + p) + 3] = a[p];
+    }
+#elif COLOR_NEON
+    for (; i < pixels; i++)
+    {
+        Lut3D_Cell(src + 4 * i, size, node, w);
+        f32 a = src[4 * i + 3];
+        float32x4_t o = vmulq_n_f32(vld1q_f32(lattice + 4 * node[0]), w[0]);
+        o = vaddq_f32(o, vmulq_n_f32(vld1q_f32(lattice + 4 * node[1]), w[1]));
+        o = vaddq_f32(o, vmulq_n_f32(vld1q_f32(lattice + 4 * node[2]), w[2]));
+        o = vaddq_f32(o, vmulq_n_f32(vld1q_f32(lattice + 4 * node[3]), w[3]));
+        vst1q_f32(dst + 4 * i, o);
+        dst[4 * i + 3] = a;
+    }
+#endif
+    for (; i < pixels; i++)
+    {
+        Lut3D_Cell(src + 4 * i, size, node, w);
+        f32 a = src[4 * i + 3];
+        for (u32 c = 0; c < 3; c++)
+        {
+            f32 o = lattice[4 * node[0] + c] * w[0];
+            o += lattice[4 * node[1] + c] * w[1];
+            o += lattice[4 * node[2] + c] * w[2];
+            o += lattice[4 * node[3] + c] * w[3];
+            dst[4 * i + c] = o;
+        }
+        dst[4 * i + 3] = a;
+    }
+}
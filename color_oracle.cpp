@@ -0,0 +1,104 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// color_oracle.cpp : Double precision reference color kernels.
+//
+
+#include "color_oracle.h"
+
+#include "colorspace.h"
+
+#include <cmath>
+#include <cstring>
+
+constexpr Color_Mat3 oracle_scrgb_to_rec2020 = Color_RGB_To_RGB(primaries_rec709, primaries_rec2020);
+
+static f64 Oracle_Clamp(f64 f, f64 high)
+{
+    return f < 0.0 ? 0.0 : f < high ? f : high;
+}
+
+u16 Oracle_ToF16(f32 f)
+{
+    u32 bits;
+    memcpy(&bits, &f, sizeof(bits));
+    u16 sign = (u16)((bits >> 16) & 0x8000);
+    if (std::isnan(f))
+        return sign | 0x7E00 | ((bits >> 13) & 0x3FF);
+    f64 a = fabs((f64)f);
+    if (std::isinf(f) || a >= 65520.0)
+        return sign | 0x7C00;
+    // Round to a multiple of the f16 spacing in a's binade, denormals have the
+    // spacing of the smallest normal binade. Dividing by a power of two is
+    // exact, so nearbyint does the only rounding, to nearest even.
+    int e = 0;
+    frexp(a, &e);
+    int binade = e - 1 < -14 ? -14 : e - 1;
+    f64 r = nearbyint(ldexp(a, 10 - binade));
+    if (r < 1024.0)
+        return sign | (u16)r;
+    // Rounding up can carry into the next binade, which is still 1024 * 2^n
+    if (r == 2048.0)
+    {
+        r = 1024.0;
+        binade++;
+    }
+    return sign | (u16)((binade + 15) << 10) | (u16)(r - 1024.0);
+}
+
+f64 Oracle_FromF16(u16 h)
+{
+    f64 sign = h & 0x8000 ? -1.0 : 1.0;
+    u32 e = (h >> 10) & 0x1F;
+    u32 m = h & 0x3FF;
+    if (e == 31)
+        return m ? NAN : sign * INFINITY;
+    return sign * (e ? ldexp(1024.0 + m, (int)e - 25) : ldexp((f64)m, -24));
+}
+
+void Oracle_scRGB_To_Rec2020(const f64 c[3], f64 o[3])
+{
+    const auto& m = oracle_scrgb_to_rec2020.m;
+    for (u32 r = 0; r < 3; r++)
+        o[r] = m[r][0] * c[0] + m[r][1] * c[1] + m[r][2] * c[2];
+}
+
+f64 Oracle_Transfer_To_PQ(f64 linear)
+{
+    constexpr f64 m1 = 2610.0 / 16384.0;
+    constexpr f64 m2 = 128.0 * 2523.0 / 4096.0;
+    constexpr f64 c1 = 3424.0 / 4096.0;
+    constexpr f64 c2 = 32.0 * 2413.0 / 4096.0;
+    constexpr f64 c3 = 32.0 * 2392.0 / 4096.0;
+    f64 y = Oracle_Clamp(linear * (80.0 / 10000.0), 1.0);
+    f64 p = pow(y, m1);
+    return pow((c1 + c2 * p) / (1.0 + c3 * p), m2);
+}
+
+f64 Oracle_Transfer_To_sRGB(f64 linear)
+{
+    f64 l = Oracle_Clamp(linear, 1.0);
+    return l <= 0.0031308 ? l * 12.92 : 1.055 * pow(l, 1.0 / 2.4) - 0.055;
+}
+
+void Oracle_Encode_scRGB16F(const f32 rgba[4], u16 o[4])
+{
+    for (u32 i = 0; i < 4; i++)
+        o[i] = Oracle_ToF16(rgba[i]);
+}
+
+void Oracle_Encode_HDR10(const f32 rgba[4], f64 o[3])
+{
+    const f64 c[3] = { rgba[0], rgba[1], rgba[2] };
+    f64 rec2020[3];
+    Oracle_scRGB_To_Rec2020(c, rec2020);
+    for (u32 i = 0; i < 3; i++)
+        o[i] = Oracle_Transfer_To_PQ(rec2020[i]) * 1023.0;
+}
+
+void Oracle_Encode_sRGB8(const f32 rgba[4], f64 o[3])
+{
+    for (u32 i = 0; i < 3; i++)
+        o[i] = Oracle_Transfer_To_sRGB(rgba[i]) * 255.0;
+}
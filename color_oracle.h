@@ -0,0 +1,43 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// color_oracle.h : Double precision reference versions of the color kernels
+// and of the whole scRGB to RGBA16F, HDR10 and sRGB8 encodes, written straight
+// from the specifications with no tables or approximations, to measure the
+// fast paths in color.cpp against.
+//
+// The integer encodes return unquantized code values, so the error of a fast
+// path is how far its code is from the exact one (at best 0.5 of a code).
+//
+
+#pragma once
+
+#include "common.h"
+
+/// The f16 nearest to f with ties to even, infinity past the largest finite
+/// value and quiet NaN keeping the upper payload bits, computed in f64.
+u16 Oracle_ToF16(f32 f);
+
+f64 Oracle_FromF16(u16 h);
+
+/// Rec.709 linear to Rec.2020 linear with the f64 matrix from colorspace.h
+void Oracle_scRGB_To_Rec2020(const f64 c[3], f64 o[3]);
+
+/// PQ inverse EOTF (SMPTE ST 2084) from scRGB (80 nits = 1.0) to a 0..1 signal
+f64 Oracle_Transfer_To_PQ(f64 linear);
+
+/// sRGB inverse EOTF (IEC 61966-2-1) from linear 0..1 to a 0..1 signal, with
+/// the exact 1/2.4 exponent
+f64 Oracle_Transfer_To_sRGB(f64 linear);
+
+/// The RGBA16F scRGB encode, bits of each channel
+void Oracle_Encode_scRGB16F(const f32 rgba[4], u16 o[4]);
+
+/// The RGB10A2 HDR10 encode of the color channels, unquantized codes 0..1023.
+/// Alpha only goes through the pixel format, so it isn't part of the oracle.
+void Oracle_Encode_HDR10(const f32 rgba[4], f64 o[3]);
+
+/// The BGRA8 sRGB encode of the color channels, unquantized codes 0..255 in
+/// RGB order
+void Oracle_Encode_sRGB8(const f32 rgba[4], f64 o[3]);
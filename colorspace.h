@@ -0,0 +1,138 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// colorspace.h : Compile time derivation of RGB <-> XYZ matrices from the
+// chromaticities of a colorspace's primaries and white point, and composition
+// of conversion chains into a single matrix.
+//
+// All of these are evaluated in f64 by the compiler, then rounded to f32 once
+// for use with Color_rgb_through_mat3, so adding a new colorspace or fusing a
+// chain costs nothing at runtime.
+//
+
+#pragma once
+
+#include "common.h"
+
+struct Color_Mat3
+{
+    f64 m[3][3];
+};
+
+struct Color_Mat3f
+{
+    f32 m[3][3];
+};
+
+/// CIE 1931 xy chromaticities of the red, green and blue primaries and the
+/// white point.
+struct Color_Primaries
+{
+    f64 rx, ry;
+    f64 gx, gy;
+    f64 bx, by;
+    f64 wx, wy;
+};
+
+// ITU-R BT.709, also sRGB and scRGB
+constexpr Color_Primaries primaries_rec709 = { 0.640, 0.330, 0.300, 0.600, 0.150, 0.060, 0.3127, 0.3290 };
+// ITU-R BT.2020, also BT.2100 (HDR10)
+constexpr Color_Primaries primaries_rec2020 = { 0.708, 0.292, 0.170, 0.797, 0.131, 0.046, 0.3127, 0.3290 };
+// Display P3, the DCI-P3 primaries with a D65 white point
+constexpr Color_Primaries primaries_display_p3 = { 0.680, 0.320, 0.265, 0.690, 0.150, 0.060, 0.3127, 0.3290 };
+// Adobe RGB (1998)
+constexpr Color_Primaries primaries_adobe_rgb = { 0.640, 0.330, 0.210, 0.710, 0.150, 0.060, 0.3127, 0.3290 };
+
+constexpr Color_Mat3 Mat3_Multiply(const Color_Mat3& a, const Color_Mat3& b)
+{
+    Color_Mat3 o = {};
+    for (u32 r = 0; r < 3; r++)
+        for (u32 c = 0; c < 3; c++)
+            o.m[r][c] = a.m[r][0] * b.m[0][c] + a.m[r][1] * b.m[1][c] + a.m[r][2] * b.m[2][c];
+    return o;
+}
+
+constexpr Color_Mat3 Mat3_Inverse(const Color_Mat3& a)
+{
+    const auto& m = a.m;
+    f64 c00 = m[1][1] * m[2][2] - m[1][2] * m[2][1];
+    f64 c01 = m[1][2] * m[2][0] - m[1][0] * m[2][2];
+    f64 c02 = m[1][0] * m[2][1] - m[1][1] * m[2][0];
+    f64 det = m[0][0] * c00 + m[0][1] * c01 + m[0][2] * c02;
+    f64 inv = 1.0 / det;
+    Color_Mat3 o = {};
+    o.m[0][0] = c00 * inv;
+    o.m[0][1] = (m[0][2] * m[2][1] - m[0][1] * m[2][2]) * inv;
+    o.m[0][2] = (m[0][1] * m[1][2] - m[0][2] * m[1][1]) * inv;
+    o.m[1][0] = c01 * inv;
+    o.m[1][1] = (m[0][0] * m[2][2] - m[0][2] * m[2][0]) * inv;
+    o.m[1][2] = (m[0][2] * m[1][0] - m[0][0] * m[1][2]) * inv;
+    o.m[2][0] = c02 * inv;
+    o.m[2][1] = (m[0][1] * m[2][0] - m[0][0] * m[2][1]) * inv;
+    o.m[2][2] = (m[0][0] * m[1][1] - m[0][1] * m[1][0]) * inv;
+    return o;
+}
+
+constexpr Color_Mat3f Mat3_To_f32(const Color_Mat3& a)
+{
+    Color_Mat3f o = {};
+    for (u32 r = 0; r < 3; r++)
+        for (u32 c = 0; c < 3; c++)
+            o.m[r][c] = (f32)a.m[r][c];
+    return o;
+}
+
+/// RGB to XYZ (Y = 1 for white) for the given primaries: the primaries' XYZ
+/// as columns, each scaled so that RGB 1,1,1 lands on the white point.
+constexpr Color_Mat3 Color_RGB_To_XYZ(const Color_Primaries& p)
+{
+    Color_Mat3 prim = { {
+        { p.rx / p.ry, p.gx / p.gy, p.bx / p.by },
+        { 1.0, 1.0, 1.0 },
+        { (1.0 - p.rx - p.ry) / p.ry, (1.0 - p.gx - p.gy) / p.gy, (1.0 - p.bx - p.by) / p.by } } };
+    Color_Mat3 inv = Mat3_Inverse(prim);
+    f64 w[3] = { p.wx / p.wy, 1.0, (1.0 - p.wx - p.wy) / p.wy };
+    Color_Mat3 o = {};
+    for (u32 c = 0; c < 3; c++)
+    {
+        f64 s = inv.m[c][0] * w[0] + inv.m[c][1] * w[1] + inv.m[c][2] * w[2];
+        for (u32 r = 0; r < 3; r++)
+            o.m[r][c] = prim.m[r][c] * s;
+    }
+    return o;
+}
+
+constexpr Color_Mat3 Color_XYZ_To_RGB(const Color_Primaries& p)
+{
+    return Mat3_Inverse(Color_RGB_To_XYZ(p));
+}
+
+/// RGB in one colorspace to RGB in another through XYZ, as one matrix. This
+/// does no chromatic adaptation, so both should share a white point (all of the
+/// colorspaces above are D65).
+constexpr Color_Mat3 Color_RGB_To_RGB(const Color_Primaries& from, const Color_Primaries& to)
+{
+    return Mat3_Multiply(Color_XYZ_To_RGB(to), Color_RGB_To_XYZ(from));
+}
+
+constexpr bool Mat3_Near(const Color_Mat3& a, const Color_Mat3& b, f64 tolerance)
+{
+    for (u32 r = 0; r < 3; r++)
+        for (u32 c = 0; c < 3; c++)
+        {
+            f64 d = a.m[r][c] - b.m[r][c];
+            if (d > tolerance || d < -tolerance)
+                return false;
+        }
+    return true;
+}
+
+// Check the derivation against the published matrices, to the number of decimal
+// places they are published with.
+static_assert(Mat3_Near(Color_RGB_To_XYZ(primaries_rec709), { { { 0.4123908, 0.3575843, 0.1804808 }, { 0.2126390, 0.7151687, 0.0721923 }, { 0.0193308, 0.1191948, 0.9505322 } } }, 1e-7), "Rec.709 to XYZ");
+static_assert(Mat3_Near(Color_RGB_To_XYZ(primaries_rec2020), { { { 0.6369580, 0.1446169, 0.1688810 }, { 0.2627002, 0.6779981, 0.0593017 }, { 0.0000000, 0.0280727, 1.0609851 } } }, 1e-7), "Rec.2020 to XYZ");
+static_assert(Mat3_Near(Color_XYZ_To_RGB(primaries_rec2020), { { { 1.7166512, -0.3556708, -0.2533663 }, { -0.6666844, 1.6164812, 0.0157685 }, { 0.0176399, -0.0427706, 0.9421031 } } }, 1e-7), "XYZ to Rec.2020");
+static_assert(Mat3_Near(Color_RGB_To_XYZ(primaries_display_p3), { { { 0.4865709, 0.2656677, 0.1982173 }, { 0.2289746, 0.6917385, 0.0792869 }, { 0.0000000, 0.0451134, 1.0439444 } } }, 1e-7), "Display P3 to XYZ");
+static_assert(Mat3_Near(Color_RGB_To_XYZ(primaries_adobe_rgb), { { { 0.57667, 0.18556, 0.18823 }, { 0.29734, 0.62736, 0.07529 }, { 0.02703, 0.07069, 0.99134 } } }, 1e-5), "Adobe RGB to XYZ");
+static_assert(Mat3_Near(Color_RGB_To_RGB(primaries_rec709, primaries_rec2020), { { { 0.6274, 0.3293, 0.0433 }, { 0.0691, 0.9195, 0.0114 }, { 0.0164, 0.0880, 0.8956 } } }, 1e-4), "Rec.709 to Rec.2020 (BT.2087)");
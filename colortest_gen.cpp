@@ -0,0 +1,647 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// colortest_gen.cpp : Writes any test pattern in any transfer and format to a
+// file, generating a band of rows at a time and writing it out before reusing
+// the buffer, so peak memory is the band buffer however big the image is.
+// Portable so reference images can be made in bulk on any machine, e.g.:
+//   c++ -O2 -std=c++17 -pthread colortest_gen.cpp color.cpp format.cpp generate.cpp image_file.cpp lut.cpp parallel.cpp trace.cpp -o colortest-gen
+//   ./colortest-gen -pattern testcolors -transfer hdr10 -width 16384 -height 16384 testcolors.png
+//
+// It also bakes a transfer into a .cube 3D LUT, and generates through one in
+// place of the transfer:
+//   ./colortest-gen -transfer hdr10 -bake-lut hdr10.cube
+//   ./colortest-gen -pattern bars -transfer hdr10 -lut hdr10.cube bars.png
+//
+// An image file takes the place of the pattern, converted from its memory
+// mapping a band at a time like any pattern:
+//   ./colortest-gen -image render.pfm -transfer hdr10 render.rgb10a2
+//
+
+#include "generate.h"
+#include "image_file.h"
+#include "lut.h"
+#include "trace.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+/// Linear RGB f32, alpha is dropped, for PFM
+struct Format_RGB32F
+{
+    static constexpr usize bpp = 12;
+    static void Pack(f32* rgba, void* dst, usize pixels)
+    {
+        for (usize x = 0; x < pixels; x++)
+            memcpy((u8*)dst + 12 * x, &rgba[4 * x], 12);
+    }
+};
+
+/// 16 bit big endian RGB, alpha is dropped, for PNG
+struct Format_RGB16_BigEndian
+{
+    static constexpr usize bpp = 6;
+    static void Pack(f32* rgba, void* dst, usize pixels)
+    {
+        u8* p = (u8*)dst;
+        for (usize x = 0; x < pixels; x++)
+        {
+            f32* c = &rgba[4 * x];
+            Pixel_To_Int(c, 65535.0f, 0.0f, 65535.0f);
+            for (u32 i = 0; i < 3; i++)
+            {
+                u32 v = (u32)c[i];
+                p[6 * x + 2 * i + 0] = (u8)(v >> 8);
+                p[6 * x + 2 * i + 1] = (u8)v;
+            }
+        }
+    }
+};
+
+enum class Gen_Container
+{
+    PFM,
+    PNG,
+    RGBA16F,
+    RGBA16,
+    RGB10A2,
+    R11G11B10F,
+    RGB9E5,
+    BGRA8,
+};
+
+enum class Gen_Transfer
+{
+    scRGB,
+    HDR10,
+    sRGB,
+};
+
+static u32 crc_table[256];
+
+static u32 Crc32(u32 crc, const u8* data, usize size)
+{
+    if (!crc_table[1])
+    {
+        for (u32 n = 0; n < 256; n++)
+        {
+            u32 c = n;
+            for (u32 k = 0; k < 8; k++)
+                c = c & 1 ? 0xedb88320 ^ (c >> 1) : c >> 1;
+            crc_table[n] = c;
+        }
+    }
+    crc = ~crc;
+    for (usize i = 0; i < size; i++)
+        crc = crc_table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+static void Put32BE(u8* p, u32 v)
+{
+    p[0] = (u8)(v >> 24);
+    p[1] = (u8)(v >> 16);
+    p[2] = (u8)(v >> 8);
+    p[3] = (u8)v;
+}
+
+/// Writes bands of rows to the file as they are generated. PNG image data is
+/// one zlib stream of stored (uncompressed) deflate blocks, split into one
+/// IDAT chunk per band, so no compression library is needed and nothing but
+/// the band has to be held in memory.
+class Gen_Output
+{
+public:
+    Gen_Output(FILE* _file, Gen_Container _container)
+        : file(_file)
+        , container(_container)
+    {
+    }
+
+    /// PFM rows go from the bottom up, so bands have to be generated in reverse
+    bool BottomUp() const { return container == Gen_Container::PFM; }
+
+    bool Begin(u32 width, u32 height, Gen_Transfer transfer)
+    {
+        if (container == Gen_Container::PFM)
+        {
+            // A negative scale means little endian
+            ok = fprintf(file, "PF\n%u %u\n-1.0\n", width, height) > 0;
+        }
+        else if (container == Gen_Container::PNG)
+        {
+            static const u8 signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+            ok = fwrite(signature, 1, 8, file) == 8;
+
+            // 16 bit RGB, no interlacing
+            u8 ihdr[13] = {};
+            Put32BE(ihdr, width);
+            Put32BE(ihdr + 4, height);
+            ihdr[8] = 16;
+            ihdr[9] = 2;
+            Chunk("IHDR", ihdr, sizeof(ihdr));
+
+            // Coding independent code points (ITU-T H.273) so readers know the
+            // primaries and transfer, full range RGB
+            u8 cicp[4] = { 1, 8, 0, 1 };
+            if (transfer == Gen_Transfer::HDR10)
+            {
+                cicp[0] = 9;
+                cicp[1] = 16;
+            }
+            else if (transfer == Gen_Transfer::sRGB)
+            {
+                cicp[1] = 13;
+            }
+            Chunk("cICP", cicp, sizeof(cicp));
+        }
+        return ok;
+    }
+
+    /// Writes count rows of pitch bytes, in the order they appear in the file
+    void Rows(const u8* rows, usize count, usize pitch, bool last)
+    {
+        TRACE_SCOPE("Gen_Output::Rows");
+        TRACE_COUNT("bytes written", count * pitch);
+        if (container == Gen_Container::PFM)
+        {
+            for (usize r = count; r-- > 0 && ok;)
+                ok = fwrite(rows + r * pitch, 1, pitch, file) == pitch;
+        }
+        else if (container == Gen_Container::PNG)
+        {
+            idat.clear();
+            if (first)
+            {
+                // Deflate with a 32K window, no preset dictionary
+                idat.push_back(0x78);
+                idat.push_back(0x01);
+                first = false;
+            }
+            const u8 filter = 0;
+            for (usize r = 0; r < count; r++)
+            {
+                Deflate_Stored(&filter, 1);
+                Deflate_Stored(rows + r * pitch, pitch);
+            }
+            Deflate_Close(last);
+            if (last)
+            {
+                u8 adler[4];
+                Put32BE(adler, (adlerB << 16) | adlerA);
+                idat.insert(idat.end(), adler, adler + 4);
+            }
+            Chunk("IDAT", idat.data(), idat.size());
+        }
+        else
+        {
+            ok = ok && fwrite(rows, pitch, count, file) == count;
+        }
+    }
+
+    bool End()
+    {
+        if (container == Gen_Container::PNG)
+            Chunk("IEND", nullptr, 0);
+        return ok;
+    }
+
+private:
+    void Chunk(const char* type, const u8* data, usize size)
+    {
+        u8 header[8];
+        Put32BE(header, (u32)size);
+        memcpy(header + 4, type, 4);
+        u8 crc[4];
+        Put32BE(crc, Crc32(Crc32(0, header + 4, 4), data, size));
+        ok = ok && fwrite(header, 1, 8, file) == 8;
+        ok = ok && (size == 0 || fwrite(data, 1, size, file) == size);
+        ok = ok && fwrite(crc, 1, 4, file) == 4;
+    }
+
+    /// Appends data to the open stored block, starting a new one whenever the
+    /// block reaches the 65535 byte limit
+    void Deflate_Stored(const u8* data, usize size)
+    {
+        while (size > 0)
+        {
+            if (blockSize == 65535)
+                Deflate_Close(false);
+            if (blockStart == ~(usize)0)
+            {
+                blockStart = idat.size();
+                idat.resize(idat.size() + 5);
+                blockSize = 0;
+            }
+            usize n = 65535 - blockSize;
+            n = n < size ? n : size;
+            idat.insert(idat.end(), data, data + n);
+            Adler32(data, n);
+            blockSize += n;
+            data += n;
+            size -= n;
+        }
+    }
+
+    /// Fills in the header of the open block, which is empty if nothing was
+    /// appended since the last one, so there is always a final block
+    void Deflate_Close(bool final)
+    {
+        if (blockStart == ~(usize)0)
+        {
+            if (!final)
+                return;
+            blockStart = idat.size();
+            idat.resize(idat.size() + 5);
+            blockSize = 0;
+        }
+        u8* h = &idat[blockStart];
+        h[0] = final ? 1 : 0;
+        h[1] = (u8)blockSize;
+        h[2] = (u8)(blockSize >> 8);
+        h[3] = (u8)~blockSize;
+        h[4] = (u8)(~blockSize >> 8);
+        blockStart = ~(usize)0;
+        blockSize = 0;
+    }
+
+    void Adler32(const u8* data, usize size)
+    {
+        // 5552 bytes is the most that can be summed before the sums overflow
+        while (size > 0)
+        {
+            usize n = size < 5552 ? size : 5552;
+            for (usize i = 0; i < n; i++)
+            {
+                adlerA += data[i];
+                adlerB += adlerA;
+            }
+            adlerA %= 65521;
+            adlerB %= 65521;
+            data += n;
+            size -= n;
+        }
+    }
+
+    FILE* file;
+    Gen_Container container;
+    bool ok = true;
+    bool first = true;
+    std::vector<u8> idat;
+    usize blockStart = ~(usize)0;
+    usize blockSize = 0;
+    u32 adlerA = 1;
+    u32 adlerB = 0;
+};
+
+struct Gen_Options
+{
+    u32 width = 1920;
+    u32 height = 1080;
+    usize bandBytes = 16 << 20;
+    /// Generates through this LUT with Transfer_scRGB in place of the transfer
+    const Lut3D* lut = nullptr;
+};
+
+template <class Pattern, class Transfer, class Format>
+static bool Gen_Stream(Gen_Output& out, const Pattern& pattern, const Gen_Options& options)
+{
+    u32 width = options.width;
+    u32 height = options.height;
+    usize pitch = Format::bpp * width;
+    u32 rows = Generate_Chunk_Rows(width, height, Format::bpp, options.bandBytes);
+    printf("generating %ux%u in bands of %u rows, %.1f MB\n", width, height, rows, (rows * pitch) / 1048576.0);
+
+    u32 done = 0;
+    bool ok = GenerateImage_Chunked<Pattern, Transfer, Format>(width, height, pattern, options.bandBytes, out.BottomUp(), [&](const void* band, u32, u32 count, usize pitch) {
+        done += count;
+        out.Rows((const u8*)band, count, pitch, done == height);
+        return true;
+    });
+    return out.End() && ok;
+}
+
+template <class Pattern, class Transfer>
+static bool Gen_Format(Gen_Output& out, Gen_Container container, const Pattern& pattern, const Gen_Options& options)
+{
+    switch (container)
+    {
+    case Gen_Container::PFM:
+        return Gen_Stream<Pattern, Transfer, Format_RGB32F>(out, pattern, options);
+    case Gen_Container::PNG:
+        return Gen_Stream<Pattern, Transfer, Format_RGB16_BigEndian>(out, pattern, options);
+    case Gen_Container::RGBA16F:
+        return Gen_Stream<Pattern, Transfer, Format_RGBA16F>(out, pattern, options);
+    case Gen_Container::RGBA16:
+        return Gen_Stream<Pattern, Transfer, Format_RGBA16>(out, pattern, options);
+    case Gen_Container::RGB10A2:
+        return Gen_Stream<Pattern, Transfer, Format_RGB10A2>(out, pattern, options);
+    case Gen_Container::R11G11B10F:
+        return Gen_Stream<Pattern, Transfer, Format_R11G11B10F>(out, pattern, options);
+    case Gen_Container::RGB9E5:
+        return Gen_Stream<Pattern, Transfer, Format_RGB9E5>(out, pattern, options);
+    case Gen_Container::BGRA8:
+        return Gen_Stream<Pattern, Transfer, Format_BGRA8>(out, pattern, options);
+    }
+    return false;
+}
+
+template <class Pattern>
+static bool Gen_Transfer_Format(Gen_Output& out, Gen_Transfer transfer, Gen_Container container, const Pattern& pattern, const Gen_Options& options)
+{
+    // The LUT's output is already in the transfer, which then only tags the file
+    if (options.lut)
+        return Gen_Format<Pattern_Lut<Pattern>, Transfer_scRGB>(out, container, Pattern_Lut<Pattern>(pattern, *options.lut), options);
+    switch (transfer)
+    {
+    case Gen_Transfer::scRGB:
+        return Gen_Format<Pattern, Transfer_scRGB>(out, container, pattern, options);
+    case Gen_Transfer::HDR10:
+        return Gen_Format<Pattern, Transfer_HDR10>(out, container, pattern, options);
+    case Gen_Transfer::sRGB:
+        return Gen_Format<Pattern, Transfer_sRGB>(out, container, pattern, options);
+    }
+    return false;
+}
+
+// 100% color bars at 80 nits, white, yellow, cyan, green, magenta, red, blue
+// and black, channel major
+static const f32 bars[4][8] = {
+    { 1.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f, 0.0f, 0.0f },
+    { 1.0f, 1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f },
+    { 1.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f },
+    { 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f },
+};
+
+static const char* const pattern_names[] = { "testcolors", "testcolors-vertical", "bars", "checkerboard", "pq-wedge" };
+
+static void Usage()
+{
+    printf("usage: colortest-gen [-pattern name] [-transfer scrgb|hdr10|srgb] [-width w] [-height h]\n");
+    printf("                     [-band MB] [-threads n] [-trace trace.json] [-lut in.cube]\n");
+    printf("                     [-image in.pfm|.rgba16f|.rgba32f [-image-size w,h]]\n");
+    printf("                     output.pfm|.png|.rgba16f|.rgba16|.rgb10a2|.r11g11b10f|.rgb9e5|.bgra8\n");
+    printf("       colortest-gen [-transfer scrgb|hdr10|srgb] [-lut-size n] [-lut-shaper pq|linear]\n");
+    printf("                     [-lut-domain lo,hi] -bake-lut out.cube\n");
+    printf("patterns:");
+    for (const char* name : pattern_names)
+        printf(" %s", name);
+    printf("\n");
+    printf("PFM stores the transfer's output as f32, PNG quantizes it to 16 bits with a cICP chunk,\n");
+    printf("and the raw formats are the packed pixels as DXGI lays them out, top row first.\n");
+    printf("-lut generates through a .cube LUT instead of the transfer, which then only tags the PNG.\n");
+    printf("-bake-lut writes the transfer as a .cube LUT, PQ shaped by default, 65^3 for hdr10 and\n");
+    printf("33^3 otherwise, over -0.5..125 (-40 to 10000 nits) or 0..1 for srgb and linear.\n");
+    printf("-image converts a linear scRGB image in place of the pattern, at its own size unless\n");
+    printf("-width or -height is given. Raw .rgba16f and .rgba32f files need -image-size.\n");
+}
+
+static bool EndsWith(const char* s, const char* suffix)
+{
+    usize a = strlen(s);
+    usize b = strlen(suffix);
+    return a >= b && strcmp(s + a - b, suffix) == 0;
+}
+
+int main(int argc, char** argv)
+{
+    Gen_Options options;
+    const char* pattern = "testcolors";
+    const char* transferName = "scrgb";
+    const char* path = nullptr;
+    const char* tracePath = nullptr;
+    const char* lutPath = nullptr;
+    const char* bakePath = nullptr;
+    const char* lutShaperName = nullptr;
+    const char* lutDomain = nullptr;
+    const char* imagePath = nullptr;
+    const char* imageSize = nullptr;
+    u32 lutSize = 0;
+    u32 width = options.width;
+    u32 height = options.height;
+    bool sized = false;
+    for (int i = 1; i < argc; i++)
+    {
+        if (i + 1 < argc && strcmp(argv[i], "-pattern") == 0)
+            pattern = argv[++i];
+        else if (i + 1 < argc && strcmp(argv[i], "-transfer") == 0)
+            transferName = argv[++i];
+        else if (i + 1 < argc && strcmp(argv[i], "-width") == 0)
+        {
+            width = (u32)atoi(argv[++i]);
+            sized = true;
+        }
+        else if (i + 1 < argc && strcmp(argv[i], "-height") == 0)
+        {
+            height = (u32)atoi(argv[++i]);
+            sized = true;
+        }
+        else if (i + 1 < argc && strcmp(argv[i], "-band") == 0)
+            options.bandBytes = (usize)(atof(argv[++i]) * 1048576.0);
+        else if (i + 1 < argc && strcmp(argv[i], "-threads") == 0)
+            Parallel_SetThreads((u32)atoi(argv[++i]));
+        else if (i + 1 < argc && strcmp(argv[i], "-trace") == 0)
+            tracePath = argv[++i];
+        else if (i + 1 < argc && strcmp(argv[i], "-lut") == 0)
+            lutPath = argv[++i];
+        else if (i + 1 < argc && strcmp(argv[i], "-bake-lut") == 0)
+            bakePath = argv[++i];
+        else if (i + 1 < argc && strcmp(argv[i], "-lut-size") == 0)
+            lutSize = (u32)atoi(argv[++i]);
+        else if (i + 1 < argc && strcmp(argv[i], "-lut-shaper") == 0)
+            lutShaperName = argv[++i];
+        else if (i + 1 < argc && strcmp(argv[i], "-lut-domain") == 0)
+            lutDomain = argv[++i];
+        else if (i + 1 < argc && strcmp(argv[i], "-image") == 0)
+            imagePath = argv[++i];
+        else if (i + 1 < argc && strcmp(argv[i], "-image-size") == 0)
+            imageSize = argv[++i];
+        else if (argv[i][0] != '-' && !path)
+            path = argv[i];
+        else
+        {
+            Usage();
+            return 1;
+        }
+    }
+    Gen_Transfer transfer;
+    if (strcmp(transferName, "scrgb") == 0)
+        transfer = Gen_Transfer::scRGB;
+    else if (strcmp(transferName, "hdr10") == 0)
+        transfer = Gen_Transfer::HDR10;
+    else if (strcmp(transferName, "srgb") == 0)
+        transfer = Gen_Transfer::sRGB;
+    else
+    {
+        Usage();
+        return 1;
+    }
+
+    if (bakePath)
+    {
+        Lut_Shaper shaper = Lut_Shaper::PQ;
+        if (lutShaperName && strcmp(lutShaperName, "linear") == 0)
+            shaper = Lut_Shaper::Linear;
+        else if (lutShaperName && strcmp(lutShaperName, "pq") != 0)
+        {
+            Usage();
+            return 1;
+        }
+        bool hdr = shaper == Lut_Shaper::PQ && transfer != Gen_Transfer::sRGB;
+        f32 lo = hdr ? -0.5f : 0.0f;
+        f32 hi = hdr ? 125.0f : 1.0f;
+        if (lutDomain && sscanf(lutDomain, "%f,%f", &lo, &hi) != 2)
+        {
+            Usage();
+            return 1;
+        }
+        if (!lutSize)
+            lutSize = transfer == Gen_Transfer::HDR10 ? 65 : 33;
+        void (*apply)(f32*, usize) = Transfer_scRGB::Apply;
+        if (transfer == Gen_Transfer::HDR10)
+            apply = Transfer_HDR10::Apply;
+        else if (transfer == Gen_Transfer::sRGB)
+            apply = Transfer_sRGB::Apply;
+        Lut3D lut;
+        if (!Lut_Bake(&lut, lutSize, shaper, lo, hi, apply))
+        {
+            printf("can't bake a %u^3 LUT over %g..%g with that shaper\n", lutSize, lo, hi);
+            return 1;
+        }
+        lut.title = std::string("colortest-gen ") + transferName;
+        if (!Lut_Write_Cube(lut, bakePath))
+        {
+            printf("failed to write %s\n", bakePath);
+            return 1;
+        }
+        printf("wrote %s, %u^3 over %g..%g\n", bakePath, lutSize, lo, hi);
+        return 0;
+    }
+
+    // The image stays mapped while it is converted, it is never read into
+    // memory of our own
+    Image_File image;
+    if (imagePath)
+    {
+        u32 rawWidth = 0;
+        u32 rawHeight = 0;
+        if (imageSize && sscanf(imageSize, "%u,%u", &rawWidth, &rawHeight) != 2)
+        {
+            Usage();
+            return 1;
+        }
+        if (!image.Open(imagePath, rawWidth, rawHeight))
+        {
+            printf("failed to open %s, or it isn't a PFM file or a raw file of the -image-size given\n", imagePath);
+            return 1;
+        }
+        if (!sized)
+        {
+            width = image.Width();
+            height = image.Height();
+        }
+    }
+
+    // Only a band is ever in memory, so just the extents are limited
+    if (!path || width < 1 || width > generate_max_extent || height < 1 || height > generate_max_extent)
+    {
+        Usage();
+        return 1;
+    }
+    options.width = width;
+    options.height = height;
+
+    Lut3D lut;
+    if (lutPath)
+    {
+        if (!Lut_Read_Cube(lutPath, &lut))
+        {
+            printf("failed to read %s\n", lutPath);
+            return 1;
+        }
+        options.lut = &lut;
+    }
+
+    Gen_Container container;
+    if (EndsWith(path, ".pfm"))
+        container = Gen_Container::PFM;
+    else if (EndsWith(path, ".png"))
+        container = Gen_Container::PNG;
+    else if (EndsWith(path, ".rgba16f"))
+        container = Gen_Container::RGBA16F;
+    else if (EndsWith(path, ".rgba16"))
+        container = Gen_Container::RGBA16;
+    else if (EndsWith(path, ".rgb10a2"))
+        container = Gen_Container::RGB10A2;
+    else if (EndsWith(path, ".r11g11b10f"))
+        container = Gen_Container::R11G11B10F;
+    else if (EndsWith(path, ".rgb9e5"))
+        container = Gen_Container::RGB9E5;
+    else if (EndsWith(path, ".bgra8"))
+        container = Gen_Container::BGRA8;
+    else
+    {
+        Usage();
+        return 1;
+    }
+
+    FILE* file = fopen(path, "wb");
+    if (!file)
+    {
+        printf("failed to open %s\n", path);
+        return 1;
+    }
+    Gen_Output out(file, container);
+    auto start = std::chrono::steady_clock::now();
+    bool ok = out.Begin(width, height, transfer);
+    if (image.IsOpen())
+    {
+        ok = ok && Gen_Transfer_Format(out, transfer, container, Pattern_Image(image), options);
+    }
+    else if (strcmp(pattern, "testcolors") == 0)
+    {
+        ok = ok && Gen_Transfer_Format(out, transfer, container, pattern_testcolors, options);
+    }
+    else if (strcmp(pattern, "testcolors-vertical") == 0)
+    {
+        ok = ok && Gen_Transfer_Format(out, transfer, container, pattern_testcolors_vertical, options);
+    }
+    else if (strcmp(pattern, "bars") == 0)
+    {
+        const Pattern_Bars p(&bars[0][0], 8);
+        ok = ok && Gen_Transfer_Format(out, transfer, container, p, options);
+    }
+    else if (strcmp(pattern, "checkerboard") == 0)
+    {
+        const Pattern_Checkerboard p = { { 2.0f, 2.0f, 2.0f, 1.0f }, { 0.0f, 0.0f, 0.0f, 1.0f }, 64 };
+        ok = ok && Gen_Transfer_Format(out, transfer, container, p, options);
+    }
+    else if (strcmp(pattern, "pq-wedge") == 0)
+    {
+        const Pattern_PQ_Wedge p(32, 0.0f, 10000.0f);
+        ok = ok && Gen_Transfer_Format(out, transfer, container, p, options);
+    }
+    else
+    {
+        fclose(file);
+        remove(path);
+        Usage();
+        return 1;
+    }
+    ok = fclose(file) == 0 && ok;
+    auto end = std::chrono::steady_clock::now();
+    if (!ok)
+    {
+        printf("failed to write %s\n", path);
+        return 1;
+    }
+    printf("wrote %s in %.2f ms\n", path, std::chrono::duration<f64, std::milli>(end - start).count());
+    if (tracePath && !Trace_Write_JSON(tracePath))
+        printf("failed to write %s, tracing needs a build with TRACE_ENABLED=1\n", tracePath);
+    return 0;
+}
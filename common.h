@@ -0,0 +1,25 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// common.h : Basic types shared by the platform code and the portable color
+// and image generation code.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Rust has better names for the regular types.
+using i8 = int8_t;
+using u8 = uint8_t;
+using i16 = int16_t;
+using u16 = uint16_t;
+using f32 = float;
+using i32 = int32_t;
+using u32 = uint32_t;
+using f64 = double;
+using i64 = int64_t;
+using u64 = uint64_t;
+using usize = size_t;
@@ -0,0 +1,156 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// compose.cpp : Renders the expected output of the test scene with the
+// reference compositor and writes it to a file, portable so it runs on any
+// machine, e.g. on Linux:
+//   c++ -O2 -std=c++17 -pthread compose.cpp reference_compositor.cpp color.cpp format.cpp generate.cpp image_file.cpp parallel.cpp trace.cpp -o compose
+//   ./compose -scale 1.5 -width 3840 -height 2160 scene.pfm
+//   ./compose -image render.pfm -width 7744 -height 13056 scene.pfm
+//
+
+#include "generate.h"
+#include "image_file.h"
+#include "reference_compositor.h"
+#include "trace.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+static void Usage()
+{
+    printf("usage: compose [-scale s] [-width w] [-height h] [-white nits] [-trace trace.json]\n");
+    printf("               [-image in.pfm|.rgba16f|.rgba32f [-image-size w,h]] output.pfm|output.rgba16f\n");
+    printf("-image shows an scRGB image file in the layers in place of testcolors.\n");
+}
+
+int main(int argc, char** argv)
+{
+    f32 scale = 1.0f;
+    u32 width = 1920;
+    u32 height = 1080;
+    Reference_Options options;
+    const char* path = nullptr;
+    const char* tracePath = nullptr;
+    const char* imagePath = nullptr;
+    const char* imageSize = nullptr;
+    for (int i = 1; i < argc; i++)
+    {
+        if (i + 1 < argc && strcmp(argv[i], "-scale") == 0)
+            scale = (f32)atof(argv[++i]);
+        else if (i + 1 < argc && strcmp(argv[i], "-width") == 0)
+            width = (u32)atoi(argv[++i]);
+        else if (i + 1 < argc && strcmp(argv[i], "-height") == 0)
+            height = (u32)atoi(argv[++i]);
+        else if (i + 1 < argc && strcmp(argv[i], "-white") == 0)
+            options.sdrWhiteLevel = (f32)atof(argv[++i]);
+        else if (i + 1 < argc && strcmp(argv[i], "-trace") == 0)
+            tracePath = argv[++i];
+        else if (i + 1 < argc && strcmp(argv[i], "-image") == 0)
+            imagePath = argv[++i];
+        else if (i + 1 < argc && strcmp(argv[i], "-image-size") == 0)
+            imageSize = argv[++i];
+        else if (argv[i][0] != '-' && !path)
+            path = argv[i];
+        else
+        {
+            Usage();
+            return 1;
+        }
+    }
+    // The canvas is RGBA16F
+    usize canvasBytes;
+    if (!path || scale <= 0.0f || !Generate_Size(width, height, 8, &canvasBytes))
+    {
+        Usage();
+        return 1;
+    }
+
+    Image_File image;
+    if (imagePath)
+    {
+        u32 rawWidth = 0;
+        u32 rawHeight = 0;
+        if (imageSize && sscanf(imageSize, "%u,%u", &rawWidth, &rawHeight) != 2)
+        {
+            Usage();
+            return 1;
+        }
+        if (!image.Open(imagePath, rawWidth, rawHeight))
+        {
+            printf("failed to open %s, or it isn't a PFM file or a raw file of the -image-size given\n", imagePath);
+            return 1;
+        }
+    }
+
+    std::vector<Scene_Layer> scene;
+    if (image.IsOpen())
+        Scene_Image(scene, scale, image.Width(), image.Height());
+    else
+        Scene_TestColors(scene, scale);
+
+    // Every column shows the same three images, and the three are generated
+    // together
+    std::vector<std::unique_ptr<u8[]>> images;
+    for (usize i = 0; i < scene.size(); i++)
+    {
+        Scene_Layer& s = scene[i];
+        for (usize j = 0; j < i && !s.pixels; j++)
+            if (scene[j].pattern == s.pattern && scene[j].dxgiFormat == s.dxgiFormat && scene[j].width == s.width && scene[j].height == s.height)
+                s.pixels = scene[j].pixels;
+        if (s.pixels)
+            continue;
+        usize bytes;
+        if (!Generate_Size(s.width, s.height, s.bytesPerPixel, &bytes))
+            continue;
+        images.emplace_back(new u8[bytes]);
+        s.pixels = images.back().get();
+    }
+    for (usize i = 0; i < scene.size(); i++)
+    {
+        const Scene_Layer& s = scene[i];
+        bool first = s.pixels != nullptr;
+        for (usize j = 0; j < i && first; j++)
+            first = !(scene[j].pattern == s.pattern && scene[j].width == s.width && scene[j].height == s.height);
+        if (!first)
+            continue;
+        Generate_Outputs outputs;
+        for (usize j = i; j < scene.size(); j++)
+        {
+            const Scene_Layer& o = scene[j];
+            if (o.pattern != s.pattern || o.width != s.width || o.height != s.height)
+                continue;
+            if (o.dxgiFormat == dxgi_format_r16g16b16a16_float)
+                outputs.scRGB.pixels = (void*)o.pixels;
+            else if (o.dxgiFormat == dxgi_format_r10g10b10a2_unorm)
+                outputs.hdr10.pixels = (void*)o.pixels;
+            else
+                outputs.sRGB.pixels = (void*)o.pixels;
+        }
+        if (s.pattern == scene_pattern_image)
+            Image_File_Generate_Multi(image, outputs, s.width, s.height);
+        else
+            GenerateImage_TestColors(outputs, s.width, s.height);
+    }
+
+    Reference_Canvas canvas;
+    auto start = std::chrono::steady_clock::now();
+    bool ok = Reference_Composite(canvas, width, height, scene.data(), scene.size(), options);
+    auto end = std::chrono::steady_clock::now();
+    printf("composited %zu layers into %ux%u in %.2f ms\n", scene.size(), width, height, std::chrono::duration<f64, std::milli>(end - start).count());
+    if (!ok)
+        printf("some layers have an unsupported format and were left out\n");
+    if (!Reference_Canvas_Save(canvas, path))
+    {
+        printf("failed to write %s\n", path);
+        return 1;
+    }
+    if (tracePath && !Trace_Write_JSON(tracePath))
+        printf("failed to write %s, tracing needs a build with TRACE_ENABLED=1\n", tracePath);
+    return 0;
+}
@@ -0,0 +1,103 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// format.cpp : The pixel formats, on top of the vectorized span conversions in
+// color.cpp, and the table of them by DXGI_FORMAT.
+//
+
+#include "format.h"
+
+void Format_RGBA16F::Pack(const f32* rgba, void* dst, usize pixels)
+{
+    ToF16_Span(rgba, (u16*)dst, 4 * pixels);
+}
+
+void Format_RGBA16F::Unpack(const void* src, f32* rgba, usize pixels)
+{
+    FromF16_Span((const u16*)src, rgba, 4 * pixels);
+}
+
+void Format_RGBA16::Pack(const f32* rgba, void* dst, usize pixels)
+{
+    Color_Pack_RGBA16_Span(rgba, (u16*)dst, pixels);
+}
+
+void Format_RGBA16::Unpack(const void* src, f32* rgba, usize pixels)
+{
+    Color_Unpack_RGBA16_Span((const u16*)src, rgba, pixels);
+}
+
+void Format_RGB10A2::Pack(const f32* rgba, void* dst, usize pixels)
+{
+    Color_Pack_RGB10A2_Span(rgba, (u32*)dst, pixels);
+}
+
+void Format_RGB10A2::Unpack(const void* src, f32* rgba, usize pixels)
+{
+    Color_Unpack_RGB10A2_Span((const u32*)src, rgba, pixels);
+}
+
+void Format_R11G11B10F::Pack(const f32* rgba, void* dst, usize pixels)
+{
+    Color_Pack_R11G11B10F_Span(rgba, (u32*)dst, pixels);
+}
+
+void Format_R11G11B10F::Unpack(const void* src, f32* rgba, usize pixels)
+{
+    Color_Unpack_R11G11B10F_Span((const u32*)src, rgba, pixels);
+}
+
+void Format_RGBA8_sRGB::Pack(const f32* rgba, void* dst, usize pixels)
+{
+    Color_Encode_RGBA8_sRGB_Span(rgba, (u32*)dst, pixels);
+}
+
+void Format_RGBA8_sRGB::Unpack(const void* src, f32* rgba, usize pixels)
+{
+    Color_Decode_RGBA8_sRGB_Span((const u32*)src, rgba, pixels);
+}
+
+void Format_RGB9E5::Pack(const f32* rgba, void* dst, usize pixels)
+{
+    Color_Pack_RGB9E5_Span(rgba, (u32*)dst, pixels);
+}
+
+void Format_RGB9E5::Unpack(const void* src, f32* rgba, usize pixels)
+{
+    Color_Unpack_RGB9E5_Span((const u32*)src, rgba, pixels);
+}
+
+void Format_BGRA8::Pack(const f32* rgba, void* dst, usize pixels)
+{
+    Color_Pack_BGRA8_Span(rgba, (u32*)dst, pixels);
+}
+
+void Format_BGRA8::Unpack(const void* src, f32* rgba, usize pixels)
+{
+    Color_Unpack_BGRA8_Span((const u32*)src, rgba, pixels);
+}
+
+template <class Format> static constexpr Format_Desc Format_Describe(const char* name)
+{
+    return { Format::dxgi, name, Format::bpp, Format::Pack, Format::Unpack };
+}
+
+const Format_Desc format_descs[] = {
+    Format_Describe<Format_RGBA16F>("R16G16B16A16_FLOAT"),
+    Format_Describe<Format_RGBA16>("R16G16B16A16_UNORM"),
+    Format_Describe<Format_RGB10A2>("R10G10B10A2_UNORM"),
+    Format_Describe<Format_R11G11B10F>("R11G11B10_FLOAT"),
+    Format_Describe<Format_RGBA8_sRGB>("R8G8B8A8_UNORM_SRGB"),
+    Format_Describe<Format_RGB9E5>("R9G9B9E5_SHAREDEXP"),
+    Format_Describe<Format_BGRA8>("B8G8R8A8_UNORM"),
+};
+const usize format_desc_count = sizeof(format_descs) / sizeof(format_descs[0]);
+
+const Format_Desc* Format_Find(u32 dxgiFormat)
+{
+    for (const Format_Desc& desc : format_descs)
+        if (desc.dxgi == dxgiFormat)
+            return &desc;
+    return nullptr;
+}
@@ -0,0 +1,109 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// format.h : Pixel formats, packing spans of RGBA f32 pixels into the DXGI
+// layouts and unpacking them again.
+//
+// Each format is a type with these members, so the generators can be
+// specialized on it at compile time (a generator only needs bpp and Pack):
+//
+//   static constexpr u32 dxgi;        // DXGI_FORMAT value
+//   static constexpr usize bpp;       // bytes per pixel
+//   static void Pack(const f32* rgba, void* dst, usize pixels);
+//   static void Unpack(const void* src, f32* rgba, usize pixels);
+//
+// Format_Find looks the same functions up by DXGI_FORMAT at runtime. The
+// values packed are whatever the format stores, already through a transfer
+// function for the UNORM formats, except the _SRGB format, which like a D3D
+// render target view takes linear values and applies the sRGB curve itself.
+//
+
+#pragma once
+
+#include "color.h"
+
+// DXGI_FORMAT values, so formats can be described without the Windows headers
+constexpr u32 dxgi_format_r16g16b16a16_float = 10;
+constexpr u32 dxgi_format_r16g16b16a16_unorm = 11;
+constexpr u32 dxgi_format_r10g10b10a2_unorm = 24;
+constexpr u32 dxgi_format_r11g11b10_float = 26;
+constexpr u32 dxgi_format_r8g8b8a8_unorm_srgb = 29;
+constexpr u32 dxgi_format_r9g9b9e5_sharedexp = 67;
+constexpr u32 dxgi_format_b8g8r8a8_unorm = 87;
+
+struct Format_RGBA16F
+{
+    static constexpr u32 dxgi = dxgi_format_r16g16b16a16_float;
+    static constexpr usize bpp = 8;
+    static void Pack(const f32* rgba, void* dst, usize pixels);
+    static void Unpack(const void* src, f32* rgba, usize pixels);
+};
+
+struct Format_RGBA16
+{
+    static constexpr u32 dxgi = dxgi_format_r16g16b16a16_unorm;
+    static constexpr usize bpp = 8;
+    static void Pack(const f32* rgba, void* dst, usize pixels);
+    static void Unpack(const void* src, f32* rgba, usize pixels);
+};
+
+struct Format_RGB10A2
+{
+    static constexpr u32 dxgi = dxgi_format_r10g10b10a2_unorm;
+    static constexpr usize bpp = 4;
+    static void Pack(const f32* rgba, void* dst, usize pixels);
+    static void Unpack(const void* src, f32* rgba, usize pixels);
+};
+
+/// No alpha, unpacks with alpha 1
+struct Format_R11G11B10F
+{
+    static constexpr u32 dxgi = dxgi_format_r11g11b10_float;
+    static constexpr usize bpp = 4;
+    static void Pack(const f32* rgba, void* dst, usize pixels);
+    static void Unpack(const void* src, f32* rgba, usize pixels);
+};
+
+/// Packs linear values, unpacks to linear
+struct Format_RGBA8_sRGB
+{
+    static constexpr u32 dxgi = dxgi_format_r8g8b8a8_unorm_srgb;
+    static constexpr usize bpp = 4;
+    static void Pack(const f32* rgba, void* dst, usize pixels);
+    static void Unpack(const void* src, f32* rgba, usize pixels);
+};
+
+/// No alpha, unpacks with alpha 1
+struct Format_RGB9E5
+{
+    static constexpr u32 dxgi = dxgi_format_r9g9b9e5_sharedexp;
+    static constexpr usize bpp = 4;
+    static void Pack(const f32* rgba, void* dst, usize pixels);
+    static void Unpack(const void* src, f32* rgba, usize pixels);
+};
+
+struct Format_BGRA8
+{
+    static constexpr u32 dxgi = dxgi_format_b8g8r8a8_unorm;
+    static constexpr usize bpp = 4;
+    static void Pack(const f32* rgba, void* dst, usize pixels);
+    static void Unpack(const void* src, f32* rgba, usize pixels);
+};
+
+/// A format's functions, for choosing the format at runtime
+struct Format_Desc
+{
+    u32 dxgi;
+    const char* name;
+    usize bpp;
+    void (*pack)(const f32* rgba, void* dst, usize pixels);
+    void (*unpack)(const void* src, f32* rgba, usize pixels);
+};
+
+/// Every format, in DXGI_FORMAT order
+extern const Format_Desc format_descs[];
+extern const usize format_desc_count;
+
+/// The format with this DXGI_FORMAT value, or nullptr if there isn't one
+const Format_Desc* Format_Find(u32 dxgiFormat);
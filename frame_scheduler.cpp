@@ -0,0 +1,116 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// frame_scheduler.cpp : Decides when the main loop runs an update.
+//
+
+#include "frame_scheduler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+// Enough updates for the percentiles to cover a few minutes of interaction
+constexpr usize frame_latency_samples = 1024;
+
+Frame_Clock Frame_Clock_Steady()
+{
+    return []() {
+        return (u64)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    };
+}
+
+Frame_Wait Frame_Wait_Sleep()
+{
+    return [](u64 timeout) {
+        // Nothing can wake a sleep early, so waiting forever would never return
+        if (timeout != frame_forever)
+            std::this_thread::sleep_for(std::chrono::nanoseconds(timeout));
+        return false;
+    };
+}
+
+Frame_Scheduler::Frame_Scheduler(Frame_Clock _clock, Frame_Wait _wait)
+    : clock(_clock)
+    , wait(_wait)
+{
+    latencies.reserve(frame_latency_samples);
+}
+
+void Frame_Scheduler::SetInterval(u64 _interval)
+{
+    interval = _interval;
+    u64 now = clock();
+    deadline = interval == frame_forever || now > frame_forever - interval ? frame_forever : now + interval;
+}
+
+void Frame_Scheduler::MarkDirty()
+{
+    if (!dirty)
+        dirtySince = clock();
+    dirty = true;
+}
+
+bool Frame_Scheduler::Step(const std::function<bool()>& pump, const std::function<void()>& update)
+{
+    u64 now = clock();
+    bool input = false;
+    if (!dirty && now < deadline)
+    {
+        input = wait(deadline == frame_forever ? frame_forever : deadline - now);
+        wakeups++;
+    }
+    if (input && !pump())
+        return false;
+
+    now = clock();
+    if (!dirty && now < deadline)
+    {
+        idleWakeups++;
+        return true;
+    }
+
+    // Whichever asked first is what the update is late for
+    u64 needed = dirty && dirtySince < deadline ? dirtySince : deadline;
+    dirty = false;
+    update();
+    u64 end = clock();
+    Record(now, end, needed);
+    deadline = interval == frame_forever || end > frame_forever - interval ? frame_forever : end + interval;
+    return true;
+}
+
+void Frame_Scheduler::Record(u64 start, u64 end, u64 needed)
+{
+    u64 duration = end - start;
+    u64 latency = end > needed ? end - needed : 0;
+    updates++;
+    durationTotal += duration;
+    durationMax = duration > durationMax ? duration : durationMax;
+    latencyMax = latency > latencyMax ? latency : latencyMax;
+    if (latencies.size() < frame_latency_samples)
+        latencies.push_back(latency);
+    else
+        latencies[latencyNext] = latency;
+    latencyNext = (latencyNext + 1) % frame_latency_samples;
+}
+
+Frame_Stats Frame_Scheduler::Stats() const
+{
+    Frame_Stats stats;
+    stats.updates = updates;
+    stats.wakeups = wakeups;
+    stats.idleWakeups = idleWakeups;
+    if (updates == 0)
+        return stats;
+    const f64 ms = 1e-6;
+    stats.durationMean = durationTotal * ms / updates;
+    stats.durationMax = durationMax * ms;
+    stats.latencyMax = latencyMax * ms;
+    std::vector<u64> sorted(latencies);
+    std::sort(sorted.begin(), sorted.end());
+    stats.latencyMedian = sorted[sorted.size() / 2] * ms;
+    stats.latency99 = sorted[(sorted.size() * 99) / 100] * ms;
+    return stats;
+}
@@ -0,0 +1,87 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// frame_scheduler.h : Decides when the main loop runs an update, sleeping
+// until a message arrives, something is marked dirty or a deadline passes,
+// and keeps statistics of how long updates take and how late they are.
+//
+
+#pragma once
+
+#include "common.h"
+
+#include <functional>
+#include <vector>
+
+/// Returns the current time in nanoseconds, from any fixed origin
+typedef std::function<u64()> Frame_Clock;
+
+/// Blocks until input arrives or timeout nanoseconds pass, whichever is first,
+/// and returns true if input arrived. frame_forever means no timeout.
+typedef std::function<bool(u64 timeout)> Frame_Wait;
+
+constexpr u64 frame_forever = ~(u64)0;
+
+/// std::chrono::steady_clock
+Frame_Clock Frame_Clock_Steady();
+
+/// Sleeps for the timeout, for loops that have no input to wait on
+Frame_Wait Frame_Wait_Sleep();
+
+/// Summary of the recent updates, in milliseconds. Duration is how long an
+/// update ran, latency is from when it was needed (the first MarkDirty or the
+/// deadline) to when it finished.
+struct Frame_Stats
+{
+    u64 updates = 0;
+    u64 wakeups = 0;
+    /// Wakeups that didn't need an update, such as messages that changed nothing
+    u64 idleWakeups = 0;
+    f64 durationMean = 0;
+    f64 durationMax = 0;
+    f64 latencyMedian = 0;
+    f64 latency99 = 0;
+    f64 latencyMax = 0;
+};
+
+class Frame_Scheduler
+{
+public:
+    Frame_Scheduler(Frame_Clock clock, Frame_Wait wait);
+
+    /// Time between updates when nothing else asks for one, such as for
+    /// polling the device state, frame_forever for none
+    void SetInterval(u64 interval);
+
+    /// Asks for an update as soon as possible, such as from a message handler
+    void MarkDirty();
+
+    /// Waits until there are messages, something is dirty or the deadline
+    /// passes. Then calls pump when the wait reported input, and update if it is
+    /// needed after that. Returns false once pump does, to quit.
+    bool Step(const std::function<bool()>& pump, const std::function<void()>& update);
+
+    Frame_Stats Stats() const;
+
+private:
+    void Record(u64 start, u64 end, u64 needed);
+
+    Frame_Clock clock;
+    Frame_Wait wait;
+    u64 interval = frame_forever;
+    u64 deadline = frame_forever;
+    bool dirty = false;
+    /// When the first MarkDirty since the last update happened
+    u64 dirtySince = 0;
+
+    u64 updates = 0;
+    u64 wakeups = 0;
+    u64 idleWakeups = 0;
+    u64 durationTotal = 0;
+    u64 durationMax = 0;
+    u64 latencyMax = 0;
+    /// The latency of the most recent updates, for percentiles
+    std::vector<u64> latencies;
+    usize latencyNext = 0;
+};
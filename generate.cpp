@@ -0,0 +1,60 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// generate.cpp : Transfers for the image generators, and the testcolors
+// generators used by the compositor scene.
+//
+
+#include "generate.h"
+
+// Convert to Rec2020 first so the PQ curve is applied to the whole span at once
+void Transfer_HDR10::Apply(f32* rgba, usize pixels)
+{
+    Color_scRGB_To_Rec2020_Span(rgba, rgba, pixels);
+    Color_Transfer_To_PQ_Span(rgba, rgba, pixels);
+}
+
+void Transfer_sRGB::Apply(f32* rgba, usize pixels)
+{
+    for (usize x = 0; x < pixels; x++)
+        Color_Transfer_To_sRGB(&rgba[4 * x], &rgba[4 * x]);
+}
+
+// The whole image, or just the caller's rect of it
+static Generate_Rect Generate_Rect_Or_Image(u32 width, u32 height, const Generate_Rect* rect)
+{
+    Generate_Rect all = { 0, 0, width, height };
+    return rect ? *rect : all;
+}
+
+void GenerateImage_RGBA16F_scRGB(u16* pixels, u32 width, u32 height, usize pitch, const Generate_Rect* rect)
+{
+    TRACE_SCOPE("GenerateImage_RGBA16F_scRGB");
+    Generate_Rect r = Generate_Rect_Or_Image(width, height, rect);
+    GenerateImage_Rect<Pattern_Gradient, Transfer_scRGB, Format_RGBA16F>(pixels, pitch ? pitch : Format_RGBA16F::bpp * r.width, width, height, r, pattern_testcolors);
+}
+
+// Generates an HDR10 image - converts scRGB gradient to Rec2100 (Rec2020 HDR),
+// uses PQ transfer function and encodes as RGB10A2.
+void GenerateImage_RGB10A2_HDR10(u32* pixels, u32 width, u32 height, usize pitch, const Generate_Rect* rect)
+{
+    TRACE_SCOPE("GenerateImage_RGB10A2_HDR10");
+    Generate_Rect r = Generate_Rect_Or_Image(width, height, rect);
+    GenerateImage_Rect<Pattern_Gradient, Transfer_HDR10, Format_RGB10A2>(pixels, pitch ? pitch : Format_RGB10A2::bpp * r.width, width, height, r, pattern_testcolors);
+}
+
+// 8bit sRGB or rec709 (Windows doesn't distinguish between them)
+void GenerateImage_BGRA8_sRGB(u32* pixels, u32 width, u32 height, usize pitch, const Generate_Rect* rect)
+{
+    TRACE_SCOPE("GenerateImage_BGRA8_sRGB");
+    Generate_Rect r = Generate_Rect_Or_Image(width, height, rect);
+    GenerateImage_Rect<Pattern_Gradient, Transfer_sRGB, Format_BGRA8>(pixels, pitch ? pitch : Format_BGRA8::bpp * r.width, width, height, r, pattern_testcolors);
+}
+
+// All three at once, for a column of the scene whose layers are the same size
+void GenerateImage_TestColors(const Generate_Outputs& outputs, u32 width, u32 height, const Generate_Rect* rect)
+{
+    TRACE_SCOPE("GenerateImage_TestColors");
+    GenerateImage_Multi_Rect(outputs, width, height, Generate_Rect_Or_Image(width, height, rect), pattern_testcolors);
+}
@@ -0,0 +1,370 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// generate.h : Test image generators.
+//
+// GenerateImage<Pattern, Transfer, Format> is specialized at compile time on
+// all three, the pattern writes spans of linear scRGB pixels, the transfer
+// converts a span in place to the output colorspace and encoding, and the
+// format (format.h) packs the span into the destination. There is no per pixel
+// dispatch, any combination is as fast as a hand written loop.
+//
+// Rows are filled in bands spread over the thread pool, and don't depend on
+// each other, so the result is the same for any number of threads.
+//
+
+#pragma once
+
+#include "format.h"
+#include "parallel.h"
+#include "pattern.h"
+#include "trace.h"
+
+#include <cstring>
+#include <memory>
+#include <new>
+#include <vector>
+
+/// Linear scRGB (Rec.709 primaries, 1.0 = 80 nits), nothing to do
+struct Transfer_scRGB
+{
+    static void Apply(f32*, usize) {}
+};
+
+/// Rec2020 primaries with the PQ transfer function (HDR10, Rec2100)
+struct Transfer_HDR10
+{
+    static void Apply(f32* rgba, usize pixels);
+};
+
+/// Rec.709 primaries with the sRGB transfer function
+struct Transfer_sRGB
+{
+    static void Apply(f32* rgba, usize pixels);
+};
+
+/// Encodes linear scRGB RGBA pixels to the destination format, using the
+/// source span as scratch space.
+template <class Transfer, class Format> struct Generate_Encoder
+{
+    static void Encode(f32* rgba, void* dst, usize pixels)
+    {
+        Transfer::Apply(rgba, pixels);
+        Format::Pack(rgba, dst, pixels);
+    }
+};
+
+/// sRGB to 8 bits is done in one step from linear, with a table
+template <> struct Generate_Encoder<Transfer_sRGB, Format_BGRA8>
+{
+    static void Encode(f32* rgba, void* dst, usize pixels)
+    {
+        Color_Encode_BGRA8_sRGB_Span(rgba, (u32*)dst, pixels);
+    }
+};
+
+/// Largest width or height the generators take, a 32K x 32K canvas covers 8K
+/// and multi-monitor spanning surfaces with room to spare
+constexpr u32 generate_max_extent = 32768;
+
+/// Bytes in a width x height image of bpp byte pixels, false if either extent
+/// is zero or over generate_max_extent, or the size doesn't fit in a usize
+/// (a 32K x 32K RGBA16F image is 8GB, more than a 32 bit build can address)
+inline bool Generate_Size(u32 width, u32 height, usize bpp, usize* bytes)
+{
+    if (width < 1 || height < 1 || width > generate_max_extent || height > generate_max_extent)
+        return false;
+    u64 size = (u64)width * height * bpp;
+    if (bpp && size / bpp / height != width)
+        return false;
+    if (size > (u64)~(usize)0)
+        return false;
+    *bytes = (usize)size;
+    return true;
+}
+
+// Rows per band, roughly 64K pixels so bands are big enough to amortize the
+// per band row buffer but there are still plenty of them to balance the load.
+inline usize Generate_Band(u32 width)
+{
+    usize rows = 65536 / ((usize)width + 1);
+    return rows < 1 ? 1 : rows;
+}
+
+/// A rectangle of an image, in pixels
+struct Generate_Rect
+{
+    u32 x;
+    u32 y;
+    u32 width;
+    u32 height;
+};
+
+/// Generates the pixels of rect in a width x height image into a caller owned
+/// buffer, such as mapped texture memory. dst points at the rect's top left
+/// pixel and rows are pitch bytes apart, pitch is at least rect.width *
+/// Format::bpp and keeps rows aligned for the format's pixel type, bytes
+/// between rows are left alone. The pixels are identical to the same pixels
+/// of GenerateImage. A rect that isn't inside the image generates nothing.
+template <class Pattern, class Transfer, class Format>
+void GenerateImage_Rect(void* dst, usize pitch, u32 width, u32 height, Generate_Rect rect, const Pattern& pattern)
+{
+    typedef Generate_Encoder<Transfer, Format> Encoder;
+    if (rect.width < 1 || rect.height < 1)
+        return;
+    if (rect.x > width || rect.width > width - rect.x || rect.y > height || rect.height > height - rect.y)
+        return;
+    TRACE_SCOPE("GenerateImage_Rect");
+    u8* base = (u8*)dst;
+    constexpr usize bpp = Format::bpp;
+    usize bytes = bpp * rect.width;
+    TRACE_COUNT("bytes generated", bytes * rect.height);
+    u32 x0 = rect.x;
+    u32 y0 = rect.y;
+    u32 count = rect.width;
+
+    switch (pattern.separability)
+    {
+    case Pattern_Separability::Row_Invariant:
+    {
+        // Only the first row is evaluated, the rest are copies of it
+        std::vector<f32> row(4 * (usize)count);
+        pattern.Span(row.data(), x0, y0, count, width, height);
+        Encoder::Encode(row.data(), base, count);
+        Parallel_For(rect.height, Generate_Band(count) * 4, [=](usize r0, usize r1) {
+            for (usize r = r0 > 0 ? r0 : 1; r < r1; r++)
+                memcpy(base + r * pitch, base, bytes);
+        });
+        break;
+    }
+    case Pattern_Separability::Column_Invariant:
+        // One pixel per row is evaluated, then doubled across the row
+        Parallel_For(rect.height, Generate_Band(count) * 4, [=, &pattern](usize r0, usize r1) {
+            for (usize r = r0; r < r1; r++)
+            {
+                u8* row = base + r * pitch;
+                f32 c[4];
+                pattern.Span(c, x0, y0 + (u32)r, 1, width, height);
+                Encoder::Encode(c, row, 1);
+                for (usize done = bpp; done < bytes; done *= 2)
+                    memcpy(row + done, row, done < bytes - done ? done : bytes - done);
+            }
+        });
+        break;
+    case Pattern_Separability::Full_2D:
+        Parallel_For(rect.height, Generate_Band(count), [=, &pattern](usize r0, usize r1) {
+            std::vector<f32> row(4 * (usize)count);
+            for (usize r = r0; r < r1; r++)
+            {
+                pattern.Span(row.data(), x0, y0 + (u32)r, count, width, height);
+                Encoder::Encode(row.data(), base + r * pitch, count);
+            }
+        });
+        break;
+    }
+}
+
+/// Generates a whole width x height image into rows pitch bytes apart
+template <class Pattern, class Transfer, class Format>
+void GenerateImage(void* dst, usize pitch, u32 width, u32 height, const Pattern& pattern)
+{
+    Generate_Rect rect = { 0, 0, width, height };
+    GenerateImage_Rect<Pattern, Transfer, Format>(dst, pitch, width, height, rect, pattern);
+}
+
+/// Generates a whole width x height image with tightly packed rows
+template <class Pattern, class Transfer, class Format>
+void GenerateImage(void* pixels, u32 width, u32 height, const Pattern& pattern)
+{
+    GenerateImage<Pattern, Transfer, Format>(pixels, Format::bpp * width, width, height, pattern);
+}
+
+/// Generates rows y0 to y1 (exclusive) of a width x height image, packed
+/// tightly from pixels, so a big image can be streamed through a buffer of a
+/// few rows.
+template <class Pattern, class Transfer, class Format>
+void GenerateImage_Rows(void* pixels, u32 width, u32 height, u32 y0, u32 y1, const Pattern& pattern)
+{
+    if (y0 >= y1)
+        return;
+    Generate_Rect rect = { 0, y0, width, y1 - y0 };
+    GenerateImage_Rect<Pattern, Transfer, Format>(pixels, Format::bpp * width, width, height, rect, pattern);
+}
+
+/// Rows of a width pixel wide image of bpp byte pixels that fit in budget
+/// bytes, at least one and at most height
+inline u32 Generate_Chunk_Rows(u32 width, u32 height, usize bpp, usize budget)
+{
+    usize pitch = bpp * width;
+    usize rows = pitch ? budget / pitch : height;
+    return rows < 1 ? 1 : rows < height ? (u32)rows : height;
+}
+
+/// Generates a width x height image a chunk of rows at a time through one
+/// buffer of at most budget bytes (but always at least one row), and hands
+/// each chunk to sink(const void* rows, u32 y0, u32 count, usize pitch), top
+/// to bottom or bottom to top. The whole image never has to fit in memory,
+/// even in a 32 bit build. The sink returns false to stop. Returns false if an
+/// extent is too big, the buffer can't be allocated or the sink stopped.
+template <class Pattern, class Transfer, class Format, class Sink>
+bool GenerateImage_Chunked(u32 width, u32 height, const Pattern& pattern, usize budget, bool bottomUp, Sink&& sink)
+{
+    // Only a chunk has to fit in memory, not the whole image
+    usize size;
+    if (!Generate_Size(width, 1, Format::bpp, &size) || height < 1 || height > generate_max_extent)
+        return false;
+    usize pitch = Format::bpp * width;
+    u32 rows = Generate_Chunk_Rows(width, height, Format::bpp, budget);
+    std::unique_ptr<u8[]> chunk(new (std::nothrow) u8[rows * pitch]);
+    if (!chunk)
+        return false;
+    for (u32 done = 0; done < height; done += rows)
+    {
+        u32 count = rows < height - done ? rows : height - done;
+        u32 y0 = bottomUp ? height - done - count : done;
+        GenerateImage_Rows<Pattern, Transfer, Format>(chunk.get(), width, height, y0, y0 + count, pattern);
+        if (!sink((const void*)chunk.get(), y0, count, pitch))
+            return false;
+    }
+    return true;
+}
+
+/// Pixels per tile of GenerateImage_Multi_Rect, small enough that a tile's
+/// linear scRGB and all three encodings of it stay in L1
+constexpr u32 generate_tile_pixels = 256;
+
+/// Where one encoding of GenerateImage_Multi_Rect goes, pixels points at the
+/// rect's top left pixel and rows are pitch bytes apart, 0 for tightly packed
+/// rows. A null pixels skips the encoding.
+struct Generate_Output
+{
+    void* pixels = nullptr;
+    usize pitch = 0;
+};
+
+/// The encodings of the compositor scene's layers, any of them may be left out
+struct Generate_Outputs
+{
+    /// Transfer_scRGB, Format_RGBA16F
+    Generate_Output scRGB;
+    /// Transfer_HDR10, Format_RGB10A2
+    Generate_Output hdr10;
+    /// Transfer_sRGB, Format_BGRA8
+    Generate_Output sRGB;
+};
+
+/// Encodes count linear scRGB pixels into each of the outputs, at row r of
+/// the rect from pixel x. src is left alone, HDR10 is converted in scratch.
+inline void Generate_Multi_Encode(const Generate_Outputs& outputs, const f32* src, f32* scratch, usize count, usize r, usize x)
+{
+    if (outputs.scRGB.pixels)
+        Format_RGBA16F::Pack(src, (u8*)outputs.scRGB.pixels + r * outputs.scRGB.pitch + x * Format_RGBA16F::bpp, count);
+    if (outputs.hdr10.pixels)
+    {
+        memcpy(scratch, src, 4 * sizeof(f32) * count);
+        Generate_Encoder<Transfer_HDR10, Format_RGB10A2>::Encode(scratch, (u8*)outputs.hdr10.pixels + r * outputs.hdr10.pitch + x * Format_RGB10A2::bpp, count);
+    }
+    if (outputs.sRGB.pixels)
+        Color_Encode_BGRA8_sRGB_Span(src, (u32*)((u8*)outputs.sRGB.pixels + r * outputs.sRGB.pitch + x * Format_BGRA8::bpp), count);
+}
+
+/// GenerateImage_Rect into several encodings at once. The pattern is
+/// evaluated once per pixel and each tile of a row is encoded into every
+/// output while it is still in cache, rather than the whole image being
+/// generated and streamed through memory once per encoding. Each output is
+/// identical to GenerateImage_Rect with its transfer and format.
+template <class Pattern>
+void GenerateImage_Multi_Rect(const Generate_Outputs& _outputs, u32 width, u32 height, Generate_Rect rect, const Pattern& pattern)
+{
+    if (rect.width < 1 || rect.height < 1)
+        return;
+    if (rect.x > width || rect.width > width - rect.x || rect.y > height || rect.height > height - rect.y)
+        return;
+    if (!_outputs.scRGB.pixels && !_outputs.hdr10.pixels && !_outputs.sRGB.pixels)
+        return;
+    TRACE_SCOPE("GenerateImage_Multi_Rect");
+    Generate_Outputs outputs = _outputs;
+    // Filled in here, read by every band
+    Generate_Output* const all[] = { &outputs.scRGB, &outputs.hdr10, &outputs.sRGB };
+    const usize bpps[] = { Format_RGBA16F::bpp, Format_RGB10A2::bpp, Format_BGRA8::bpp };
+    for (usize i = 0; i < 3; i++)
+    {
+        if (!all[i]->pitch)
+            all[i]->pitch = bpps[i] * rect.width;
+        if (all[i]->pixels)
+            TRACE_COUNT("bytes generated", bpps[i] * rect.width * rect.height);
+    }
+    u32 x0 = rect.x;
+    u32 y0 = rect.y;
+    u32 count = rect.width;
+
+    switch (pattern.separability)
+    {
+    case Pattern_Separability::Row_Invariant:
+    {
+        // Only the first row is evaluated, the rest of each output are copies
+        // of its first row
+        std::vector<f32> row(4 * (usize)count);
+        std::vector<f32> scratch(4 * (usize)count);
+        pattern.Span(row.data(), x0, y0, count, width, height);
+        Generate_Multi_Encode(outputs, row.data(), scratch.data(), count, 0, 0);
+        Parallel_For(rect.height, Generate_Band(count) * 4, [=](usize r0, usize r1) {
+            for (usize i = 0; i < 3; i++)
+            {
+                u8* base = (u8*)all[i]->pixels;
+                for (usize r = r0 > 0 ? r0 : 1; base && r < r1; r++)
+                    memcpy(base + r * all[i]->pitch, base, bpps[i] * count);
+            }
+        });
+        break;
+    }
+    case Pattern_Separability::Column_Invariant:
+        // One pixel per row is evaluated, then doubled across each output's row
+        Parallel_For(rect.height, Generate_Band(count) * 4, [=, &pattern](usize r0, usize r1) {
+            for (usize r = r0; r < r1; r++)
+            {
+                f32 c[4];
+                f32 scratch[4];
+                pattern.Span(c, x0, y0 + (u32)r, 1, width, height);
+                Generate_Multi_Encode(outputs, c, scratch, 1, r, 0);
+                for (usize i = 0; i < 3; i++)
+                {
+                    if (!all[i]->pixels)
+                        continue;
+                    u8* row = (u8*)all[i]->pixels + r * all[i]->pitch;
+                    usize bytes = bpps[i] * count;
+                    for (usize done = bpps[i]; done < bytes; done *= 2)
+                        memcpy(row + done, row, done < bytes - done ? done : bytes - done);
+                }
+            }
+        });
+        break;
+    case Pattern_Separability::Full_2D:
+        Parallel_For(rect.height, Generate_Band(count), [=, &pattern](usize r0, usize r1) {
+            std::vector<f32> tile(4 * (usize)generate_tile_pixels);
+            std::vector<f32> scratch(4 * (usize)generate_tile_pixels);
+            for (usize r = r0; r < r1; r++)
+            {
+                for (u32 x = 0; x < count; x += generate_tile_pixels)
+                {
+                    u32 n = count - x < generate_tile_pixels ? count - x : generate_tile_pixels;
+                    pattern.Span(tile.data(), x0 + x, y0 + (u32)r, n, width, height);
+                    Generate_Multi_Encode(outputs, tile.data(), scratch.data(), n, r, x);
+                }
+            }
+        });
+        break;
+    }
+}
+
+// The testcolors gradient, pitch is the distance between rows in bytes, 0 for
+// tightly packed rows, and rect (the whole image if null) is the part of the
+// image generated, starting at pixels
+void GenerateImage_RGBA16F_scRGB(u16* pixels, u32 width, u32 height, usize pitch = 0, const Generate_Rect* rect = nullptr);
+void GenerateImage_RGB10A2_HDR10(u32* pixels, u32 width, u32 height, usize pitch = 0, const Generate_Rect* rect = nullptr);
+void GenerateImage_BGRA8_sRGB(u32* pixels, u32 width, u32 height, usize pitch = 0, const Generate_Rect* rect = nullptr);
+
+/// The testcolors gradient into any of the three encodings in one pass, rect
+/// (the whole image if null) is the part of the image generated
+void GenerateImage_TestColors(const Generate_Outputs& outputs, u32 width, u32 height, const Generate_Rect* rect = nullptr);
@@ -0,0 +1,140 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// image_cache.cpp : Keeps generated test images around across device resets
+// and DPI changes.
+//
+
+#include "image_cache.h"
+
+#include <cstring>
+
+usize Image_Key_Hash::operator()(const Image_Key& k) const
+{
+    u32 white;
+    memcpy(&white, &k.whiteLevel, sizeof(white));
+    // FNV-1a over the fields
+    u64 h = 14695981039346656037ull;
+    for (u32 v : { k.pattern, k.width, k.height, k.format, k.transfer, white })
+    {
+        h ^= v;
+        h *= 1099511628211ull;
+    }
+    return (usize)h;
+}
+
+Image_Cache::Image_Cache(usize budgetBytes)
+    : budget(budgetBytes)
+{
+}
+
+std::shared_ptr<const Image_Pixels> Image_Cache::Get(const Image_Key& key, usize size, const std::function<void(void* pixels)>& generate)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = index.find(key);
+        if (it != index.end())
+        {
+            hits++;
+            lru.splice(lru.begin(), lru, it->second);
+            return it->second->pixels;
+        }
+        misses++;
+    }
+
+    auto pixels = std::make_shared<Image_Pixels>(size);
+    generate(pixels->data());
+
+    std::lock_guard<std::mutex> lock(mutex);
+    return Insert(key, std::move(pixels));
+}
+
+std::shared_ptr<const Image_Pixels> Image_Cache::Find(const Image_Key& key)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = index.find(key);
+    return it == index.end() ? nullptr : it->second->pixels;
+}
+
+std::shared_ptr<const Image_Pixels> Image_Cache::Put(const Image_Key& key, std::shared_ptr<const Image_Pixels> pixels)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return Insert(key, std::move(pixels));
+}
+
+std::shared_ptr<const Image_Pixels> Image_Cache::Insert(const Image_Key& key, std::shared_ptr<const Image_Pixels> pixels)
+{
+    // Another thread may have generated the same image in the meantime
+    auto it = index.find(key);
+    if (it != index.end())
+    {
+        lru.splice(lru.begin(), lru, it->second);
+        return it->second->pixels;
+    }
+    usize size = pixels->size();
+    if (size > budget)
+        return pixels;
+    lru.push_front(Entry{ key, pixels });
+    index[key] = lru.begin();
+    bytes += size;
+    Evict();
+    return pixels;
+}
+
+void Image_Cache::Evict()
+{
+    while (bytes > budget && !lru.empty())
+    {
+        Entry& e = lru.back();
+        bytes -= e.pixels->size();
+        index.erase(e.key);
+        lru.pop_back();
+        evictions++;
+    }
+}
+
+void Image_Cache::SetBudget(usize budgetBytes)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    budget = budgetBytes;
+    Evict();
+}
+
+usize Image_Cache::Budget() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return budget;
+}
+
+void Image_Cache::Clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    lru.clear();
+    index.clear();
+    bytes = 0;
+}
+
+u64 Image_Cache::Hits() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return hits;
+}
+
+u64 Image_Cache::Misses() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return misses;
+}
+
+u64 Image_Cache::Evictions() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return evictions;
+}
+
+usize Image_Cache::Bytes() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return bytes;
+}
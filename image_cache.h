@@ -0,0 +1,116 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// image_cache.h : Keeps generated test images around across device resets and
+// DPI changes, so recreating the scene doesn't regenerate identical pixels.
+//
+
+#pragma once
+
+#include "common.h"
+
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+/// Everything that determines the pixels of a generated image. The pattern is
+/// an id chosen by the caller, format and transfer are typically the
+/// DXGI_FORMAT and DXGI_COLOR_SPACE_TYPE of the layer.
+struct Image_Key
+{
+    u32 pattern = 0;
+    u32 width = 0;
+    u32 height = 0;
+    u32 format = 0;
+    u32 transfer = 0;
+    /// SDR white level in nits
+    f32 whiteLevel = 80.0f;
+
+    bool operator==(const Image_Key& o) const
+    {
+        return pattern == o.pattern && width == o.width && height == o.height &&
+            format == o.format && transfer == o.transfer && whiteLevel == o.whiteLevel;
+    }
+};
+
+struct Image_Key_Hash
+{
+    usize operator()(const Image_Key& k) const;
+};
+
+/// A block of generated pixels, left uninitialized on allocation since the
+/// generators write every byte.
+class Image_Pixels
+{
+public:
+    explicit Image_Pixels(usize size)
+        : pixels(new u8[size])
+        , bytes(size)
+    {
+    }
+    u8* data() { return pixels.get(); }
+    const u8* data() const { return pixels.get(); }
+    usize size() const { return bytes; }
+
+private:
+    std::unique_ptr<u8[]> pixels;
+    usize bytes;
+};
+
+/// Least recently used cache of generated images, limited to a byte budget.
+/// Images are handed out as shared pointers, so an evicted image stays valid
+/// for as long as a caller still holds it. Safe to use from several threads,
+/// generation runs outside the lock.
+class Image_Cache
+{
+public:
+    explicit Image_Cache(usize budgetBytes);
+
+    /// Returns the cached pixels for key, or allocates size bytes, calls generate
+    /// to fill them in and caches the result. An image larger than the whole
+    /// budget is returned without being cached.
+    std::shared_ptr<const Image_Pixels> Get(const Image_Key& key, usize size, const std::function<void(void* pixels)>& generate);
+
+    /// The cached pixels for key, or nullptr, without counting a hit or a miss
+    /// or making them recently used, for callers that generate several images
+    /// at once
+    std::shared_ptr<const Image_Pixels> Find(const Image_Key& key);
+
+    /// Caches pixels generated for key and returns them, or the ones already
+    /// cached if another thread got there first. Pixels larger than the whole
+    /// budget are returned without being cached.
+    std::shared_ptr<const Image_Pixels> Put(const Image_Key& key, std::shared_ptr<const Image_Pixels> pixels);
+
+    void SetBudget(usize budgetBytes);
+    usize Budget() const;
+    void Clear();
+
+    u64 Hits() const;
+    u64 Misses() const;
+    u64 Evictions() const;
+    usize Bytes() const;
+
+private:
+    struct Entry
+    {
+        Image_Key key;
+        std::shared_ptr<const Image_Pixels> pixels;
+    };
+
+    void Evict();
+    /// Put with the lock held
+    std::shared_ptr<const Image_Pixels> Insert(const Image_Key& key, std::shared_ptr<const Image_Pixels> pixels);
+
+    mutable std::mutex mutex;
+    /// Most recently used at the front
+    std::list<Entry> lru;
+    std::unordered_map<Image_Key, std::list<Entry>::iterator, Image_Key_Hash> index;
+    usize budget;
+    usize bytes = 0;
+    u64 hits = 0;
+    u64 misses = 0;
+    u64 evictions = 0;
+};
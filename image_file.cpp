@@ -0,0 +1,322 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// image_file.cpp : Memory mapped image files and the pattern that converts
+// them a span at a time.
+//
+
+#include "image_file.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <string>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static bool Image_File_EndsWith(const char* s, const char* suffix)
+{
+    usize a = strlen(s);
+    usize b = strlen(suffix);
+    return a >= b && strcmp(s + a - b, suffix) == 0;
+}
+
+static bool Image_File_Space(u8 c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// Copies the next whitespace separated word of a PFM header at *pos into
+// token, false if there is none or it's too long to be a header field
+static bool Image_File_Token(const u8* p, usize size, usize* pos, char* token, usize tokenSize)
+{
+    usize i = *pos;
+    while (i < size && Image_File_Space(p[i]))
+        i++;
+    usize n = 0;
+    while (i < size && !Image_File_Space(p[i]))
+    {
+        if (n + 1 >= tokenSize)
+            return false;
+        token[n++] = (char)p[i++];
+    }
+    token[n] = 0;
+    *pos = i;
+    return n > 0;
+}
+
+static bool Image_File_Extent(const char* token, u32* extent)
+{
+    char* end;
+    unsigned long v = strtoul(token, &end, 10);
+    if (*end || token[0] < '0' || token[0] > '9' || v < 1 || v > generate_max_extent)
+        return false;
+    *extent = (u32)v;
+    return true;
+}
+
+static bool Image_File_Host_Little_Endian()
+{
+    const u16 one = 1;
+    u8 first;
+    memcpy(&first, &one, 1);
+    return first == 1;
+}
+
+static f32 Image_File_F32(const u8* p, bool byteSwap)
+{
+    u8 b[4] = { p[0], p[1], p[2], p[3] };
+    if (byteSwap)
+    {
+        b[0] = p[3];
+        b[1] = p[2];
+        b[2] = p[1];
+        b[3] = p[0];
+    }
+    f32 f;
+    memcpy(&f, b, 4);
+    return f;
+}
+
+bool Image_File::Open(const char* path, u32 rawWidth, u32 rawHeight)
+{
+    Close();
+    bool pfm = Image_File_EndsWith(path, ".pfm");
+    if (pfm)
+        layout = Image_File_Layout::RGB32F;
+    else if (Image_File_EndsWith(path, ".rgba16f"))
+        layout = Image_File_Layout::RGBA16F;
+    else if (Image_File_EndsWith(path, ".rgba32f"))
+        layout = Image_File_Layout::RGBA32F;
+    else
+        return false;
+
+#ifdef _WIN32
+    int chars = MultiByteToWideChar(CP_UTF8, 0, path, -1, nullptr, 0);
+    if (chars < 1)
+        return false;
+    std::wstring widePath((usize)chars, L'\0');
+    MultiByteToWideChar(CP_UTF8, 0, path, -1, &widePath[0], chars);
+    HANDLE file = CreateFileW(widePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+    LARGE_INTEGER fileSize = {};
+    if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0 && (u64)fileSize.QuadPart <= (u64)~(usize)0)
+    {
+        // The view keeps the file and the mapping open until it is unmapped
+        HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping)
+        {
+            view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            viewSize = view ? (usize)fileSize.QuadPart : 0;
+            CloseHandle(mapping);
+        }
+    }
+    CloseHandle(file);
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0 && (u64)st.st_size <= (u64)~(usize)0)
+    {
+        void* p = mmap(nullptr, (usize)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (p != MAP_FAILED)
+        {
+            view = p;
+            viewSize = (usize)st.st_size;
+#ifdef MADV_SEQUENTIAL
+            // Bands are converted top to bottom, so read ahead and drop pages
+            // behind, a hint the kernel is free to ignore
+            madvise(view, viewSize, MADV_SEQUENTIAL);
+#endif
+        }
+    }
+    close(fd);
+#endif
+    if (!view)
+        return false;
+
+    const u8* base = (const u8*)view;
+    usize offset = 0;
+    bool littleEndian = true;
+    if (pfm)
+    {
+        // "PF" or "Pf", width, height and a scale whose sign is the byte order,
+        // then a single whitespace character before the rows
+        char token[64];
+        f64 scale = 0.0;
+        bool ok = Image_File_Token(base, viewSize, &offset, token, sizeof(token)) && (strcmp(token, "PF") == 0 || strcmp(token, "Pf") == 0);
+        if (ok && token[1] == 'f')
+            layout = Image_File_Layout::Gray32F;
+        ok = ok && Image_File_Token(base, viewSize, &offset, token, sizeof(token)) && Image_File_Extent(token, &width);
+        ok = ok && Image_File_Token(base, viewSize, &offset, token, sizeof(token)) && Image_File_Extent(token, &height);
+        if (ok && Image_File_Token(base, viewSize, &offset, token, sizeof(token)))
+        {
+            char* end;
+            scale = strtod(token, &end);
+            ok = !*end && scale != 0.0 && std::isfinite(scale);
+        }
+        else
+        {
+            ok = false;
+        }
+        if (!ok || offset >= viewSize)
+        {
+            Close();
+            return false;
+        }
+        offset++;
+        littleEndian = scale < 0.0;
+        bottomUp = true;
+    }
+    else
+    {
+        width = rawWidth;
+        height = rawHeight;
+    }
+
+    bpp = layout == Image_File_Layout::RGB32F ? 12 : layout == Image_File_Layout::Gray32F ? 4 : layout == Image_File_Layout::RGBA16F ? 8 : 16;
+    usize bytes;
+    bool sized = Generate_Size(width, height, bpp, &bytes);
+    // Raw files are nothing but the rows, PFM files may have trailing bytes
+    if (!sized || (pfm ? bytes > viewSize - offset : bytes != viewSize))
+    {
+        Close();
+        return false;
+    }
+    data = base + offset;
+    pitch = bpp * width;
+    byteSwap = littleEndian != Image_File_Host_Little_Endian();
+    return true;
+}
+
+void Image_File::Close()
+{
+    if (view)
+    {
+#ifdef _WIN32
+        UnmapViewOfFile(view);
+#else
+        munmap(view, viewSize);
+#endif
+    }
+    view = nullptr;
+    viewSize = 0;
+    data = nullptr;
+    pitch = 0;
+    bpp = 0;
+    width = 0;
+    height = 0;
+    bottomUp = false;
+    byteSwap = false;
+}
+
+const u8* Image_File::Row(u32 y) const
+{
+    return data + (usize)(bottomUp ? height - 1 - y : y) * pitch;
+}
+
+void Image_File::Convert(const u8* src, f32* rgba, u32 count) const
+{
+    switch (layout)
+    {
+    case Image_File_Layout::RGB32F:
+        for (u32 i = 0; i < count; i++)
+        {
+            for (u32 c = 0; c < 3; c++)
+                rgba[4 * i + c] = Image_File_F32(src + 12 * i + 4 * c, byteSwap);
+            rgba[4 * i + 3] = 1.0f;
+        }
+        break;
+    case Image_File_Layout::Gray32F:
+        for (u32 i = 0; i < count; i++)
+        {
+            f32 v = Image_File_F32(src + 4 * i, byteSwap);
+            rgba[4 * i + 0] = v;
+            rgba[4 * i + 1] = v;
+            rgba[4 * i + 2] = v;
+            rgba[4 * i + 3] = 1.0f;
+        }
+        break;
+    case Image_File_Layout::RGBA16F:
+        // Raw rows start on a page and are a multiple of 8 bytes, so the
+        // halves are aligned
+        if (!byteSwap)
+        {
+            FromF16_Span((const u16*)src, rgba, 4 * (usize)count);
+            break;
+        }
+        for (usize i = 0; i < 4 * (usize)count; i++)
+            rgba[i] = FromF16((u16)(src[2 * i] | src[2 * i + 1] << 8));
+        break;
+    case Image_File_Layout::RGBA32F:
+        if (!byteSwap)
+        {
+            memcpy(rgba, src, 16 * (usize)count);
+            break;
+        }
+        for (usize i = 0; i < 4 * (usize)count; i++)
+            rgba[i] = Image_File_F32(src + 4 * i, true);
+        break;
+    }
+}
+
+void Image_File::Read(f32* rgba, u32 x, u32 y, u32 count, u32 w, u32 h) const
+{
+    if (w == width && h == height)
+    {
+        Convert(Row(y) + x * bpp, rgba, count);
+        return;
+    }
+    // Nearest neighbour, each destination pixel's center mapped into the image
+    const u8* row = Row((u32)(((2 * (u64)y + 1) * height) / (2 * (u64)h)));
+    for (u32 i = 0; i < count; i++)
+    {
+        u32 sx = (u32)(((2 * (u64)(x + i) + 1) * width) / (2 * (u64)w));
+        Convert(row + sx * bpp, &rgba[4 * i], 1);
+    }
+}
+
+bool Image_File_Generate(const Image_File& image, void* pixels, usize pitch, u32 width, u32 height, u32 dxgiFormat, const Generate_Rect* rect)
+{
+    TRACE_SCOPE("Image_File_Generate");
+    if (!image.IsOpen())
+        return false;
+    Generate_Rect r = { 0, 0, width, height };
+    if (rect)
+        r = *rect;
+    const Pattern_Image pattern(image);
+    switch (dxgiFormat)
+    {
+    case dxgi_format_r16g16b16a16_float:
+        GenerateImage_Rect<Pattern_Image, Transfer_scRGB, Format_RGBA16F>(pixels, pitch ? pitch : Format_RGBA16F::bpp * r.width, width, height, r, pattern);
+        return true;
+    case dxgi_format_r10g10b10a2_unorm:
+        GenerateImage_Rect<Pattern_Image, Transfer_HDR10, Format_RGB10A2>(pixels, pitch ? pitch : Format_RGB10A2::bpp * r.width, width, height, r, pattern);
+        return true;
+    case dxgi_format_b8g8r8a8_unorm:
+        GenerateImage_Rect<Pattern_Image, Transfer_sRGB, Format_BGRA8>(pixels, pitch ? pitch : Format_BGRA8::bpp * r.width, width, height, r, pattern);
+        return true;
+    }
+    return false;
+}
+
+void Image_File_Generate_Multi(const Image_File& image, const Generate_Outputs& outputs, u32 width, u32 height, const Generate_Rect* rect)
+{
+    TRACE_SCOPE("Image_File_Generate_Multi");
+    if (!image.IsOpen())
+        return;
+    Generate_Rect r = { 0, 0, width, height };
+    if (rect)
+        r = *rect;
+    GenerateImage_Multi_Rect(outputs, width, height, r, Pattern_Image(image));
+}
@@ -0,0 +1,107 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// image_file.h : Linear scRGB images read from files, to show real content in
+// place of the generated test patterns.
+//
+// The file is memory mapped and never copied, Pattern_Image converts each span
+// the generators ask for straight from the mapped rows, so an image goes
+// through the same transfers and formats as any pattern a band of rows at a
+// time. Only the pages of the band being converted have to be resident, and
+// they are the file's own (clean, shared with the OS file cache), so an 8K
+// RGBA32F image costs no memory of ours beyond a row of f32 per thread.
+//
+// PFM files ("PF" RGB or "Pf" grayscale, either byte order) carry their size.
+// Raw .rgba16f and .rgba32f files are tightly packed little endian RGBA rows,
+// top row first, as colortest-gen writes them, and need the size from the
+// caller.
+//
+
+#pragma once
+
+#include "generate.h"
+
+enum class Image_File_Layout
+{
+    /// PFM "PF", 3 f32 per pixel, rows bottom up
+    RGB32F,
+    /// PFM "Pf", 1 f32 per pixel, rows bottom up
+    Gray32F,
+    RGBA16F,
+    RGBA32F,
+};
+
+/// A read only memory mapping of an image file
+class Image_File
+{
+public:
+    Image_File() = default;
+    /// The mapping is released once, by its owner
+    Image_File(const Image_File&) = delete;
+    Image_File& operator=(const Image_File&) = delete;
+    ~Image_File() { Close(); }
+
+    /// Maps a .pfm, .rgba16f or .rgba32f file (by extension, path is UTF-8).
+    /// rawWidth and rawHeight are the size of a raw file, whose length has to
+    /// match, and are ignored for PFM. Returns false, leaving the image
+    /// closed, if the file can't be mapped or isn't a valid image, or either
+    /// extent is over generate_max_extent.
+    bool Open(const char* path, u32 rawWidth = 0, u32 rawHeight = 0);
+    void Close();
+    bool IsOpen() const { return data != nullptr; }
+
+    u32 Width() const { return width; }
+    u32 Height() const { return height; }
+    Image_File_Layout Layout() const { return layout; }
+
+    /// Writes count linear scRGB RGBA pixels starting at x, y of the image
+    /// scaled to a width x height one with nearest neighbour sampling, which
+    /// is a plain conversion of part of a row when the sizes match. Grayscale
+    /// is spread to RGB, and alpha is 1 unless the file has it.
+    void Read(f32* rgba, u32 x, u32 y, u32 count, u32 width, u32 height) const;
+
+private:
+    /// Row y counting from the top
+    const u8* Row(u32 y) const;
+    void Convert(const u8* src, f32* rgba, u32 count) const;
+
+    const u8* data = nullptr;
+    usize pitch = 0;
+    usize bpp = 0;
+    u32 width = 0;
+    u32 height = 0;
+    Image_File_Layout layout = Image_File_Layout::RGBA32F;
+    bool bottomUp = false;
+    bool byteSwap = false;
+    /// The whole mapping, data is somewhere in it
+    void* view = nullptr;
+    usize viewSize = 0;
+};
+
+/// An image file as a pattern, so the generators stream it into any transfer
+/// and format
+struct Pattern_Image
+{
+    const Image_File& image;
+    Pattern_Separability separability = Pattern_Separability::Full_2D;
+
+    explicit Pattern_Image(const Image_File& _image)
+        : image(_image)
+    {
+    }
+
+    void Span(f32* rgba, u32 x, u32 y, u32 count, u32 width, u32 height) const
+    {
+        image.Read(rgba, x, y, count, width, height);
+    }
+};
+
+/// The image scaled to width x height, or rect of it, into rows pitch bytes
+/// apart in a layer format: RGBA16F scRGB, RGB10A2 HDR10 or BGRA8 sRGB, by
+/// its DXGI_FORMAT as in the scene. Returns false for any other format.
+bool Image_File_Generate(const Image_File& image, void* pixels, usize pitch, u32 width, u32 height, u32 dxgiFormat, const Generate_Rect* rect = nullptr);
+
+/// Image_File_Generate into any of the three layer encodings in one pass, so
+/// the file is read and converted once between them
+void Image_File_Generate_Multi(const Image_File& image, const Generate_Outputs& outputs, u32 width, u32 height, const Generate_Rect* rect = nullptr);
@@ -0,0 +1,534 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// lut.cpp : Baking, evaluating and reading and writing 3D LUTs.
+//
+
+#include "lut.h"
+
+#include "parallel.h"
+#include "trace.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// Pixels shaped at a time by Lut_Apply, in a buffer on the stack
+constexpr usize lut_block_pixels = 256;
+
+// PQ signal of a linear scRGB value, mirrored for negative ones, in f64 so the
+// baked nodes land where the shaper puts them
+static f64 Lut_PQ_Signal(f64 linear)
+{
+    constexpr f64 m1 = 2610.0 / 16384.0;
+    constexpr f64 m2 = 128.0 * 2523.0 / 4096.0;
+    constexpr f64 c1 = 3424.0 / 4096.0;
+    constexpr f64 c2 = 32.0 * 2413.0 / 4096.0;
+    constexpr f64 c3 = 32.0 * 2392.0 / 4096.0;
+    f64 y = fabs(linear) * (80.0 / 10000.0);
+    y = y < 1.0 ? y : 1.0;
+    f64 p = pow(y, m1);
+    f64 s = pow((c1 + c2 * p) / (1.0 + c3 * p), m2);
+    return linear < 0.0 ? -s : s;
+}
+
+static f64 Lut_PQ_Linear(f64 signal)
+{
+    constexpr f64 m1 = 2610.0 / 16384.0;
+    constexpr f64 m2 = 128.0 * 2523.0 / 4096.0;
+    constexpr f64 c1 = 3424.0 / 4096.0;
+    constexpr f64 c2 = 32.0 * 2413.0 / 4096.0;
+    constexpr f64 c3 = 32.0 * 2392.0 / 4096.0;
+    f64 e = pow(fabs(signal), 1.0 / m2);
+    f64 n = e - c1;
+    f64 y = pow((n > 0.0 ? n : 0.0) / (c2 - c3 * e), 1.0 / m1) * (10000.0 / 80.0);
+    return signal < 0.0 ? -y : y;
+}
+
+// A PQ shaped axis. Spread evenly from lo to hi in signal the nodes would put
+// linear 0 between two of them on the steepest part of the curve, and black
+// would come out of the lattice a couple of 10-bit codes off. So a domain
+// that spans 0 splits the nodes between the negative and positive signals in
+// proportion, each side evenly spaced, with 0 on the node between.
+struct Lut_PQ_Axis
+{
+    f64 lo;
+    f64 pivot;
+    f64 hi;
+    /// Lattice coordinate of pivot
+    f64 zero;
+};
+
+static Lut_PQ_Axis Lut_PQ_Axis_Of(f32 domainMin, f32 domainMax, u32 size)
+{
+    Lut_PQ_Axis axis = { Lut_PQ_Signal(domainMin), Lut_PQ_Signal(0.0), Lut_PQ_Signal(domainMax), 0.0 };
+    if (size > 2 && axis.lo < axis.pivot && axis.pivot < axis.hi)
+    {
+        f64 k = nearbyint((axis.pivot - axis.lo) / (axis.hi - axis.lo) * (size - 1));
+        k = k < 1.0 ? 1.0 : k > size - 2 ? size - 2 : k;
+        axis.zero = k / (size - 1);
+    }
+    else
+        axis.pivot = axis.lo;
+    return axis;
+}
+
+// The lattice coordinate of a linear value on the shaper's curve, for baking
+// and for writing a PQ shaper to a .cube file
+static f64 Lut_Shape_f64(const Lut3D& lut, u32 c, f64 linear)
+{
+    if (lut.shaper == Lut_Shaper::PQ)
+    {
+        Lut_PQ_Axis axis = Lut_PQ_Axis_Of(lut.domainMin[c], lut.domainMax[c], lut.size);
+        f64 s = Lut_PQ_Signal(linear);
+        if (s < axis.pivot)
+            return axis.zero * (s - axis.lo) / (axis.pivot - axis.lo);
+        return axis.zero + (1.0 - axis.zero) * (s - axis.pivot) / (axis.hi - axis.pivot);
+    }
+    return (linear - lut.domainMin[c]) / ((f64)lut.domainMax[c] - lut.domainMin[c]);
+}
+
+// Each channel's shaper curve in the form Lut_Shape evaluates, worked out once
+// per Lut_Apply. Four lanes so the PQ loop vectorizes, alpha's is put back.
+struct Lut_Shaping
+{
+    f32 lo[4] = {};
+    f32 scale[4] = {};
+    /// PQ, signals below pivot go from lo with scale, the rest from pivot,
+    /// starting at lattice coordinate zero, with above
+    f32 pivot[4] = {};
+    f32 zero[4] = {};
+    f32 above[4] = {};
+};
+
+static Lut_Shaping Lut_Shaping_Of(const Lut3D& lut)
+{
+    Lut_Shaping shaping;
+    if (lut.shaper != Lut_Shaper::PQ)
+    {
+        // A table's scale is to its entries
+        const f32 last = lut.shaper == Lut_Shaper::Table ? (f32)(lut.shaperSize - 1) : 1.0f;
+        for (u32 c = 0; c < 3; c++)
+        {
+            shaping.lo[c] = lut.domainMin[c];
+            shaping.scale[c] = last / (lut.domainMax[c] - lut.domainMin[c]);
+        }
+    }
+    else
+    {
+        // The span's curve for the ends of the domain and for 0 too, so they
+        // land on their nodes exactly
+        f32 ends[12] = { fabsf(lut.domainMin[0]), fabsf(lut.domainMin[1]), fabsf(lut.domainMin[2]), 1.0f,
+            fabsf(lut.domainMax[0]), fabsf(lut.domainMax[1]), fabsf(lut.domainMax[2]), 1.0f, 0.0f, 0.0f, 0.0f, 1.0f };
+        Color_Transfer_To_PQ_Span(ends, ends, 3);
+        for (u32 c = 0; c < 3; c++)
+        {
+            Lut_PQ_Axis axis = Lut_PQ_Axis_Of(lut.domainMin[c], lut.domainMax[c], lut.size);
+            f32 lo = lut.domainMin[c] < 0.0f ? -ends[c] : ends[c];
+            f32 hi = lut.domainMax[c] < 0.0f ? -ends[4 + c] : ends[4 + c];
+            f32 pivot = axis.pivot == axis.lo ? lo : ends[8 + c];
+            f32 zero = (f32)axis.zero;
+            shaping.lo[c] = lo;
+            shaping.scale[c] = pivot > lo ? zero / (pivot - lo) : 0.0f;
+            shaping.pivot[c] = pivot;
+            shaping.zero[c] = zero;
+            shaping.above[c] = (1.0f - zero) / (hi - pivot);
+        }
+    }
+    return shaping;
+}
+
+// Lattice coordinates of count RGBA pixels, alpha is copied
+static void Lut_Shape(const Lut3D& lut, const Lut_Shaping& shaping, const f32* src, f32* dst, usize pixels)
+{
+    switch (lut.shaper)
+    {
+    case Lut_Shaper::Linear:
+        for (usize i = 0; i < pixels; i++)
+        {
+            for (u32 c = 0; c < 4; c++)
+                dst[4 * i + c] = (src[4 * i + c] - shaping.lo[c]) * shaping.scale[c];
+        }
+        break;
+    case Lut_Shaper::PQ:
+        for (usize i = 0; i < 4 * pixels; i++)
+            dst[i] = fabsf(src[i]);
+        Color_Transfer_To_PQ_Span(dst, dst, pixels);
+        for (usize i = 0; i < pixels; i++)
+        {
+            for (u32 c = 0; c < 4; c++)
+            {
+                f32 m = dst[4 * i + c];
+                f32 s = src[4 * i + c] < 0.0f ? -m : m;
+                f32 below = (s - shaping.lo[c]) * shaping.scale[c];
+                f32 above = shaping.zero[c] + (s - shaping.pivot[c]) * shaping.above[c];
+                dst[4 * i + c] = s < shaping.pivot[c] ? below : above;
+            }
+        }
+        break;
+    case Lut_Shaper::Table:
+    {
+        const f32 last = (f32)(lut.shaperSize - 1);
+        for (usize i = 0; i < pixels; i++)
+        {
+            for (u32 c = 0; c < 3; c++)
+            {
+                f32 x = (src[4 * i + c] - shaping.lo[c]) * shaping.scale[c];
+                x = x > 0.0f ? (x < last ? x : last) : 0.0f;
+                u32 k = (u32)x;
+                k = k < lut.shaperSize - 2 ? k : lut.shaperSize - 2;
+                f32 a = lut.shaperTable[3 * k + c];
+                f32 b = lut.shaperTable[3 * (k + 1) + c];
+                dst[4 * i + c] = a + (b - a) * (x - (f32)k);
+            }
+        }
+        break;
+    }
+    }
+    for (usize i = 0; i < pixels; i++)
+        dst[4 * i + 3] = src[4 * i + 3];
+}
+
+bool Lut_Bake(Lut3D* lut, u32 size, Lut_Shaper shaper, f32 domainMin, f32 domainMax, void (*transform)(f32* rgba, usize pixels))
+{
+    if (size < lut_min_size || size > lut_max_size || !(domainMin < domainMax) || shaper == Lut_Shaper::Table)
+        return false;
+    if (shaper == Lut_Shaper::PQ && (domainMin < -125.0f || domainMax > 125.0f))
+        return false;
+    TRACE_SCOPE("Lut_Bake");
+    Lut3D baked;
+    baked.shaper = shaper;
+    baked.size = size;
+    for (u32 c = 0; c < 3; c++)
+    {
+        baked.domainMin[c] = domainMin;
+        baked.domainMax[c] = domainMax;
+    }
+
+    // The linear value of each lattice coordinate, the same on every axis
+    std::vector<f32> node(size);
+    Lut_PQ_Axis axis = Lut_PQ_Axis_Of(domainMin, domainMax, size);
+    for (u32 i = 0; i < size; i++)
+    {
+        f64 t = (f64)i / (size - 1);
+        if (shaper == Lut_Shaper::Linear)
+            node[i] = (f32)(domainMin + (domainMax - (f64)domainMin) * t);
+        else if (t < axis.zero)
+            node[i] = (f32)Lut_PQ_Linear(axis.lo + (axis.pivot - axis.lo) * t / axis.zero);
+        else
+            node[i] = (f32)Lut_PQ_Linear(axis.pivot + (axis.hi - axis.pivot) * (t - axis.zero) / (1.0 - axis.zero));
+    }
+    node[0] = domainMin;
+    node[size - 1] = domainMax;
+
+    // A plane of constant blue at a time
+    usize plane = (usize)size * size;
+    baked.lattice.resize(4 * plane * size);
+    Parallel_For(size, 1, [&](usize b0, usize b1) {
+        std::vector<f32> rgba(4 * plane);
+        for (usize b = b0; b < b1; b++)
+        {
+            for (usize i = 0; i < plane; i++)
+            {
+                rgba[4 * i + 0] = node[i % size];
+                rgba[4 * i + 1] = node[i / size];
+                rgba[4 * i + 2] = node[b];
+                rgba[4 * i + 3] = 1.0f;
+            }
+            transform(rgba.data(), plane);
+            f32* out = &baked.lattice[4 * plane * b];
+            for (usize i = 0; i < plane; i++)
+            {
+                memcpy(&out[4 * i], &rgba[4 * i], 3 * sizeof(f32));
+                out[4 * i + 3] = 0.0f;
+            }
+        }
+    });
+    *lut = std::move(baked);
+    return true;
+}
+
+void Lut_Apply(const Lut3D& lut, const f32* src, f32* dst, usize pixels)
+{
+    const Lut_Shaping shaping = Lut_Shaping_Of(lut);
+    f32 coords[4 * lut_block_pixels];
+    for (usize done = 0; done < pixels; done += lut_block_pixels)
+    {
+        usize n = pixels - done < lut_block_pixels ? pixels - done : lut_block_pixels;
+        Lut_Shape(lut, shaping, src + 4 * done, coords, n);
+        Color_Lut3D_Span(coords, dst + 4 * done, n, lut.lattice.data(), lut.size);
+    }
+}
+
+// Appends a line of three values, with enough digits to read back the same f32
+static void Lut_Cube_Line(std::string& text, f64 r, f64 g, f64 b)
+{
+    char line[64];
+    snprintf(line, sizeof(line), "%.9g %.9g %.9g\n", r, g, b);
+    text += line;
+}
+
+std::string Lut_Format_Cube(const Lut3D& lut)
+{
+    std::string text;
+    char line[128];
+    if (!lut.title.empty())
+        text += "TITLE \"" + lut.title + "\"\n";
+    bool uniform = true;
+    for (u32 c = 1; c < 3; c++)
+        uniform = uniform && lut.domainMin[c] == lut.domainMin[0] && lut.domainMax[c] == lut.domainMax[0];
+    u32 shaperSize = lut.shaper == Lut_Shaper::PQ ? lut_cube_shaper_size : lut.shaperSize;
+    if (lut.shaper == Lut_Shaper::PQ)
+        text += "# Shaper: PQ\n";
+    if (lut.shaper != Lut_Shaper::Linear)
+    {
+        snprintf(line, sizeof(line), "LUT_1D_SIZE %u\n", shaperSize);
+        text += line;
+    }
+    if (lut.shaper != Lut_Shaper::Linear && uniform)
+    {
+        snprintf(line, sizeof(line), "LUT_1D_INPUT_RANGE %.9g %.9g\n", lut.domainMin[0], lut.domainMax[0]);
+        text += line;
+    }
+    else
+    {
+        snprintf(line, sizeof(line), "DOMAIN_MIN %.9g %.9g %.9g\nDOMAIN_MAX %.9g %.9g %.9g\n", lut.domainMin[0], lut.domainMin[1], lut.domainMin[2],
+            lut.domainMax[0], lut.domainMax[1], lut.domainMax[2]);
+        text += line;
+    }
+    snprintf(line, sizeof(line), "LUT_3D_SIZE %u\n", lut.size);
+    text += line;
+
+    if (lut.shaper == Lut_Shaper::PQ)
+    {
+        for (u32 i = 0; i < shaperSize; i++)
+        {
+            f64 s[3];
+            for (u32 c = 0; c < 3; c++)
+            {
+                f64 t = (f64)i / (shaperSize - 1);
+                s[c] = Lut_Shape_f64(lut, c, lut.domainMin[c] + (lut.domainMax[c] - (f64)lut.domainMin[c]) * t);
+            }
+            Lut_Cube_Line(text, s[0], s[1], s[2]);
+        }
+    }
+    else if (lut.shaper == Lut_Shaper::Table)
+    {
+        for (u32 i = 0; i < shaperSize; i++)
+            Lut_Cube_Line(text, lut.shaperTable[3 * i], lut.shaperTable[3 * i + 1], lut.shaperTable[3 * i + 2]);
+    }
+    usize nodes = (usize)lut.size * lut.size * lut.size;
+    for (usize i = 0; i < nodes; i++)
+        Lut_Cube_Line(text, lut.lattice[4 * i], lut.lattice[4 * i + 1], lut.lattice[4 * i + 2]);
+    return text;
+}
+
+// Parses exactly count numbers from s, which has nothing else but spaces
+static bool Lut_Numbers(const char* s, f32* values, u32 count)
+{
+    for (u32 i = 0; i < count; i++)
+    {
+        char* end;
+        values[i] = strtof(s, &end);
+        if (end == s)
+            return false;
+        s = end;
+    }
+    while (*s == ' ' || *s == '\t')
+        s++;
+    return *s == '\0';
+}
+
+bool Lut_Parse_Cube(const char* text, Lut3D* lut)
+{
+    Lut3D parsed;
+    u32 size1D = 0;
+    u32 size3D = 0;
+    f32 domainMin[3] = { 0.0f, 0.0f, 0.0f };
+    f32 domainMax[3] = { 1.0f, 1.0f, 1.0f };
+    f32 range1D[2] = { 0.0f, 0.0f };
+    f32 range3D[2] = { 0.0f, 1.0f };
+    bool hasRange1D = false;
+    bool hasRange3D = false;
+    bool pq = false;
+    std::vector<f32> values;
+    std::string line;
+    for (const char* s = text; *s;)
+    {
+        const char* end = s;
+        while (*end && *end != '\n' && *end != '\r')
+            end++;
+        line.assign(s, end);
+        s = *end ? end + 1 : end;
+        usize first = line.find_first_not_of(" \t");
+        if (first == std::string::npos)
+            continue;
+        const char* l = line.c_str() + first;
+        if (*l == '#')
+        {
+            pq = pq || strncmp(l, "# Shaper: PQ", 12) == 0;
+            continue;
+        }
+
+        f32 v[3];
+        if ((*l >= '0' && *l <= '9') || *l == '-' || *l == '+' || *l == '.')
+        {
+            if (!Lut_Numbers(l, v, 3))
+                return false;
+            values.insert(values.end(), v, v + 3);
+            continue;
+        }
+        // Keywords all come before the data
+        if (!values.empty())
+            return false;
+        if (strncmp(l, "TITLE", 5) == 0)
+        {
+            const char* open = strchr(l, '"');
+            const char* close = open ? strchr(open + 1, '"') : nullptr;
+            if (!close)
+                return false;
+            parsed.title.assign(open + 1, close);
+        }
+        else if (strncmp(l, "LUT_1D_SIZE", 11) == 0)
+        {
+            if (!Lut_Numbers(l + 11, v, 1) || !(v[0] >= 2.0f && v[0] <= 65536.0f))
+                return false;
+            size1D = (u32)v[0];
+        }
+        else if (strncmp(l, "LUT_3D_SIZE", 11) == 0)
+        {
+            if (!Lut_Numbers(l + 11, v, 1) || !(v[0] >= (f32)lut_min_size && v[0] <= (f32)lut_max_size))
+                return false;
+            size3D = (u32)v[0];
+        }
+        else if (strncmp(l, "DOMAIN_MIN", 10) == 0)
+        {
+            if (!Lut_Numbers(l + 10, domainMin, 3))
+                return false;
+        }
+        else if (strncmp(l, "DOMAIN_MAX", 10) == 0)
+        {
+            if (!Lut_Numbers(l + 10, domainMax, 3))
+                return false;
+        }
+        else if (strncmp(l, "LUT_1D_INPUT_RANGE", 18) == 0)
+        {
+            if (!Lut_Numbers(l + 18, range1D, 2))
+                return false;
+            hasRange1D = true;
+        }
+        else if (strncmp(l, "LUT_3D_INPUT_RANGE", 18) == 0)
+        {
+            if (!Lut_Numbers(l + 18, range3D, 2))
+                return false;
+            hasRange3D = true;
+        }
+        // Anything else is a keyword some other tool uses, like
+        // LUT_IN_VIDEO_RANGE, which doesn't change the data
+    }
+    usize nodes = (usize)size3D * size3D * size3D;
+    if ((!size1D && !size3D) || values.size() != 3 * (size1D + nodes))
+        return false;
+
+    // The domain is the 1D LUT's when there is one, whose output is the 3D
+    // LUT's input range
+    const f32 ranged[2][3] = { { range1D[0], range1D[0], range1D[0] }, { range1D[1], range1D[1], range1D[1] } };
+    const f32 ranged3D[2][3] = { { range3D[0], range3D[0], range3D[0] }, { range3D[1], range3D[1], range3D[1] } };
+    const f32* lo = size1D && hasRange1D ? ranged[0] : !size1D && hasRange3D ? ranged3D[0] : domainMin;
+    const f32* hi = size1D && hasRange1D ? ranged[1] : !size1D && hasRange3D ? ranged3D[1] : domainMax;
+    for (u32 c = 0; c < 3; c++)
+    {
+        if (!(lo[c] < hi[c]))
+            return false;
+        parsed.domainMin[c] = lo[c];
+        parsed.domainMax[c] = hi[c];
+    }
+
+    const f32* data3D = values.data() + 3 * size1D;
+    bool has3D = size3D != 0;
+    std::vector<f32> corners;
+    if (size1D)
+    {
+        // Without a 3D LUT the 1D LUT's output goes through a 2^3 lattice
+        // spanning its range, which interpolates each channel on its own
+        f32 outLo[3] = { range3D[0], range3D[0], range3D[0] };
+        f32 outHi[3] = { range3D[1], range3D[1], range3D[1] };
+        if (!size3D)
+        {
+            for (u32 c = 0; c < 3; c++)
+            {
+                outLo[c] = outHi[c] = values[c];
+                for (u32 i = 0; i < size1D; i++)
+                {
+                    f32 x = values[3 * i + c];
+                    outLo[c] = x < outLo[c] ? x : outLo[c];
+                    outHi[c] = x > outHi[c] ? x : outHi[c];
+                }
+                outHi[c] = outHi[c] > outLo[c] ? outHi[c] : outLo[c] + 1.0f;
+            }
+            size3D = 2;
+            nodes = 8;
+            for (u32 i = 0; i < nodes; i++)
+                for (u32 c = 0; c < 3; c++)
+                    corners.push_back((i >> c) & 1 ? outHi[c] : outLo[c]);
+            data3D = corners.data();
+        }
+        else if (!(range3D[0] < range3D[1]))
+        {
+            return false;
+        }
+        parsed.shaper = Lut_Shaper::Table;
+        parsed.shaperSize = size1D;
+        parsed.shaperTable.resize(3 * (usize)size1D);
+        for (u32 i = 0; i < size1D; i++)
+            for (u32 c = 0; c < 3; c++)
+                parsed.shaperTable[3 * i + c] = (values[3 * i + c] - outLo[c]) / (outHi[c] - outLo[c]);
+    }
+    // Our own PQ shaper comes back exact rather than sampled
+    bool pqDomain = true;
+    for (u32 c = 0; c < 3; c++)
+        pqDomain = pqDomain && parsed.domainMin[c] >= -125.0f && parsed.domainMax[c] <= 125.0f;
+    if (pq && pqDomain && parsed.shaper == Lut_Shaper::Table && has3D)
+    {
+        parsed.shaper = Lut_Shaper::PQ;
+        parsed.shaperSize = 0;
+        parsed.shaperTable.clear();
+    }
+
+    parsed.size = size3D;
+    parsed.lattice.resize(4 * nodes);
+    for (usize i = 0; i < nodes; i++)
+    {
+        memcpy(&parsed.lattice[4 * i], &data3D[3 * i], 3 * sizeof(f32));
+        parsed.lattice[4 * i + 3] = 0.0f;
+    }
+    *lut = std::move(parsed);
+    return true;
+}
+
+bool Lut_Write_Cube(const Lut3D& lut, const char* path)
+{
+    FILE* file = fopen(path, "wb");
+    if (!file)
+        return false;
+    std::string text = Lut_Format_Cube(lut);
+    bool ok = fwrite(text.data(), 1, text.size(), file) == text.size();
+    return fclose(file) == 0 && ok;
+}
+
+bool Lut_Read_Cube(const char* path, Lut3D* lut)
+{
+    FILE* file = fopen(path, "rb");
+    if (!file)
+        return false;
+    std::string text;
+    char buffer[65536];
+    usize n;
+    while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        text.append(buffer, n);
+    bool ok = !ferror(file);
+    fclose(file);
+    return ok && Lut_Parse_Cube(text.c_str(), lut);
+}
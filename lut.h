@@ -0,0 +1,103 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// lut.h : 3D LUTs, any conversion from linear scRGB baked into a lattice and
+// evaluated with tetrahedral interpolation at a constant cost per pixel, and
+// read from and written to .cube files to compare against other tools.
+//
+// A shaper first maps each channel from the LUT's input domain to a 0..1
+// lattice coordinate. Linear spaces the nodes evenly, which suits SDR. PQ
+// spaces them evenly in PQ signal (mirrored for negative values, which wide
+// gamut scRGB colors have), so an HDR domain reaching 10000 nits still has
+// most of its nodes where the eye can tell them apart, with 0 always on a node
+// so black comes out exact. Table is a 1D LUT per
+// channel, as read from a .cube file.
+//
+
+#pragma once
+
+#include "pattern.h"
+
+#include <string>
+#include <vector>
+
+enum class Lut_Shaper
+{
+    Linear,
+    PQ,
+    Table,
+};
+
+/// Lattice points per axis, the .cube limits
+constexpr u32 lut_min_size = 2;
+constexpr u32 lut_max_size = 256;
+
+/// Entries in the 1D LUT a .cube file gets for a PQ shaper
+constexpr u32 lut_cube_shaper_size = 4096;
+
+struct Lut3D
+{
+    std::string title;
+    Lut_Shaper shaper = Lut_Shaper::Linear;
+    /// Input range of each channel, anything outside is clamped to it
+    f32 domainMin[3] = { 0.0f, 0.0f, 0.0f };
+    f32 domainMax[3] = { 1.0f, 1.0f, 1.0f };
+    /// Lut_Shaper::Table, shaperSize RGB entries evenly spaced across the
+    /// domain, each a lattice coordinate in 0..1
+    u32 shaperSize = 0;
+    std::vector<f32> shaperTable;
+    /// size^3 RGBA nodes, red changing fastest then green then blue, as in a
+    /// .cube file, alpha 0 (Color_Lut3D_Span's layout)
+    u32 size = 0;
+    std::vector<f32> lattice;
+};
+
+/// Bakes transform, which converts a span of linear scRGB RGBA pixels in place
+/// (a Transfer's Apply, say), into a size^3 LUT over domainMin..domainMax on
+/// every channel. Returns false if size is outside lut_min_size..lut_max_size,
+/// the domain is empty, the shaper is Table or a PQ domain goes past 10000
+/// nits (125.0) either way.
+bool Lut_Bake(Lut3D* lut, u32 size, Lut_Shaper shaper, f32 domainMin, f32 domainMax, void (*transform)(f32* rgba, usize pixels));
+
+/// Converts count linear scRGB RGBA pixels through the LUT, alpha is passed
+/// through. src and dst may be the same.
+void Lut_Apply(const Lut3D& lut, const f32* src, f32* dst, usize pixels);
+
+/// The LUT as a .cube file. A Linear shaper becomes the 3D LUT's DOMAIN_MIN
+/// and DOMAIN_MAX, the others a 1D shaper LUT ahead of the 3D one with
+/// LUT_1D_INPUT_RANGE (the layout DaVinci Resolve reads), where PQ is sampled
+/// at lut_cube_shaper_size points and marked with a "# Shaper: PQ" comment
+/// so Lut_Parse_Cube gets the exact curve back.
+std::string Lut_Format_Cube(const Lut3D& lut);
+
+/// Reads a .cube file: a 3D LUT, a 1D LUT (applied per channel through a 2^3
+/// lattice) or both, with TITLE, DOMAIN_MIN, DOMAIN_MAX, LUT_1D_INPUT_RANGE
+/// and LUT_3D_INPUT_RANGE. Returns false, leaving lut alone, if the text isn't
+/// one.
+bool Lut_Parse_Cube(const char* text, Lut3D* lut);
+
+bool Lut_Write_Cube(const Lut3D& lut, const char* path);
+bool Lut_Read_Cube(const char* path, Lut3D* lut);
+
+/// A pattern seen through a LUT, so the generators write the LUT's output
+/// with Transfer_scRGB and any format
+template <class Pattern> struct Pattern_Lut
+{
+    const Pattern& pattern;
+    const Lut3D& lut;
+    Pattern_Separability separability;
+
+    Pattern_Lut(const Pattern& _pattern, const Lut3D& _lut)
+        : pattern(_pattern)
+        , lut(_lut)
+        , separability(_pattern.separability)
+    {
+    }
+
+    void Span(f32* rgba, u32 x, u32 y, u32 count, u32 width, u32 height) const
+    {
+        pattern.Span(rgba, x, y, count, width, height);
+        Lut_Apply(lut, rgba, rgba, count);
+    }
+};
@@ -0,0 +1,253 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// parallel.cpp : A small thread pool for splitting image generation into bands
+// of rows, and for running whole generators in the background.
+//
+
+#include "parallel.h"
+#include "trace.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct Parallel_Job
+{
+    const std::function<void(usize, usize)>* fn;
+    /// Parallel_Start's function, which the job has to keep alive itself
+    std::function<void(usize, usize)> owned;
+    usize count;
+    usize grain;
+    std::atomic<usize> next{ 0 };
+    std::atomic<usize> finished{ 0 };
+    std::mutex mutex;
+    std::condition_variable done;
+};
+
+class Parallel_Pool
+{
+public:
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<std::shared_ptr<Parallel_Job>> jobs;
+    std::vector<std::thread> workers;
+    bool quit = false;
+    /// Signalled whenever a job finishes, for Parallel_Wait_Any
+    std::mutex finishedMutex;
+    std::condition_variable finishedAny;
+
+    ~Parallel_Pool();
+    void Start(u32 threads);
+    void Stop();
+    void Worker();
+};
+
+// Wakes whoever waits for the job, by itself or with others
+static void Parallel_Finished(Parallel_Pool& pool, Parallel_Job& job)
+{
+    {
+        std::lock_guard<std::mutex> lock(job.mutex);
+        job.done.notify_all();
+    }
+    {
+        std::lock_guard<std::mutex> lock(pool.finishedMutex);
+    }
+    pool.finishedAny.notify_all();
+}
+
+// Grab chunks of the job until there are none left, returns true if this
+// thread finished the last chunk.
+static bool Parallel_Run(Parallel_Job& job)
+{
+    usize chunks = (job.count + job.grain - 1) / job.grain;
+    bool last = false;
+    for (;;)
+    {
+        usize chunk = job.next.fetch_add(1);
+        if (chunk >= chunks)
+            break;
+        usize begin = chunk * job.grain;
+        usize end = begin + job.grain < job.count ? begin + job.grain : job.count;
+        {
+            TRACE_SCOPE("Parallel_For");
+            (*job.fn)(begin, end);
+        }
+        last = job.finished.fetch_add(1) + 1 == chunks;
+    }
+    return last;
+}
+
+Parallel_Pool::~Parallel_Pool()
+{
+    Stop();
+}
+
+void Parallel_Pool::Start(u32 threads)
+{
+    quit = false;
+    // The calling thread does its share, so it counts as one of the threads
+    for (u32 i = 1; i < threads; i++)
+        workers.emplace_back(&Parallel_Pool::Worker, this);
+}
+
+void Parallel_Pool::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+    }
+    wake.notify_all();
+    for (auto& t : workers)
+        t.join();
+    workers.clear();
+}
+
+void Parallel_Pool::Worker()
+{
+    for (;;)
+    {
+        std::shared_ptr<Parallel_Job> job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this] { return quit || !jobs.empty(); });
+            if (quit)
+                return;
+            job = jobs.front();
+            // Every chunk is handed out, so nobody else needs to see this job
+            if (job->next.load() >= (job->count + job->grain - 1) / job->grain)
+            {
+                jobs.pop_front();
+                continue;
+            }
+        }
+        if (Parallel_Run(*job))
+            Parallel_Finished(*this, *job);
+    }
+}
+
+static Parallel_Pool pool;
+static std::atomic<u32> poolThreads{ 0 };
+// The pool is started on first use unless Parallel_SetThreads got there first,
+// once even if several threads ask at the same time
+static std::once_flag poolStarted;
+
+void Parallel_SetThreads(u32 threads)
+{
+    if (threads == 0)
+        threads = std::thread::hardware_concurrency();
+    threads = threads < 1 ? 1 : threads;
+    if (threads == poolThreads.load())
+        return;
+    pool.Stop();
+    pool.Start(threads);
+    poolThreads = threads;
+}
+
+u32 Parallel_Threads()
+{
+    std::call_once(poolStarted, [] {
+        if (poolThreads.load() == 0)
+            Parallel_SetThreads(0);
+    });
+    return poolThreads.load();
+}
+
+void Parallel_For(usize count, usize grain, const std::function<void(usize begin, usize end)>& fn)
+{
+    grain = grain < 1 ? 1 : grain;
+    if (count <= grain || Parallel_Threads() == 1)
+    {
+        for (usize begin = 0; begin < count; begin += grain)
+            fn(begin, begin + grain < count ? begin + grain : count);
+        return;
+    }
+
+    auto job = std::make_shared<Parallel_Job>();
+    job->fn = &fn;
+    job->count = count;
+    job->grain = grain;
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        pool.jobs.push_back(job);
+    }
+    pool.wake.notify_all();
+
+    // Help out rather than sleep, then wait for any chunks still running on
+    // the workers
+    usize chunks = (count + grain - 1) / grain;
+    Parallel_Run(*job);
+    std::unique_lock<std::mutex> lock(job->mutex);
+    job->done.wait(lock, [&] { return job->finished.load() == chunks; });
+}
+
+Parallel_Task Parallel_Start(std::function<void()> fn)
+{
+    auto job = std::make_shared<Parallel_Job>();
+    job->owned = [fn](usize, usize) { fn(); };
+    job->fn = &job->owned;
+    job->count = 1;
+    job->grain = 1;
+    // Without pool threads nobody would take it off the queue
+    if (Parallel_Threads() > 1)
+    {
+        {
+            std::lock_guard<std::mutex> lock(pool.mutex);
+            pool.jobs.push_back(job);
+        }
+        pool.wake.notify_one();
+    }
+    return job;
+}
+
+void Parallel_Wait(const Parallel_Task& task)
+{
+    if (Parallel_Run(*task))
+        Parallel_Finished(pool, *task);
+    std::unique_lock<std::mutex> lock(task->mutex);
+    task->done.wait(lock, [&] { return task->finished.load() == 1; });
+}
+
+usize Parallel_Wait_Any(const Parallel_Task* tasks, usize count, bool* taken)
+{
+    for (;;)
+    {
+        // A finished task, or one to run here
+        usize unstarted = count;
+        usize remaining = 0;
+        for (usize i = 0; i < count; i++)
+        {
+            if (taken[i])
+                continue;
+            remaining++;
+            if (tasks[i]->finished.load() == 1)
+            {
+                taken[i] = true;
+                return i;
+            }
+            if (unstarted == count && tasks[i]->next.load() == 0)
+                unstarted = i;
+        }
+        if (remaining == 0)
+            return count;
+        if (unstarted < count)
+        {
+            if (Parallel_Run(*tasks[unstarted]))
+                Parallel_Finished(pool, *tasks[unstarted]);
+            continue;
+        }
+        // Everything left is running on other threads
+        std::unique_lock<std::mutex> lock(pool.finishedMutex);
+        pool.finishedAny.wait(lock, [&] {
+            for (usize i = 0; i < count; i++)
+                if (!taken[i] && tasks[i]->finished.load() == 1)
+                    return true;
+            return false;
+        });
+    }
+}
@@ -0,0 +1,47 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// parallel.h : A small thread pool for splitting image generation into bands
+// of rows, and for running whole generators in the background.
+//
+
+#pragma once
+
+#include "common.h"
+
+#include <functional>
+#include <memory>
+
+/// Sets the number of threads Parallel_For uses, including the calling thread,
+/// 0 means one per hardware thread. Must not be called while a Parallel_For is
+/// running.
+void Parallel_SetThreads(u32 threads);
+u32 Parallel_Threads();
+
+/// Calls fn(begin, end) for consecutive chunks of [0, count), each at most
+/// grain long, on the pool threads and the calling thread, and returns once
+/// every chunk has finished. It is safe to call from several threads at once,
+/// and from inside fn.
+void Parallel_For(usize count, usize grain, const std::function<void(usize begin, usize end)>& fn);
+
+struct Parallel_Job;
+
+/// A function running in the background, from Parallel_Start
+typedef std::shared_ptr<Parallel_Job> Parallel_Task;
+
+/// Starts fn on a pool thread and returns at once, so it overlaps with
+/// whatever the caller does next. fn may call Parallel_For, its bands share the
+/// pool with everything else. With one thread there are no pool threads, and
+/// fn runs on the thread that waits for it.
+Parallel_Task Parallel_Start(std::function<void()> fn);
+
+/// Returns once the task has finished, running it on this thread if no other
+/// thread has started it.
+void Parallel_Wait(const Parallel_Task& task);
+
+/// Waits for any of count tasks whose taken flag is false to finish, sets its
+/// flag and returns its index, in the order they finish. Rather than sleep
+/// while none has finished, runs one nobody has started yet on this thread.
+/// Returns count once every flag is set.
+usize Parallel_Wait_Any(const Parallel_Task* tasks, usize count, bool* taken);
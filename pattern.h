@@ -0,0 +1,197 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// pattern.h : Test patterns for the image generators.
+//
+// A pattern is any type with these members, the generator engine is
+// specialized on the type so there are no indirect calls per pixel:
+//
+//   Pattern_Separability separability;
+//   // Writes count linear scRGB RGBA pixels starting at x, y
+//   void Span(f32* rgba, u32 x, u32 y, u32 count, u32 width, u32 height) const;
+//
+
+#pragma once
+
+#include "color.h"
+
+#include <cassert>
+#include <cmath>
+
+/// Which coordinates a pattern actually depends on, so the generators can
+/// evaluate a single row or column and replicate it instead of evaluating
+/// every pixel.
+enum class Pattern_Separability
+{
+    /// Only depends on x, every row is the same
+    Row_Invariant,
+    /// Only depends on y, every pixel in a row is the same
+    Column_Invariant,
+    Full_2D,
+};
+
+/// Adapts a PixelCallback function, for one-off patterns where an indirect
+/// call per pixel doesn't matter.
+struct Pattern_Callback
+{
+    void (*callback)(float output[], f32 x, f32 y, f32 width, f32 height);
+    Pattern_Separability separability;
+
+    void Span(f32* rgba, u32 x, u32 y, u32 count, u32 width, u32 height) const
+    {
+        for (u32 i = 0; i < count; i++)
+            callback(&rgba[4 * i], (f32)(x + i), y, width, height);
+    }
+};
+
+/// Evenly spaced gradient through two or more stops across the width (or down
+/// the height), the stops are channel major like testcolors, so
+/// table[c * stops + i] is channel c of stop i. Fewer than two stops is a
+/// programming error, Sample interpolates between stop i and i + 1.
+struct Pattern_Gradient
+{
+    const f32* table;
+    u32 stops;
+    bool vertical;
+    Pattern_Separability separability;
+
+    constexpr Pattern_Gradient(const f32* _table, u32 _stops, bool _vertical)
+        : table(_table)
+        , stops(_stops)
+        , vertical(_vertical)
+        , separability(_vertical ? Pattern_Separability::Column_Invariant : Pattern_Separability::Row_Invariant)
+    {
+        assert(_stops >= 2);
+    }
+
+    // Same math as PixelCallback_TestColors_scRGB, so the testcolors gradient
+    // is bit exact with it
+    void Sample(f32 output[], f32 pos, f32 length) const
+    {
+        const u32 limit1 = stops - 1;
+        const u32 limit2 = stops - 2;
+        f32 f = (pos / (length - 1.0f)) * limit1;
+        f = f < 0.0f ? 0.0f : f < (float)limit1 ? f : (float)limit1;
+        u32 i = (int)floor(f);
+        i = i < limit2 ? i : limit2;
+        f32 lerp = (f - i) < 1.0f ? (f - i) : 1.0f;
+        f32 ilerp = 1.0f - lerp;
+        for (u32 c = 0; c < 4; c++)
+            output[c] = table[c * stops + i] * ilerp + table[c * stops + i + 1] * lerp;
+    }
+
+    void Span(f32* rgba, u32 x, u32 y, u32 count, u32 width, u32 height) const
+    {
+        if (vertical)
+        {
+            f32 c[4];
+            Sample(c, y, height);
+            for (u32 i = 0; i < count; i++)
+                for (u32 j = 0; j < 4; j++)
+                    rgba[4 * i + j] = c[j];
+        }
+        else
+        {
+            for (u32 i = 0; i < count; i++)
+                Sample(&rgba[4 * i], (f32)(x + i), width);
+        }
+    }
+};
+
+/// Equal width vertical bars, channel major like Pattern_Gradient, at least
+/// one.
+struct Pattern_Bars
+{
+    const f32* table;
+    u32 bars;
+    Pattern_Separability separability = Pattern_Separability::Row_Invariant;
+
+    constexpr Pattern_Bars(const f32* _table, u32 _bars)
+        : table(_table)
+        , bars(_bars)
+    {
+        assert(_bars >= 1);
+    }
+
+    void Span(f32* rgba, u32 x, u32, u32 count, u32 width, u32) const
+    {
+        for (u32 i = 0; i < count; i++)
+        {
+            u32 bar = (u32)((x + i) * (u64)bars / width);
+            for (u32 c = 0; c < 4; c++)
+                rgba[4 * i + c] = table[c * bars + bar];
+        }
+    }
+};
+
+/// Two colors alternating in size x size pixel squares, a size of 0 is taken
+/// as 1.
+struct Pattern_Checkerboard
+{
+    f32 a[4];
+    f32 b[4];
+    u32 size;
+    Pattern_Separability separability = Pattern_Separability::Full_2D;
+
+    Pattern_Checkerboard(const f32 (&_a)[4], const f32 (&_b)[4], u32 _size)
+        : size(_size < 1 ? 1 : _size)
+    {
+        for (u32 j = 0; j < 4; j++)
+        {
+            a[j] = _a[j];
+            b[j] = _b[j];
+        }
+    }
+
+    void Span(f32* rgba, u32 x, u32 y, u32 count, u32, u32) const
+    {
+        u32 row = y / size;
+        for (u32 i = 0; i < count; i++)
+        {
+            const f32* c = ((x + i) / size + row) & 1 ? b : a;
+            for (u32 j = 0; j < 4; j++)
+                rgba[4 * i + j] = c[j];
+        }
+    }
+};
+
+/// Gray steps across the width with equal PQ signal spacing between two
+/// luminances, so an HDR10 layer shows evenly spaced code values.
+struct Pattern_PQ_Wedge
+{
+    static constexpr u32 max_steps = 64;
+    f32 level[max_steps];
+    u32 steps;
+    Pattern_Separability separability = Pattern_Separability::Row_Invariant;
+
+    Pattern_PQ_Wedge(u32 _steps, f32 minNits, f32 maxNits)
+    {
+        steps = _steps < 1 ? 1 : _steps < max_steps ? _steps : max_steps;
+        f32 lo[4] = { minNits / 80.0f, 0.0f, 0.0f, 1.0f };
+        f32 hi[4] = { maxNits / 80.0f, 0.0f, 0.0f, 1.0f };
+        Color_Transfer_To_PQ(lo, lo);
+        Color_Transfer_To_PQ(hi, hi);
+        for (u32 i = 0; i < steps; i++)
+        {
+            f32 t = steps > 1 ? (f32)i / (f32)(steps - 1) : 0.0f;
+            level[i] = Color_Transfer_From_PQ(lo[0] + (hi[0] - lo[0]) * t);
+        }
+    }
+
+    void Span(f32* rgba, u32 x, u32, u32 count, u32 width, u32) const
+    {
+        for (u32 i = 0; i < count; i++)
+        {
+            f32 v = level[(u32)((x + i) * (u64)steps / width)];
+            rgba[4 * i + 0] = v;
+            rgba[4 * i + 1] = v;
+            rgba[4 * i + 2] = v;
+            rgba[4 * i + 3] = 1.0f;
+        }
+    }
+};
+
+/// The testcolors gradient, horizontally and vertically
+constexpr Pattern_Gradient pattern_testcolors = { &testcolors[0][0], 7, false };
+constexpr Pattern_Gradient pattern_testcolors_vertical = { &testcolors[0][0], 7, true };
@@ -1,4 +1,4 @@
-/* This Source Code Form is subject to the terms of the Mozilla Public
+﻿/* This Source Code Form is subject to the terms of the Mozilla Public
  * License, v. 2.0. If a copy of the MPL was not distributed with this
  * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
 
@@ -8,6 +8,7 @@
 #pragma comment(lib, "d3d11.lib")
 #pragma comment(lib, "dcomp.lib")
 #pragma comment(lib, "dxgi.lib")
+#pragma comment(lib, "shell32.lib")
 
 #ifndef WINVER              // Allow use of features specific to Windows 7 or later.
 #define WINVER 0x0A00       // Change this to the appropriate value to target other versions of Windows.
@@ -24,29 +25,31 @@
 #define WIN32_LEAN_AND_MEAN     // Exclude rarely-used items from Windows headers
 
 #include "Resource.h"
+#include "arena.h"
+#include "common.h"
+#include "frame_scheduler.h"
+#include "generate.h"
+#include "image_cache.h"
+#include "image_file.h"
+#include "scene.h"
+#include "trace.h"
 
 #include <cassert>
 #include <chrono>
+#include <cstdio>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <sstream>
+#include <utility>
 #include <vector>
 
 #include <Windows.h>
 #include <d3d11.h>
 #include <dcomp.h>
 #include <dxgi1_6.h>
-
-// Rust has better names for the regular types.
-using i8 = int8_t;
-using u8 = uint8_t;
-using i16 = int16_t;
-using u16 = uint16_t;
-using f32 = float;
-using i32 = int32_t;
-using u32 = uint32_t;
-using f64 = double;
-using i64 = int64_t;
-using u64 = uint64_t;
-using usize = size_t;
+#include <shellapi.h>
 
 template <class T> void SafeRelease(T** ppT)
 {
@@ -77,9 +80,10 @@ public:
     u32 height = 0;
     DXGI_COLOR_SPACE_TYPE dxgiColorspace = DXGI_COLOR_SPACE_RGB_FULL_G10_NONE_P709;
     DXGI_FORMAT dxgiFormat = DXGI_FORMAT_R16G16B16A16_FLOAT;
-    u8 bytesPerPixel;
-    bool isWindow;
-    bool isSurface;
+    u8 bytesPerPixel = 0;
+    u32 pattern = scene_pattern_testcolors;
+    bool isWindow = false;
+    bool isSurface = false;
 
     /// DirectComposition visual represents the presentation shape (rect) and
     /// various rendering properties
@@ -97,20 +101,61 @@ public:
     IDXGISwapChain3* swapchain3 = nullptr;
     /// DXGI surface is a single image that retains previous content
     IDXGISurface* surface = nullptr;
-
+    /// The cached image the layer shows, if it fits in the cache
+    std::shared_ptr<const Image_Pixels> image;
+
+    Compositor_Layer() = default;
+    /// Layers own their DirectComposition and DXGI objects, so they can be
+    /// moved (when the scene changes) but never copied, which would release
+    /// the objects twice
+    Compositor_Layer(const Compositor_Layer&) = delete;
+    Compositor_Layer& operator=(const Compositor_Layer&) = delete;
+    Compositor_Layer(Compositor_Layer&& o) { *this = std::move(o); }
+    Compositor_Layer& operator=(Compositor_Layer&& o);
     ~Compositor_Layer();
-    void VisualWithSwapChain(Compositor* comp, f32 _x, f32 _y, u32 _width, u32 _height, DXGI_COLOR_SPACE_TYPE _type, DXGI_FORMAT _format, u8 _bpp, void* tPixels);
-    void VisualWithSurface(Compositor* comp, f32 _x, f32 _y, u32 _width, u32 _height, DXGI_COLOR_SPACE_TYPE _type, DXGI_FORMAT _format, u8 _bpp, void* tPixels);
+    /// Releases the swapchain or surface so the next VisualWith call makes a
+    /// new one, for when the size or format changes
+    void ReleaseContent();
+    /// Make the visual and its swapchain or surface if the layer has none,
+    /// Compositor::Present fills it in
+    void VisualWithSwapChain(Compositor* comp, f32 _x, f32 _y, u32 _width, u32 _height, DXGI_COLOR_SPACE_TYPE _type, DXGI_FORMAT _format, u8 _bpp, u32 _pattern);
+    void VisualWithSurface(Compositor* comp, f32 _x, f32 _y, u32 _width, u32 _height, DXGI_COLOR_SPACE_TYPE _type, DXGI_FORMAT _format, u8 _bpp, u32 _pattern);
 };
 
-Compositor_Layer::~Compositor_Layer()
+Compositor_Layer& Compositor_Layer::operator=(Compositor_Layer&& o)
 {
-    // This crashes for some reason
-    // SafeRelease(&swapchain3);
+    // Swap, so whatever this layer held is released by o
+    std::swap(x, o.x);
+    std::swap(y, o.y);
+    std::swap(width, o.width);
+    std::swap(height, o.height);
+    std::swap(dxgiColorspace, o.dxgiColorspace);
+    std::swap(dxgiFormat, o.dxgiFormat);
+    std::swap(bytesPerPixel, o.bytesPerPixel);
+    std::swap(pattern, o.pattern);
+    std::swap(isWindow, o.isWindow);
+    std::swap(isSurface, o.isSurface);
+    std::swap(dcompvisual, o.dcompvisual);
+    std::swap(swapchain1, o.swapchain1);
+    std::swap(swapchain3, o.swapchain3);
+    std::swap(surface, o.surface);
+    std::swap(image, o.image);
+    return *this;
+}
+
+void Compositor_Layer::ReleaseContent()
+{
+    SafeRelease(&swapchain3);
     SafeRelease(&swapchain1);
     SafeRelease(&surface);
-    // This crashes for some reason
-    // SafeRelease(&dcompvisual);
+}
+
+Compositor_Layer::~Compositor_Layer()
+{
+    // These used to crash when the layers were iterated by value, each copy
+    // released the objects again. Layers can't be copied any more.
+    ReleaseContent();
+    SafeRelease(&dcompvisual);
 }
 
 class Compositor
@@ -130,23 +175,82 @@ public:
     ID3D11DeviceContext* context = nullptr;
     IDCompositionVisual* rootvisual = nullptr;
 
-    // Currently active layers
+    // Description of the current scene, what the layers show
+    std::vector<Scene_Layer> scene;
+    // Currently active layers, layers[i] shows scene[i]
     std::vector<Compositor_Layer> layers;
+    // The scene UpdateScene wants to show, kept to reuse its memory
+    std::vector<Scene_Layer> desiredScene;
+    // Generated layer images, kept across device resets and DPI changes
+    Image_Cache imageCache{ 256 * 1024 * 1024 };
+    // GenerateTestColors runs of the desired scene by (width, height), so the
+    // other layers of a column wait for the images its first layer is making
+    // rather than making them again, and layers of other sizes don't wait.
+    // The mutex is only held to find or add a run.
+    std::mutex testColorsMutex;
+    std::map<std::pair<u32, u32>, std::shared_future<void>> testColorsRuns;
+    std::shared_ptr<const Image_Pixels> windowImage;
+    // Most bytes of staging texture UpdateSwapChain generates into at once,
+    // images bigger than this are uploaded a band of rows at a time
+    usize uploadBudget = 32 * 1024 * 1024;
+    // Layer images the cache won't keep (image files, anything over its
+    // budget), which Generate makes on the thread pool ahead of their upload.
+    // They are only needed until the apply that made them returns, which
+    // rewinds the arena. A chunk starts at one large page and grows to the
+    // biggest recent apply. The mutex is held to allocate, not to generate.
+    Arena sceneArena{ 2 * 1024 * 1024, Arena_Pages::Large };
+    std::mutex sceneArenaMutex;
+    // Most bytes of sceneArena an apply uses, layers past it are generated
+    // into the staging textures at upload instead
+    usize prepareBudget = sizeof(usize) < 8 ? 256 * 1024 * 1024 : (usize)1024 * 1024 * 1024;
+    // The image file from the command line, shown in place of testcolors when
+    // open. It stays mapped for the whole run and is converted into a buffer
+    // per layer on the thread pool while prepareBudget allows, otherwise
+    // straight into the staging textures at upload.
+    Image_File inputImage;
 
     ~Compositor();
     void UpdateStatus();
     void DestroyDevice();
     void CreateDevice(HWND hWnd);
-    void CreateScene();
+    void ResetScene();
+    void CreateScene(HWND hWnd);
+    void UpdateScene();
+    void DesiredScene();
+    void MakeLayer(Compositor_Layer& layer, const Scene_Layer& s);
     void Update(HWND hWnd, bool reset);
     void MakeWindowSwapChain(DXGI_COLOR_SPACE_TYPE _type, DXGI_FORMAT _format);
-    void UpdateSwapChain(IDXGISwapChain1* swapchain, DXGI_COLOR_SPACE_TYPE _type, DXGI_FORMAT _format, u8 _bpp, void* tPixels);
+    void UpdateSwapChain(IDXGISwapChain1* swapchain, u32 _pattern, DXGI_COLOR_SPACE_TYPE _type, DXGI_FORMAT _format, u8 _bpp, void* tPixels);
+    void GenerateTestImage(u32 _pattern, void* pixels, usize pitch, u32 _width, u32 _height, DXGI_FORMAT _format, const Generate_Rect* rect = nullptr);
+    std::shared_ptr<const Image_Pixels> GetTestImage(u32 _pattern, u32 _width, u32 _height, DXGI_COLOR_SPACE_TYPE _type, DXGI_FORMAT _format, u8 _bpp);
+    void GenerateTestColors(u32 _width, u32 _height);
+    void GenerateTestColorsRun(u32 _width, u32 _height);
+
+    // Scene_Apply_Async backend, so a scene change only touches the layers
+    // that changed, and their images are generated on the thread pool while
+    // the device, visuals and swapchains are made
+    typedef Compositor_Layer Layer;
+    struct Pixels
+    {
+        // Cached, kept by the layer
+        std::shared_ptr<const Image_Pixels> image;
+        // In sceneArena, made just for the upload
+        void* prepared = nullptr;
+    };
+    Pixels Generate(const Scene_Layer& s);
+    void Present(Compositor_Layer& layer, const Scene_Layer& s, const Pixels& pixels);
+    void Add(Compositor_Layer& layer, const Scene_Layer& s, Compositor_Layer* below);
+    void Remove(Compositor_Layer& layer, const Scene_Layer& old);
+    void Move(Compositor_Layer& layer, const Scene_Layer& s);
+    void Content(Compositor_Layer& layer, const Scene_Layer& old, const Scene_Layer& s);
+    void Commit();
 };
 
 void Compositor::DestroyDevice()
 {
     status = Compositor_Status::No_Device;
     layers.clear();
+    scene.clear();
     if (rootvisual) {
         rootvisual->RemoveAllVisuals();
     }
@@ -179,6 +283,7 @@ void Compositor::UpdateStatus()
 
 void Compositor::CreateDevice(HWND hWnd)
 {
+    TRACE_SCOPE("Compositor::CreateDevice");
     // Assume device creation failed if this function exits early.
     status = Compositor_Status::Device_Creation_Failed;
     hWindow = hWnd;
@@ -264,13 +369,43 @@ void Compositor::CreateDevice(HWND hWnd)
     status = Compositor_Status::Running;
 }
 
-void Compositor::UpdateSwapChain(IDXGISwapChain1* swapchain, DXGI_COLOR_SPACE_TYPE _type, DXGI_FORMAT _format, u8 _bpp, void* tPixels)
+// Generates a test image, or just rect of it, into rows pitch bytes apart,
+// which may be mapped texture memory
+void Compositor::GenerateTestImage(u32 _pattern, void* pixels, usize pitch, u32 _width, u32 _height, DXGI_FORMAT _format, const Generate_Rect* rect)
 {
+    if (_pattern == scene_pattern_image)
+    {
+        // Only the layer formats are in the scene
+        if (!Image_File_Generate(inputImage, pixels, pitch, _width, _height, _format, rect))
+            assert(false);
+        return;
+    }
+    switch (_format)
+    {
+    case DXGI_FORMAT_R16G16B16A16_FLOAT:
+        GenerateImage_RGBA16F_scRGB((u16*)pixels, _width, _height, pitch, rect);
+        break;
+    case DXGI_FORMAT_R10G10B10A2_UNORM:
+        GenerateImage_RGB10A2_HDR10((u32*)pixels, _width, _height, pitch, rect);
+        break;
+    case DXGI_FORMAT_B8G8R8A8_UNORM:
+        GenerateImage_BGRA8_sRGB((u32*)pixels, _width, _height, pitch, rect);
+        break;
+    default:
+        assert(false);
+        break;
+    }
+}
+
+void Compositor::UpdateSwapChain(IDXGISwapChain1* swapchain, u32 _pattern, DXGI_COLOR_SPACE_TYPE _type, DXGI_FORMAT _format, u8 _bpp, void* tPixels)
+{
+    TRACE_SCOPE("Compositor::UpdateSwapChain");
     DXGI_SWAP_CHAIN_DESC1 scDesc = {};
     swapchain->GetDesc1(&scDesc);
     ID3D11Resource* buffer = nullptr;
     ID3D11RenderTargetView* view = nullptr;
     ID3D11Texture2D* tex = nullptr;
+    ID3D11Texture2D* staging[2] = {};
     D3D11_TEXTURE2D_DESC tDesc;
     tDesc.Width = scDesc.Width;
     tDesc.Height = scDesc.Height;
@@ -279,7 +414,7 @@ void Compositor::UpdateSwapChain(IDXGISwapChain1* swapchain, DXGI_COLOR_SPACE_TY
     tDesc.Format = _format;
     u8 bpp = _bpp;
     // tDesc uses UINT, so let's check for overflow first.
-    u64 tPitch = tDesc.Width * bpp;
+    u64 tPitch = (u64)tDesc.Width * bpp;
     u64 tSlicePitch = tPitch * tDesc.Height;
     if (tPitch > UINT_MAX || tSlicePitch > UINT_MAX)
     {
@@ -299,15 +434,52 @@ void Compositor::UpdateSwapChain(IDXGISwapChain1* swapchain, DXGI_COLOR_SPACE_TY
     if (SUCCEEDED(hr) && buffer)
     {
 #if !USE_RENDERTARGETVIEW
-        // Just copy pixels into the backbuffer
-        D3D11_BOX texBox;
-        texBox.left = 0;
-        texBox.right = scDesc.Width;
-        texBox.top = 0;
-        texBox.bottom = scDesc.Height;
-        texBox.front = 0;
-        texBox.back = 1;
-        context->UpdateSubresource(buffer, 0, &texBox, tPixels, static_cast<UINT>(tPitch), static_cast<UINT>(tSlicePitch));
+        if (!tPixels)
+        {
+            // Generate straight into mapped staging textures with the
+            // driver's pitch and let the GPU copy them, so there is no image
+            // sized buffer of our own. Big images go a band of rows at a time
+            // to stay under uploadBudget, alternating between two staging
+            // textures so the next band is generated while the GPU copies
+            // the last one.
+            u32 rows = Generate_Chunk_Rows(scDesc.Width, scDesc.Height, bpp, uploadBudget / 2);
+            D3D11_TEXTURE2D_DESC sDesc = tDesc;
+            sDesc.Height = rows;
+            sDesc.Usage = D3D11_USAGE_STAGING;
+            sDesc.BindFlags = 0;
+            sDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+            for (u32 i = 0; i < (rows < scDesc.Height ? 2u : 1u) && SUCCEEDED(hr); i++)
+                hr = d3d->CreateTexture2D(&sDesc, nullptr, &staging[i]);
+            assert(SUCCEEDED(hr));
+            for (u32 y = 0, i = 0; y < scDesc.Height && SUCCEEDED(hr); y += rows, i = staging[1] ? i ^ 1 : 0)
+            {
+                Generate_Rect rect = { 0, y, scDesc.Width, rows < scDesc.Height - y ? rows : scDesc.Height - y };
+                D3D11_MAPPED_SUBRESOURCE mapped = {};
+                hr = context->Map(staging[i], 0, D3D11_MAP_WRITE, 0, &mapped);
+                assert(SUCCEEDED(hr));
+                if (SUCCEEDED(hr) && mapped.pData)
+                {
+                    GenerateTestImage(_pattern, mapped.pData, mapped.RowPitch, scDesc.Width, scDesc.Height, _format, &rect);
+                    context->Unmap(staging[i], 0);
+                    D3D11_BOX box = { 0, 0, 0, rect.width, rect.height, 1 };
+                    context->CopySubresourceRegion(buffer, 0, 0, y, 0, staging[i], 0, &box);
+                    TRACE_COUNT("bytes uploaded", (u64)mapped.RowPitch * rect.height);
+                }
+            }
+        }
+        else
+        {
+            // Just copy pixels into the backbuffer
+            D3D11_BOX texBox;
+            texBox.left = 0;
+            texBox.right = scDesc.Width;
+            texBox.top = 0;
+            texBox.bottom = scDesc.Height;
+            texBox.front = 0;
+            texBox.back = 1;
+            context->UpdateSubresource(buffer, 0, &texBox, tPixels, static_cast<UINT>(tPitch), static_cast<UINT>(tSlicePitch));
+            TRACE_COUNT("bytes uploaded", tSlicePitch);
+        }
 #else
         // Create a texture to hold the pixels, and set up a shader to
         // copy that into the backbuffer
@@ -321,7 +493,24 @@ void Compositor::UpdateSwapChain(IDXGISwapChain1* swapchain, DXGI_COLOR_SPACE_TY
             tInitData.SysMemPitch = static_cast<UINT>(tPitch);
             tInitData.SysMemSlicePitch = static_cast<UINT>(tSlicePitch);
             tInitData.pSysMem = tPixels;
-            hr = d3d->CreateTexture2D(&tDesc, &tInitData, &tex);
+            if (!tPixels)
+            {
+                // Generate straight into the mapped texture
+                tDesc.Usage = D3D11_USAGE_DYNAMIC;
+                tDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+            }
+            hr = d3d->CreateTexture2D(&tDesc, tPixels ? &tInitData : nullptr, &tex);
+            if (SUCCEEDED(hr) && tex && !tPixels)
+            {
+                D3D11_MAPPED_SUBRESOURCE mapped = {};
+                hr = context->Map(tex, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
+                assert(SUCCEEDED(hr));
+                if (SUCCEEDED(hr))
+                {
+                    GenerateTestImage(_pattern, mapped.pData, mapped.RowPitch, tDesc.Width, tDesc.Height, _format);
+                    context->Unmap(tex, 0);
+                }
+            }
             if (SUCCEEDED(hr) && tex)
             {
                 D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc;
@@ -341,6 +530,9 @@ void Compositor::UpdateSwapChain(IDXGISwapChain1* swapchain, DXGI_COLOR_SPACE_TY
 
     if (tex)
         tex->Release();
+    for (ID3D11Texture2D* t : staging)
+        if (t)
+            t->Release();
     if (view)
         view->Release();
     if (buffer)
@@ -392,7 +584,7 @@ void Compositor::MakeWindowSwapChain(DXGI_COLOR_SPACE_TYPE _type, DXGI_FORMAT _f
     }
 }
 
-void Compositor_Layer::VisualWithSwapChain(Compositor* comp, f32 _x, f32 _y, u32 _width, u32 _height, DXGI_COLOR_SPACE_TYPE _type, DXGI_FORMAT _format, u8 _bpp, void *tPixels)
+void Compositor_Layer::VisualWithSwapChain(Compositor* comp, f32 _x, f32 _y, u32 _width, u32 _height, DXGI_COLOR_SPACE_TYPE _type, DXGI_FORMAT _format, u8 _bpp, u32 _pattern)
 {
     x = _x;
     y = _y;
@@ -401,6 +593,7 @@ void Compositor_Layer::VisualWithSwapChain(Compositor* comp, f32 _x, f32 _y, u32
     dxgiColorspace = _type;
     dxgiFormat = _format;
     bytesPerPixel = _bpp;
+    pattern = _pattern;
     isSurface = false;
     isWindow = false;
 
@@ -454,14 +647,9 @@ void Compositor_Layer::VisualWithSwapChain(Compositor* comp, f32 _x, f32 _y, u32
         swapchain3->SetColorSpace1(dxgiColorspace);
         dcompvisual->SetContent(swapchain3);
     }
-
-    // Render a new frame in the swapchain and present it
-    if (swapchain1 && width >= 1 && height >= 1) {
-        comp->UpdateSwapChain(swapchain1, _type, _format, _bpp, tPixels);
-    }
 }
 
-void Compositor_Layer::VisualWithSurface(Compositor* comp, f32 _x, f32 _y, u32 _width, u32 _height, DXGI_COLOR_SPACE_TYPE _type, DXGI_FORMAT _format, u8 _bpp, void* tPixels)
+void Compositor_Layer::VisualWithSurface(Compositor* comp, f32 _x, f32 _y, u32 _width, u32 _height, DXGI_COLOR_SPACE_TYPE _type, DXGI_FORMAT _format, u8 _bpp, u32 _pattern)
 {
     x = _x;
     y = _y;
@@ -470,6 +658,7 @@ void Compositor_Layer::VisualWithSurface(Compositor* comp, f32 _x, f32 _y, u32 _
     dxgiColorspace = _type;
     dxgiFormat = _format;
     bytesPerPixel = _bpp;
+    pattern = _pattern;
     isSurface = true;
     isWindow = false;
 
@@ -487,6 +676,7 @@ void Compositor_Layer::VisualWithSurface(Compositor* comp, f32 _x, f32 _y, u32 _
 
 void Compositor::Update(HWND hWnd, bool reset)
 {
+    TRACE_SCOPE("Compositor::Update");
     // Get the current DPI of the display the window is on
     f32 newscale = 1.0f;
     HDC hdc = GetDC(hWnd);
@@ -497,9 +687,7 @@ void Compositor::Update(HWND hWnd, bool reset)
         ReleaseDC(hWnd, hdc);
     }
     // TODO: Get SDRWhiteLevel from DisplayConfigGetDeviceInfo...
-    if (fabs(scale - newscale) > 0.01f) {
-        reset = true;
-    }
+    // A DPI change doesn't need a new device, UpdateScene resizes the layers
     scale = newscale;
     if (hWindow != hWnd) {
         reset = true;
@@ -511,25 +699,22 @@ void Compositor::Update(HWND hWnd, bool reset)
     // If an error is encountered, we reinitialize the device and try again, but
     // only once, if the device is lost repeatedly we're not going to make
     // progress, so two attempts is probably optimal
+    bool rebuilt = false;
     for (i32 tries = 2; tries >= 0; tries--)
     {
         UpdateStatus();
         if (status != Compositor_Status::Running || reset) {
+            TRACE_SCOPE("Compositor::Update rebuild");
             reset = false;
             DestroyDevice();
-            CreateDevice(hWnd);
-            CreateScene();
-            // Add the layer visuals to our root visual as they must form a tree
-            for (auto layer : layers) {
-                if (layer.dcompvisual) {
-                    HRESULT hr = rootvisual->AddVisual(layer.dcompvisual, TRUE, nullptr);
-                    assert(SUCCEEDED(hr));
-                }
-            }
-            // Commit transaction so it displays the new layers
-            dcomp->Commit();
+            CreateScene(hWnd);
+            rebuilt = true;
         }
     }
+    // Otherwise only the layers that changed are regenerated and presented
+    if (!rebuilt && status == Compositor_Status::Running) {
+        UpdateScene();
+    }
 }
 
 Compositor::~Compositor()
@@ -537,266 +722,281 @@ Compositor::~Compositor()
     DestroyDevice();
 }
 
-// These test colors represent an scRGB color wheel with deliberately wide gamut
-// colors (which often require negative values for other components) and HDR
-// intensity (2.0 = 160 nits scene referred)
-const f32 testcolors[4][7] = {
-    // Red
-    {  2.00f,  2.00f, -0.20f, -0.20f, -0.20f,  2.00f,  2.00f},
-    // Green
-    { -0.20f,  2.00f,  2.00f,  2.00f, -0.20f, -0.20f, -0.20f},
-    // Blue
-    { -0.20f, -0.20f, -0.20f,  2.00f,  2.00f,  2.00f, -0.20f},
-    // Alpha
-    {  1.00f,  1.00f,  1.00f,  1.00f,  1.00f,  1.00f,  1.00f}
-};
+static_assert(dxgi_format_r16g16b16a16_float == DXGI_FORMAT_R16G16B16A16_FLOAT, "format.h DXGI values");
+static_assert(dxgi_format_r10g10b10a2_unorm == DXGI_FORMAT_R10G10B10A2_UNORM, "format.h DXGI values");
+static_assert(dxgi_format_b8g8r8a8_unorm == DXGI_FORMAT_B8G8R8A8_UNORM, "format.h DXGI values");
+static_assert(dxgi_format_r16g16b16a16_unorm == DXGI_FORMAT_R16G16B16A16_UNORM, "format.h DXGI values");
+static_assert(dxgi_format_r11g11b10_float == DXGI_FORMAT_R11G11B10_FLOAT, "format.h DXGI values");
+static_assert(dxgi_format_r8g8b8a8_unorm_srgb == DXGI_FORMAT_R8G8B8A8_UNORM_SRGB, "format.h DXGI values");
+static_assert(dxgi_format_r9g9b9e5_sharedexp == DXGI_FORMAT_R9G9B9E5_SHAREDEXP, "format.h DXGI values");
+static_assert(dxgi_color_space_rgb_full_g22_none_p709 == DXGI_COLOR_SPACE_RGB_FULL_G22_NONE_P709, "scene.h DXGI values");
+static_assert(dxgi_color_space_rgb_full_g10_none_p709 == DXGI_COLOR_SPACE_RGB_FULL_G10_NONE_P709, "scene.h DXGI values");
+static_assert(dxgi_color_space_rgb_full_g2084_none_p2020 == DXGI_COLOR_SPACE_RGB_FULL_G2084_NONE_P2020, "scene.h DXGI values");
+static_assert(dxgi_alpha_mode_premultiplied == DXGI_ALPHA_MODE_PREMULTIPLIED, "scene.h DXGI values");
+static_assert(dxgi_alpha_mode_ignore == DXGI_ALPHA_MODE_IGNORE, "scene.h DXGI values");
+
+// Returns a test image from the cache, or nullptr for images the cache would
+// refuse to keep, such as 16K layers, which UpdateSwapChain generates straight
+// into mapped texture memory instead. The image file is never cached, it is
+// already in memory (the file's mapping), and an 8K copy of it per format is
+// what showing it from the mapping avoids.
+static Image_Key TestImageKey(u32 _pattern, u32 _width, u32 _height, DXGI_COLOR_SPACE_TYPE _type, DXGI_FORMAT _format)
+{
+    Image_Key key;
+    key.pattern = _pattern;
+    key.width = _width;
+    key.height = _height;
+    key.format = _format;
+    key.transfer = _type;
+    return key;
+}
 
-void PixelCallback_TestColors_scRGB(float output[], f32 x, f32 y, f32 width, f32 height)
+std::shared_ptr<const Image_Pixels> Compositor::GetTestImage(u32 _pattern, u32 _width, u32 _height, DXGI_COLOR_SPACE_TYPE _type, DXGI_FORMAT _format, u8 _bpp)
 {
-    constexpr u32 limit = sizeof(testcolors[0]) / sizeof(testcolors[0][0]);
-    constexpr u32 limit1 = limit - 1;
-    constexpr u32 limit2 = limit - 2;
-    f32 f = (x / (width - 1.0f)) * limit1;
-    f = f < 0.0f ? 0.0f : f < (float)limit1 ? f : (float)limit1;
-    u32 i = (int)floor(f);
-    i = i < 0 ? 0 : i < limit2 ? i : limit2;
-    f32 lerp = (f - i) < 1.0f ? (f - i) : 1.0f;
-    f32 ilerp = 1.0f - lerp;
-    for (u32 c = 0; c < 4; c++)
-        output[c] = testcolors[c][i] * ilerp + testcolors[c][i + 1] * lerp;
+    usize size;
+    if (_pattern == scene_pattern_image || !Generate_Size(_width, _height, _bpp, &size) || size > imageCache.Budget()) {
+        return nullptr;
+    }
+
+    auto generate = [=](void* pixels) {
+        GenerateTestImage(_pattern, pixels, (usize)_bpp * _width, _width, _height, _format);
+    };
+    return imageCache.Get(TestImageKey(_pattern, _width, _height, _type, _format), size, generate);
 }
 
-static void Pixel_To_Int(f32 c[], f32 scale, f32 low, f32 high)
+// Runs GenerateTestColorsRun once per size of the desired scene. The first
+// layer of a size runs it, the others wait until it is done.
+void Compositor::GenerateTestColors(u32 _width, u32 _height)
 {
-    for (u32 i = 0; i < 4; i++)
-    {
-        f32 f = c[i];
-        f *= scale;
-        f = floorf(f + 0.5f);
-        f = f < low ? low : f < high ? f : high;
-        c[i] = f;
-    }
-}
-
-/// This converts an f32 to an f16 using bit manipulation (which achieves round
-/// toward zero behavior, which may not be the active floating point mode).
-/// See https://en.wikipedia.org/wiki/Half-precision_floating-point_format and
-/// compare to https://en.wikipedia.org/wiki/Single-precision_floating-point_format
-static u16 ToF16(f32 f)
-{
-    // Some notes:
-    // f32 is 1 sign bit, 8 exponent bits, 23 mantissa bits
-    // f16 is 1 sign bit, 5 exponent bits, 10 mantissa bits
-    // 1.0 as f32 is 0x3f800000 (exp=127 of 0-255)
-    // s0 e01111111 m00000000000000000000000
-    // 1.0 as f16 is 0x7800 (exp=15 of 0-31)
-    // s0 e...01111 m0000000000.............
-    // if we shift the exponents to align the same, 127-15=112, f16 exp is f32
-    // exp - 112, since the sign bit precedes it we need to mask that off before
-    // adjusting, the mantissa directly follows the exponent so we can shift
-    // both by the same amount to align with the f16 format, and subtract 112
-    // from the exponent and we get f16 from f32 with bit math alone.
-    //
-    // e112 = s0 e011100000 m... = 0x38000000
-    // e113 = s0 e011100001 m... = 0x38800000
-    //
-    // We also have to handle the fact that e103 to 112 become denormals, but
-    // it is easier to simply treat <=e112 as zero, a lot of float
-    // implementations either ignore denormals or process them very slowly so
-    // turning them into zero is a reasonable behavior here.
-    union
+    std::promise<void> done;
+    std::shared_future<void> pending;
     {
-        f32 f;
-        u32 i;
+        std::lock_guard<std::mutex> lock(testColorsMutex);
+        auto run = testColorsRuns.emplace(std::make_pair(_width, _height), std::shared_future<void>());
+        if (run.second) {
+            run.first->second = done.get_future().share();
+        } else {
+            pending = run.first->second;
+        }
+    }
+    if (pending.valid()) {
+        pending.wait();
+        return;
     }
-    u;
-    u.f = f;
-    u32 i = u.i;
-    // Adjust exponent from +127 bias to +15 bias, if it would become less than
-    // exponent 1 we treat it as a full zero (rather than try to deal with
-    // denormals, which typically have a performance penalty anyway)
-    u32 a = ((i & 0x7FFFFFFF) < 0x38800000) ? 0 : i - 0x38000000;
-    // Shift exponent and mantissa to the correct place (same shift for both)
-    // and put the sign bit into place
-    u16 n = (a >> 13) | ((a & 0x80000000) >> 16);
-    return n;
+    GenerateTestColorsRun(_width, _height);
+    done.set_value();
 }
 
-void GenerateImage_RGBA16F_scRGB(u16* pixels, u16 width, u16 height)
+// Generates the testcolors image of every layer of the desired scene that is
+// _width x _height in one pass, so a column's scRGB, HDR10 and sRGB layers
+// evaluate the gradient once between them, and caches them. Images already
+// cached or too big for the cache are left out.
+void Compositor::GenerateTestColorsRun(u32 _width, u32 _height)
 {
-    for (u16 y = 0; y < height; y++)
-    {
-        for (u16 x = 0; x < width; x++)
-        {
-            auto p = (u16*)pixels + 4 * (y * width + x);
-            f32 c[4];
-            PixelCallback_TestColors_scRGB(c, x, y, width, height);
-            for (u16 i = 0; i < 4; i++)
-                p[i] = (u16)ToF16(c[i]);
+    std::shared_ptr<Image_Pixels> images[3];
+    Image_Key keys[3];
+    Generate_Outputs outputs;
+    bool any = false;
+    for (const Scene_Layer& s : desiredScene) {
+        if (s.pattern != scene_pattern_testcolors || s.width != _width || s.height != _height) {
+            continue;
+        }
+        Generate_Output* output = nullptr;
+        usize i = 0;
+        switch (s.dxgiFormat) {
+        case DXGI_FORMAT_R16G16B16A16_FLOAT:
+            output = &outputs.scRGB;
+            i = 0;
+            break;
+        case DXGI_FORMAT_R10G10B10A2_UNORM:
+            output = &outputs.hdr10;
+            i = 1;
+            break;
+        case DXGI_FORMAT_B8G8R8A8_UNORM:
+            output = &outputs.sRGB;
+            i = 2;
+            break;
+        }
+        usize size;
+        if (!output || output->pixels || !Generate_Size(_width, _height, s.bytesPerPixel, &size) || size > imageCache.Budget()) {
+            continue;
+        }
+        keys[i] = TestImageKey(s.pattern, _width, _height, (DXGI_COLOR_SPACE_TYPE)s.dxgiColorspace, (DXGI_FORMAT)s.dxgiFormat);
+        if (imageCache.Find(keys[i])) {
+            continue;
+        }
+        images[i] = std::make_shared<Image_Pixels>(size);
+        output->pixels = images[i]->data();
+        any = true;
+    }
+    if (!any) {
+        return;
+    }
+    GenerateImage_TestColors(outputs, _width, _height);
+    for (usize i = 0; i < 3; i++) {
+        if (images[i]) {
+            imageCache.Put(keys[i], images[i]);
         }
     }
 }
 
-constexpr f32 scrgb_to_xyzd65[3][3] = {
-    { 0.4123908f,  0.3575843f,  0.1804808f},
-    { 0.2126390f,  0.7151687f,  0.0721923f},
-    { 0.0193308f,  0.1191948f,  0.9505322f} };
+void Compositor::ResetScene()
+{
+    scene.clear();
+    layers.clear();
+    windowImage.reset();
+}
 
-constexpr f32 xyzd65_to_rec2020[3][3] = {
-    { 1.7166512f, -0.3556708f, -0.2533663f},
-    {-0.6666844f,  1.6164812f,  0.0157685f},
-    { 0.0176399f, -0.0427706f,  0.9421031f} };
+// Makes the device and the whole scene, generating the layer images on the
+// thread pool while the device and swapchains are created, and presenting
+// each layer as soon as its image is ready
+void Compositor::CreateScene(HWND hWnd)
+{
+    TRACE_SCOPE("Compositor::CreateScene");
+    ResetScene();
+    DesiredScene();
+    // Starting from an empty scene every layer is added
+    Scene_Apply_Async(*this, scene, layers, desiredScene.data(), desiredScene.size(), [&]() {
+        CreateDevice(hWnd);
+        if (status != Compositor_Status::Running) {
+            return false;
+        }
+#if WINDOW_BACKGROUND
+        MakeWindowSwapChain(DXGI_COLOR_SPACE_RGB_FULL_G10_NONE_P709, DXGI_FORMAT_R16G16B16A16_FLOAT);
+        // Get the window swapchain size
+        DXGI_SWAP_CHAIN_DESC1 scDesc = {};
+        windowswapchain1->GetDesc1(&scDesc);
+        // The image has to be the swapchain's size, anything too big for the
+        // cache is generated into the swapchain in bands by UpdateSwapChain
+        windowImage = GetTestImage(scene_pattern_testcolors, scDesc.Width, scDesc.Height, DXGI_COLOR_SPACE_RGB_FULL_G10_NONE_P709, DXGI_FORMAT_R16G16B16A16_FLOAT, 8);
+        UpdateSwapChain(windowswapchain1, scene_pattern_testcolors, DXGI_COLOR_SPACE_RGB_FULL_G10_NONE_P709, DXGI_FORMAT_R16G16B16A16_FLOAT, 8, windowImage ? (void*)windowImage->data() : nullptr);
+#endif
+        return true;
+    });
+    // Every prepared image has been uploaded
+    sceneArena.Reset();
+}
 
-void Color_rgb_through_mat3(const f32 c[], f32 o[], const f32 mat[3][3]) {
-    o[0] = c[0] * mat[0][0] + c[1] * mat[0][1] + c[2] * mat[0][2];
-    o[1] = c[0] * mat[1][0] + c[1] * mat[1][1] + c[2] * mat[1][2];
-    o[2] = c[0] * mat[2][0] + c[1] * mat[2][1] + c[2] * mat[2][2];
+// Diffs the scene for the current DPI against the one being shown, and only
+// regenerates, presents and commits the layers that changed
+void Compositor::UpdateScene()
+{
+    TRACE_SCOPE("Compositor::UpdateScene");
+    DesiredScene();
+    Scene_Apply_Async(*this, scene, layers, desiredScene.data(), desiredScene.size(), []() { return true; });
+    sceneArena.Reset();
 }
 
-void Color_scRGB_To_Rec2020(f32 c[3], f32 o[3])
+// Lays out the scene for the current DPI in desiredScene
+void Compositor::DesiredScene()
 {
-    f32 xyz[3];
-    Color_rgb_through_mat3(c, xyz, scrgb_to_xyzd65);
-    Color_rgb_through_mat3(xyz, o, xyzd65_to_rec2020);
+    desiredScene.clear();
+    // Runs were for the last desired scene, and no pool task is using them
+    testColorsRuns.clear();
+    if (inputImage.IsOpen()) {
+        Scene_Image(desiredScene, scale, inputImage.Width(), inputImage.Height());
+    } else {
+        Scene_TestColors(desiredScene, scale);
+    }
 }
 
-void Color_Transfer_To_PQ(const f32 c[3], f32 o[3])
+// Makes the layer's visual and swapchain if it has none, and places it
+void Compositor::MakeLayer(Compositor_Layer& layer, const Scene_Layer& s)
 {
-    constexpr auto m1 = 2610.0f / 16384.0f;
-    constexpr auto m2 = 128.0f * 2523.0f / 4096.0f;
-    constexpr auto c1 = 3424.0f / 4096.0f;
-    constexpr auto c2 = 32.0f * 2413.0f / 4096.0f;
-    constexpr auto c3 = 32.0f * 2392.0f / 4096.0f;
-    for (u32 i = 0; i < 3; i++)
-    {
-        f32 y = c[i] * 80.0f / 10000.0f;
-        y = y < 0.0f ? 0.0f : y;
-        f32 j = powf(y, m1);
-        f32 f = powf((c1 + c2 * j) / (1 + c3 * j), m2);
-        o[i] = f < 0.0f ? 0.0f : f < 1.0f ? f : 1.0f;
+    if (s.isSurface) {
+        layer.VisualWithSurface(this, s.x, s.y, s.width, s.height, (DXGI_COLOR_SPACE_TYPE)s.dxgiColorspace, (DXGI_FORMAT)s.dxgiFormat, s.bytesPerPixel, s.pattern);
+    } else {
+        layer.VisualWithSwapChain(this, s.x, s.y, s.width, s.height, (DXGI_COLOR_SPACE_TYPE)s.dxgiColorspace, (DXGI_FORMAT)s.dxgiFormat, s.bytesPerPixel, s.pattern);
     }
-    o[3] = c[3];
 }
 
-// Generates an HDR10 image - converts scRGB gradient to Rec2100 (Rec2020 HDR),
-// uses PQ transfer function and encodes as RGB10A2.
-void GenerateImage_RGB10A2_HDR10(u32* pixels, u16 width, u16 height)
+// Runs on the thread pool, so only touches the cache, the image file and
+// desiredScene (which stays put until Scene_Apply_Async returns), never the
+// device. Layers showing the same image share it through the cache, and
+// testcolors layers the same size are generated together. Images the cache
+// won't keep, image files above all, are generated into sceneArena while
+// prepareBudget allows, so Present only uploads them.
+Compositor::Pixels Compositor::Generate(const Scene_Layer& s)
 {
-    for (u16 y = 0; y < height; y++)
+    Pixels pixels;
+    if (s.pattern == scene_pattern_testcolors) {
+        GenerateTestColors(s.width, s.height);
+    }
+    pixels.image = GetTestImage(s.pattern, s.width, s.height, (DXGI_COLOR_SPACE_TYPE)s.dxgiColorspace, (DXGI_FORMAT)s.dxgiFormat, s.bytesPerPixel);
+    usize size;
+    if (pixels.image || !Generate_Size(s.width, s.height, s.bytesPerPixel, &size)) {
+        return pixels;
+    }
     {
-        for (u16 x = 0; x < width; x++)
-        {
-            auto p = (u32*)pixels + y * width + x;
-            f32 scrgb[4];
-            PixelCallback_TestColors_scRGB(scrgb, x, y, width, height);
-            f32 rec2020[4];
-            Color_scRGB_To_Rec2020(scrgb, rec2020);
-            f32 t[4];
-            Color_Transfer_To_PQ(rec2020, t);
-            t[3] = scrgb[3];
-            Pixel_To_Int(t, 1023.0f, 0.0f, 1023.0f);
-            *p =
-                (u32)t[0] * 0x1 +
-                (u32)t[1] * 0x400 +
-                (u32)t[2] * 0x100000 +
-                ((u32)t[3] >> 8) * 0xC0000000;
+        std::lock_guard<std::mutex> lock(sceneArenaMutex);
+        if (size <= prepareBudget && sceneArena.Bytes() <= prepareBudget - size) {
+            pixels.prepared = sceneArena.Allocate(size);
         }
     }
+    if (!pixels.prepared) {
+        return pixels;
+    }
+    TRACE_SCOPE("Compositor::Generate uncached");
+    GenerateTestImage(s.pattern, pixels.prepared, (usize)s.bytesPerPixel * s.width, s.width, s.height, (DXGI_FORMAT)s.dxgiFormat);
+    return pixels;
 }
 
-void Color_Transfer_To_sRGB(f32 c[], f32 o[])
+// Renders a new frame in the layer's swapchain and presents it
+void Compositor::Present(Compositor_Layer& layer, const Scene_Layer&, const Pixels& pixels)
 {
-    // sRGB piecewise gamma
-    for (u32 i = 0; i < 3; i++)
-    {
-        f32 f = c[i];
-        f = f < 0.0f ? 0.0f : f < 1.0f ? f : 1.0f;
-        o[i] = f < 0.0031308f ? f * 12.92f : 1.055f * powf(f, 0.41666f) - 0.055f;
+    layer.image = pixels.image;
+    if (!layer.isSurface && layer.swapchain1 && layer.width >= 1 && layer.height >= 1) {
+        UpdateSwapChain(layer.swapchain1, layer.pattern, layer.dxgiColorspace, layer.dxgiFormat, layer.bytesPerPixel, pixels.image ? (void*)pixels.image->data() : pixels.prepared);
     }
-    o[3] = c[3];
 }
 
-void GenerateImage_BGRA8_sRGB(u32* pixels, u16 width, u16 height)
+void Compositor::Add(Compositor_Layer& layer, const Scene_Layer& s, Compositor_Layer* below)
 {
-    // 8bit sRGB or rec709 (Windows doesn't distinguish between them)
-    for (u16 y = 0; y < height; y++)
-    {
-        for (u16 x = 0; x < width; x++)
-        {
-            auto p = pixels + y * width + x;
-            f32 c[4];
-            PixelCallback_TestColors_scRGB(c, x, y, width, height);
-            Color_Transfer_To_sRGB(c, c);
-            Pixel_To_Int(c, 255.0f, 0.0f, 255.0f);
-            *p =
-                (u32)c[2] * 0x1 +
-                (u32)c[1] * 0x100 +
-                (u32)c[0] * 0x10000 +
-                (u32)c[3] * 0x1000000;
+    MakeLayer(layer, s);
+    // The visuals must form a tree under the root visual, in z order
+    if (layer.dcompvisual) {
+        HRESULT hr;
+        if (below && below->dcompvisual) {
+            hr = rootvisual->AddVisual(layer.dcompvisual, TRUE, below->dcompvisual);
+        } else {
+            hr = rootvisual->AddVisual(layer.dcompvisual, FALSE, nullptr);
         }
+        assert(SUCCEEDED(hr));
     }
 }
 
-void Compositor::CreateScene()
+void Compositor::Remove(Compositor_Layer& layer, const Scene_Layer&)
 {
-    layers.clear();
-    layers.reserve(16);
+    // The layer's objects, its visual too, are released when it is destroyed
+    if (layer.dcompvisual) {
+        HRESULT hr = rootvisual->RemoveVisual(layer.dcompvisual);
+        assert(SUCCEEDED(hr));
+    }
+}
 
-#if WINDOW_BACKGROUND
-    MakeWindowSwapChain(DXGI_COLOR_SPACE_RGB_FULL_G10_NONE_P709, DXGI_FORMAT_R16G16B16A16_FLOAT);
-    // Get the window swapchain size
-    DXGI_SWAP_CHAIN_DESC1 scDesc = {};
-    windowswapchain1->GetDesc1(&scDesc);
-    u32 windowWidth = static_cast<u16>(scDesc.Width);
-    u32 windowHeight = static_cast<u16>(scDesc.Height);
-    windowWidth = windowWidth < 1 ? 1 : windowWidth < 16384 ? windowWidth : 32;
-    windowHeight = windowHeight < 1 ? 1 : windowHeight < 16384 ? windowHeight : 32;
-    auto pixelsWindow = new u16[4 * windowWidth * windowHeight];
-    GenerateImage_RGBA16F_scRGB(pixelsWindow, windowWidth, windowHeight);
-    UpdateSwapChain(windowswapchain1, DXGI_COLOR_SPACE_RGB_FULL_G10_NONE_P709, DXGI_FORMAT_R16G16B16A16_FLOAT, 8, (void*)pixelsWindow);
-#endif
+void Compositor::Move(Compositor_Layer& layer, const Scene_Layer& s)
+{
+    layer.x = s.x;
+    layer.y = s.y;
+    if (layer.dcompvisual) {
+        layer.dcompvisual->SetOffsetX(s.x);
+        layer.dcompvisual->SetOffsetY(s.y);
+    }
+}
 
-    u32 w = (u32)(256.0f * scale);
-    u32 h = (u32)(64.0f * scale);
-    w = w < 1 ? 1 : w < 16384 ? w : 16384;
-    h = h < 1 ? 1 : h < 16384 ? h : 16384;
-    auto pixelsSCRGB16F = new u16[4 * w * h];
-    GenerateImage_RGBA16F_scRGB(pixelsSCRGB16F, w, h);
-    auto pixelsHDR10 = new u32[w * h];
-    GenerateImage_RGB10A2_HDR10(pixelsHDR10, w, h);
-    auto pixelsSRGB8 = new u32[w * h];
-    GenerateImage_BGRA8_sRGB(pixelsSRGB8, w, h);
-
-    f32 fw = (f32)w;
-    f32 fh = (f32)h;
-    f32 grid_w = fw + 4 * scale;
-    f32 grid_h = fh;
-    f32 x = 32 * scale;
-    f32 y = 32 * scale;
-
-    // Add some smaller gradients as visuals using swapchains in various formats
-    layers.push_back(Compositor_Layer());
-    layers[layers.size() - 1].VisualWithSwapChain(this, x, y, w, h, DXGI_COLOR_SPACE_RGB_FULL_G10_NONE_P709, DXGI_FORMAT_R16G16B16A16_FLOAT, 8, (void*)pixelsSCRGB16F);
-    y += grid_h;
-    layers.push_back(Compositor_Layer());
-    layers[layers.size() - 1].VisualWithSwapChain(this, x, y, w, h, DXGI_COLOR_SPACE_RGB_FULL_G2084_NONE_P2020, DXGI_FORMAT_R10G10B10A2_UNORM, 4, (void*)pixelsHDR10);
-    y += grid_h;
-    layers.push_back(Compositor_Layer());
-    layers[layers.size() - 1].VisualWithSwapChain(this, x, y, w, h, DXGI_COLOR_SPACE_RGB_FULL_G22_NONE_P709, DXGI_FORMAT_B8G8R8A8_UNORM, 4, (void*)pixelsSRGB8);
-    y += grid_h;
-
-    // Add some smaller gradients as visuals using surfaces in various formats
-    x += grid_w;
-    y = 32 * scale;
-    layers.push_back(Compositor_Layer());
-    layers[layers.size() - 1].VisualWithSurface(this, x, y, w, h, DXGI_COLOR_SPACE_RGB_FULL_G10_NONE_P709, DXGI_FORMAT_R16G16B16A16_FLOAT, 8, (void*)pixelsSCRGB16F);
-    y += grid_h;
-    layers.push_back(Compositor_Layer());
-    layers[layers.size() - 1].VisualWithSurface(this, x, y, w, h, DXGI_COLOR_SPACE_RGB_FULL_G2084_NONE_P2020, DXGI_FORMAT_R10G10B10A2_UNORM, 4, (void*)pixelsHDR10);
-    y += grid_h;
-    layers.push_back(Compositor_Layer());
-    layers[layers.size() - 1].VisualWithSurface(this, x, y, w, h, DXGI_COLOR_SPACE_RGB_FULL_G22_NONE_P709, DXGI_FORMAT_B8G8R8A8_UNORM, 4, (void*)pixelsSRGB8);
-    y += grid_h;
+void Compositor::Content(Compositor_Layer& layer, const Scene_Layer& old, const Scene_Layer& s)
+{
+    // The swapchain can be reused for new pixels of the same size and format
+    if (old.width != s.width || old.height != s.height || old.dxgiFormat != s.dxgiFormat || old.dxgiColorspace != s.dxgiColorspace) {
+        layer.ReleaseContent();
+    }
+    MakeLayer(layer, s);
+}
+
+void Compositor::Commit()
+{
+    HRESULT hr = dcomp->Commit();
+    assert(SUCCEEDED(hr));
 }
 
 #define MAX_LOADSTRING 100
@@ -810,6 +1010,9 @@ u32 win_dpiY;
 WCHAR szTitle[MAX_LOADSTRING];                  // The title bar text
 WCHAR szWindowClass[MAX_LOADSTRING];            // the main window class name
 static Compositor* compositor;
+static Frame_Scheduler* scheduler;
+// Set by WM_DISPLAYCHANGE, the next update rebuilds the device and scene
+static bool displayChanged = false;
 
 // Forward declarations of functions included in this code module:
 ATOM                MyRegisterClass(HINSTANCE hInstance);
@@ -817,13 +1020,37 @@ BOOL                InitInstance(HINSTANCE, int);
 LRESULT CALLBACK    WndProc(HWND, UINT, WPARAM, LPARAM);
 INT_PTR CALLBACK    About(HWND, UINT, WPARAM, LPARAM);
 
+// Maps the image file named on the command line, if any, for the compositor to
+// show instead of testcolors:
+//   testcolorspaces.exe image.pfm
+//   testcolorspaces.exe image.rgba16f|image.rgba32f width height
+static void OpenInputImage(LPCWSTR commandLine)
+{
+    if (!commandLine || !commandLine[0])
+        return;
+    int argc = 0;
+    LPWSTR* argv = CommandLineToArgvW(commandLine, &argc);
+    if (!argv)
+        return;
+    // lpCmdLine has no program name, so the image is argv[0]
+    char path[4 * MAX_PATH] = {};
+    u32 rawWidth = argc >= 3 ? (u32)_wtoi(argv[1]) : 0;
+    u32 rawHeight = argc >= 3 ? (u32)_wtoi(argv[2]) : 0;
+    bool ok = argc >= 1 && WideCharToMultiByte(CP_UTF8, 0, argv[0], -1, path, sizeof(path), nullptr, nullptr) > 0;
+    LocalFree(argv);
+    if (ok && !compositor->inputImage.Open(path, rawWidth, rawHeight)) {
+        char text[sizeof(path) + 64];
+        snprintf(text, sizeof(text), "failed to open %s, showing testcolors\n", path);
+        OutputDebugStringA(text);
+    }
+}
+
 int APIENTRY wWinMain(_In_ HINSTANCE hInstance,
                      _In_opt_ HINSTANCE hPrevInstance,
                      _In_ LPWSTR    lpCmdLine,
                      _In_ int       nCmdShow)
 {
     UNREFERENCED_PARAMETER(hPrevInstance);
-    UNREFERENCED_PARAMETER(lpCmdLine);
 
     // TODO: Place code here.
 
@@ -838,15 +1065,22 @@ int APIENTRY wWinMain(_In_ HINSTANCE hInstance,
         return FALSE;
     }
 
+    OpenInputImage(lpCmdLine);
+
     HACCEL hAccelTable = LoadAccelerators(hInstance, MAKEINTRESOURCE(IDC_TESTCOLORSPACES));
 
-    MSG msg;
+    MSG msg = {};
 
-    // Main message loop:
-    quit = false;
-    compositor->Update(hWindow, true);
-    for (;;)
-    {
+    // Sleep until there are messages, waking for any kind of input
+    auto wait = [](u64 timeout) {
+        DWORD ms = INFINITE;
+        if (timeout != frame_forever) {
+            u64 rounded = (timeout + 999999) / 1000000;
+            ms = rounded < INFINITE ? static_cast<DWORD>(rounded) : INFINITE - 1;
+        }
+        return MsgWaitForMultipleObjectsEx(0, nullptr, ms, QS_ALLINPUT, MWMO_INPUTAVAILABLE) == WAIT_OBJECT_0;
+    };
+    auto pump = [&]() {
         while (PeekMessage(&msg, nullptr, 0, 0, TRUE))
         {
             if (!TranslateAccelerator(msg.hwnd, hAccelTable, &msg))
@@ -855,14 +1089,36 @@ int APIENTRY wWinMain(_In_ HINSTANCE hInstance,
                 DispatchMessage(&msg);
             }
         }
-        if (quit)
-            break;
-        // Refresh the scene no faster than 60hz, we don't actually use any
-        // wait timeouts, so this is the only way we're yielding CPU
-        Sleep(16);
-        compositor->Update(hWindow, false);
+        return !quit;
+    };
+    auto update = []() {
+        bool reset = displayChanged;
+        displayChanged = false;
+        compositor->Update(hWindow, reset);
+    };
+
+    // Main message loop, Update runs when a message marks the scene dirty,
+    // and every quarter second to notice a lost device
+    quit = false;
+    compositor->Update(hWindow, true);
+    scheduler = new Frame_Scheduler(Frame_Clock_Steady(), wait);
+    scheduler->SetInterval(250000000);
+    while (scheduler->Step(pump, update))
+    {
     }
 
+    Frame_Stats stats = scheduler->Stats();
+    char text[256];
+    snprintf(text, sizeof(text), "%llu updates, %llu wakeups (%llu idle), update %.2f ms mean %.2f ms max, latency %.2f ms median %.2f ms 99%% %.2f ms max\n",
+        (unsigned long long)stats.updates, (unsigned long long)stats.wakeups, (unsigned long long)stats.idleWakeups,
+        stats.durationMean, stats.durationMax, stats.latencyMedian, stats.latency99, stats.latencyMax);
+    OutputDebugStringA(text);
+#if TRACE_ENABLED
+    Trace_Write_JSON("testcolorspaces.trace.json");
+#endif
+    delete scheduler;
+    scheduler = nullptr;
+
     // Shutdown
     compositor->DestroyDevice();
     delete compositor;
@@ -981,6 +1237,19 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
             EndPaint(hWnd, &ps);
         }
         break;
+    case WM_DPICHANGED:
+        // The layers are sized for the DPI, UpdateScene resizes them
+        if (scheduler)
+            scheduler->MarkDirty();
+        return DefWindowProc(hWnd, message, wParam, lParam);
+    case WM_DISPLAYCHANGE:
+        // HDR or the display's color space may have been toggled, which the
+        // scene diff can't see as the layers are the same, so rebuild the
+        // swapchains and their images from scratch
+        displayChanged = true;
+        if (scheduler)
+            scheduler->MarkDirty();
+        return DefWindowProc(hWnd, message, wParam, lParam);
     case WM_CLOSE:
         quit = true;
         DestroyWindow(hWnd);
@@ -0,0 +1,194 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// reference_compositor.cpp : CPU compositor for scene descriptions.
+//
+
+#include "reference_compositor.h"
+
+#include "color.h"
+#include "colorspace.h"
+#include "parallel.h"
+#include "trace.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+constexpr Color_Mat3f rec2020_to_scrgb = Mat3_To_f32(Color_RGB_To_RGB(primaries_rec2020, primaries_rec709));
+
+enum class Reference_Decode
+{
+    RGBA16F,
+    RGB10A2,
+    BGRA8,
+};
+
+/// How to turn one layer's pixels into linear scRGB
+struct Reference_Layer
+{
+    const Scene_Layer* layer;
+    Reference_Decode decode;
+    /// Code value to linear scRGB, for the integer formats
+    f32 table[1024];
+    bool rec2020;
+    /// Canvas position, rounded
+    i64 x;
+    i64 y;
+};
+
+static bool Reference_Layer_Prepare(Reference_Layer& r, const Scene_Layer& layer, const Reference_Options& options)
+{
+    r.layer = &layer;
+    r.rec2020 = false;
+    r.x = (i64)floor(layer.x + 0.5f);
+    r.y = (i64)floor(layer.y + 0.5f);
+    const f32 sdr = options.sdrWhiteLevel / 80.0f;
+    u32 codes = 0;
+    if (layer.dxgiFormat == dxgi_format_r16g16b16a16_float && layer.dxgiColorspace == dxgi_color_space_rgb_full_g10_none_p709)
+    {
+        r.decode = Reference_Decode::RGBA16F;
+    }
+    else if (layer.dxgiFormat == dxgi_format_r10g10b10a2_unorm && layer.dxgiColorspace == dxgi_color_space_rgb_full_g2084_none_p2020)
+    {
+        r.decode = Reference_Decode::RGB10A2;
+        r.rec2020 = true;
+        for (u32 i = 0; i < 1024; i++)
+            r.table[i] = Color_Transfer_From_PQ(i / 1023.0f);
+    }
+    else if (layer.dxgiFormat == dxgi_format_r10g10b10a2_unorm && layer.dxgiColorspace == dxgi_color_space_rgb_full_g22_none_p709)
+    {
+        r.decode = Reference_Decode::RGB10A2;
+        codes = 1024;
+    }
+    else if (layer.dxgiFormat == dxgi_format_b8g8r8a8_unorm && layer.dxgiColorspace == dxgi_color_space_rgb_full_g22_none_p709)
+    {
+        r.decode = Reference_Decode::BGRA8;
+        codes = 256;
+    }
+    else
+    {
+        return false;
+    }
+    // Windows treats G22 content as sRGB
+    for (u32 i = 0; i < codes; i++)
+        r.table[i] = Color_Transfer_From_sRGB(i / (f32)(codes - 1)) * sdr;
+    return true;
+}
+
+// Decodes count pixels of one row of the layer, starting at column x
+static void Reference_Layer_Decode(const Reference_Layer& r, u32 row, u32 x, u32 count, f32* rgba)
+{
+    const Scene_Layer& layer = *r.layer;
+    const u8* src = (const u8*)layer.pixels + ((usize)row * layer.width + x) * layer.bytesPerPixel;
+    switch (r.decode)
+    {
+    case Reference_Decode::RGBA16F:
+        FromF16_Span((const u16*)src, rgba, 4 * (usize)count);
+        break;
+    case Reference_Decode::RGB10A2:
+        Color_Decode_RGB10A2_Span((const u32*)src, rgba, count, r.table);
+        break;
+    case Reference_Decode::BGRA8:
+        Color_Decode_BGRA8_Span((const u32*)src, rgba, count, r.table);
+        break;
+    }
+    if (r.rec2020)
+        Color_rgb_through_mat3_Span(rgba, rgba, count, rec2020_to_scrgb.m);
+}
+
+bool Reference_Composite(Reference_Canvas& canvas, u32 width, u32 height, const Scene_Layer* layers, usize count, const Reference_Options& options)
+{
+    TRACE_SCOPE("Reference_Composite");
+    canvas.width = width;
+    canvas.height = height;
+    canvas.pixels.resize((usize)width * height * 4);
+
+    bool ok = true;
+    std::vector<Reference_Layer> prepared;
+    prepared.reserve(count);
+    for (usize i = 0; i < count; i++)
+    {
+        if (!layers[i].pixels || !layers[i].width || !layers[i].height)
+            continue;
+        prepared.emplace_back();
+        if (!Reference_Layer_Prepare(prepared.back(), layers[i], options))
+        {
+            prepared.pop_back();
+            ok = false;
+        }
+    }
+
+    // Each canvas row is built up in f32 and converted to f16 once, so rows
+    // don't depend on each other and bands of them run in parallel
+    std::vector<f32> background(4 * (usize)width);
+    for (u32 x = 0; x < width; x++)
+        memcpy(&background[4 * (usize)x], options.background, sizeof(options.background));
+    usize grain = 65536 / ((usize)width + 1);
+    grain = grain < 1 ? 1 : grain;
+    Parallel_For(height, grain, [&](usize begin, usize end) {
+        std::vector<f32> row(4 * (usize)width);
+        std::vector<f32> decoded(4 * (usize)width);
+        for (usize y = begin; y < end; y++)
+        {
+            memcpy(row.data(), background.data(), row.size() * sizeof(f32));
+            for (const Reference_Layer& r : prepared)
+            {
+                const Scene_Layer& layer = *r.layer;
+                i64 ly = (i64)y - r.y;
+                if (ly < 0 || ly >= layer.height)
+                    continue;
+                i64 x0 = r.x > 0 ? r.x : 0;
+                i64 x1 = r.x + layer.width < width ? r.x + layer.width : width;
+                if (x0 >= x1)
+                    continue;
+                u32 n = (u32)(x1 - x0);
+                f32* dst = &row[4 * (usize)x0];
+                if (layer.dxgiAlphaMode == dxgi_alpha_mode_premultiplied)
+                {
+                    Reference_Layer_Decode(r, (u32)ly, (u32)(x0 - r.x), n, decoded.data());
+                    Pixel_Over_Span(decoded.data(), dst, n);
+                }
+                else
+                {
+                    // Opaque, decode straight into the canvas row
+                    Reference_Layer_Decode(r, (u32)ly, (u32)(x0 - r.x), n, dst);
+                    for (u32 i = 0; i < n; i++)
+                        dst[4 * i + 3] = 1.0f;
+                }
+            }
+            ToF16_Span(row.data(), &canvas.pixels[4 * y * width], 4 * (usize)width);
+        }
+    });
+    return ok;
+}
+
+bool Reference_Canvas_Save(const Reference_Canvas& canvas, const char* path)
+{
+    TRACE_SCOPE("Reference_Canvas_Save");
+    FILE* file = fopen(path, "wb");
+    if (!file)
+        return false;
+    bool ok = true;
+    usize length = strlen(path);
+    if (length >= 4 && strcmp(path + length - 4, ".pfm") == 0)
+    {
+        // PFM rows go from the bottom up, a negative scale means little endian
+        fprintf(file, "PF\n%u %u\n-1.0\n", canvas.width, canvas.height);
+        std::vector<f32> rgba(4 * (usize)canvas.width);
+        std::vector<f32> rgb(3 * (usize)canvas.width);
+        for (u32 y = canvas.height; y-- > 0 && ok;)
+        {
+            FromF16_Span(&canvas.pixels[4 * (usize)y * canvas.width], rgba.data(), rgba.size());
+            for (u32 x = 0; x < canvas.width; x++)
+                memcpy(&rgb[3 * (usize)x], &rgba[4 * (usize)x], 3 * sizeof(f32));
+            ok = fwrite(rgb.data(), sizeof(f32), rgb.size(), file) == rgb.size();
+        }
+    }
+    else
+    {
+        ok = fwrite(canvas.pixels.data(), sizeof(u16), canvas.pixels.size(), file) == canvas.pixels.size();
+    }
+    return fclose(file) == 0 && ok;
+}
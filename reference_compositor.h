@@ -0,0 +1,43 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// reference_compositor.h : CPU compositor for scene descriptions, producing the
+// image we expect the desktop compositor to show, without a GPU or Windows.
+//
+// Like DWM with advanced color enabled, every layer is decoded to linear scRGB
+// and blended into an FP16 scRGB canvas. SDR layers are scaled so their white
+// lands on the SDR white level. Layer offsets are rounded to whole pixels and
+// layers are never scaled, the same as the visuals in CreateScene.
+//
+
+#pragma once
+
+#include "scene.h"
+
+#include <vector>
+
+struct Reference_Canvas
+{
+    u32 width = 0;
+    u32 height = 0;
+    /// RGBA16F scRGB, tightly packed rows
+    std::vector<u16> pixels;
+};
+
+struct Reference_Options
+{
+    /// Linear scRGB color the canvas starts out as
+    f32 background[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+    /// Nits that SDR white (sRGB 1.0) is shown at, 80 nits is scRGB 1.0
+    f32 sdrWhiteLevel = 80.0f;
+};
+
+/// Composites count layers, first at the bottom, into a width x height canvas.
+/// Returns false if a layer has a format and colorspace combination the
+/// reference compositor doesn't know, that layer is left out.
+bool Reference_Composite(Reference_Canvas& canvas, u32 width, u32 height, const Scene_Layer* layers, usize count, const Reference_Options& options);
+
+/// Writes the canvas to a file, as a PFM (32-bit float RGB, alpha is dropped)
+/// if the path ends in .pfm, otherwise as the raw RGBA16F rows.
+bool Reference_Canvas_Save(const Reference_Canvas& canvas, const char* path);
@@ -0,0 +1,52 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// scene.cpp : Diffing two versions of a scene.
+//
+
+#include "scene.h"
+
+// Scenes are a handful of layers, so matching is a simple search
+void Scene_Diff(const Scene_Layer* current, usize currentCount, const Scene_Layer* desired, usize desiredCount, std::vector<Scene_Op>& ops, std::vector<usize>& previous)
+{
+    ops.clear();
+    previous.assign(desiredCount, scene_none);
+    std::vector<bool> kept(currentCount, false);
+
+    // Matched layers have to stay in the same order, so a layer is only kept
+    // if it comes after the last one kept
+    usize last = scene_none;
+    for (usize i = 0; i < desiredCount; i++)
+    {
+        for (usize j = 0; j < currentCount; j++)
+        {
+            if (kept[j] || current[j].id != desired[i].id)
+                continue;
+            if (current[j].isSurface == desired[i].isSurface && (last == scene_none || j > last))
+            {
+                previous[i] = j;
+                kept[j] = true;
+                last = j;
+            }
+            break;
+        }
+    }
+
+    for (usize j = 0; j < currentCount; j++)
+        if (!kept[j])
+            ops.push_back({ Scene_Change::Remove, j, scene_none });
+    for (usize i = 0; i < desiredCount; i++)
+    {
+        usize j = previous[i];
+        if (j == scene_none)
+        {
+            ops.push_back({ Scene_Change::Add, scene_none, i });
+            continue;
+        }
+        if (current[j].x != desired[i].x || current[j].y != desired[i].y)
+            ops.push_back({ Scene_Change::Move, j, i });
+        if (!Scene_Same_Content(current[j], desired[i]))
+            ops.push_back({ Scene_Change::Content, j, i });
+    }
+}
@@ -0,0 +1,326 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// scene.h : Platform independent description of the layers in the test scene,
+// shared by the Windows compositor and the reference compositor.
+//
+
+#pragma once
+
+#include "format.h"
+#include "parallel.h"
+#include "trace.h"
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+// DXGI_COLOR_SPACE_TYPE and DXGI_ALPHA_MODE values, so scenes can be described
+// without the Windows headers (the DXGI_FORMAT values are in format.h)
+constexpr u32 dxgi_color_space_rgb_full_g22_none_p709 = 0;
+constexpr u32 dxgi_color_space_rgb_full_g10_none_p709 = 1;
+constexpr u32 dxgi_color_space_rgb_full_g2084_none_p2020 = 12;
+constexpr u32 dxgi_alpha_mode_premultiplied = 1;
+constexpr u32 dxgi_alpha_mode_ignore = 3;
+
+// Images a layer can show
+constexpr u32 scene_pattern_testcolors = 1;
+/// The image file the app was started with (image_file.h)
+constexpr u32 scene_pattern_image = 2;
+
+constexpr usize scene_none = ~(usize)0;
+
+/// Largest layer width or height, layers are D3D11 textures and swapchains
+/// (D3D11_REQ_TEXTURE2D_U_OR_V_DIMENSION)
+constexpr u32 scene_max_extent = 16384;
+
+/// One visual of the scene, with the same properties Compositor_Layer is
+/// created with.
+struct Scene_Layer
+{
+    /// Identifies the layer from one version of the scene to the next, so a
+    /// diff can tell a layer that changed from one that was replaced
+    u32 id = 0;
+    f32 x = 0;
+    f32 y = 0;
+    u32 width = 0;
+    u32 height = 0;
+    u32 dxgiColorspace = dxgi_color_space_rgb_full_g10_none_p709;
+    u32 dxgiFormat = dxgi_format_r16g16b16a16_float;
+    u32 dxgiAlphaMode = dxgi_alpha_mode_ignore;
+    u8 bytesPerPixel = 8;
+    bool isSurface = false;
+    /// Which image the layer shows, one of the scene_pattern values
+    u32 pattern = scene_pattern_testcolors;
+    /// Tightly packed rows of width * bytesPerPixel bytes
+    const void* pixels = nullptr;
+};
+
+/// The colorspaces and formats each column of the scene shows the image in
+struct Scene_Kind
+{
+    u32 colorspace;
+    u32 format;
+    u8 bpp;
+};
+
+constexpr Scene_Kind scene_kinds[] = {
+    { dxgi_color_space_rgb_full_g10_none_p709, dxgi_format_r16g16b16a16_float, 8 },
+    { dxgi_color_space_rgb_full_g2084_none_p2020, dxgi_format_r10g10b10a2_unorm, 4 },
+    { dxgi_color_space_rgb_full_g22_none_p709, dxgi_format_b8g8r8a8_unorm, 4 },
+};
+
+/// Appends a column of w x h layers at x, y, one per scene_kinds entry, top to
+/// bottom
+template <class Layers> void Scene_Column(Layers& layers, f32 x, f32 y, u32 w, u32 h, u32 pattern, bool isSurface)
+{
+    for (const Scene_Kind& kind : scene_kinds)
+    {
+        Scene_Layer layer;
+        layer.id = (u32)layers.size();
+        layer.x = x;
+        layer.y = y;
+        layer.width = w;
+        layer.height = h;
+        layer.dxgiColorspace = kind.colorspace;
+        layer.dxgiFormat = kind.format;
+        layer.bytesPerPixel = kind.bpp;
+        layer.isSurface = isSurface;
+        layer.pattern = pattern;
+        layers.push_back(layer);
+        y += (f32)h;
+    }
+}
+
+/// Lays out the testcolors scene at a DPI scale, a column of swapchain visuals
+/// and a column of surface visuals, each with an scRGB, HDR10 and sRGB layer.
+/// The pixels are left for the caller to fill in.
+template <class Layers> void Scene_TestColors(Layers& layers, f32 scale)
+{
+    u32 w = (u32)(256.0f * scale);
+    u32 h = (u32)(64.0f * scale);
+    w = w < 1 ? 1 : w < scene_max_extent ? w : scene_max_extent;
+    h = h < 1 ? 1 : h < scene_max_extent ? h : scene_max_extent;
+
+    f32 grid_w = (f32)w + 4 * scale;
+    for (u32 column = 0; column < 2; column++)
+        Scene_Column(layers, 32 * scale + column * grid_w, 32 * scale, w, h, scene_pattern_testcolors, column == 1);
+}
+
+/// Lays out the image scene, a column of swapchain visuals showing a width x
+/// height image file as scRGB, HDR10 and sRGB, one image pixel per layer
+/// pixel whatever the DPI scale so the content isn't resampled. An image over
+/// scene_max_extent is shrunk to fit, keeping its aspect ratio. There is no
+/// surface column, the images are big enough that one copy of each is plenty.
+template <class Layers> void Scene_Image(Layers& layers, f32 scale, u32 width, u32 height)
+{
+    u32 w = width < 1 ? 1 : width;
+    u32 h = height < 1 ? 1 : height;
+    if (w > scene_max_extent || h > scene_max_extent)
+    {
+        u32 longest = w > h ? w : h;
+        w = (u32)((u64)w * scene_max_extent / longest);
+        h = (u32)((u64)h * scene_max_extent / longest);
+        w = w < 1 ? 1 : w;
+        h = h < 1 ? 1 : h;
+    }
+    Scene_Column(layers, 32 * scale, 32 * scale, w, h, scene_pattern_image, false);
+}
+
+enum class Scene_Change
+{
+    /// A new layer, at desired index
+    Add,
+    /// A layer that is gone, at current index
+    Remove,
+    /// A layer whose position changed
+    Move,
+    /// A layer whose image changed, its size, format, colorspace or pattern
+    Content,
+};
+
+/// One change between two versions of a scene. current and desired are the
+/// layer's index in each, scene_none for a layer only in one of them.
+struct Scene_Op
+{
+    Scene_Change change;
+    usize current;
+    usize desired;
+};
+
+/// Whether two layers show the same pixels, wherever they are
+inline bool Scene_Same_Content(const Scene_Layer& a, const Scene_Layer& b)
+{
+    return a.width == b.width && a.height == b.height && a.dxgiColorspace == b.dxgiColorspace && a.dxgiFormat == b.dxgiFormat &&
+           a.dxgiAlphaMode == b.dxgiAlphaMode && a.bytesPerPixel == b.bytesPerPixel && a.pattern == b.pattern;
+}
+
+/// Compares the current layers with the desired ones, both in z order, and
+/// lists the changes, removals first and then the rest in desired order. A
+/// layer moved and resized gets both a Move and a Content op. Layers are
+/// matched by id, one that switched between swapchain and surface or changed
+/// z order relative to the other matched layers is removed and added again.
+/// previous[i] is set to the current index desired layer i is kept from, or
+/// scene_none if it is added.
+void Scene_Diff(const Scene_Layer* current, usize currentCount, const Scene_Layer* desired, usize desiredCount, std::vector<Scene_Op>& ops, std::vector<usize>& previous);
+
+/// Carries out the ops of a Scene_Diff for Scene_Apply and Scene_Apply_Async:
+/// removes, adds, moves and changes the layers, calls present(next) with the
+/// new layers once they all have their objects, for whatever the caller does
+/// about pixels, then replaces current and layers and commits.
+template <class Backend, class Scene, class Layers, class Present>
+void Scene_Apply_Ops(Backend& backend, Scene& current, Layers& layers, const Scene_Layer* desired, usize count, const std::vector<Scene_Op>& ops, const std::vector<usize>& previous, Present&& present)
+{
+    for (const Scene_Op& op : ops)
+        if (op.change == Scene_Change::Remove)
+            backend.Remove(layers[op.current], current[op.current]);
+
+    Layers next(layers.get_allocator());
+    next.resize(count);
+    for (usize i = 0; i < count; i++)
+        if (previous[i] != scene_none)
+            next[i] = std::move(layers[previous[i]]);
+
+    for (const Scene_Op& op : ops)
+    {
+        switch (op.change)
+        {
+        case Scene_Change::Add:
+            backend.Add(next[op.desired], desired[op.desired], op.desired > 0 ? &next[op.desired - 1] : nullptr);
+            break;
+        case Scene_Change::Remove:
+            break;
+        case Scene_Change::Move:
+            backend.Move(next[op.desired], desired[op.desired]);
+            break;
+        case Scene_Change::Content:
+            backend.Content(next[op.desired], current[op.current], desired[op.desired]);
+            break;
+        }
+    }
+
+    present(next);
+    layers = std::move(next);
+    current.assign(desired, desired + count);
+    backend.Commit();
+}
+
+/// Brings a retained scene up to date with the desired layers, doing only the
+/// work for the layers that changed. current and layers are the scene and the
+/// backend's objects for each of its layers from the last call (empty the
+/// first time), in z order, and are replaced with desired and its objects.
+/// The backend is any type with these members:
+///
+///   typedef ... Layer; // default constructible and movable
+///   void Remove(Layer& layer, const Scene_Layer& old);
+///   void Move(Layer& layer, const Scene_Layer& s);
+///   void Content(Layer& layer, const Scene_Layer& old, const Scene_Layer& s);
+///   // below is the layer under this one, nullptr for the bottom layer
+///   void Add(Layer& layer, const Scene_Layer& s, Layer* below);
+///   void Commit();
+///
+/// Commit is called once at the end, only if anything changed. Returns the
+/// number of changes.
+template <class Backend, class Scene, class Layers>
+usize Scene_Apply(Backend& backend, Scene& current, Layers& layers, const Scene_Layer* desired, usize count)
+{
+    std::vector<Scene_Op> ops;
+    std::vector<usize> previous;
+    Scene_Diff(current.data(), current.size(), desired, count, ops, previous);
+    if (ops.empty())
+        return 0;
+
+    // The backend's Add and Content show the pixels themselves
+    Scene_Apply_Ops(backend, current, layers, desired, count, ops, previous, [](Layers&) {});
+    return ops.size();
+}
+
+/// Scene_Apply with the pixels of the added and changed layers generated in
+/// the background (Parallel_Start), at the same time as each other, as the
+/// caller's setup and as the backend making the layers' objects. The backend
+/// has Scene_Apply's members, except that Add and Content only make or resize
+/// the layer's objects, and these:
+///
+///   typedef ... Pixels; // default constructible and copyable
+///   // On pool threads, at the same time as each other and any other member,
+///   // once for each set of layers with the same content
+///   Pixels Generate(const Scene_Layer& s);
+///   // Shows the pixels in a layer that has had its Add or Content
+///   void Present(Layer& layer, const Scene_Layer& s, const Pixels& pixels);
+///
+/// setup() runs on the calling thread once generation has started, to make a
+/// device after a reset, say. If it returns false nothing else is done,
+/// current and layers are left alone and 0 is returned. Otherwise the layers
+/// are presented in the order their pixels are ready, Commit is called once
+/// after the last, and the number of changes is returned. The first frame
+/// then takes about as long as the slower of setup plus the layer objects and
+/// the slowest image, rather than all of them one after another.
+template <class Backend, class Scene, class Layers, class Setup>
+usize Scene_Apply_Async(Backend& backend, Scene& current, Layers& layers, const Scene_Layer* desired, usize count, Setup&& setup)
+{
+    typedef typename Backend::Pixels Pixels;
+    std::vector<Scene_Op> ops;
+    std::vector<usize> previous;
+    Scene_Diff(current.data(), current.size(), desired, count, ops, previous);
+
+    // One task per distinct image, source[i] is the task making layer i's
+    // and shown[t] the first layer showing task t's
+    std::vector<usize> source(count, scene_none);
+    std::vector<usize> shown;
+    for (const Scene_Op& op : ops)
+    {
+        if (op.change != Scene_Change::Add && op.change != Scene_Change::Content)
+            continue;
+        usize i = op.desired;
+        for (usize t = 0; t < shown.size() && source[i] == scene_none; t++)
+            if (Scene_Same_Content(desired[shown[t]], desired[i]))
+                source[i] = t;
+        if (source[i] == scene_none)
+        {
+            source[i] = shown.size();
+            shown.push_back(i);
+        }
+    }
+    std::vector<Pixels> pixels(shown.size());
+    std::vector<Parallel_Task> tasks;
+    for (usize t = 0; t < shown.size(); t++)
+    {
+        const Scene_Layer* s = &desired[shown[t]];
+        Pixels* out = &pixels[t];
+        tasks.push_back(Parallel_Start([&backend, s, out]() { *out = backend.Generate(*s); }));
+    }
+
+    bool ready;
+    {
+        TRACE_SCOPE("Scene_Apply_Async setup");
+        ready = setup();
+    }
+    if (!ready)
+    {
+        // The tasks write into pixels, which is about to go away
+        for (const Parallel_Task& task : tasks)
+            Parallel_Wait(task);
+        return 0;
+    }
+    if (ops.empty())
+        return 0;
+
+    Scene_Apply_Ops(backend, current, layers, desired, count, ops, previous, [&](Layers& next) {
+        // Each image goes to its layers as soon as it is ready, this thread
+        // generates the ones no pool thread has got to yet
+        std::unique_ptr<bool[]> taken(new bool[tasks.size()]());
+        for (;;)
+        {
+            usize t = Parallel_Wait_Any(tasks.data(), tasks.size(), taken.get());
+            if (t == tasks.size())
+                break;
+            TRACE_SCOPE("Scene_Apply_Async present");
+            for (usize i = 0; i < count; i++)
+                if (source[i] == t)
+                    backend.Present(next[i], desired[i], pixels[t]);
+            pixels[t] = Pixels();
+        }
+    });
+    return ops.size();
+}
@@ -0,0 +1,175 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// trace.cpp : Per thread event rings and the Chrome trace JSON export.
+//
+
+#include "trace.h"
+
+#if TRACE_ENABLED
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Events per thread before the oldest are overwritten, 1.3MB per thread
+constexpr u64 trace_ring_events = 1 << 15;
+// Distinct counter names
+constexpr u32 trace_max_counters = 64;
+
+struct Trace_Event
+{
+    const char* name;
+    u64 start;
+    /// Duration of a complete event, unused for counters
+    u64 duration;
+    i64 value;
+    bool counter;
+};
+
+/// Only the owning thread writes, it fills the slot then publishes it by
+/// advancing head. The exporter reads up to head and then discards anything
+/// the writer may have overwritten meanwhile.
+struct Trace_Ring
+{
+    Trace_Event events[trace_ring_events];
+    std::atomic<u64> head{ 0 };
+    u32 thread = 0;
+};
+
+// Rings are never freed, so events from threads that have exited, such as
+// after Parallel_SetThreads, can still be exported
+static std::mutex trace_mutex;
+static std::vector<std::unique_ptr<Trace_Ring>> trace_rings;
+static thread_local Trace_Ring* trace_ring = nullptr;
+
+// Counter totals, a slot is claimed by swapping its name in, so lookups take
+// no locks either
+static std::atomic<const char*> trace_counter_names[trace_max_counters];
+static std::atomic<i64> trace_counter_totals[trace_max_counters];
+
+static Trace_Ring* Trace_Thread_Ring()
+{
+    if (!trace_ring)
+    {
+        std::unique_ptr<Trace_Ring> ring(new Trace_Ring);
+        std::lock_guard<std::mutex> lock(trace_mutex);
+        ring->thread = (u32)trace_rings.size() + 1;
+        trace_ring = ring.get();
+        trace_rings.push_back(std::move(ring));
+    }
+    return trace_ring;
+}
+
+static void Trace_Push(const Trace_Event& event)
+{
+    Trace_Ring* ring = Trace_Thread_Ring();
+    u64 head = ring->head.load(std::memory_order_relaxed);
+    ring->events[head % trace_ring_events] = event;
+    ring->head.store(head + 1, std::memory_order_release);
+}
+
+u64 Trace_Now()
+{
+    return (u64)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Trace_Complete(const char* name, u64 start, u64 end)
+{
+    Trace_Push({ name, start, end - start, 0, false });
+}
+
+void Trace_Count(const char* name, i64 delta)
+{
+    for (u32 i = 0; i < trace_max_counters; i++)
+    {
+        const char* slot = trace_counter_names[i].load(std::memory_order_acquire);
+        if (!slot && trace_counter_names[i].compare_exchange_strong(slot, name, std::memory_order_acq_rel))
+            slot = name;
+        if (slot == name || strcmp(slot, name) == 0)
+        {
+            i64 total = trace_counter_totals[i].fetch_add(delta) + delta;
+            Trace_Push({ name, Trace_Now(), 0, total, true });
+            return;
+        }
+    }
+}
+
+// Names are literals from our own code, but escape them anyway so the JSON is
+// always valid
+static void Trace_Write_Name(FILE* file, const char* name)
+{
+    fputc('"', file);
+    for (const char* c = name; *c; c++)
+    {
+        if (*c == '"' || *c == '\\')
+            fputc('\\', file);
+        if ((u8)*c >= 0x20)
+            fputc(*c, file);
+    }
+    fputc('"', file);
+}
+
+bool Trace_Write_JSON(const char* path)
+{
+    FILE* file = fopen(path, "w");
+    if (!file)
+        return false;
+
+    std::vector<Trace_Ring*> rings;
+    {
+        std::lock_guard<std::mutex> lock(trace_mutex);
+        for (auto& ring : trace_rings)
+            rings.push_back(ring.get());
+    }
+
+    // Timestamps are microseconds from the first event
+    u64 origin = ~(u64)0;
+    for (Trace_Ring* ring : rings)
+    {
+        u64 head = ring->head.load(std::memory_order_acquire);
+        u64 first = head > trace_ring_events ? head - trace_ring_events : 0;
+        for (u64 i = first; i < head; i++)
+            origin = ring->events[i % trace_ring_events].start < origin ? ring->events[i % trace_ring_events].start : origin;
+    }
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool comma = false;
+    std::vector<Trace_Event> events;
+    for (Trace_Ring* ring : rings)
+    {
+        u64 head = ring->head.load(std::memory_order_acquire);
+        u64 first = head > trace_ring_events ? head - trace_ring_events : 0;
+        events.assign(ring->events, ring->events + trace_ring_events);
+        // Drop the slots the writer reused while they were being copied
+        u64 after = ring->head.load(std::memory_order_acquire);
+        first = after > trace_ring_events && after - trace_ring_events > first ? after - trace_ring_events : first;
+        for (u64 i = first; i < head; i++)
+        {
+            const Trace_Event& e = events[i % trace_ring_events];
+            fprintf(file, "%s{\"name\":", comma ? ",\n" : "");
+            Trace_Write_Name(file, e.name);
+            if (e.counter)
+                fprintf(file, ",\"ph\":\"C\",\"ts\":%.3f,\"pid\":1,\"tid\":%u,\"args\":{\"value\":%lld}}", (e.start - origin) / 1000.0, ring->thread, (long long)e.value);
+            else
+                fprintf(file, ",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u}", (e.start - origin) / 1000.0, e.duration / 1000.0, ring->thread);
+            comma = true;
+        }
+    }
+    fprintf(file, "\n]}\n");
+    return fclose(file) == 0;
+}
+
+#else
+
+bool Trace_Write_JSON(const char*)
+{
+    return false;
+}
+
+#endif
@@ -0,0 +1,60 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// trace.h : Scoped timing and counters for the slow paths, exported as Chrome
+// trace JSON (chrome://tracing or ui.perfetto.dev).
+//
+// Build with TRACE_ENABLED=1 to record, otherwise the macros compile to
+// nothing. Each thread records into its own ring buffer, so recording takes no
+// locks after a thread's first event, and when a ring wraps the oldest events
+// are dropped.
+//
+//   TRACE_SCOPE("CreateDevice");            // times the rest of the scope
+//   TRACE_COUNT("bytes generated", size);   // adds to a running total
+//
+
+#pragma once
+
+#include "common.h"
+
+#ifndef TRACE_ENABLED
+#define TRACE_ENABLED 0
+#endif
+
+/// Writes every recorded event to path as Chrome trace JSON, returns false if
+/// the file can't be written or tracing is compiled out.
+bool Trace_Write_JSON(const char* path);
+
+#if TRACE_ENABLED
+
+u64 Trace_Now();
+/// name must be a string literal, or otherwise outlive the trace
+void Trace_Complete(const char* name, u64 start, u64 end);
+/// Adds delta to the counter's total across all threads and records the total
+void Trace_Count(const char* name, i64 delta);
+
+struct Trace_Scope
+{
+    const char* name;
+    u64 start;
+
+    explicit Trace_Scope(const char* _name)
+        : name(_name)
+        , start(Trace_Now())
+    {
+    }
+    ~Trace_Scope() { Trace_Complete(name, start, Trace_Now()); }
+};
+
+#define TRACE_CONCAT2(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT2(a, b)
+#define TRACE_SCOPE(name) Trace_Scope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+#define TRACE_COUNT(name, delta) Trace_Count(name, (i64)(delta))
+
+#else
+
+#define TRACE_SCOPE(name) ((void)0)
+#define TRACE_COUNT(name, delta) ((void)0)
+
+#endif